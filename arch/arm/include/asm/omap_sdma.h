@@ -114,6 +114,14 @@ typedef struct omap_sdma {
 
 #define CDP_TRANSFER_MODE_NORMAL	(0x0 << 8)
 
+#define CSR_MISALIGNED_ADRS_ERR		(0x1 << 11)
+#define CSR_SUPERVISOR_ERR		(0x1 << 10)
+#define CSR_TRANS_ERR			(0x1 << 8)
+#define CSR_BLOCK			(0x1 << 5)
+#define CSR_FRAME			(0x1 << 3)
+#define CSR_ERR_MASK			(CSR_MISALIGNED_ADRS_ERR | \
+					 CSR_SUPERVISOR_ERR | CSR_TRANS_ERR)
+
 
 #endif
 
@@ -126,10 +126,10 @@ int do_blk(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	}
 	if (!strcmp(action, "erase"))
 		is_erase = 1;
-#ifdef CONFIG_MD5
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 	else if (!strcmp(action, "md5"))
 		is_md5 = 1;
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 	else if (!strcmp(action, "read"))
 		is_read = 1;
 	else if (!strcmp(action, "write"))
@@ -183,7 +183,7 @@ int do_blk(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		if (is_erase) {
 			blks_done = blk_curr_dev->block_erase(blk_curr_dev->dev,
 							blk, cnt);
-#ifdef CONFIG_MD5
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 		} else if (is_md5) {
 			unsigned char md5[16];
 			blks_done = cnt;
@@ -197,7 +197,7 @@ int do_blk(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 					md5[4], md5[5], md5[6], md5[7],
 					md5[8], md5[9], md5[10], md5[11],
 					md5[12], md5[13], md5[14], md5[15]);
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 		} else if (is_read) {
 			blks_done = blk_curr_dev->block_read(blk_curr_dev->dev,
 							blk, cnt, (void *)addr);
@@ -230,7 +230,7 @@ int do_blk(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 				action, blk_curr_name, ptn.start, cnt);
 	if (is_erase) {
 		err = partition_erase_blks(blk_curr_dev, &ptn, &cnt);
-#ifdef CONFIG_MD5
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 	} else if (is_md5) {
 		unsigned char md5[16];
 		err = partition_md5_blks(blk_curr_dev, &ptn, &cnt, md5);
@@ -242,7 +242,7 @@ int do_blk(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 				md5[4], md5[5], md5[6], md5[7],
 				md5[8], md5[9], md5[10], md5[11],
 				md5[12], md5[13], md5[14], md5[15]);
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 	} else if (is_read) {
 		err = partition_read_blks(blk_curr_dev, &ptn,
 						&cnt, (void *)addr);
@@ -267,10 +267,10 @@ U_BOOT_CMD(
 	"blk partition [dev] - print partition table\n"
 	"blk erase blk# cnt\n"
 	"blk erase partition [cnt]\n"
-#ifdef CONFIG_MD5
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 	"blk md5 blk# cnt\n"
 	"blk md5 partition [cnt]\n"
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 	"blk read addr blk# cnt\n"
 	"blk read addr partition [cnt]\n"
 	"blk write addr blk# cnt\n"
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <common.h>
+#include <command.h>
+#include <blkcache.h>
+
+int do_blkcache(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	if (argc != 2)
+		return cmd_usage(cmdtp);
+
+	if (!strcmp(argv[1], "show")) {
+		blkcache_print();
+	} else if (!strcmp(argv[1], "flush")) {
+		blkcache_invalidate(NULL);
+		blkcache_reset_stats();
+	} else
+		return cmd_usage(cmdtp);
+
+	return 0;
+}
+
+U_BOOT_CMD(
+	blkcache, 2, 0, do_blkcache,
+	"block device read cache",
+	"show - print cache statistics\n"
+	"blkcache flush - drop all cached blocks and reset statistics"
+);
@@ -86,7 +86,8 @@ static int do_imls (cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 static void fixup_silent_linux (void);
 #endif
 
-static image_header_t *image_get_kernel (ulong img_addr, int verify);
+static image_header_t *image_get_kernel (ulong img_addr, int verify,
+					int *dcrc_deferred);
 #if defined(CONFIG_FIT)
 static int fit_check_kernel (const void *fit, int os_noffset, int verify);
 #endif
@@ -327,6 +328,30 @@ static int bootm_start(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]
 #define BOOTM_ERR_RESET		-1
 #define BOOTM_ERR_OVERLAP	-2
 #define BOOTM_ERR_UNIMPLEMENTED	-3
+#define BOOTM_ERR_BADCRC	-4
+/*
+ * Move an uncompressed kernel to its load address, returning the crc32
+ * of the data.  Each chunk is summed just before it is copied, so the
+ * image is only read once.  Only used when load <= from or the two do
+ * not overlap, so a forward chunked copy is safe.
+ */
+static uint32_t bootm_copy_crc(ulong to, ulong from, ulong len)
+{
+	uint32_t crc = 0;
+
+	while (len) {
+		ulong n = min(len, (ulong)CHUNKSZ);
+
+		crc = crc32(crc, (uchar *)from, n);
+		memmove((void *)to, (void *)from, n);
+		to += n;
+		from += n;
+		len -= n;
+		WATCHDOG_RESET();
+	}
+	return crc;
+}
+
 static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 {
 	uint8_t comp = os.comp;
@@ -336,29 +361,37 @@ static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 	ulong image_start = os.image_start;
 	ulong image_len = os.image_len;
 	uint unc_len = CONFIG_SYS_BOOTM_LEN;
-#if defined(CONFIG_LZMA) || defined(CONFIG_LZO)
+#if defined(CONFIG_GZIP) || defined(CONFIG_LZMA) || defined(CONFIG_LZO)
 	int ret;
-#endif /* defined(CONFIG_LZMA) || defined(CONFIG_LZO) */
+#endif
 
 	const char *type_name = genimg_get_type_name (os.type);
+	uint32_t dcrc = 0;
 
 	switch (comp) {
 	case IH_COMP_NONE:
 		if (load == blob_start || load == image_start) {
 			printf ("   XIP %s ... ", type_name);
+		} else if (images.dcrc_deferred) {
+			printf ("   Loading %s ... ", type_name);
+			dcrc = bootm_copy_crc(load, image_start, image_len);
 		} else {
 			printf ("   Loading %s ... ", type_name);
 			memmove_wd ((void *)load, (void *)image_start,
 					image_len, CHUNKSZ);
 		}
 		*load_end = load + image_len;
-		puts("OK\n");
 		break;
 #ifdef CONFIG_GZIP
 	case IH_COMP_GZIP:
 		printf ("   Uncompressing %s ... ", type_name);
-		if (gunzip ((void *)load, unc_len,
-					(uchar *)image_start, &image_len) != 0) {
+		if (images.dcrc_deferred)
+			ret = gunzip_crc((void *)load, unc_len,
+					(uchar *)image_start, &image_len, &dcrc);
+		else
+			ret = gunzip((void *)load, unc_len,
+					(uchar *)image_start, &image_len);
+		if (ret != 0) {
 			puts ("GUNZIP: uncompress, out-of-mem or overwrite error "
 				"- must RESET board to recover\n");
 			if (boot_progress)
@@ -433,9 +466,20 @@ static int bootm_load_os(image_info_t os, ulong *load_end, int boot_progress)
 		return BOOTM_ERR_UNIMPLEMENTED;
 	}
 
-	flush_cache(load, (*load_end - load) * sizeof(ulong));
+	flush_cache(load, *load_end - load);
 
 	puts ("OK\n");
+
+	if (images.dcrc_deferred) {
+		images.dcrc_deferred = 0;
+		if (dcrc != image_get_dcrc(&images.legacy_hdr_os_copy)) {
+			puts ("   Bad Data CRC\n");
+			if (boot_progress)
+				show_boot_progress (-3);
+			return BOOTM_ERR_BADCRC;
+		}
+	}
+
 	debug ("   kernel loaded at 0x%08lx, end = 0x%08lx\n", load, *load_end);
 	if (boot_progress)
 		show_boot_progress (7);
@@ -668,6 +712,12 @@ int do_bootm (cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			show_boot_progress (-7);
 			return 1;
 		}
+		/* a corrupt image is rejected, as if checked up front */
+		if (ret == BOOTM_ERR_BADCRC) {
+			if (iflag)
+				enable_interrupts();
+			return 1;
+		}
 	}
 
 	lmb_reserve(&images.lmb, images.os.load, (load_end - images.os.load));
@@ -730,6 +780,7 @@ int bootm_maybe_autostart(cmd_tbl_t *cmdtp, const char *cmd)
  * image_get_kernel - verify legacy format kernel image
  * @img_addr: in RAM address of the legacy format image to be verified
  * @verify: data CRC verification flag
+ * @dcrc_deferred: set if the data CRC is left to bootm_load_os()
  *
  * image_get_kernel() verifies legacy image integrity and returns pointer to
  * legacy image header if image verification was completed successfully.
@@ -738,7 +789,8 @@ int bootm_maybe_autostart(cmd_tbl_t *cmdtp, const char *cmd)
  *     pointer to a legacy image header if valid image was found
  *     otherwise return NULL
  */
-static image_header_t *image_get_kernel (ulong img_addr, int verify)
+static image_header_t *image_get_kernel (ulong img_addr, int verify,
+					int *dcrc_deferred)
 {
 	image_header_t *hdr = (image_header_t *)img_addr;
 
@@ -758,7 +810,32 @@ static image_header_t *image_get_kernel (ulong img_addr, int verify)
 	show_boot_progress (3);
 	image_print_contents (hdr);
 
-	if (verify) {
+	/*
+	 * A plain kernel's data CRC covers exactly what bootm_load_os()
+	 * reads, so check it in that pass instead of one of its own.
+	 * MULTI images also cover other parts, and XIP images and
+	 * copies that must run backwards are not read front to back.
+	 */
+	*dcrc_deferred = 0;
+	if (verify && image_get_type(hdr) == IH_TYPE_KERNEL) {
+		ulong data = image_get_data(hdr);
+		ulong load = image_get_load(hdr);
+
+		switch (image_get_comp(hdr)) {
+#ifdef CONFIG_GZIP
+		case IH_COMP_GZIP:
+			*dcrc_deferred = 1;
+			break;
+#endif
+		case IH_COMP_NONE:
+			*dcrc_deferred = load != img_addr && load != data &&
+				(load < data ||
+				 load >= data + image_get_data_size(hdr));
+			break;
+		}
+	}
+
+	if (verify && !*dcrc_deferred) {
 		puts ("   Verifying Checksum ... ");
 		if (!image_check_dcrc (hdr)) {
 			printf ("Bad Data CRC\n");
@@ -882,7 +959,8 @@ static void *boot_get_kernel (cmd_tbl_t *cmdtp, int flag, int argc, char * const
 	case IMAGE_FORMAT_LEGACY:
 		printf ("## Booting kernel from Legacy Image at %08lx ...\n",
 				img_addr);
-		hdr = image_get_kernel (img_addr, images->verify);
+		hdr = image_get_kernel (img_addr, images->verify,
+					&images->dcrc_deferred);
 		if (!hdr)
 			return NULL;
 		show_boot_progress (5);
@@ -62,6 +62,8 @@
 #include <command.h>
 #include <malloc.h>
 #include <fastboot.h>
+#include <hash.h>
+#include <sha1.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -848,15 +850,8 @@ static void fbt_handle_erase(char *cmdbuf)
 
 #define SPARSE_HEADER_MAJOR_VER 1
 
-static int _unsparse(unsigned char *source,
-					lbaint_t sector, lbaint_t num_blks)
+static int sparse_check_header(sparse_header_t *header, u64 section_size)
 {
-	sparse_header_t *header = (void *) source;
-	u32 i;
-	unsigned long blksz = priv.dev_desc->blksz;
-	u64 section_size = (u64)num_blks * blksz;
-	u64 outlen = 0;
-
 	FBTINFO("sparse_header:\n");
 	FBTINFO("\t         magic=0x%08X\n", header->magic);
 	FBTINFO("\t       version=%u.%u\n", header->major_version,
@@ -881,10 +876,145 @@ static int _unsparse(unsigned char *source,
 
 	if ((header->major_version != SPARSE_HEADER_MAJOR_VER) ||
 	    (header->file_hdr_sz != sizeof(sparse_header_t)) ||
-	    (header->chunk_hdr_sz != sizeof(chunk_header_t))) {
+	    (header->chunk_hdr_sz != sizeof(chunk_header_t)) ||
+	    (!header->blk_sz) ||
+	    (header->blk_sz % priv.dev_desc->blksz)) {
 		printf("sparse: incompatible format\n");
 		return 1;
 	}
+	return 0;
+}
+
+static int sparse_write_blks(lbaint_t sector, lbaint_t blkcnt,
+			     const void *source)
+{
+	if (priv.dev_desc->block_write(priv.dev_desc->dev, sector, blkcnt,
+				       source) != blkcnt) {
+		printf("sparse: block write to sector %lu"
+		       " of %lu blocks failed\n", sector, blkcnt);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * FILL chunks are written from a buffer replicating the fill value, in
+ * batches as large as the buffer.  Zero fills of at least
+ * CONFIG_FASTBOOT_SPARSE_ERASE_MIN_BLKS blocks are erased (trimmed)
+ * instead when the device reports that erased blocks read back as zero.
+ */
+#ifndef CONFIG_FASTBOOT_SPARSE_FILL_BUF_SIZE
+#define CONFIG_FASTBOOT_SPARSE_FILL_BUF_SIZE	(1024 * 1024)
+#endif
+#ifndef CONFIG_FASTBOOT_SPARSE_ERASE_MIN_BLKS
+#define CONFIG_FASTBOOT_SPARSE_ERASE_MIN_BLKS	2048
+#endif
+
+static u32 *sparse_fill_buf;
+static u32 sparse_fill_val;
+
+static int sparse_fill_blks(lbaint_t sector, lbaint_t blkcnt, u32 fill,
+			    u32 *crc)
+{
+	block_dev_desc_t *dev = priv.dev_desc;
+	unsigned long blksz = dev->blksz;
+	lbaint_t buf_blks, n;
+	int i;
+
+	if (!fill && dev->erase_is_zero && dev->block_erase &&
+	    (blkcnt >= CONFIG_FASTBOOT_SPARSE_ERASE_MIN_BLKS)) {
+		FBTDBG("sparse: FILL erase(sector=%lu,blkcnt=%lu)\n",
+		       sector, blkcnt);
+		if (dev->block_erase(dev->dev, sector, blkcnt) == blkcnt) {
+			if (crc)
+				*crc = crc32_zeros(*crc, (u64)blkcnt * blksz);
+			return 0;
+		}
+		printf("sparse: erase of sector %lu failed,"
+		       " writing fill instead\n", sector);
+	}
+
+	buf_blks = CONFIG_FASTBOOT_SPARSE_FILL_BUF_SIZE / blksz;
+	if (!sparse_fill_buf) {
+		sparse_fill_buf = malloc(buf_blks * blksz);
+		if (!sparse_fill_buf) {
+			printf("sparse: no memory for fill buffer\n");
+			return 1;
+		}
+		memset(sparse_fill_buf, 0, buf_blks * blksz);
+		sparse_fill_val = 0;
+	}
+	if (sparse_fill_val != fill) {
+		for (i = 0; i < (buf_blks * blksz) / sizeof(u32); i++)
+			sparse_fill_buf[i] = fill;
+		sparse_fill_val = fill;
+	}
+
+	while (blkcnt) {
+		n = min(blkcnt, buf_blks);
+		if (sparse_write_blks(sector, n, sparse_fill_buf))
+			return 1;
+		if (crc && fill)
+			*crc = crc32(*crc, (u8 *)sparse_fill_buf, n * blksz);
+		else if (crc)
+			*crc = crc32_zeros(*crc, (u64)n * blksz);
+		sector += n;
+		blkcnt -= n;
+	}
+	return 0;
+}
+
+static int sparse_check_crc(u32 crc, u32 expected)
+{
+	if (crc != expected) {
+		printf("sparse: CRC32 mismatch, computed 0x%08x"
+		       " expected 0x%08x\n", crc, expected);
+		return 1;
+	}
+	FBTDBG("sparse: CRC32 0x%08x ok\n", crc);
+	return 0;
+}
+
+/* Only pay for crc32 over the image if it has something to check */
+static int sparse_needs_crc(sparse_header_t *header, unsigned char *source,
+			    unsigned char *end)
+{
+	chunk_header_t *chunk;
+	u32 i;
+
+	if (header->image_checksum)
+		return 1;
+
+	source += header->file_hdr_sz;
+	for (i = 0; i < header->total_chunks; i++) {
+		chunk = (void *)source;
+		if ((source + sizeof(chunk_header_t) > end) ||
+		    (chunk->total_sz < sizeof(chunk_header_t)))
+			break;
+		if (chunk->chunk_type == CHUNK_TYPE_CRC32)
+			return 1;
+		source += chunk->total_sz;
+	}
+	return 0;
+}
+
+static int _unsparse(unsigned char *source,
+					lbaint_t sector, lbaint_t num_blks)
+{
+	sparse_header_t *header = (void *) source;
+	u32 i;
+	unsigned long blksz = priv.dev_desc->blksz;
+	u64 section_size = (u64)num_blks * blksz;
+	u64 outlen = 0;
+	u32 crc = 0;
+	u32 *crcp = NULL;
+
+	if (sparse_check_header(header, section_size))
+		return 1;
+
+	if (sparse_needs_crc(header, source, priv.image_start_ptr +
+			     priv.d_bytes))
+		crcp = &crc;
 
 	/* Skip the header now */
 	source += header->file_hdr_sz;
@@ -893,6 +1023,7 @@ static int _unsparse(unsigned char *source,
 		u64 clen = 0;
 		lbaint_t blkcnt;
 		chunk_header_t *chunk = (void *) source;
+		u32 data;
 
 		FBTINFO("chunk_header:\n");
 		FBTINFO("\t    chunk_type=%u\n", chunk->chunk_type);
@@ -924,19 +1055,40 @@ static int _unsparse(unsigned char *source,
 			FBTDBG("sparse: RAW blk=%d bsz=%d:"
 			       " write(sector=%lu,clen=%llu)\n",
 			       chunk->chunk_sz, header->blk_sz, sector, clen);
-			if (priv.dev_desc->block_write(priv.dev_desc->dev,
-						       sector, blkcnt, source)
-						!= blkcnt) {
-				printf("sparse: block write to sector %lu"
-					" of %llu bytes (%ld blkcnt) failed\n",
-					sector, clen, blkcnt);
+			if (sparse_write_blks(sector, blkcnt, source))
 				return 1;
-			}
+			if (crcp)
+				crc = crc32(crc, source, clen);
 
 			sector += (clen / blksz);
 			source += clen;
 			break;
 
+		case CHUNK_TYPE_FILL:
+			if (chunk->total_sz !=
+			    (sizeof(chunk_header_t) + sizeof(data))) {
+				printf("sparse: bogus FILL chunk\n");
+				return 1;
+			}
+			memcpy(&data, source, sizeof(data));
+			clen = (u64)chunk->chunk_sz * header->blk_sz;
+			FBTDBG("sparse: FILL 0x%08x blk=%d bsz=%d:"
+			       " fill(sector=%lu,clen=%llu)\n", data,
+			       chunk->chunk_sz, header->blk_sz, sector, clen);
+
+			outlen += clen;
+			if (outlen > section_size) {
+				printf("sparse: section size %llu MB limit:"
+				       " exceeded\n", section_size/(1024*1024));
+				return 1;
+			}
+			if (sparse_fill_blks(sector, clen / blksz, data, crcp))
+				return 1;
+
+			sector += (clen / blksz);
+			source += sizeof(data);
+			break;
+
 		case CHUNK_TYPE_DONT_CARE:
 			if (chunk->total_sz != sizeof(chunk_header_t)) {
 				printf("sparse: bogus DONT CARE chunk\n");
@@ -953,9 +1105,23 @@ static int _unsparse(unsigned char *source,
 				       " exceeded\n", section_size/(1024*1024));
 				return 1;
 			}
+			if (crcp)
+				crc = crc32_zeros(crc, clen);
 			sector += (clen / blksz);
 			break;
 
+		case CHUNK_TYPE_CRC32:
+			if (chunk->total_sz !=
+			    (sizeof(chunk_header_t) + sizeof(data))) {
+				printf("sparse: bogus CRC32 chunk\n");
+				return 1;
+			}
+			memcpy(&data, source, sizeof(data));
+			if (sparse_check_crc(crc, data))
+				return 1;
+			source += sizeof(data);
+			break;
+
 		default:
 			printf("sparse: unknown chunk ID %04x\n",
 			       chunk->chunk_type);
@@ -963,6 +1129,10 @@ static int _unsparse(unsigned char *source,
 		}
 	}
 
+	if (header->image_checksum &&
+	    sparse_check_crc(crc, header->image_checksum))
+		return 1;
+
 	printf("sparse: out-length %llu MB\n", outlen/(1024*1024));
 	return 0;
 }
@@ -982,6 +1152,411 @@ static int do_unsparse(disk_partition_t *ptn, unsigned char *source,
 	return rtn;
 }
 
+/*
+ * Streaming flash support
+ *
+ * 'oem stream <partition>' arms the next download to be written to
+ * <partition> a window at a time, instead of being buffered whole in
+ * the transfer buffer and written by the 'flash:' command.  The
+ * download is received in windows of the transfer buffer; each full
+ * window is handed to fbt_stream_parse(), which writes every complete
+ * block it can (parsing sparse chunk headers on the way) and leaves
+ * any partial block or header to be prepended to the next window.
+ * Receiving and writing take turns, they do not overlap.  The image
+ * size is therefore only limited by the partition.
+ *
+ * board_fbt_handle_flash() sees the first window only; see
+ * fbt_stream_board_check().
+ */
+#ifndef CONFIG_FASTBOOT_STREAM_WINDOW_SIZE
+#define CONFIG_FASTBOOT_STREAM_WINDOW_SIZE	(4 * 1024 * 1024)
+#endif
+
+enum fbt_stream_state {
+	STREAM_START,		/* format not known yet */
+	STREAM_RAW,		/* plain image, written as it arrives */
+	STREAM_CHUNK_HDR,	/* waiting for a sparse chunk header */
+	STREAM_CHUNK_DATA,	/* writing the data of a RAW sparse chunk */
+	STREAM_DONE,		/* all sparse chunks written */
+	STREAM_ERROR,
+};
+
+static struct {
+	disk_partition_t *ptn;		/* armed target of next download */
+	disk_partition_t *done_ptn;	/* target of last good stream */
+	enum fbt_stream_state state;
+	sparse_header_t header;
+	u32 chunk;			/* sparse chunks seen so far */
+	u64 chunk_left;			/* RAW chunk bytes still to write */
+	u64 outlen;			/* bytes covered in the partition */
+	lbaint_t sector;		/* next sector to write */
+	u32 crc;			/* crc32 of sparse output so far */
+	u32 window;			/* receive window size */
+	u32 carry;			/* bytes held over to next window */
+	u64 received;
+	int rejected;			/* board refused the image */
+} stream;
+
+static void fbt_stream_fail(const char *msg)
+{
+	printf("stream: %s\n", msg);
+	stream.state = STREAM_ERROR;
+}
+
+static int fbt_stream_covers(u64 clen)
+{
+	disk_partition_t *ptn = stream.ptn;
+
+	stream.outlen += clen;
+	if (stream.outlen > (u64)ptn->size * priv.dev_desc->blksz) {
+		fbt_stream_fail("image larger than partition");
+		return 0;
+	}
+	return 1;
+}
+
+/* Consume as much of buf as possible and return the number of bytes
+ * used.  When last is set no more data follows, so a trailing partial
+ * block of a raw image is zero padded and written; buf must have room
+ * for one more block beyond len for that.
+ */
+static u32 fbt_stream_parse(u8 *buf, u32 len, int last)
+{
+	unsigned long blksz = priv.dev_desc->blksz;
+	u8 *p = buf;
+	u8 *end = buf + len;
+	u32 avail, n;
+
+	while ((stream.state != STREAM_DONE) &&
+	       (stream.state != STREAM_ERROR)) {
+		avail = end - p;
+
+		switch (stream.state) {
+		case STREAM_START:
+			if (avail < sizeof(stream.header) && !last)
+				return p - buf;
+			if ((avail >= sizeof(stream.header)) &&
+			    (((sparse_header_t *)p)->magic ==
+			     SPARSE_HEADER_MAGIC)) {
+				printf("fastboot: streaming sparse image\n");
+				memcpy(&stream.header, p,
+				       sizeof(stream.header));
+				if (sparse_check_header(&stream.header,
+						(u64)stream.ptn->size * blksz)) {
+					fbt_stream_fail("bad sparse header");
+					break;
+				}
+				p += stream.header.file_hdr_sz;
+				stream.state = STREAM_CHUNK_HDR;
+			} else {
+				printf("fastboot: streaming raw image\n");
+				stream.state = STREAM_RAW;
+			}
+			break;
+
+		case STREAM_RAW:
+			n = avail - (avail % blksz);
+			if (last && (n != avail)) {
+				memset(end, 0, blksz - (avail - n));
+				n += blksz;
+			}
+			if (!n)
+				return p - buf;
+			if (!fbt_stream_covers(n))
+				break;
+			if (sparse_write_blks(stream.sector, n / blksz, p)) {
+				fbt_stream_fail("write failed");
+				break;
+			}
+			stream.sector += n / blksz;
+			p = (n > avail) ? end : (p + n);
+			if (p == end)
+				return p - buf;
+			break;
+
+		case STREAM_CHUNK_HDR: {
+			chunk_header_t chunk;
+			u64 clen;
+			u32 data;
+
+			if (stream.chunk == stream.header.total_chunks) {
+				stream.state = STREAM_DONE;
+				break;
+			}
+			if (avail < sizeof(chunk))
+				return p - buf;
+			memcpy(&chunk, p, sizeof(chunk));
+			/* FILL and CRC32 carry their 4 bytes of data */
+			if (((chunk.chunk_type == CHUNK_TYPE_FILL) ||
+			     (chunk.chunk_type == CHUNK_TYPE_CRC32)) &&
+			    (avail < sizeof(chunk) + sizeof(data)))
+				return p - buf;
+			p += sizeof(chunk);
+			stream.chunk++;
+
+			clen = (u64)chunk.chunk_sz * stream.header.blk_sz;
+			switch (chunk.chunk_type) {
+			case CHUNK_TYPE_RAW:
+				if (chunk.total_sz != (clen + sizeof(chunk))) {
+					fbt_stream_fail("bad RAW chunk size");
+					break;
+				}
+				if (!fbt_stream_covers(clen))
+					break;
+				stream.chunk_left = clen;
+				if (clen)
+					stream.state = STREAM_CHUNK_DATA;
+				break;
+
+			case CHUNK_TYPE_FILL:
+				if (chunk.total_sz !=
+				    (sizeof(chunk) + sizeof(data))) {
+					fbt_stream_fail("bogus FILL chunk");
+					break;
+				}
+				memcpy(&data, p, sizeof(data));
+				p += sizeof(data);
+				if (!fbt_stream_covers(clen))
+					break;
+				if (sparse_fill_blks(stream.sector, clen / blksz,
+						     data, &stream.crc)) {
+					fbt_stream_fail("fill failed");
+					break;
+				}
+				stream.sector += clen / blksz;
+				break;
+
+			case CHUNK_TYPE_DONT_CARE:
+				if (chunk.total_sz != sizeof(chunk)) {
+					fbt_stream_fail("bogus DONT CARE chunk");
+					break;
+				}
+				if (!fbt_stream_covers(clen))
+					break;
+				stream.crc = crc32_zeros(stream.crc, clen);
+				stream.sector += clen / blksz;
+				break;
+
+			case CHUNK_TYPE_CRC32:
+				if (chunk.total_sz !=
+				    (sizeof(chunk) + sizeof(data))) {
+					fbt_stream_fail("bogus CRC32 chunk");
+					break;
+				}
+				memcpy(&data, p, sizeof(data));
+				p += sizeof(data);
+				if (sparse_check_crc(stream.crc, data))
+					fbt_stream_fail("CRC32 mismatch");
+				break;
+
+			default:
+				printf("sparse: unknown chunk ID %04x\n",
+				       chunk.chunk_type);
+				fbt_stream_fail("unsupported sparse image");
+				break;
+			}
+			break;
+		}
+
+		case STREAM_CHUNK_DATA:
+			n = min((u64)avail, stream.chunk_left);
+			n -= n % blksz;
+			if (!n)
+				return p - buf;
+			if (sparse_write_blks(stream.sector, n / blksz, p)) {
+				fbt_stream_fail("write failed");
+				break;
+			}
+			stream.crc = crc32(stream.crc, p, n);
+			stream.sector += n / blksz;
+			stream.chunk_left -= n;
+			p += n;
+			if (!stream.chunk_left)
+				stream.state = STREAM_CHUNK_HDR;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	/* anything after the last chunk, or after an error, is dropped */
+	return len;
+}
+
+static void fbt_stream_set_window(void)
+{
+	struct urb *urb = endpoint_instance[RX_EP_INDEX].rcv_urb;
+
+	urb->buffer = priv.transfer_buffer + stream.carry;
+	urb->buffer_length = min((u64)stream.window,
+				 priv.d_size - stream.received);
+	urb->actual_length = 0;
+	urb->whole = 1;
+}
+
+/*
+ * Give the board the same say over a streamed image as 'flash:' gives it,
+ * on the first window of len bytes.  A check that needs more of the
+ * image than that fails it.  A handler that picks part of the download
+ * to flash, like the HS xloader one, can only be followed when the whole
+ * image is in the window; *buf and *len are then moved to that part.
+ */
+static int fbt_stream_board_check(u8 **buf, u32 *len, int last)
+{
+	int rc = 0;
+
+	priv.image_start_ptr = priv.transfer_buffer;
+	priv.d_bytes = *len;
+	if (board_fbt_handle_flash(stream.ptn, &priv)) {
+		/* the handler set priv.response */
+		printf("stream: board_fbt_handle_flash() error\n");
+		rc = -1;
+	} else if ((priv.image_start_ptr != priv.transfer_buffer) ||
+		   (priv.d_bytes != *len)) {
+		if (last) {
+			*buf = priv.image_start_ptr;
+			*len = priv.d_bytes;
+		} else {
+			printf("stream: board handler needs the whole image\n");
+			strcpy(priv.response,
+			       "FAILimage too large to stream to partition");
+			rc = -1;
+		}
+	}
+	priv.d_bytes = 0;
+	return rc;
+}
+
+/* Called instead of buffering when a 'download:' arrives while armed */
+static int fbt_stream_start(void)
+{
+	unsigned long blksz = priv.dev_desc->blksz;
+	u64 window = CONFIG_FASTBOOT_STREAM_WINDOW_SIZE;
+
+	/* leave room for held over bytes and final block padding, and
+	 * keep windows a multiple of the bulk packet size so each one
+	 * ends on a packet boundary.
+	 */
+	if (window > priv.transfer_buffer_size - 2 * blksz)
+		window = priv.transfer_buffer_size - 2 * blksz;
+	window &= ~(u64)(CONFIG_USBD_FASTBOOT_BULK_PKTSIZE_HS - 1);
+	if (!window) {
+		printf("stream: transfer buffer too small\n");
+		return 1;
+	}
+
+	if (partition_write_pre(stream.ptn)) {
+		printf("stream: pre-write commands for partition '%s'"
+		       " failed\n", stream.ptn->name);
+		return 1;
+	}
+
+	stream.state = STREAM_START;
+	stream.chunk = 0;
+	stream.chunk_left = 0;
+	stream.outlen = 0;
+	stream.sector = stream.ptn->start;
+	stream.crc = 0;
+	stream.window = window;
+	stream.carry = 0;
+	stream.received = 0;
+	stream.rejected = 0;
+
+	printf("streaming %llu bytes to partition '%s'\n",
+	       priv.d_size, stream.ptn->name);
+	fbt_stream_set_window();
+	return 0;
+}
+
+static int fbt_stream_rx(unsigned int length)
+{
+	struct usb_endpoint_instance *ep = &endpoint_instance[RX_EP_INDEX];
+	disk_partition_t *ptn = stream.ptn;
+	u8 *buf = priv.transfer_buffer;
+	u32 avail, used;
+	int last;
+
+	/* wait until the current window is full */
+	if (length < ep->rcv_urb->buffer_length)
+		return 0;
+
+	stream.received += length;
+	last = (stream.received >= priv.d_size);
+
+	avail = stream.carry + length;
+	if ((stream.received == length) &&
+	    fbt_stream_board_check(&buf, &avail, last)) {
+		stream.rejected = 1;
+		fbt_stream_fail("image refused by the board");
+	}
+	used = fbt_stream_parse(buf, avail, last);
+	stream.carry = avail - used;
+	if (stream.carry)
+		memmove(priv.transfer_buffer, buf + used, stream.carry);
+
+	if (!last) {
+		fbt_stream_set_window();
+		return 0;
+	}
+
+	/* transfer complete */
+	if ((stream.state == STREAM_CHUNK_HDR) ||
+	    (stream.state == STREAM_CHUNK_DATA))
+		fbt_stream_fail("sparse image truncated");
+	else if ((stream.state == STREAM_DONE) &&
+		 stream.header.image_checksum &&
+		 sparse_check_crc(stream.crc, stream.header.image_checksum))
+		fbt_stream_fail("image checksum mismatch");
+
+	if (partition_write_post(ptn) && (stream.state != STREAM_ERROR))
+		fbt_stream_fail("post-write commands failed");
+
+	if (stream.state == STREAM_ERROR) {
+		printf("Writing streamed '%s' FAILED!\n", ptn->name);
+		if (!stream.rejected)
+			strcpy(priv.response, "FAILstreamed write failed");
+	} else {
+		printf("Writing streamed '%s' DONE! (%llu bytes)\n",
+		       ptn->name, stream.outlen);
+		stream.done_ptn = ptn;
+		strcpy(priv.response, "OKAY");
+	}
+	stream.ptn = NULL;
+
+	/* nothing is left in the transfer buffer to flash or boot */
+	priv.d_size = 0;
+	priv.d_bytes = 0;
+	priv.flag |= FASTBOOT_FLAG_RESPONSE;
+
+	/* restore default buffer in urb */
+	ep->rcv_urb->buffer = (u8 *)ep->rcv_urb->buffer_data;
+	ep->rcv_urb->buffer_length = sizeof(ep->rcv_urb->buffer_data);
+	ep->rcv_urb->whole = 0;
+	return 1;
+}
+
+static void fbt_handle_oem_stream(const char *partition_name)
+{
+	disk_partition_t *ptn;
+
+	ptn = fastboot_flash_find_ptn(partition_name);
+	if (ptn == NULL) {
+		printf("Partition %s does not exist\n", partition_name);
+		strcpy(priv.response, "FAILpartition does not exist");
+		return;
+	}
+	if (is_env_partition(ptn) || is_info_partition(ptn)) {
+		printf("Not allowed to stream to %s partition\n", ptn->name);
+		strcpy(priv.response, "FAILnot allowed to stream to partition");
+		return;
+	}
+
+	printf("next download will be streamed to '%s'\n", ptn->name);
+	stream.ptn = ptn;
+	strcpy(priv.response, "OKAY");
+}
+
 static int fbt_save_info(disk_partition_t *info_ptn)
 {
 	struct info_partition_header *info_header;
@@ -1036,6 +1611,23 @@ static void fbt_handle_flash(char *cmdbuf, int check_unlock)
 		return;
 	}
 
+	/* the image was already written while it was downloaded */
+	if (!priv.d_bytes && stream.done_ptn) {
+		ptn = fastboot_flash_find_ptn(cmdbuf + 6);
+		if (ptn == stream.done_ptn) {
+			printf("'%s' was written by streamed download\n",
+			       ptn->name);
+			sprintf(priv.response, "OKAY");
+		} else {
+			printf("%s: failed, image was streamed to '%s'\n",
+			       __func__, stream.done_ptn->name);
+			sprintf(priv.response,
+				"FAILimage was streamed to another partition");
+		}
+		stream.done_ptn = NULL;
+		return;
+	}
+
 	if (!priv.d_bytes) {
 		printf("%s: failed, no image downloaded\n", __func__);
 		sprintf(priv.response, "FAILno image downloaded");
@@ -1543,6 +2135,71 @@ static void fbt_dump_kmsg(void)
 	strcpy(priv.response, "OKAY");
 }
 
+#ifdef CONFIG_HASH
+/* most we read per block_read while hashing a partition */
+#ifndef CONFIG_FASTBOOT_HASH_BUFLEN
+#define CONFIG_FASTBOOT_HASH_BUFLEN	(8 * 1024 * 1024)
+#endif
+
+static void fbt_handle_oem_hash(char *args)
+{
+	unsigned char digest[HASH_MAX_DIGEST_SIZE];
+	char digest_str[2 * HASH_MAX_DIGEST_SIZE + 1];
+	const struct hash_algo *algo;
+	disk_partition_t *ptn;
+	char *alg_name;
+	loff_t bytes = 0;
+	u64 offset, buflen;
+	int err;
+
+	alg_name = strchr(args, ':');
+	if (!alg_name) {
+		sprintf(priv.response, "FAILusage: hash:<partition>:<alg>");
+		return;
+	}
+	*alg_name++ = '\0';
+
+	algo = hash_find_algo(alg_name);
+	if (!algo) {
+		sprintf(priv.response, "FAILunsupported algorithm");
+		return;
+	}
+	ptn = fastboot_flash_find_ptn(args);
+	if (!ptn) {
+		sprintf(priv.response, "FAILpartition does not exist");
+		return;
+	}
+
+	/*
+	 * Read in large chunks through the part of the transfer buffer
+	 * past any pending download, so it can still be flashed after.
+	 */
+	offset = ALIGN(priv.d_bytes, priv.dev_desc->blksz);
+	if (offset + priv.dev_desc->blksz > priv.transfer_buffer_size) {
+		/* no room left past it, the download has to go */
+		printf("oem hash: discarding the pending download\n");
+		priv.d_bytes = 0;
+		offset = 0;
+	}
+	buflen = priv.transfer_buffer_size - offset;
+	if (buflen > CONFIG_FASTBOOT_HASH_BUFLEN)
+		buflen = CONFIG_FASTBOOT_HASH_BUFLEN;
+
+	err = partition_hash_bytes(priv.dev_desc, ptn, &bytes, alg_name,
+				digest, priv.transfer_buffer + offset, buflen);
+	if (err) {
+		printf("Hashing '%s' failed with error %d\n", ptn->name, err);
+		sprintf(priv.response, "FAILhash failed");
+		return;
+	}
+
+	hash_to_str(digest, algo->digest_size, digest_str);
+	printf("%s %s: %s\n", ptn->name, algo->name, digest_str);
+	fbt_send_raw_info(digest_str, strlen(digest_str));
+	strcpy(priv.response, "OKAY");
+}
+#endif /* CONFIG_HASH */
+
 static void fbt_handle_oem(char *cmdbuf)
 {
 	cmdbuf += 4;
@@ -1634,6 +2291,8 @@ static void fbt_handle_oem(char *cmdbuf)
 			return;
 		}
 		fbt_set_unlocked(0);
+		/* an armed stream must not write once we are locked */
+		stream.ptn = NULL;
 		strcpy(priv.response, "OKAY");
 		return;
 	}
@@ -1662,6 +2321,28 @@ static void fbt_handle_oem(char *cmdbuf)
 		return;
 	}
 
+	/* %fastboot oem stream <partition>
+	 * write the next download to <partition> as it is received,
+	 * a window at a time.  follow with
+	 * 'fastboot flash <partition> <image>'.
+	 */
+	if (strncmp(cmdbuf, "stream ", 7) == 0) {
+		FBTDBG("oem %s\n", cmdbuf);
+		fbt_handle_oem_stream(cmdbuf + 7);
+		return;
+	}
+
+#ifdef CONFIG_HASH
+	/* %fastboot oem hash:<partition>:<algorithm>
+	 * hash the whole partition; the digest comes back as INFO
+	 */
+	if (strncmp(cmdbuf, "hash:", 5) == 0) {
+		FBTDBG("oem %s\n", cmdbuf);
+		fbt_handle_oem_hash(cmdbuf + 5);
+		return;
+	}
+#endif
+
 	/* %fastboot oem saveinfo */
 	if (strcmp(cmdbuf, "saveinfo") == 0) {
 		disk_partition_t *info_ptn;
@@ -1757,6 +2438,9 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 	int clear_cmd_buf;
 
 	if (priv.d_size) {
+		if (stream.ptn)
+			return fbt_stream_rx(length);
+
 		if (length < priv.d_size) {
 			/* don't clear cmd buf because we've replaced it
 			 * with our transfer buffer.  we'll clear it at
@@ -1775,6 +2459,7 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 		ep = &endpoint_instance[RX_EP_INDEX];
 		ep->rcv_urb->buffer = (u8 *)ep->rcv_urb->buffer_data;
 		ep->rcv_urb->buffer_length = sizeof(ep->rcv_urb->buffer_data);
+		ep->rcv_urb->whole = 0;
 
 		FBTINFO("downloaded %llu bytes\n", priv.d_bytes);
 
@@ -1829,6 +2514,7 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 	/* %fastboot continue */
 	else if (strcmp(cmdbuf, "continue") == 0) {
 		FBTDBG("continue\n");
+		stream.ptn = NULL;
 		strcpy(priv.response, "OKAY");
 		priv.exit = 1;
 	}
@@ -1836,6 +2522,7 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 	/* %fastboot boot <kernel> [ <ramdisk> ] */
 	else if (memcmp(cmdbuf, "boot", 4) == 0) {
 		FBTDBG("boot\n");
+		stream.ptn = NULL;
 		fbt_handle_boot(cmdbuf);
 	}
 
@@ -1851,8 +2538,23 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 		priv.d_bytes = 0;
 
 		FBTINFO("starting download of %llu bytes\n", priv.d_size);
+		stream.done_ptn = NULL;
 		if (priv.d_size == 0) {
 			strcpy(priv.response, "FAILdata invalid size");
+		} else if (stream.ptn && !priv.unlocked) {
+			priv.d_size = 0;
+			stream.ptn = NULL;
+			strcpy(priv.response, "FAILdevice is locked");
+		} else if (stream.ptn) {
+			if (fbt_stream_start()) {
+				priv.d_size = 0;
+				stream.ptn = NULL;
+				strcpy(priv.response, "FAILstream setup failed");
+			} else {
+				sprintf(priv.response, "DATA%08llx",
+					priv.d_size);
+				clear_cmd_buf = 0;
+			}
 		} else if (priv.d_size > priv.transfer_buffer_size) {
 			priv.d_size = 0;
 			strcpy(priv.response, "FAILdata too large");
@@ -1867,6 +2569,7 @@ static int fbt_rx_process(unsigned char *buffer, int length)
 			ep->rcv_urb->buffer = priv.transfer_buffer;
 			ep->rcv_urb->buffer_length = priv.d_size;
 			ep->rcv_urb->actual_length = 0;
+			ep->rcv_urb->whole = 1;
 
 			/* don't poison the cmd buffer because
 			 * we've replaced it with our
@@ -2234,7 +2937,105 @@ static void bootimg_print_image_hdr(struct fastboot_boot_img_hdr *hdr)
 #endif
 }
 
-/* booti [ <addr> | <partition> ] */
+/*
+ * The bootimg id is the SHA1 of the kernel, ramdisk and second stage
+ * payloads, each followed by its 32 bit size (see mkbootimg).  With
+ * CONFIG_FASTBOOT_BOOTI_VERIFY booti checks it; payloads read from a
+ * partition are hashed a chunk at a time as they land in memory so the
+ * check costs no extra pass over the images.
+ */
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+#ifndef CONFIG_FASTBOOT_BOOTI_HASH_CHUNK
+#define CONFIG_FASTBOOT_BOOTI_HASH_CHUNK	(256 * 1024)
+#endif
+#define BOOTI_SHA1_LEN	20
+#endif
+
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+static int booti_has_id(struct fastboot_boot_img_hdr *hdr)
+{
+	int i;
+
+	/* images from tools that leave the id blank can't be checked */
+	for (i = 0; i < BOOTI_SHA1_LEN / sizeof(hdr->id[0]); i++)
+		if (hdr->id[i])
+			return 1;
+	printf("booti: image has no id, not verified\n");
+	return 0;
+}
+
+static void booti_hash(sha1_context *ctx, void *buf, u32 size)
+{
+	sha1_update(ctx, buf, size);
+	sha1_update(ctx, (u8 *)&size, sizeof(size));
+}
+#endif
+
+/* Does the load address range [dst, dst + dlen) hit [src, src + slen)? */
+static int booti_overlap(u32 dst, u32 dlen, void *src, u32 slen)
+{
+	u32 s = (u32)src;
+
+	return dlen && slen && dst < s + slen && s < dst + dlen;
+}
+
+/* A payload within a run of blocks read from the boot partition */
+struct booti_seg {
+	u32 off;	/* byte offset in the run */
+	u32 size;	/* payload size in bytes */
+};
+
+/* Read a run of bytes starting at sector into dst.  If ctx is set, each
+ * payload in segs is hashed, followed by its size, as soon as it is in
+ * memory.
+ */
+static int booti_read_run(block_dev_desc_t *blkdev, lbaint_t sector,
+			  u8 *dst, u32 len, const struct booti_seg *segs,
+			  int nsegs, sha1_context *ctx)
+{
+	unsigned long blksz = blkdev->blksz;
+	lbaint_t blocks = DIV_ROUND_UP(len, blksz);
+	lbaint_t chunk = blocks;
+	lbaint_t done = 0, n;
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+	u32 avail, hashed = 0, start, end;
+	int seg = 0;
+
+	if (ctx)
+		chunk = max(CONFIG_FASTBOOT_BOOTI_HASH_CHUNK / blksz, 1UL);
+#endif
+
+	do {
+		n = min(chunk, blocks - done);
+		if (n && (blkdev->block_read(blkdev->dev, sector + done, n,
+					     dst + done * blksz) != n))
+			return 1;
+		done += n;
+
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+		/* hash whatever payload bytes just landed */
+		avail = min((u64)done * blksz, (u64)len);
+		while (ctx && (seg < nsegs)) {
+			start = segs[seg].off + hashed;
+			end = min(avail, segs[seg].off + segs[seg].size);
+			if (end > start) {
+				sha1_update(ctx, dst + start, end - start);
+				hashed += end - start;
+			}
+			if (hashed < segs[seg].size)
+				break;
+			sha1_update(ctx, (u8 *)&segs[seg].size,
+				    sizeof(segs[seg].size));
+			hashed = 0;
+			seg++;
+		}
+#endif
+	} while (done < blocks);
+
+	return 0;
+}
+
+/* booti [ <addr> | <partition> ] [ second ] */
 static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	char *boot_source = "boot";
@@ -2243,9 +3044,18 @@ static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	struct fastboot_boot_img_hdr *hdr = NULL;
 	bootm_headers_t images;
 	int need_post_ran = 0;
+	int load_second = 0;
+	struct booti_seg segs[2];
+	sha1_context *ctx = NULL;
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+	sha1_context sha1_ctx;
+	u8 digest[BOOTI_SHA1_LEN];
+#endif
 
 	if (argc >= 2)
 		boot_source = argv[1];
+	if ((argc >= 3) && !strcmp(argv[2], "second"))
+		load_second = 1;
 
 	if (!blkdev) {
 		printf("fastboot was not successfully initialized\n");
@@ -2256,7 +3066,8 @@ static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	if (ptn) {
 		unsigned long blksz;
 		unsigned sector;
-		unsigned blocks;
+		u32 ksize, rsize;
+		int i;
 
 		if (partition_read_pre(ptn)) {
 			printf("pre-read commands for partition '%s' failed\n",
@@ -2283,23 +3094,82 @@ static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		}
 
 		bootimg_print_image_hdr(hdr);
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+		if (booti_has_id(hdr)) {
+			sha1_starts(&sha1_ctx);
+			ctx = &sha1_ctx;
+		}
+#endif
 
+		ksize = ALIGN(hdr->kernel_size, hdr->page_size);
+		rsize = ALIGN(hdr->ramdisk_size, hdr->page_size);
 		sector = ptn->start + (hdr->page_size / blksz);
-		blocks = DIV_ROUND_UP(hdr->kernel_size, blksz);
-		if (blkdev->block_read(blkdev->dev, sector, blocks,
-					      (void *) hdr->kernel_addr) !=
-		    blocks) {
-			printf("booti: failed to read kernel\n");
+		if ((hdr->page_size % blksz) || (ksize % blksz)) {
+			printf("booti: page size %u not a multiple of block"
+			       " size %lu\n", hdr->page_size, blksz);
 			goto fail;
 		}
 
-		sector += ALIGN(hdr->kernel_size, hdr->page_size) / blksz;
-		blocks = DIV_ROUND_UP(hdr->ramdisk_size, blksz);
-		if (blkdev->block_read(blkdev->dev, sector, blocks,
-					      (void *) hdr->ramdisk_addr) !=
-		    blocks) {
-			printf("booti: failed to read ramdisk\n");
-			goto fail;
+		segs[0].off = 0;
+		segs[0].size = hdr->kernel_size;
+		if (hdr->ramdisk_addr == hdr->kernel_addr + ksize) {
+			/* the ramdisk follows the kernel in memory just as
+			 * it does in the image, so read both in one go.
+			 */
+			segs[1].off = ksize;
+			segs[1].size = hdr->ramdisk_size;
+			if (booti_read_run(blkdev, sector,
+					   (u8 *)hdr->kernel_addr,
+					   ksize + hdr->ramdisk_size,
+					   segs, 2, ctx)) {
+				printf("booti: failed to read kernel"
+				       " and ramdisk\n");
+				goto fail;
+			}
+		} else {
+			if (booti_read_run(blkdev, sector,
+					   (u8 *)hdr->kernel_addr,
+					   hdr->kernel_size, segs, 1, ctx)) {
+				printf("booti: failed to read kernel\n");
+				goto fail;
+			}
+			segs[0].size = hdr->ramdisk_size;
+			if (booti_read_run(blkdev, sector + ksize / blksz,
+					   (u8 *)hdr->ramdisk_addr,
+					   hdr->ramdisk_size, segs, 1, ctx)) {
+				printf("booti: failed to read ramdisk\n");
+				goto fail;
+			}
+		}
+
+		/* the second stage is only read when asked for, or
+		 * when it is needed to check the id
+		 */
+		segs[0].size = hdr->second_size;
+		if (load_second || ctx) {
+			u8 *second = (u8 *)hdr->second_addr;
+			int scratch = !load_second && hdr->second_size;
+
+			if (scratch) {
+				second = malloc(ALIGN(hdr->second_size,
+						      blksz));
+				if (!second) {
+					printf("booti: no memory to check"
+					       " second stage\n");
+					goto fail;
+				}
+			}
+			i = booti_read_run(blkdev,
+					   sector + (ksize + rsize) / blksz,
+					   second, hdr->second_size, segs, 1,
+					   ctx);
+			if (scratch)
+				free(second);
+			if (i) {
+				printf("booti: failed to read second"
+				       " stage\n");
+				goto fail;
+			}
 		}
 		if (need_post_ran) {
 			need_post_ran = 0;
@@ -2311,7 +3181,7 @@ static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		}
 	} else {
 		unsigned addr;
-		void *kaddr, *raddr;
+		void *kaddr, *raddr, *saddr;
 		char *ep;
 
 		addr = simple_strtoul(boot_source, &ep, 16);
@@ -2346,12 +3216,54 @@ static int do_booti(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		kaddr = (void *)(addr + hdr->page_size);
 		raddr = (void *)(kaddr + ALIGN(hdr->kernel_size,
 					       hdr->page_size));
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+		/* check the payloads in place, before they get moved */
+		if (booti_has_id(hdr)) {
+			sha1_starts(&sha1_ctx);
+			ctx = &sha1_ctx;
+			booti_hash(ctx, kaddr, hdr->kernel_size);
+			booti_hash(ctx, raddr, hdr->ramdisk_size);
+			booti_hash(ctx, raddr + ALIGN(hdr->ramdisk_size,
+						      hdr->page_size),
+				   hdr->second_size);
+		}
+#endif
+		saddr = raddr + ALIGN(hdr->ramdisk_size, hdr->page_size);
+		/* the second stage goes last, so its source must survive
+		 * the kernel and ramdisk moves
+		 */
+		if (load_second &&
+		    (booti_overlap(hdr->kernel_addr, hdr->kernel_size,
+				   saddr, hdr->second_size) ||
+		     booti_overlap(hdr->ramdisk_addr, hdr->ramdisk_size,
+				   saddr, hdr->second_size))) {
+			printf("booti: second stage overlaps the kernel or "
+			       "ramdisk load address\n");
+			goto fail;
+		}
 		memmove((void *)hdr->kernel_addr, kaddr, hdr->kernel_size);
 		memmove((void *)hdr->ramdisk_addr, raddr, hdr->ramdisk_size);
+		if (load_second)
+			memmove((void *)hdr->second_addr, saddr,
+				hdr->second_size);
 	}
 
+#ifdef CONFIG_FASTBOOT_BOOTI_VERIFY
+	if (ctx) {
+		sha1_finish(ctx, digest);
+		if (memcmp(digest, hdr->id, BOOTI_SHA1_LEN)) {
+			printf("booti: image id mismatch, image is corrupt\n");
+			goto fail;
+		}
+		printf("booti: image id verified\n");
+	}
+#endif
+
 	printf("kernel   @ %08x (%d)\n", hdr->kernel_addr, hdr->kernel_size);
 	printf("ramdisk  @ %08x (%d)\n", hdr->ramdisk_addr, hdr->ramdisk_size);
+	if (load_second)
+		printf("second   @ %08x (%d)\n", hdr->second_addr,
+		       hdr->second_size);
 
 #ifdef CONFIG_CMDLINE_TAG
 
@@ -2425,13 +3337,14 @@ fail:
 }
 
 U_BOOT_CMD(
-	booti,	2,	1,	do_booti,
+	booti,	3,	1,	do_booti,
 	"boot android bootimg",
-	"[ <addr> | <partition> ]\n    - boot application image\n"
+	"[ <addr> | <partition> ] [ second ]\n    - boot application image\n"
 	"\t'addr' should be the address of the boot image which is\n"
 	"\tzImage+ramdisk.img if in memory.  'partition' is the name\n"
 	"\tof the partition to boot from.  The default is to boot\n"
-	"\tfrom the 'boot' partition.\n"
+	"\tfrom the 'boot' partition.  The second stage payload is\n"
+	"\tonly loaded when 'second' is given.\n"
 );
 
 static void fbt_request_start_fastboot(void)
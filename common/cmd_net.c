@@ -27,8 +27,12 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#if defined(CONFIG_CMD_WGET)
+#include "../net/wget.h"
+#endif
 
 static int netboot_common (proto_t, cmd_tbl_t *, int , char * const []);
+static void netboot_update_env(void);
 
 int do_bootp (cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
@@ -108,6 +112,54 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+int do_wget(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	block_dev_desc_t *dev;
+	disk_partition_t ptn;
+	char *s;
+	int size;
+
+	if (argc <= 3)
+		return netboot_common(WGET, cmdtp, argc, argv);
+	if (argc > 5)
+		return cmd_usage(cmdtp);
+
+	/* wget <interface> <dev> <partition> [[hostIPaddr:]path] */
+	dev = get_dev(argv[1], simple_strtoul(argv[2], NULL, 16));
+	if (!dev) {
+		printf("Unknown device %s %s\n", argv[1], argv[2]);
+		return 1;
+	}
+	if (get_partition_by_name(dev, argv[3], &ptn)) {
+		printf("No partition '%s' on %s %s\n", argv[3],
+		       argv[1], argv[2]);
+		return 1;
+	}
+	if ((s = getenv("loadaddr")) != NULL)
+		load_addr = simple_strtoul(s, NULL, 16);
+	if (argc == 5)
+		copy_filename(BootFile, argv[4], sizeof(BootFile));
+
+	WgetSetPartition(dev, &ptn);
+	size = NetLoop(WGET);
+	WgetSetPartition(NULL, NULL);
+	if (size < 0)
+		return 1;
+
+	netboot_update_env();
+	return 0;
+}
+
+U_BOOT_CMD(
+	wget,	5,	1,	do_wget,
+	"load a file via network using HTTP",
+	"[loadAddress] [[hostIPaddr:]path]\n"
+	"wget <interface> <dev> <partition> [[hostIPaddr:]path]\n"
+	"    - write the file to a partition, staging it at $loadaddr"
+);
+#endif
+
 static void netboot_update_env (void)
 {
 	char tmp[22];
@@ -0,0 +1,922 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * USB mass storage gadget: exports a block device to the host with the
+ * Bulk-Only Transport and the handful of SCSI commands that Linux,
+ * Windows and OS X use on a disk.
+ *
+ * The buffer at load_addr carries the data.  READ(10) is read from the
+ * device in halves, so that one half goes out on the bus (by DMA on
+ * MUSB) while the next one is read.  WRITE(10) data is collected in the
+ * buffer as a write-back cache of one run of consecutive blocks and goes
+ * to the device as a single multi-block write when the buffer is full,
+ * when a write is not contiguous, when the host reads, synchronizes the
+ * cache or ejects, and after the host has been idle for a while.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <part.h>
+#include <scsi.h>
+#include <asm/unaligned.h>
+
+#include <usb_defs.h>
+
+#if defined(CONFIG_PPC)
+#include <usb/mpc8xx_udc.h>
+#elif defined(CONFIG_OMAP1510)
+#include <usb/omap1510_udc.h>
+#elif defined(CONFIG_MUSB_UDC)
+#include <usb/musb_udc.h>
+#elif defined(CONFIG_PXA27X)
+#include <usb/pxa27x_udc.h>
+#elif defined(CONFIG_SPEAR3XX) || defined(CONFIG_SPEAR600)
+#include <usb/spr_udc.h>
+#endif
+
+/* Data buffer at load_addr; half of it when reading */
+#ifndef CONFIG_UMS_BUFFER_SIZE
+#define CONFIG_UMS_BUFFER_SIZE		(8 << 20)
+#endif
+/* Write the cache back once the host has been quiet this long */
+#ifndef CONFIG_UMS_FLUSH_IDLE_MS
+#define CONFIG_UMS_FLUSH_IDLE_MS	500
+#endif
+#ifndef CONFIG_USBD_UMS_PRODUCTID
+#define CONFIG_USBD_UMS_PRODUCTID	CONFIG_USBD_PRODUCTID
+#endif
+#ifndef CONFIG_USBD_UMS_BULK_PKTSIZE_HS
+#define CONFIG_USBD_UMS_BULK_PKTSIZE_HS	512
+#endif
+#ifndef CONFIG_USBD_UMS_BULK_PKTSIZE_FS
+#define CONFIG_USBD_UMS_BULK_PKTSIZE_FS	64
+#endif
+
+#define STR_LANG		0x00
+#define STR_MANUFACTURER	0x01
+#define STR_PRODUCT		0x02
+#define STR_SERIAL		0x03
+#define STR_COUNT		0x04
+
+#define	NUM_CONFIGS	1
+#define	NUM_INTERFACES	1
+#define	NUM_ENDPOINTS	2
+
+#define	RX_EP_INDEX	1
+#define	TX_EP_INDEX	2
+
+/* Bulk-Only Transport */
+#define UMS_REQ_GET_MAX_LUN	0xfe
+#define UMS_REQ_RESET		0xff
+
+#define UMS_CBW_SIGNATURE	0x43425355	/* "USBC" */
+#define UMS_CSW_SIGNATURE	0x53425355	/* "USBS" */
+#define UMS_CBW_SIZE		31
+#define UMS_CSW_SIZE		13
+#define UMS_CBW_DATA_IN		0x80
+
+#define UMS_CSW_GOOD		0
+#define UMS_CSW_FAILED		1
+#define UMS_CSW_PHASE_ERROR	2
+
+struct ums_cbw {
+	u32	signature;
+	u32	tag;
+	u32	data_len;
+	u8	flags;
+	u8	lun;
+	u8	cb_len;
+	u8	cb[16];
+} __attribute__ ((packed));
+
+struct ums_csw {
+	u32	signature;
+	u32	tag;
+	u32	residue;
+	u8	status;
+} __attribute__ ((packed));
+
+/* Sense keys and additional sense codes */
+#define SK_NO_SENSE		0x00
+#define SK_MEDIUM_ERROR		0x03
+#define SK_ILLEGAL_REQUEST	0x05
+#define ASC_WRITE_ERROR		0x0c
+#define ASC_READ_ERROR		0x11
+#define ASC_INVALID_OPCODE	0x20
+#define ASC_LBA_OUT_OF_RANGE	0x21
+#define ASC_INVALID_FIELD	0x24
+
+/* SCSI commands not in scsi.h */
+#define SCSI_READ_FMT_CAPAC	0x23
+
+struct _ums_config_desc {
+	struct usb_configuration_descriptor configuration_desc;
+	struct usb_interface_descriptor interface_desc;
+	struct usb_endpoint_descriptor endpoint_desc[NUM_ENDPOINTS];
+};
+
+/* defined and used by gadget/ep0.c */
+extern struct usb_string_descriptor **usb_strings;
+
+static char serial_number[33];
+static u8 wstr_lang[4] = {4, USB_DT_STRING, 0x9, 0x4};
+static u8 wstr_manufacturer[2 + 2*(sizeof(CONFIG_USBD_MANUFACTURER)-1)];
+static u8 wstr_product[2 + 2*(sizeof(CONFIG_USBD_PRODUCT_NAME)-1)];
+static u8 wstr_serial[2 + 2*(sizeof(serial_number) - 1)];
+
+static struct usb_device_descriptor device_descriptor = {
+	.bLength = sizeof(struct usb_device_descriptor),
+	.bDescriptorType =	USB_DT_DEVICE,
+	.bcdUSB =		cpu_to_le16(USB_BCD_VERSION),
+	.bDeviceClass =		0x00,
+	.bDeviceSubClass =	0x00,
+	.bDeviceProtocol =	0x00,
+	.bMaxPacketSize0 =	EP0_MAX_PACKET_SIZE,
+	.idVendor =		cpu_to_le16(CONFIG_USBD_VENDORID),
+	.idProduct =		cpu_to_le16(CONFIG_USBD_UMS_PRODUCTID),
+	.bcdDevice =		cpu_to_le16(0x0100),
+	.iManufacturer =	STR_MANUFACTURER,
+	.iProduct =		STR_PRODUCT,
+	.iSerialNumber =	STR_SERIAL,
+	.bNumConfigurations =	NUM_CONFIGS
+};
+
+static struct _ums_config_desc ums_config_desc = {
+	.configuration_desc = {
+		.bLength = sizeof(struct usb_configuration_descriptor),
+		.bDescriptorType = USB_DT_CONFIG,
+		.wTotalLength =	cpu_to_le16(sizeof(struct _ums_config_desc)),
+		.bNumInterfaces = NUM_INTERFACES,
+		.bConfigurationValue = 1,
+		.iConfiguration = 0,
+		.bmAttributes =	BMATTRIBUTE_SELF_POWERED | BMATTRIBUTE_RESERVED,
+		.bMaxPower = 0x32,
+	},
+	.interface_desc = {
+		.bLength  = sizeof(struct usb_interface_descriptor),
+		.bDescriptorType = USB_DT_INTERFACE,
+		.bInterfaceNumber = 0,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = NUM_ENDPOINTS,
+		.bInterfaceClass = USB_CLASS_MASS_STORAGE,
+		.bInterfaceSubClass = US_SC_SCSI,
+		.bInterfaceProtocol = US_PR_BULK,
+		.iInterface = 0,
+	},
+	.endpoint_desc = {
+		{
+			.bLength = sizeof(struct usb_endpoint_descriptor),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = RX_EP_INDEX | USB_DIR_OUT,
+			.bmAttributes =	USB_ENDPOINT_XFER_BULK,
+			.bInterval = 0,
+		},
+		{
+			.bLength = sizeof(struct usb_endpoint_descriptor),
+			.bDescriptorType = USB_DT_ENDPOINT,
+			.bEndpointAddress = TX_EP_INDEX | USB_DIR_IN,
+			.bmAttributes = USB_ENDPOINT_XFER_BULK,
+			.bInterval = 0,
+		},
+	},
+};
+
+static struct usb_interface_descriptor interface_descriptors[NUM_INTERFACES];
+static struct usb_endpoint_descriptor *ep_descriptor_ptrs[NUM_ENDPOINTS];
+
+static struct usb_string_descriptor *ums_string_table[STR_COUNT];
+static struct usb_device_instance device_instance[1];
+static struct usb_bus_instance bus_instance[1];
+static struct usb_configuration_instance config_instance[NUM_CONFIGS];
+static struct usb_interface_instance interface_instance[NUM_INTERFACES];
+static struct usb_alternate_instance alternate_instance[NUM_INTERFACES];
+static struct usb_endpoint_instance endpoint_instance[NUM_ENDPOINTS + 1];
+
+static struct {
+	block_dev_desc_t *dev;
+	u8		*buf;
+	lbaint_t	buf_blks;	/* size of buf in blocks */
+	int		configured;
+	int		reset;		/* bus reset or Bulk-Only Reset */
+	int		exit;
+	int		eject;		/* exit once the CSW is sent */
+	ulong		last_cmd;	/* get_timer() of the last CBW */
+
+	/* write-back cache: blocks wb_start.. at buf */
+	lbaint_t	wb_start;
+	lbaint_t	wb_blks;
+	int		wb_error;	/* a write-back failed, not reported yet */
+
+	u8		sense_key;
+	u8		asc;
+
+	u64		rd_bytes;
+	u64		wr_bytes;
+} ums;
+
+/* Replies to everything but READ(10) / WRITE(10) */
+static u8 ums_resp[512] __attribute__ ((aligned(32)));
+static struct ums_csw ums_csw __attribute__ ((aligned(32)));
+
+/* utility function for converting char * to wide string used by USB */
+static void str2wide(char *str, u16 *wide)
+{
+	int i;
+	for (i = 0; i < strlen(str) && str[i]; i++) {
+		#if defined(__LITTLE_ENDIAN)
+			wide[i] = (u16) str[i];
+		#elif defined(__BIG_ENDIAN)
+			wide[i] = ((u16)(str[i])<<8);
+		#else
+			#error "__LITTLE_ENDIAN or __BIG_ENDIAN undefined"
+		#endif
+	}
+}
+
+static void ums_init_strings(void)
+{
+	struct usb_string_descriptor *string;
+	char *id = getenv("fbt_id#");
+
+	if (id == NULL)
+		id = getenv("dieid#");
+	if (id == NULL)
+		id = "00123";
+	strncpy(serial_number, id, sizeof(serial_number));
+	serial_number[sizeof(serial_number) - 1] = '\0';
+
+	ums_string_table[STR_LANG] = (struct usb_string_descriptor *)wstr_lang;
+
+	string = (struct usb_string_descriptor *) wstr_manufacturer;
+	string->bLength = sizeof(wstr_manufacturer);
+	string->bDescriptorType = USB_DT_STRING;
+	str2wide(CONFIG_USBD_MANUFACTURER, string->wData);
+	ums_string_table[STR_MANUFACTURER] = string;
+
+	string = (struct usb_string_descriptor *) wstr_product;
+	string->bLength = sizeof(wstr_product);
+	string->bDescriptorType = USB_DT_STRING;
+	str2wide(CONFIG_USBD_PRODUCT_NAME, string->wData);
+	ums_string_table[STR_PRODUCT] = string;
+
+	string = (struct usb_string_descriptor *) wstr_serial;
+	memset(string, 0, sizeof(wstr_serial));
+	string->bLength = 2 + 2 * strlen(serial_number);
+	string->bDescriptorType = USB_DT_STRING;
+	str2wide(serial_number, string->wData);
+	ums_string_table[STR_SERIAL] = string;
+
+	usb_strings = ums_string_table;
+}
+
+static void ums_init_endpoints(void)
+{
+	int i;
+
+	bus_instance->max_endpoints = NUM_ENDPOINTS + 1;
+
+	for (i = 1; i <= NUM_ENDPOINTS; i++) {
+		/* configure packetsize based on HS negotiation status */
+		if (device_instance->speed == USB_SPEED_HIGH)
+			ep_descriptor_ptrs[i - 1]->wMaxPacketSize =
+				cpu_to_le16(CONFIG_USBD_UMS_BULK_PKTSIZE_HS);
+		else
+			ep_descriptor_ptrs[i - 1]->wMaxPacketSize =
+				cpu_to_le16(CONFIG_USBD_UMS_BULK_PKTSIZE_FS);
+
+		endpoint_instance[i].tx_packetSize =
+			le16_to_cpu(ep_descriptor_ptrs[i - 1]->wMaxPacketSize);
+		endpoint_instance[i].rcv_packetSize =
+			le16_to_cpu(ep_descriptor_ptrs[i - 1]->wMaxPacketSize);
+
+		udc_setup_ep(device_instance, i, &endpoint_instance[i]);
+	}
+}
+
+/*
+ * Arm the bulk-out endpoint for the next CBW, and nothing more: the host
+ * may send the data of a WRITE right behind it, which has to stay in the
+ * fifo until ums_rx() says where it goes.
+ */
+static void ums_rx_cbw(void)
+{
+	struct urb *urb = endpoint_instance[RX_EP_INDEX].rcv_urb;
+
+	urb->buffer = (u8 *)urb->buffer_data;
+	urb->buffer_length = UMS_CBW_SIZE;
+	urb->actual_length = 0;
+	urb->whole = 0;
+}
+
+static void ums_event_handler(struct usb_device_instance *device,
+			      usb_device_event_t event, int data)
+{
+	switch (event) {
+	case DEVICE_RESET:
+	case DEVICE_BUS_INACTIVE:
+		ums.configured = 0;
+		ums.reset = 1;
+		break;
+	case DEVICE_CONFIGURED:
+		ums.configured = 1;
+		break;
+	case DEVICE_ADDRESS_ASSIGNED:
+		ums_init_endpoints();
+		break;
+	default:
+		break;
+	}
+}
+
+/* Class requests on ep0 */
+static int ums_class_setup(struct usb_device_request *request,
+			   struct urb *urb)
+{
+	switch (request->bRequest) {
+	case UMS_REQ_GET_MAX_LUN:
+		urb->buffer[0] = 0;
+		urb->actual_length = 1;
+		break;
+	case UMS_REQ_RESET:
+		ums.reset = 1;
+		break;
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+static void ums_init_instances(void)
+{
+	int i;
+
+	memset(device_instance, 0, sizeof(struct usb_device_instance));
+	device_instance->device_state = STATE_INIT;
+	device_instance->device_descriptor = &device_descriptor;
+	device_instance->event = ums_event_handler;
+	device_instance->cdc_recv_setup = ums_class_setup;
+	device_instance->bus = bus_instance;
+	device_instance->configurations = NUM_CONFIGS;
+	device_instance->configuration_instance_array = config_instance;
+
+	memset(bus_instance, 0, sizeof(struct usb_bus_instance));
+	bus_instance->device = device_instance;
+	bus_instance->endpoint_array = endpoint_instance;
+	bus_instance->max_endpoints = 1;
+	bus_instance->maxpacketsize = 64;
+	bus_instance->serial_number_str = serial_number;
+
+	memset(config_instance, 0, sizeof(struct usb_configuration_instance));
+	config_instance->interfaces = NUM_INTERFACES;
+	config_instance->configuration_descriptor =
+		(struct usb_configuration_descriptor *)&ums_config_desc;
+	config_instance->interface_instance_array = interface_instance;
+
+	memset(interface_instance, 0, sizeof(struct usb_interface_instance));
+	interface_instance->alternates = 1;
+	interface_instance->alternates_instance_array = alternate_instance;
+
+	memset(alternate_instance, 0, sizeof(struct usb_alternate_instance));
+	alternate_instance->interface_descriptor = interface_descriptors;
+	alternate_instance->endpoints = NUM_ENDPOINTS;
+	alternate_instance->endpoints_descriptor_array = ep_descriptor_ptrs;
+
+	memset(endpoint_instance, 0, sizeof(endpoint_instance));
+	endpoint_instance[0].endpoint_address = 0;
+	endpoint_instance[0].rcv_packetSize = EP0_MAX_PACKET_SIZE;
+	endpoint_instance[0].rcv_attributes = USB_ENDPOINT_XFER_CONTROL;
+	endpoint_instance[0].tx_packetSize = EP0_MAX_PACKET_SIZE;
+	endpoint_instance[0].tx_attributes = USB_ENDPOINT_XFER_CONTROL;
+	udc_setup_ep(device_instance, 0, &endpoint_instance[0]);
+
+	for (i = 1; i <= NUM_ENDPOINTS; i++) {
+		ep_descriptor_ptrs[i - 1] = &ums_config_desc.endpoint_desc[i - 1];
+
+		endpoint_instance[i].endpoint_address =
+			ep_descriptor_ptrs[i - 1]->bEndpointAddress;
+		endpoint_instance[i].rcv_attributes =
+			ep_descriptor_ptrs[i - 1]->bmAttributes;
+		endpoint_instance[i].tx_attributes =
+			ep_descriptor_ptrs[i - 1]->bmAttributes;
+		endpoint_instance[i].rcv_packetSize =
+			CONFIG_USBD_UMS_BULK_PKTSIZE_FS;
+		endpoint_instance[i].tx_packetSize =
+			CONFIG_USBD_UMS_BULK_PKTSIZE_FS;
+
+		urb_link_init(&endpoint_instance[i].rcv);
+		urb_link_init(&endpoint_instance[i].rdy);
+		urb_link_init(&endpoint_instance[i].tx);
+		urb_link_init(&endpoint_instance[i].done);
+
+		if (endpoint_instance[i].endpoint_address & USB_DIR_IN)
+			endpoint_instance[i].tx_urb =
+				usbd_alloc_urb(device_instance,
+					       &endpoint_instance[i]);
+		else
+			endpoint_instance[i].rcv_urb =
+				usbd_alloc_urb(device_instance,
+					       &endpoint_instance[i]);
+	}
+	ums_rx_cbw();
+}
+
+/*
+ * Run the controller while waiting for a transfer.  Returns non-zero
+ * when the transfer has to be given up: Ctrl-C, a reset or a cable pull.
+ */
+static int ums_poll_abort(void)
+{
+	udc_irq();
+	if (ctrlc())
+		ums.exit = 1;
+	return ums.exit || ums.reset || !ums.configured;
+}
+
+/* Queue len bytes at buf on bulk-in; the caller waits with ums_tx_wait */
+static void ums_tx_start(void *buf, u32 len)
+{
+	struct usb_endpoint_instance *ep = &endpoint_instance[TX_EP_INDEX];
+	struct urb *urb = ep->tx_urb;
+
+	urb->buffer = buf;
+	urb->buffer_length = len;
+	urb->actual_length = len;
+	udc_endpoint_write(ep);
+}
+
+/*
+ * usbd_tx_complete() zeroes the urb once it is all handed to the
+ * controller, after which its buffer may be reused.  On an abort the
+ * rest is dropped, it must not go out after a reset.
+ */
+static int ums_tx_wait(void)
+{
+	struct usb_endpoint_instance *ep = &endpoint_instance[TX_EP_INDEX];
+
+	while (ep->tx_urb->actual_length)
+		if (ums_poll_abort()) {
+			ep->tx_urb->actual_length = 0;
+			return -1;
+		}
+	return 0;
+}
+
+static int ums_rx(void *buf, u32 len)
+{
+	struct urb *urb = endpoint_instance[RX_EP_INDEX].rcv_urb;
+
+	urb->buffer = buf;
+	urb->buffer_length = len;
+	urb->actual_length = 0;
+	urb->whole = 1;
+	while (urb->actual_length < len)
+		if (ums_poll_abort())
+			return -1;
+	return 0;
+}
+
+/* Pad a data-in phase that we cannot fill */
+static int ums_tx_zeros(u32 len)
+{
+	u32 n;
+
+	memset(ums_resp, 0, sizeof(ums_resp));
+	while (len) {
+		n = min(len, (u32)sizeof(ums_resp));
+		ums_tx_start(ums_resp, n);
+		if (ums_tx_wait())
+			return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Take a data-out phase that we have no use for */
+static int ums_rx_discard(u32 len)
+{
+	u32 n;
+
+	while (len) {
+		n = min(len, (u32)sizeof(ums_resp));
+		if (ums_rx(ums_resp, n))
+			return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+static void ums_sense(u8 key, u8 asc)
+{
+	ums.sense_key = key;
+	ums.asc = asc;
+}
+
+/*
+ * Write the cache back to the device.  The host got GOOD for this data
+ * long ago, so a failure is also kept in wb_error until a command that
+ * depends on the data being stored can report it.
+ */
+static int ums_flush(void)
+{
+	lbaint_t n;
+
+	if (!ums.wb_blks)
+		return 0;
+	n = ums.dev->block_write(ums.dev->dev, ums.wb_start, ums.wb_blks,
+				 ums.buf);
+	if (n != ums.wb_blks) {
+		printf("ums: writing %lu blocks at %lu failed\n",
+		       (ulong)ums.wb_blks, (ulong)ums.wb_start);
+		ums.wb_blks = 0;
+		ums.wb_error = 1;
+		ums_sense(SK_MEDIUM_ERROR, ASC_WRITE_ERROR);
+		return -1;
+	}
+	ums.wr_bytes += (u64)n * ums.dev->blksz;
+	ums.wb_blks = 0;
+	return 0;
+}
+
+/* Flush, and take any write-back failure not reported yet */
+static int ums_sync(void)
+{
+	ums_flush();
+	if (!ums.wb_error)
+		return 0;
+	ums.wb_error = 0;
+	ums_sense(SK_MEDIUM_ERROR, ASC_WRITE_ERROR);
+	return -1;
+}
+
+/*
+ * READ(10): the two halves of the buffer take turns, one being read from
+ * the device while the other one is on the bus.  Returns the number of
+ * bytes not transferred, or -1 when the transfer was aborted.
+ */
+static int ums_read(lbaint_t lba, lbaint_t blks)
+{
+	lbaint_t half = max(ums.buf_blks / 2, (lbaint_t)1);
+	ulong blksz = ums.dev->blksz;
+	u8 *buf[2] = { ums.buf, ums.buf + half * blksz };
+	int cur = 0;
+	lbaint_t n;
+
+	if (ums_flush())
+		return blks * blksz;
+
+	while (blks) {
+		n = min(blks, half);
+		if (ums.dev->block_read(ums.dev->dev, lba, n, buf[cur]) != n) {
+			printf("ums: reading %lu blocks at %lu failed\n",
+			       (ulong)n, (ulong)lba);
+			ums_sense(SK_MEDIUM_ERROR, ASC_READ_ERROR);
+			break;
+		}
+		/* the other half is still going out */
+		if (ums_tx_wait())
+			return -1;
+		ums_tx_start(buf[cur], n * blksz);
+		ums.rd_bytes += n * blksz;
+		cur ^= 1;
+		lba += n;
+		blks -= n;
+	}
+	if (ums_tx_wait())
+		return -1;
+	return blks * blksz;
+}
+
+/*
+ * WRITE(10): the data is received straight into the write-back cache.
+ * Returns the number of bytes not stored, or -1 when aborted.
+ */
+static int ums_write(lbaint_t lba, lbaint_t blks)
+{
+	ulong blksz = ums.dev->blksz;
+	lbaint_t n;
+
+	while (blks) {
+		/* the cache holds a single run of blocks */
+		if (ums.wb_blks && (lba != ums.wb_start + ums.wb_blks ||
+				    ums.wb_blks == ums.buf_blks) &&
+		    ums_flush())
+			break;
+		if (!ums.wb_blks)
+			ums.wb_start = lba;
+
+		n = min(blks, ums.buf_blks - ums.wb_blks);
+		if (ums_rx(ums.buf + ums.wb_blks * blksz, n * blksz))
+			return -1;
+		ums.wb_blks += n;
+		lba += n;
+		blks -= n;
+	}
+	return blks * blksz;
+}
+
+static int ums_rw(struct ums_cbw *cbw, u32 *residue)
+{
+	u32 host_len = le32_to_cpu(cbw->data_len);
+	int is_read = (cbw->cb[0] == SCSI_READ10);
+	lbaint_t lba = get_unaligned_be32(&cbw->cb[2]);
+	lbaint_t blks = get_unaligned_be16(&cbw->cb[7]);
+	int left;
+
+	if (host_len != blks * ums.dev->blksz ||
+	    (host_len && !(cbw->flags & UMS_CBW_DATA_IN) != !is_read)) {
+		/* the host and we disagree about the data phase */
+		*residue = host_len;
+		return UMS_CSW_PHASE_ERROR;
+	}
+	if (lba > ums.dev->lba || blks > ums.dev->lba - lba) {
+		ums_sense(SK_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+		*residue = host_len;
+		if (is_read)
+			return ums_tx_zeros(host_len) ? -1 : UMS_CSW_FAILED;
+		return ums_rx_discard(host_len) ? -1 : UMS_CSW_FAILED;
+	}
+
+	if (is_read) {
+		left = ums_read(lba, blks);
+		if (left > 0 && ums_tx_zeros(left))
+			return -1;
+	} else {
+		/* fail the write after an earlier write-back failed */
+		if (ums.wb_error)
+			left = host_len;
+		else
+			left = ums_write(lba, blks);
+		if (left > 0) {
+			ums.wb_error = 0;
+			ums_sense(SK_MEDIUM_ERROR, ASC_WRITE_ERROR);
+			if (ums_rx_discard(left))
+				return -1;
+		}
+	}
+	if (left < 0)
+		return -1;
+	*residue = left;
+	return left ? UMS_CSW_FAILED : UMS_CSW_GOOD;
+}
+
+static int ums_inquiry(u8 *cb, u8 *resp)
+{
+	/* no vital product data pages */
+	if (cb[1] & 0x01) {
+		ums_sense(SK_ILLEGAL_REQUEST, ASC_INVALID_FIELD);
+		return -1;
+	}
+	resp[0] = 0x00;		/* direct access block device */
+	resp[1] = 0x80;		/* removable */
+	resp[2] = 0x02;		/* SCSI-2 */
+	resp[3] = 0x02;		/* response data format */
+	resp[4] = 36 - 5;	/* additional length */
+	sprintf((char *)resp + 8, "%-8.8s%-16.16s%-4.4s",
+		"U-Boot", CONFIG_USBD_PRODUCT_NAME, "1.00");
+	return 36;
+}
+
+static int ums_mode_sense(u8 *cb, u8 *resp)
+{
+	int ten = (cb[0] == SCSI_MODE_SEN10);
+	int hdr = ten ? 8 : 4;
+	int page = cb[2] & 0x3f;
+	u8 *p = resp + hdr;
+
+	/* only the caching page, which tells the host to sync us */
+	if (page == 0x08 || page == 0x3f) {
+		p[0] = 0x08;
+		p[1] = 0x12;
+		p[2] = 0x04;	/* WCE */
+		p += 20;
+	} else {
+		ums_sense(SK_ILLEGAL_REQUEST, ASC_INVALID_FIELD);
+		return -1;
+	}
+
+	if (ten)
+		put_unaligned_be16(p - resp - 2, resp);
+	else
+		resp[0] = p - resp - 1;
+	return p - resp;
+}
+
+/*
+ * Run one command.  Returns the CSW status with *residue set, or -1 when
+ * the command was aborted and no CSW must be sent.
+ */
+static int ums_command(struct ums_cbw *cbw, u32 *residue)
+{
+	u32 host_len = le32_to_cpu(cbw->data_len);
+	u8 *cb = cbw->cb;
+	u8 *resp = ums_resp;
+	int len = 0;
+	u32 n;
+
+	if (cb[0] == SCSI_READ10 || cb[0] == SCSI_WRITE10)
+		return ums_rw(cbw, residue);
+
+	memset(resp, 0, sizeof(ums_resp));
+	switch (cb[0]) {
+	case SCSI_TST_U_RDY:
+	case SCSI_MED_REMOVL:
+	case SCSI_VERIFY:
+		break;
+	case SCSI_REQ_SENSE:
+		resp[0] = 0x70;		/* current error, fixed format */
+		resp[2] = ums.sense_key;
+		resp[7] = 18 - 8;
+		resp[12] = ums.asc;
+		len = 18;
+		ums_sense(SK_NO_SENSE, 0);
+		break;
+	case SCSI_INQUIRY:
+		len = ums_inquiry(cb, resp);
+		break;
+	case SCSI_MODE_SEN6:
+	case SCSI_MODE_SEN10:
+		len = ums_mode_sense(cb, resp);
+		break;
+	case SCSI_RD_CAPAC:
+		put_unaligned_be32(ums.dev->lba - 1, resp);
+		put_unaligned_be32(ums.dev->blksz, resp + 4);
+		len = 8;
+		break;
+	case SCSI_READ_FMT_CAPAC:
+		resp[3] = 8;		/* capacity list length */
+		put_unaligned_be32(ums.dev->lba, resp + 4);
+		/* 24-bit block length after the descriptor type */
+		put_unaligned_be32(ums.dev->blksz, resp + 8);
+		resp[8] = 0x02;		/* formatted media */
+		len = 12;
+		break;
+	case SCSI_SYNC_CACHE:
+		if (ums_sync())
+			len = -1;
+		break;
+	case SCSI_START_STP:
+		if (ums_sync()) {
+			len = -1;
+			break;
+		}
+		/* eject: the host is done with us */
+		if ((cb[4] & 0x03) == 0x02) {
+			printf("ums: ejected by host\n");
+			ums.eject = 1;
+		}
+		break;
+	default:
+		ums_sense(SK_ILLEGAL_REQUEST, ASC_INVALID_OPCODE);
+		len = -1;
+		break;
+	}
+
+	*residue = host_len;
+	if (!host_len)
+		return (len > 0) ? UMS_CSW_PHASE_ERROR :
+		       (len < 0) ? UMS_CSW_FAILED : UMS_CSW_GOOD;
+
+	if (!(cbw->flags & UMS_CBW_DATA_IN)) {
+		/* nothing here takes data from the host */
+		if (ums_rx_discard(host_len))
+			return -1;
+		return UMS_CSW_FAILED;
+	}
+
+	/*
+	 * There is no way to stall the bulk-in endpoint here, so a short
+	 * reply is padded with zeros to what the host asked for.
+	 */
+	if (len > (int)host_len)
+		len = host_len;
+	n = min(host_len, (u32)sizeof(ums_resp));
+	ums_tx_start(resp, n);
+	if (ums_tx_wait() || (host_len > n && ums_tx_zeros(host_len - n)))
+		return -1;
+	if (len < 0) {
+		*residue = host_len;
+		return UMS_CSW_FAILED;
+	}
+	*residue = host_len - len;
+	return UMS_CSW_GOOD;
+}
+
+static int ums_send_csw(u32 tag, u32 residue, int status)
+{
+	ums_csw.signature = cpu_to_le32(UMS_CSW_SIGNATURE);
+	ums_csw.tag = tag;
+	ums_csw.residue = cpu_to_le32(residue);
+	ums_csw.status = status;
+	ums_tx_start(&ums_csw, UMS_CSW_SIZE);
+	return ums_tx_wait();
+}
+
+static void ums_handle_rx(void)
+{
+	struct urb *urb = endpoint_instance[RX_EP_INDEX].rcv_urb;
+	struct ums_cbw cbw;
+	u32 residue = 0;
+	int status;
+
+	if (urb->actual_length == 0) {
+		if (ums.wb_blks &&
+		    get_timer(ums.last_cmd) > CONFIG_UMS_FLUSH_IDLE_MS)
+			ums_flush();
+		return;
+	}
+
+	memcpy(&cbw, urb->buffer, sizeof(cbw));
+	if (urb->actual_length != UMS_CBW_SIZE ||
+	    le32_to_cpu(cbw.signature) != UMS_CBW_SIGNATURE ||
+	    cbw.lun != 0 || cbw.cb_len == 0 || cbw.cb_len > 16) {
+		debug("ums: invalid CBW, %u bytes\n", urb->actual_length);
+		ums_rx_cbw();
+		return;
+	}
+	ums.last_cmd = get_timer(0);
+
+	status = ums_command(&cbw, &residue);
+	if (status < 0)
+		return;
+	ums_rx_cbw();
+	if (ums_send_csw(cbw.tag, residue, status))
+		debug("ums: CSW for tag %08x not sent\n", cbw.tag);
+	if (ums.eject)
+		ums.exit = 1;
+}
+
+static int do_ums(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	int ret;
+
+	if (argc != 3)
+		return cmd_usage(cmdtp);
+
+	memset(&ums, 0, sizeof(ums));
+	ums.dev = get_dev(argv[1], simple_strtoul(argv[2], NULL, 16));
+	if (ums.dev == NULL || ums.dev->type == DEV_TYPE_UNKNOWN ||
+	    ums.dev->blksz == 0) {
+		printf("ums: no device %s %s\n", argv[1], argv[2]);
+		return 1;
+	}
+	if (ums.dev->block_write == NULL) {
+		printf("ums: %s %s cannot be written\n", argv[1], argv[2]);
+		return 1;
+	}
+	ums.buf = (u8 *)load_addr;
+	ums.buf_blks = CONFIG_UMS_BUFFER_SIZE / ums.dev->blksz;
+	if (ums.buf_blks == 0) {
+		printf("ums: buffer smaller than a block\n");
+		return 1;
+	}
+
+	ret = udc_init();
+	if (ret < 0) {
+		printf("ums: UDC init failure\n");
+		return 1;
+	}
+	ums_init_strings();
+	ums_init_instances();
+	udc_startup_events(device_instance);
+	udc_connect();
+
+	printf("UMS: %s %s, %lu blocks of %lu bytes; Ctrl-C to exit\n",
+	       argv[1], argv[2], (ulong)ums.dev->lba, ums.dev->blksz);
+
+	while (!ums.exit) {
+		udc_irq();
+		if (ctrlc())
+			break;
+		if (ums.reset) {
+			ums.reset = 0;
+			ums_rx_cbw();
+		}
+		if (ums.configured)
+			ums_handle_rx();
+		else if (ums.wb_blks)
+			ums_flush();
+	}
+
+	ret = ums_sync() ? 1 : 0;
+	udc_disconnect();
+	udc_disable();
+
+	printf("UMS: read %llu, wrote %llu bytes\n", ums.rd_bytes,
+	       ums.wr_bytes);
+	return ret;
+}
+
+U_BOOT_CMD(ums, 3, 0, do_ums,
+	"export a block device as USB mass storage",
+	"<interface> <dev>\n"
+	"    - e.g. 'ums mmc 0'; Ctrl-C or an eject from the host exits");
@@ -564,6 +564,9 @@ int do_usb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 					break;
 				usb_display_desc(dev);
 				usb_display_config(dev);
+#ifdef CONFIG_USB_STORAGE
+				usb_stor_show_speed(dev);
+#endif
 			}
 			return 0;
 		} else {
@@ -584,6 +587,9 @@ int do_usb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			} else {
 				usb_display_desc(dev);
 				usb_display_config(dev);
+#ifdef CONFIG_USB_STORAGE
+				usb_stor_show_speed(dev);
+#endif
 			}
 		}
 		return 0;
@@ -52,8 +52,7 @@
 #endif
 
 #if defined(CONFIG_FIT)
-#include <u-boot/md5.h>
-#include <sha1.h>
+#include <hash.h>
 
 static int fit_check_ramdisk (const void *fit, int os_noffset,
 		uint8_t arch, int verify);
@@ -2449,6 +2448,7 @@ int fit_set_timestamp (void *fit, int noffset, time_t timestamp)
 	return 0;
 }
 
+#ifdef USE_HOSTCC
 /**
  * calculate_hash - calculate and return hash for provided input data
  * @data: pointer to the input data
@@ -2488,7 +2488,6 @@ static int calculate_hash (const void *data, int data_len, const char *algo,
 	return 0;
 }
 
-#ifdef USE_HOSTCC
 /**
  * fit_set_hashes - process FIT component image nodes and calculate hashes
  * @fit: pointer to the FIT format image header
@@ -2659,6 +2658,74 @@ int fit_image_hash_set_value (void *fit, int noffset, uint8_t *value,
 }
 #endif /* USE_HOSTCC */
 
+#ifndef USE_HOSTCC
+/*
+ * Hash nodes of one image checked in a single pass over its data; an
+ * image with more is checked in several passes.
+ */
+#ifndef CONFIG_FIT_MAX_HASH_NODES
+#define CONFIG_FIT_MAX_HASH_NODES	4
+#endif
+
+/**
+ * fit_image_check_hash_nodes - hash image data and check it against nodes
+ * @fit: pointer to the FIT format image header
+ * @image_noffset: component image node offset
+ * @data: component image data
+ * @size: component image data length
+ * @ctx: hash contexts, one per hash node, already initialised
+ * @node: hash node offsets
+ * @n: number of hash nodes
+ *
+ * fit_image_check_hash_nodes() runs all n digests over the data in one
+ * pass and compares each with the value stored in its hash node.
+ *
+ * returns:
+ *     1, if all hashes are valid
+ *     0, otherwise (or on error)
+ */
+static int fit_image_check_hash_nodes (const void *fit, int image_noffset,
+				const void *data, size_t size,
+				struct hash_ctx *ctx, const int *node, int n)
+{
+	uint8_t		value[CONFIG_FIT_MAX_HASH_NODES][HASH_MAX_DIGEST_SIZE];
+	uint8_t		*fit_value;
+	int		fit_value_len;
+	char		*err_msg = "";
+	int		i;
+
+	hash_update_wd (ctx, n, data, size, CONFIG_HASH_CHUNK_SIZE);
+	for (i = 0; i < n; i++)
+		hash_final (&ctx[i], value[i]);
+
+	for (i = 0; i < n; i++) {
+		printf ("%s", ctx[i].algo->name);
+
+		if (fit_image_hash_get_value (fit, node[i], &fit_value,
+						&fit_value_len)) {
+			err_msg = " error!\nCan't get hash value property";
+			goto error;
+		}
+
+		if (fit_value_len != hash_digest_size (&ctx[i])) {
+			err_msg = " error !\nBad hash value len";
+			goto error;
+		} else if (memcmp (value[i], fit_value, fit_value_len) != 0) {
+			err_msg = " error!\nBad hash value";
+			goto error;
+		}
+		printf ("+ ");
+	}
+
+	return 1;
+
+error:
+	printf ("%s for '%s' hash node in '%s' image node\n",
+			err_msg, fit_get_name (fit, node[i], NULL),
+			fit_get_name (fit, image_noffset, NULL));
+	return 0;
+}
+
 /**
  * fit_image_check_hashes - verify data intergity
  * @fit: pointer to the FIT format image header
@@ -2666,7 +2733,7 @@ int fit_image_hash_set_value (void *fit, int noffset, uint8_t *value,
  *
  * fit_image_check_hashes() goes over component image hash nodes,
  * re-calculates each data hash and compares with the value stored in hash
- * node.
+ * node.  All the hashes are calculated in the same pass over the data.
  *
  * returns:
  *     1, if all hashes are valid
@@ -2677,10 +2744,9 @@ int fit_image_check_hashes (const void *fit, int image_noffset)
 	const void	*data;
 	size_t		size;
 	char		*algo;
-	uint8_t		*fit_value;
-	int		fit_value_len;
-	uint8_t		value[FIT_MAX_HASH_LEN];
-	int		value_len;
+	struct hash_ctx	ctx[CONFIG_FIT_MAX_HASH_NODES];
+	int		node[CONFIG_FIT_MAX_HASH_NODES];
+	int		n = 0;
 	int		noffset;
 	int		ndepth;
 	char		*err_msg = "";
@@ -2713,31 +2779,27 @@ int fit_image_check_hashes (const void *fit, int image_noffset)
 						"property";
 				goto error;
 			}
-			printf ("%s", algo);
-
-			if (fit_image_hash_get_value (fit, noffset, &fit_value,
-							&fit_value_len)) {
-				err_msg = " error!\nCan't get hash value "
-						"property";
-				goto error;
-			}
 
-			if (calculate_hash (data, size, algo, value, &value_len)) {
+			if (hash_init (&ctx[n], algo)) {
+				printf ("%s", algo);
 				err_msg = " error!\nUnsupported hash algorithm";
 				goto error;
 			}
-
-			if (value_len != fit_value_len) {
-				err_msg = " error !\nBad hash value len";
-				goto error;
-			} else if (memcmp (value, fit_value, value_len) != 0) {
-				err_msg = " error!\nBad hash value";
-				goto error;
+			node[n++] = noffset;
+
+			if (n == CONFIG_FIT_MAX_HASH_NODES) {
+				if (!fit_image_check_hash_nodes (fit,
+						image_noffset, data, size,
+						ctx, node, n))
+					return 0;
+				n = 0;
 			}
-			printf ("+ ");
 		}
 	}
 
+	if (n)
+		return fit_image_check_hash_nodes (fit, image_noffset,
+						data, size, ctx, node, n);
 	return 1;
 
 error:
@@ -2795,6 +2857,7 @@ int fit_all_image_check_hashes (const void *fit)
 	}
 	return 1;
 }
+#endif /* !USE_HOSTCC */
 
 /**
  * fit_image_check_os - check whether image node is of a given os type
@@ -54,6 +54,7 @@
 #include <asm/processor.h>
 
 #include <part.h>
+#include <div64.h>
 #include <usb.h>
 
 #undef USB_STOR_DEBUG
@@ -157,6 +158,14 @@ struct us_data {
 
 static struct us_data usb_stor[USB_MAX_STOR_DEV];
 
+/* Bytes moved and time spent, for the "usb info" throughput report */
+struct usb_stor_stats {
+	unsigned long long bytes;
+	unsigned long ms;
+};
+static struct usb_stor_stats usb_stor_rd_stats[USB_MAX_STOR_DEV];
+static struct usb_stor_stats usb_stor_wr_stats[USB_MAX_STOR_DEV];
+
 
 #define USB_STOR_TRANSPORT_GOOD	   0
 #define USB_STOR_TRANSPORT_FAILED -1
@@ -189,6 +198,32 @@ void usb_show_progress(void)
  * show info on storage devices; 'usb start/init' must be invoked earlier
  * as we only retrieve structures populated during devices initialization
  */
+static void usb_stor_show_rate(const char *what, struct usb_stor_stats *st)
+{
+	unsigned long kib = st->bytes >> 10;
+
+	printf("  %s %lu KiB in %lu ms", what, kib, st->ms);
+	if (st->ms)
+		printf(", %lu KiB/s",
+		       (unsigned long)lldiv((unsigned long long)kib * 1000,
+					    st->ms));
+	puts("\n");
+}
+
+/* Throughput of the storage devices behind a USB device so far */
+void usb_stor_show_speed(struct usb_device *dev)
+{
+	int i;
+
+	for (i = 0; i < usb_max_devs; i++) {
+		if (usb_dev_desc[i].target != dev->devnum)
+			continue;
+		printf(" Storage device %d (lun %d):\n", i, usb_dev_desc[i].lun);
+		usb_stor_show_rate("Read: ", &usb_stor_rd_stats[i]);
+		usb_stor_show_rate("Write:", &usb_stor_wr_stats[i]);
+	}
+}
+
 int usb_stor_info(void)
 {
 	int i;
@@ -251,6 +286,8 @@ int usb_stor_scan(int mode)
 	}
 
 	usb_max_devs = 0;
+	memset(usb_stor_rd_stats, 0, sizeof(usb_stor_rd_stats));
+	memset(usb_stor_wr_stats, 0, sizeof(usb_stor_wr_stats));
 	for (i = 0; i < USB_MAX_DEVICE; i++) {
 		dev = usb_get_dev_index(i); /* get device */
 		USB_STOR_PRINTF("i=%d\n", i);
@@ -1040,7 +1077,18 @@ static void usb_bin_fixup(struct usb_device_descriptor descriptor,
 }
 #endif /* CONFIG_USB_BIN_FIXUP */
 
-#define USB_MAX_READ_BLK 20
+/*
+ * The largest READ(10)/WRITE(10) we issue.  EHCI chains as many qTDs as a
+ * transfer needs, so it can take the full 16-bit block count of the
+ * command; the other host drivers only handle small transfers.
+ */
+#if defined(CONFIG_USB_MAX_XFER_BLK)
+#define USB_MAX_XFER_BLK	CONFIG_USB_MAX_XFER_BLK
+#elif defined(CONFIG_USB_EHCI)
+#define USB_MAX_XFER_BLK	65535
+#else
+#define USB_MAX_XFER_BLK	20
+#endif
 
 unsigned long usb_stor_read(int device, unsigned long blknr,
 			    unsigned long blkcnt, void *buffer)
@@ -1050,6 +1098,7 @@ unsigned long usb_stor_read(int device, unsigned long blknr,
 	struct usb_device *dev;
 	int retry, i;
 	ccb *srb = &usb_ccb;
+	ulong ts;
 
 	if (blkcnt == 0)
 		return 0;
@@ -1080,17 +1129,18 @@ unsigned long usb_stor_read(int device, unsigned long blknr,
 
 	USB_STOR_PRINTF("\nusb_read: dev %d startblk %lx, blccnt %lx"
 			" buffer %lx\n", device, start, blks, buf_addr);
+	ts = get_timer(0);
 
 	do {
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_READ_BLK)
-			smallblks = USB_MAX_READ_BLK;
+		if (blks > USB_MAX_XFER_BLK)
+			smallblks = USB_MAX_XFER_BLK;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_READ_BLK)
+		if (smallblks == USB_MAX_XFER_BLK)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1112,13 +1162,14 @@ retry_it:
 			start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_READ_BLK)
+	usb_stor_rd_stats[device].bytes +=
+		(unsigned long long)blkcnt * usb_dev_desc[device].blksz;
+	usb_stor_rd_stats[device].ms += get_timer(ts);
+	if (blkcnt >= USB_MAX_XFER_BLK)
 		debug("\n");
 	return blkcnt;
 }
 
-#define USB_MAX_WRITE_BLK 20
-
 unsigned long usb_stor_write(int device, unsigned long blknr,
 				unsigned long blkcnt, const void *buffer)
 {
@@ -1127,6 +1178,7 @@ unsigned long usb_stor_write(int device, unsigned long blknr,
 	struct usb_device *dev;
 	int retry, i;
 	ccb *srb = &usb_ccb;
+	ulong ts;
 
 	if (blkcnt == 0)
 		return 0;
@@ -1158,6 +1210,7 @@ unsigned long usb_stor_write(int device, unsigned long blknr,
 
 	USB_STOR_PRINTF("\nusb_write: dev %d startblk %lx, blccnt %lx"
 			" buffer %lx\n", device, start, blks, buf_addr);
+	ts = get_timer(0);
 
 	do {
 		/* If write fails retry for max retry count else
@@ -1165,12 +1218,12 @@ unsigned long usb_stor_write(int device, unsigned long blknr,
 		 */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_WRITE_BLK)
-			smallblks = USB_MAX_WRITE_BLK;
+		if (blks > USB_MAX_XFER_BLK)
+			smallblks = USB_MAX_XFER_BLK;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_WRITE_BLK)
+		if (smallblks == USB_MAX_XFER_BLK)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1192,7 +1245,10 @@ retry_it:
 			start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_WRITE_BLK)
+	usb_stor_wr_stats[device].bytes +=
+		(unsigned long long)blkcnt * usb_dev_desc[device].blksz;
+	usb_stor_wr_stats[device].ms += get_timer(ts);
+	if (blkcnt >= USB_MAX_XFER_BLK)
 		debug("\n");
 	return blkcnt;
 
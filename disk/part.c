@@ -27,9 +27,10 @@
 #include <errno.h>
 #include <ide.h>
 #include <part.h>
-#ifdef CONFIG_MD5
+#include <blkcache.h>
+#include <hash.h>
+#ifdef CONFIG_HASH
 #include <malloc.h>
-#include <u-boot/md5.h>
 #endif
 
 #undef	PART_DEBUG
@@ -318,29 +319,40 @@ int partition_erase_bytes(block_dev_desc_t *dev, disk_partition_t *ptn,
 	return _partition_erase(dev, ptn, bytecnt, NULL);
 }
 
-#ifdef CONFIG_MD5
-void partition_md5_helper(block_dev_desc_t *dev, lbaint_t blk_start,
-				lbaint_t *blkcnt, unsigned char md5[16])
+#ifdef CONFIG_HASH
+/* default read size when the caller does not supply a buffer */
+#ifndef CONFIG_PARTITION_HASH_BUFLEN
+#ifdef CONF_MD5_BUFLEN
+#define CONFIG_PARTITION_HASH_BUFLEN CONF_MD5_BUFLEN
+#else
+#define CONFIG_PARTITION_HASH_BUFLEN (64*1024)
+#endif
+#endif
+
+void partition_hash_helper(block_dev_desc_t *dev, lbaint_t blk_start,
+				lbaint_t *blkcnt, struct hash_ctx *ctx,
+				void *buffer, unsigned long buflen)
 {
-	struct MD5Context context;
 	lbaint_t buf_blks, blks_left, blks_read;
-	unsigned char *buf;
-#ifndef CONF_MD5_BUFLEN
-#define CONF_MD5_BUFLEN (16*1024)
-#endif
+	unsigned char *buf = buffer;
 
-	buf_blks = CONF_MD5_BUFLEN / dev->blksz;
-	if (!buf_blks) {
-		*blkcnt = 0;
-		return;
-	}
-	buf = malloc(buf_blks * dev->blksz);
 	if (!buf) {
+		/* fall back to smaller reads if the heap is tight */
+		for (buflen = CONFIG_PARTITION_HASH_BUFLEN;
+		     buflen >= dev->blksz; buflen /= 2) {
+			buf = malloc(buflen);
+			if (buf)
+				break;
+		}
+	}
+	buf_blks = buflen / dev->blksz;
+	if (!buf || !buf_blks) {
+		if (buf != buffer)
+			free(buf);
 		*blkcnt = 0;
 		return;
 	}
 
-	MD5Init(&context);
 	blks_left = *blkcnt;
 	while (blks_left) {
 		if (blks_left < buf_blks)
@@ -348,20 +360,21 @@ void partition_md5_helper(block_dev_desc_t *dev, lbaint_t blk_start,
 
 		blks_read = dev->block_read(dev->dev, blk_start, buf_blks,
 									buf);
-		MD5Update(&context, buf, blks_read * dev->blksz);
+		hash_update(ctx, buf, blks_read * dev->blksz);
 		blk_start += blks_read;
 		blks_left -= blks_read;
 		if (blks_read != buf_blks)
 			break;
 	}
-	MD5Final(md5, &context);
 
-	free(buf);
+	if (buf != buffer)
+		free(buf);
 	*blkcnt -= blks_left;
 }
-static int _partition_md5(block_dev_desc_t *dev, disk_partition_t *ptn,
+static int _partition_hash(block_dev_desc_t *dev, disk_partition_t *ptn,
 				loff_t *bytecnt_p, lbaint_t *blkcnt_p,
-				unsigned char md5[16])
+				const char *algo, unsigned char *digest,
+				void *buffer, unsigned long buflen)
 {
 	/*
 	 * Fetch the number of bytes or blocks and then zero them right away
@@ -369,11 +382,15 @@ static int _partition_md5(block_dev_desc_t *dev, disk_partition_t *ptn,
 	 */
 	loff_t bytes_to_do = get_and_zero_loff_t(bytecnt_p);
 	lbaint_t blks_to_do = get_and_zero_lbaint_t(blkcnt_p), blks_done;
+	struct hash_ctx ctx;
 	int err = _partition_validate(dev, ptn, bytecnt_p, blkcnt_p,
 							(void *)-1/*fake*/);
 	if (err)
 		return err;
 
+	if (hash_init(&ctx, algo))
+		return -EINVAL;
+
 	err = partition_read_pre(ptn);
 	if (err)
 		return err;
@@ -386,7 +403,9 @@ static int _partition_md5(block_dev_desc_t *dev, disk_partition_t *ptn,
 		blks_to_do = ptn->size;
 
 	blks_done = blks_to_do;
-	partition_md5_helper(dev, ptn->start, &blks_done, md5);
+	partition_hash_helper(dev, ptn->start, &blks_done, &ctx,
+				buffer, buflen);
+	hash_final(&ctx, digest);
 
 	if (blkcnt_p)
 		*blkcnt_p = blks_done;
@@ -399,17 +418,43 @@ static int _partition_md5(block_dev_desc_t *dev, disk_partition_t *ptn,
 		return -EIO;
 	return err;
 }
+int partition_hash_blks(block_dev_desc_t *dev, disk_partition_t *ptn,
+				lbaint_t *blkcnt, const char *algo,
+				unsigned char *digest)
+{
+	return _partition_hash(dev, ptn, NULL, blkcnt, algo, digest, NULL, 0);
+}
+int partition_hash_bytes(block_dev_desc_t *dev, disk_partition_t *ptn,
+				loff_t *bytecnt, const char *algo,
+				unsigned char *digest, void *buffer,
+				unsigned long buflen)
+{
+	return _partition_hash(dev, ptn, bytecnt, NULL, algo, digest,
+				buffer, buflen);
+}
+#endif /* CONFIG_HASH */
+
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
+void partition_md5_helper(block_dev_desc_t *dev, lbaint_t blk_start,
+				lbaint_t *blkcnt, unsigned char md5[16])
+{
+	struct hash_ctx ctx;
+
+	hash_init(&ctx, "md5");
+	partition_hash_helper(dev, blk_start, blkcnt, &ctx, NULL, 0);
+	hash_final(&ctx, md5);
+}
 int partition_md5_blks(block_dev_desc_t *dev, disk_partition_t *ptn,
 				lbaint_t *blkcnt, unsigned char md5[16])
 {
-	return _partition_md5(dev, ptn, NULL, blkcnt, md5);
+	return _partition_hash(dev, ptn, NULL, blkcnt, "md5", md5, NULL, 0);
 }
 int partition_md5_bytes(block_dev_desc_t *dev, disk_partition_t *ptn,
 				loff_t *bytecnt, unsigned char md5[16])
 {
-	return _partition_md5(dev, ptn, bytecnt, NULL, md5);
+	return _partition_hash(dev, ptn, bytecnt, NULL, "md5", md5, NULL, 0);
 }
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 
 static int _partition_read(block_dev_desc_t *dev, disk_partition_t *ptn,
 				loff_t *bytecnt_p, lbaint_t *blkcnt_p,
@@ -567,7 +612,22 @@ int partition_erase_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
 {
 	return -ENODEV;
 }
-#ifdef CONFIG_MD5
+#ifdef CONFIG_HASH
+int partition_hash_blks(block_dev_desc_t *dev, disk_partition_t *ptn,
+				lbaint_t *blkcnt, const char *algo,
+				unsigned char *digest)
+{
+	return -ENODEV;
+}
+int partition_hash_bytes(block_dev_desc_t *dev, disk_partition_t *ptn,
+				loff_t *bytecnt, const char *algo,
+				unsigned char *digest, void *buffer,
+				unsigned long buflen)
+{
+	return -ENODEV;
+}
+#endif /* CONFIG_HASH */
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 int partition_md5_blks(block_dev_desc_t *dev, disk_partition_t *ptn,
 							lbaint_t *blkcnt)
 {
@@ -578,7 +638,7 @@ int partition_md5_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
 {
 	return -ENODEV;
 }
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 int partition_read_blks(block_dev_desc_t *dev, disk_partition_t *ptn,
 					lbaint_t *blkcnt, void *buffer)
 {
@@ -765,6 +825,9 @@ void dev_print (block_dev_desc_t *dev_desc)
 
 void init_part (block_dev_desc_t * dev_desc)
 {
+	/* (re)initialized device: cache it, dropping anything stale */
+	blkcache_attach(dev_desc);
+
 #ifdef CONFIG_ISO_PARTITION
 	if (test_part_iso(dev_desc) == 0) {
 		dev_desc->part_type = PART_TYPE_ISO;
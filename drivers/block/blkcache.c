@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * Read cache for block_dev_desc_t devices.
+ *
+ * Filesystem code tends to read a sector or two at a time (FAT chain
+ * walks, ext2 indirect blocks) and often re-reads the same sectors.
+ * blkcache_attach() swaps a device's block ops for ones that go
+ * through a small LRU of extents.  A miss fills a whole extent: a short
+ * one for random access, or a full CONFIG_BLKCACHE_ENTRY_SIZE one when
+ * the read follows on from the previous one, so a sequential walk turns
+ * into a few large transfers.  Reads that are at least an extent long
+ * bypass the cache.  Writes and erases go straight to the device after
+ * dropping any overlapping extents, so the cache never holds dirty data.
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <part.h>
+#include <blkcache.h>
+
+/* Number of extents kept */
+#ifndef CONFIG_BLKCACHE_ENTRIES
+#define CONFIG_BLKCACHE_ENTRIES		8
+#endif
+
+/* Size of one extent in bytes, and of a sequential readahead */
+#ifndef CONFIG_BLKCACHE_ENTRY_SIZE
+#define CONFIG_BLKCACHE_ENTRY_SIZE	(32 * 1024)
+#endif
+
+/* Bytes read on a non-sequential miss */
+#ifndef CONFIG_BLKCACHE_MIN_FILL
+#define CONFIG_BLKCACHE_MIN_FILL	(4 * 1024)
+#endif
+
+/* Alignment of the extent buffers, for drivers that DMA into them */
+#ifdef CONFIG_SYS_CACHELINE_SIZE
+#define BLKCACHE_ALIGN			CONFIG_SYS_CACHELINE_SIZE
+#else
+#define BLKCACHE_ALIGN			64
+#endif
+
+/* Number of devices that can be attached at once */
+#ifndef CONFIG_BLKCACHE_MAX_DEVS
+#define CONFIG_BLKCACHE_MAX_DEVS	4
+#endif
+
+struct blkcache_dev {
+	block_dev_desc_t *desc;
+	unsigned long (*block_read)(int dev, lbaint_t start,
+				    lbaint_t blkcnt, void *buffer);
+	unsigned long (*block_write)(int dev, lbaint_t start,
+				     lbaint_t blkcnt, const void *buffer);
+	unsigned long (*block_erase)(int dev, lbaint_t start,
+				     lbaint_t blkcnt);
+	lbaint_t next;		/* block after the end of the last read */
+};
+
+struct blkcache_entry {
+	block_dev_desc_t *desc;	/* NULL if unused */
+	lbaint_t start;
+	lbaint_t blkcnt;
+	ulong stamp;		/* last use, for LRU */
+	char *data;
+};
+
+static struct blkcache_dev cache_devs[CONFIG_BLKCACHE_MAX_DEVS];
+static struct blkcache_entry cache[CONFIG_BLKCACHE_ENTRIES];
+static char *cache_data;
+static ulong cache_clock;
+static struct blkcache_stats stats;
+
+static struct blkcache_dev *blkcache_find(int if_type, int dev)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_BLKCACHE_MAX_DEVS; i++) {
+		block_dev_desc_t *desc = cache_devs[i].desc;
+
+		if (desc && desc->if_type == if_type && desc->dev == dev)
+			return &cache_devs[i];
+	}
+	return NULL;
+}
+
+static void blkcache_drop(block_dev_desc_t *desc, lbaint_t start,
+			  lbaint_t blkcnt)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_BLKCACHE_ENTRIES; i++) {
+		struct blkcache_entry *e = &cache[i];
+
+		if (!e->desc || (desc && e->desc != desc))
+			continue;
+		if (blkcnt && (e->start >= start + blkcnt ||
+			       e->start + e->blkcnt <= start))
+			continue;
+		e->desc = NULL;
+		stats.invalidates++;
+	}
+}
+
+static struct blkcache_entry *blkcache_lookup(block_dev_desc_t *desc,
+					      lbaint_t blk)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_BLKCACHE_ENTRIES; i++) {
+		struct blkcache_entry *e = &cache[i];
+
+		if (e->desc == desc && blk >= e->start &&
+		    blk < e->start + e->blkcnt)
+			return e;
+	}
+	return NULL;
+}
+
+static struct blkcache_entry *blkcache_victim(void)
+{
+	struct blkcache_entry *victim = &cache[0];
+	int i;
+
+	if (!cache_data) {
+		cache_data = memalign(BLKCACHE_ALIGN,
+				      CONFIG_BLKCACHE_ENTRIES *
+				      CONFIG_BLKCACHE_ENTRY_SIZE);
+		if (!cache_data)
+			return NULL;
+		for (i = 0; i < CONFIG_BLKCACHE_ENTRIES; i++)
+			cache[i].data = cache_data +
+					i * CONFIG_BLKCACHE_ENTRY_SIZE;
+	}
+
+	for (i = 0; i < CONFIG_BLKCACHE_ENTRIES; i++) {
+		if (!cache[i].desc)
+			return &cache[i];
+		if (cache[i].stamp < victim->stamp)
+			victim = &cache[i];
+	}
+	return victim;
+}
+
+static unsigned long blkcache_read(struct blkcache_dev *cd, lbaint_t start,
+				   lbaint_t blkcnt, void *buffer)
+{
+	block_dev_desc_t *desc = cd->desc;
+	ulong blksz = desc->blksz;
+	lbaint_t entry_blks = CONFIG_BLKCACHE_ENTRY_SIZE / blksz;
+	lbaint_t fill, todo = blkcnt;
+	int sequential = (start == cd->next);
+	struct blkcache_entry *e;
+	char *dst = buffer;
+
+	cd->next = start + blkcnt;
+
+	/* let the driver deal with out of range requests */
+	if (start + blkcnt > desc->lba)
+		return cd->block_read(desc->dev, start, blkcnt, buffer);
+
+	while (todo) {
+		lbaint_t n;
+
+		e = blkcache_lookup(desc, start);
+		if (e) {
+			stats.hits++;
+			e->stamp = ++cache_clock;
+			n = min(todo, e->start + e->blkcnt - start);
+			memcpy(dst, e->data + (start - e->start) * blksz,
+			       n * blksz);
+		} else {
+			stats.misses++;
+			e = (todo < entry_blks) ? blkcache_victim() : NULL;
+			if (!e) {
+				/* too big to be worth caching */
+				stats.bypass++;
+				n = cd->block_read(desc->dev, start, todo, dst);
+				if (n != todo)
+					return blkcnt - todo + n;
+				break;
+			}
+
+			if (sequential)
+				fill = entry_blks;
+			else
+				fill = max(todo, (lbaint_t)
+					   (CONFIG_BLKCACHE_MIN_FILL / blksz));
+			if (fill > desc->lba - start)
+				fill = desc->lba - start;
+
+			stats.fills++;
+			e->desc = NULL;
+			if (cd->block_read(desc->dev, start, fill,
+					   e->data) != fill) {
+				/* retry just what was asked for, uncached */
+				n = cd->block_read(desc->dev, start, todo, dst);
+				if (n != todo)
+					return blkcnt - todo + n;
+				break;
+			}
+			e->desc = desc;
+			e->start = start;
+			e->blkcnt = fill;
+			e->stamp = ++cache_clock;
+
+			n = min(todo, fill);
+			memcpy(dst, e->data, n * blksz);
+		}
+		todo -= n;
+		start += n;
+		dst += n * blksz;
+	}
+
+	return blkcnt;
+}
+
+static unsigned long blkcache_write(struct blkcache_dev *cd, lbaint_t start,
+				    lbaint_t blkcnt, const void *buffer)
+{
+	blkcache_drop(cd->desc, start, blkcnt);
+	return cd->block_write(cd->desc->dev, start, blkcnt, buffer);
+}
+
+static unsigned long blkcache_erase(struct blkcache_dev *cd, lbaint_t start,
+				    lbaint_t blkcnt)
+{
+	blkcache_drop(cd->desc, start, blkcnt);
+	return cd->block_erase(cd->desc->dev, start, blkcnt);
+}
+
+/*
+ * The block ops only get a device number, which is not unique across
+ * interfaces, so each interface type gets its own set of entry points.
+ */
+#define BLKCACHE_OPS(name, type)					\
+static unsigned long blkcache_##name##_read(int dev, lbaint_t start,	\
+		lbaint_t blkcnt, void *buffer)				\
+{									\
+	struct blkcache_dev *cd = blkcache_find(type, dev);		\
+	return cd ? blkcache_read(cd, start, blkcnt, buffer) : 0;	\
+}									\
+static unsigned long blkcache_##name##_write(int dev, lbaint_t start,	\
+		lbaint_t blkcnt, const void *buffer)			\
+{									\
+	struct blkcache_dev *cd = blkcache_find(type, dev);		\
+	return cd ? blkcache_write(cd, start, blkcnt, buffer) : 0;	\
+}									\
+static unsigned long blkcache_##name##_erase(int dev, lbaint_t start,	\
+		lbaint_t blkcnt)					\
+{									\
+	struct blkcache_dev *cd = blkcache_find(type, dev);		\
+	return cd ? blkcache_erase(cd, start, blkcnt) : 0;		\
+}
+
+BLKCACHE_OPS(ide, IF_TYPE_IDE)
+BLKCACHE_OPS(scsi, IF_TYPE_SCSI)
+BLKCACHE_OPS(atapi, IF_TYPE_ATAPI)
+BLKCACHE_OPS(usb, IF_TYPE_USB)
+BLKCACHE_OPS(mmc, IF_TYPE_MMC)
+BLKCACHE_OPS(sd, IF_TYPE_SD)
+BLKCACHE_OPS(sata, IF_TYPE_SATA)
+
+static const struct blkcache_ops {
+	int if_type;
+	unsigned long (*block_read)(int dev, lbaint_t start,
+				    lbaint_t blkcnt, void *buffer);
+	unsigned long (*block_write)(int dev, lbaint_t start,
+				     lbaint_t blkcnt, const void *buffer);
+	unsigned long (*block_erase)(int dev, lbaint_t start,
+				     lbaint_t blkcnt);
+} blkcache_ops[] = {
+	{ IF_TYPE_IDE, blkcache_ide_read, blkcache_ide_write,
+	  blkcache_ide_erase },
+	{ IF_TYPE_SCSI, blkcache_scsi_read, blkcache_scsi_write,
+	  blkcache_scsi_erase },
+	{ IF_TYPE_ATAPI, blkcache_atapi_read, blkcache_atapi_write,
+	  blkcache_atapi_erase },
+	{ IF_TYPE_USB, blkcache_usb_read, blkcache_usb_write,
+	  blkcache_usb_erase },
+	{ IF_TYPE_MMC, blkcache_mmc_read, blkcache_mmc_write,
+	  blkcache_mmc_erase },
+	{ IF_TYPE_SD, blkcache_sd_read, blkcache_sd_write,
+	  blkcache_sd_erase },
+	{ IF_TYPE_SATA, blkcache_sata_read, blkcache_sata_write,
+	  blkcache_sata_erase },
+};
+
+void blkcache_attach(block_dev_desc_t *dev_desc)
+{
+	const struct blkcache_ops *ops = NULL;
+	struct blkcache_dev *cd = NULL;
+	int i;
+
+	if (!dev_desc->block_read || !dev_desc->blksz ||
+	    dev_desc->blksz > CONFIG_BLKCACHE_ENTRY_SIZE)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(blkcache_ops); i++)
+		if (blkcache_ops[i].if_type == dev_desc->if_type)
+			ops = &blkcache_ops[i];
+	if (!ops)
+		return;
+
+	for (i = 0; i < CONFIG_BLKCACHE_MAX_DEVS; i++) {
+		if (cache_devs[i].desc == dev_desc) {
+			cd = &cache_devs[i];
+			break;
+		}
+		if (!cd && !cache_devs[i].desc)
+			cd = &cache_devs[i];
+	}
+	if (!cd)
+		return;
+
+	blkcache_drop(dev_desc, 0, 0);
+	cd->next = 0;
+
+	/* a rescan may have put the driver's own ops back */
+	if (dev_desc->block_read == ops->block_read)
+		return;
+
+	cd->desc = dev_desc;
+	cd->block_read = dev_desc->block_read;
+	cd->block_write = dev_desc->block_write;
+	cd->block_erase = dev_desc->block_erase;
+
+	dev_desc->block_read = ops->block_read;
+	if (dev_desc->block_write)
+		dev_desc->block_write = ops->block_write;
+	if (dev_desc->block_erase)
+		dev_desc->block_erase = ops->block_erase;
+}
+
+void blkcache_invalidate(block_dev_desc_t *dev_desc)
+{
+	blkcache_drop(dev_desc, 0, 0);
+}
+
+void blkcache_get_stats(struct blkcache_stats *s)
+{
+	memcpy(s, &stats, sizeof(stats));
+}
+
+void blkcache_reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void blkcache_print(void)
+{
+	int i, used = 0;
+
+	for (i = 0; i < CONFIG_BLKCACHE_ENTRIES; i++)
+		if (cache[i].desc)
+			used++;
+
+	printf("entries:     %d of %d, %d bytes each\n", used,
+	       CONFIG_BLKCACHE_ENTRIES, CONFIG_BLKCACHE_ENTRY_SIZE);
+	printf("hits:        %lu\n", stats.hits);
+	printf("misses:      %lu\n", stats.misses);
+	printf("fills:       %lu\n", stats.fills);
+	printf("bypassed:    %lu\n", stats.bypass);
+	printf("invalidated: %lu\n", stats.invalidates);
+
+	for (i = 0; i < CONFIG_BLKCACHE_MAX_DEVS; i++) {
+		block_dev_desc_t *desc = cache_devs[i].desc;
+
+		if (desc)
+			printf("attached:    if_type %d dev %d\n",
+			       desc->if_type, desc->dev);
+	}
+}
@@ -28,6 +28,7 @@
 #include <command.h>
 #include <mmc.h>
 #include <part.h>
+#include <blkcache.h>
 #include <malloc.h>
 #include <linux/list.h>
 #include <div64.h>
@@ -159,6 +160,10 @@ int mmc_set_blocklen(struct mmc *mmc, int len)
 {
 	struct mmc_cmd cmd;
 
+	/* CMD16 is illegal in DDR mode, the block length is fixed at 512 */
+	if (mmc->ddr_mode)
+		return 0;
+
 	cmd.cmdidx = MMC_CMD_SET_BLOCKLEN;
 	cmd.resp_type = MMC_RSP_R1;
 	cmd.cmdarg = len;
@@ -309,16 +314,19 @@ mmc_write_blocks(struct mmc *mmc, ulong start, lbaint_t blkcnt, const void*src)
 	}
 
 	/* SPI multiblock writes terminate using a special
-	 * token, not a STOP_TRANSMISSION request.
+	 * token, not a STOP_TRANSMISSION request.  Hosts with
+	 * MMC_MODE_AUTO_CMD12 have already sent it.
 	 */
 	if (!mmc_host_is_spi(mmc) && blkcnt > 1) {
-		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
-		cmd.cmdarg = 0;
-		cmd.resp_type = MMC_RSP_R1b;
-		cmd.flags = 0;
-		if (mmc_send_cmd(mmc, &cmd, NULL)) {
-			printf("mmc fail to send stop cmd\n");
-			return 0;
+		if (!(mmc->host_caps & MMC_MODE_AUTO_CMD12)) {
+			cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
+			cmd.cmdarg = 0;
+			cmd.resp_type = MMC_RSP_R1b;
+			cmd.flags = 0;
+			if (mmc_send_cmd(mmc, &cmd, NULL)) {
+				printf("mmc fail to send stop cmd\n");
+				return 0;
+			}
 		}
 
 		/* Waiting for the ready status */
@@ -379,7 +387,11 @@ int mmc_read_blocks(struct mmc *mmc, void *dst, ulong start, lbaint_t blkcnt)
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	/*
+	 * Nothing to program after a read, so once the host has sent
+	 * CMD12 on its own the card is ready for the next command.
+	 */
+	if (blkcnt > 1 && !(mmc->host_caps & MMC_MODE_AUTO_CMD12)) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -650,7 +662,7 @@ int mmc_change_freq(struct mmc *mmc)
 	if (err)
 		return err;
 
-	cardtype = ext_csd[196] & 0xf;
+	cardtype = ext_csd[EXT_CSD_CARD_TYPE] & 0x3f;
 
 	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING, 1);
 
@@ -667,10 +679,18 @@ int mmc_change_freq(struct mmc *mmc)
 	if (!ext_csd[185])
 		return 0;
 
-	/* High Speed is set, there are two types: 52MHz and 26MHz */
-	if (cardtype & MMC_HS_52MHZ)
+	/*
+	 * High Speed is set, there are two types: 52MHz and 26MHz.  The
+	 * DDR and HS200 modes build on 52MHz high speed; the 1.2V I/O
+	 * variants are left out as no host here can switch to 1.2V.
+	 */
+	if (cardtype & MMC_HS_52MHZ) {
 		mmc->card_caps |= MMC_MODE_HS_52MHz | MMC_MODE_HS;
-	else
+		if (cardtype & EXT_CSD_CARD_TYPE_DDR_1_8V)
+			mmc->card_caps |= MMC_MODE_DDR_52MHz;
+		if (cardtype & EXT_CSD_CARD_TYPE_HS200_1_8V)
+			mmc->card_caps |= MMC_MODE_HS200;
+	} else
 		mmc->card_caps |= MMC_MODE_HS;
 
 	return 0;
@@ -683,6 +703,9 @@ int mmc_switch_part(int dev_num, unsigned int part_num)
 	if (!mmc)
 		return -1;
 
+	/* the same LBAs now address another partition */
+	blkcache_invalidate(&mmc->block_dev);
+
 	return mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_PART_CONF,
 			  (mmc->part_config & ~PART_ACCESS_MASK)
 			  | (part_num & PART_ACCESS_MASK));
@@ -866,6 +889,118 @@ void mmc_set_bus_width(struct mmc *mmc, uint width)
 	mmc_set_ios(mmc);
 }
 
+/*
+ * eMMC bus modes, fastest first.  A mode is tried only if both card and
+ * host have every capability in caps; if switching to it fails, or the
+ * EXT_CSD no longer reads back intact, the next one down is tried.  A
+ * clock of 0 means the legacy/high speed SDR rate from card_caps.
+ */
+static const struct mmc_bus_mode {
+	const char *name;
+	uint caps;
+	uint width;
+	u8 ext_csd_width;
+	u8 timing;
+	uint ddr;
+	uint clock;
+} mmc_bus_modes[] = {
+	{ "8-bit HS200", MMC_MODE_HS200 | MMC_MODE_8BIT,
+	  8, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS200, 0, 200000000 },
+	{ "4-bit HS200", MMC_MODE_HS200 | MMC_MODE_4BIT,
+	  4, EXT_CSD_BUS_WIDTH_4, EXT_CSD_TIMING_HS200, 0, 200000000 },
+	{ "8-bit DDR52", MMC_MODE_DDR_52MHz | MMC_MODE_8BIT,
+	  8, EXT_CSD_BUS_WIDTH_8_DDR, EXT_CSD_TIMING_HS, 1, 52000000 },
+	{ "4-bit DDR52", MMC_MODE_DDR_52MHz | MMC_MODE_4BIT,
+	  4, EXT_CSD_BUS_WIDTH_4_DDR, EXT_CSD_TIMING_HS, 1, 52000000 },
+	{ "8-bit", MMC_MODE_8BIT,
+	  8, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS, 0, 0 },
+	{ "4-bit", MMC_MODE_4BIT,
+	  4, EXT_CSD_BUS_WIDTH_4, EXT_CSD_TIMING_HS, 0, 0 },
+	{ "1-bit", 0,
+	  1, EXT_CSD_BUS_WIDTH_1, EXT_CSD_TIMING_HS, 0, 0 },
+};
+
+/* Re-read the EXT_CSD and compare read-only fields against ref */
+static int mmc_ext_csd_matches(struct mmc *mmc, const char *ref)
+{
+	char ext_csd[512];
+
+	if (mmc_send_ext_csd(mmc, ext_csd))
+		return 0;
+
+	return ext_csd[EXT_CSD_REV] == ref[EXT_CSD_REV] &&
+		ext_csd[EXT_CSD_CARD_TYPE] == ref[EXT_CSD_CARD_TYPE] &&
+		ext_csd[EXT_CSD_ERASED_MEM_CONT] ==
+			ref[EXT_CSD_ERASED_MEM_CONT] &&
+		!memcmp(&ext_csd[EXT_CSD_SEC_CNT], &ref[EXT_CSD_SEC_CNT], 4);
+}
+
+static int mmc_select_bus_mode(struct mmc *mmc)
+{
+	const struct mmc_bus_mode *mode;
+	char ext_csd[512];
+	uint sdr_clock;
+	int err, i;
+
+	if (mmc->card_caps & MMC_MODE_HS) {
+		if (mmc->card_caps & MMC_MODE_HS_52MHz)
+			sdr_clock = 52000000;
+		else
+			sdr_clock = 26000000;
+	} else
+		sdr_clock = 20000000;
+
+	/* Reference copy, read while still on the 1-bit bus */
+	err = mmc_send_ext_csd(mmc, ext_csd);
+	if (err)
+		return err;
+
+	for (i = 0; i < ARRAY_SIZE(mmc_bus_modes); i++) {
+		mode = &mmc_bus_modes[i];
+
+		if ((mmc->card_caps & mode->caps) != mode->caps)
+			continue;
+		if (mode->timing == EXT_CSD_TIMING_HS200 &&
+		    !mmc->execute_tuning)
+			continue;
+
+		err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
+				EXT_CSD_BUS_WIDTH, mode->ext_csd_width);
+		if (err)
+			continue;
+
+		mmc->ddr_mode = mode->ddr;
+		mmc_set_bus_width(mmc, mode->width);
+
+		/* HS200 is entered after the width switch, then tuned */
+		if (mode->timing == EXT_CSD_TIMING_HS200) {
+			err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
+					EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS200);
+			if (!err) {
+				mmc_set_clock(mmc, mode->clock);
+				err = mmc->execute_tuning(mmc);
+			}
+		} else
+			mmc_set_clock(mmc, mode->clock ? mode->clock : sdr_clock);
+
+		if (!err && mmc_ext_csd_matches(mmc, ext_csd)) {
+			printf("%s: bus mode = %s\n", __func__, mode->name);
+			return 0;
+		}
+
+		printf("%s: %s failed, falling back\n", __func__, mode->name);
+
+		/* Commands only use CMD, so we can always step back down */
+		mmc->ddr_mode = 0;
+		mmc_set_clock(mmc, sdr_clock);
+		if (mode->timing == EXT_CSD_TIMING_HS200)
+			mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
+					EXT_CSD_HS_TIMING, EXT_CSD_TIMING_HS);
+	}
+
+	return err ? err : UNUSABLE_ERR;
+}
+
 int mmc_startup(struct mmc *mmc)
 {
 	int err;
@@ -1016,6 +1151,7 @@ int mmc_startup(struct mmc *mmc)
 	 */
 	mmc->erase_grp_size = 1;
 	mmc->part_config = MMCPART_NOAVAILABLE;
+	mmc->block_dev.erase_is_zero = 0;
 	if (!IS_SD(mmc) && (mmc->version >= MMC_VERSION_4)) {
 		/* check  ext_csd version and capacity */
 		err = mmc_send_ext_csd(mmc, ext_csd);
@@ -1051,6 +1187,10 @@ int mmc_startup(struct mmc *mmc)
 		/* store the partition info of emmc */
 		if (ext_csd[160] & PART_SUPPORT)
 			mmc->part_config = ext_csd[179];
+
+		/* erased/trimmed blocks read back as all 0s or all 1s */
+		if (!err && !ext_csd[EXT_CSD_ERASED_MEM_CONT])
+			mmc->block_dev.erase_is_zero = 1;
 	}
 
 	if (IS_SD(mmc))
@@ -1090,38 +1230,13 @@ int mmc_startup(struct mmc *mmc)
 			mmc_set_clock(mmc, 50000000);
 		else
 			mmc_set_clock(mmc, 25000000);
+	} else if (!mmc_host_is_spi(mmc) && mmc->version >= MMC_VERSION_4) {
+		err = mmc_select_bus_mode(mmc);
+		if (err)
+			return err;
 	} else {
-		if (mmc->card_caps & MMC_MODE_8BIT) {
-			/* Set the card to use 8 bit*/
-			err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
-					EXT_CSD_BUS_WIDTH,
-					EXT_CSD_BUS_WIDTH_8);
-
-			if (err)
-				return err;
-
-			printf("%s: bus width = 8\n", __func__);
-			mmc_set_bus_width(mmc, 8);
-		} else if (mmc->card_caps & MMC_MODE_4BIT) {
-			/* Set the card to use 4 bit*/
-			err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL,
-					EXT_CSD_BUS_WIDTH,
-					EXT_CSD_BUS_WIDTH_4);
-
-			if (err)
-				return err;
-
-			printf("%s: bus width = 4\n", __func__);
-			mmc_set_bus_width(mmc, 4);
-		}
-
-		if (mmc->card_caps & MMC_MODE_HS) {
-			if (mmc->card_caps & MMC_MODE_HS_52MHz)
-				mmc_set_clock(mmc, 52000000);
-			else
-				mmc_set_clock(mmc, 26000000);
-		} else
-			mmc_set_clock(mmc, 20000000);
+		/* no EXT_CSD to switch with: 1-bit bus, legacy clock */
+		mmc_set_clock(mmc, 20000000);
 	}
 
 	/* fill in device description */
@@ -1218,6 +1333,7 @@ int mmc_init(struct mmc *mmc)
 	if (err)
 		return err;
 
+	mmc->ddr_mode = 0;
 	mmc_set_bus_width(mmc, 1);
 	mmc_set_clock(mmc, 1);
 
@@ -35,20 +35,32 @@
 
 #ifdef CONFIG_SPL_BUILD
 # undef CONFIG_OMAP_MMC_USE_DMA_WRITES
+# undef CONFIG_OMAP_MMC_USE_DMA_READS
 #endif
 
-#ifdef CONFIG_OMAP_MMC_USE_DMA_WRITES
+#if defined(CONFIG_OMAP_MMC_USE_DMA_WRITES) || \
+	defined(CONFIG_OMAP_MMC_USE_DMA_READS)
+# define OMAP_MMC_USE_SDMA
 # include <asm/omap_sdma.h>
 #endif
 
+/*
+ * DMA reads invalidate the destination once the transfer is done, so the
+ * buffer must not share a cache line with anything else.
+ */
+#ifndef CONFIG_OMAP_MMC_DMA_ALIGN
+#define CONFIG_OMAP_MMC_DMA_ALIGN	32
+#endif
+
 /* If we fail after 1 second wait, something is really bad */
 #define MAX_RETRY_MS	1000
 
 static int mmc_read_data(hsmmc_t *mmc_base, char *buf, unsigned int size);
 static int mmc_write_data(hsmmc_t *mmc_base, const char *buf, unsigned int size);
-#ifdef CONFIG_OMAP_MMC_USE_DMA_WRITES
+#ifdef OMAP_MMC_USE_SDMA
 static void mmc_dma_start(struct mmc* mmc, hsmmc_t *mmc_base, const char *buf, unsigned int blkSiz, unsigned int numBlk, int write);
 static int mmc_dma_wait_for_transfer_complete(struct mmc* mmc, hsmmc_t *mmc_base, const char *buf, unsigned int blkSiz, unsigned int numBlk);
+static void mmc_dma_stop(void);
 #endif
 static struct mmc hsmmc_dev[3];
 unsigned char mmc_board_init(struct mmc *mmc)
@@ -235,7 +247,9 @@ static int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 	hsmmc_t *mmc_base = (hsmmc_t *)mmc->priv;
 	unsigned int flags, mmc_stat;
 	ulong start;
-	int canUseDma = 1;
+#ifdef OMAP_MMC_USE_SDMA
+	int canUseDma = 0;
+#endif
 
 	start = get_timer(0);
 	while ((readl(&mmc_base->pstate) & DATI_MASK) == DATI_CMDDIS) {
@@ -300,6 +314,13 @@ static int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 		if ((cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK) ||
 			 (cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK)) {
 			flags |= (MSBS_MULTIBLK | BCE_ENABLE);
+			/*
+			 * Let the controller send CMD12 itself as soon as the
+			 * last block is through, instead of mmc.c issuing it
+			 * once we have drained the data and returned.
+			 */
+			if (mmc->host_caps & MMC_MODE_AUTO_CMD12)
+				flags = (flags & ~ACEN_DISABLE) | ACEN_ENABLE;
 			data->blocksize = 512;
 			writel(data->blocksize | (data->blocks << 16),
 							&mmc_base->blk);
@@ -312,19 +333,27 @@ static int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 			flags |= (DP_DATA | DDIR_WRITE);
 
 #ifdef CONFIG_OMAP_MMC_USE_DMA_WRITES
-		if (data->flags & MMC_DATA_WRITE) {
-
-			if ((((unsigned)data->src) & 3) || (((unsigned)data->blocksize) & 3)) {
-				canUseDma = 0;
-			} else {
-				flags = (flags &~ DE_DISABLE) | DE_ENABLE;
-
-				mmc_dma_start(mmc, mmc_base, data->src,
-						data->blocksize, data->blocks, 1);
-			}
+		if ((data->flags & MMC_DATA_WRITE) &&
+		    !(((unsigned)data->src) & 3) &&
+		    !(((unsigned)data->blocksize) & 3)) {
+			flags = (flags &~ DE_DISABLE) | DE_ENABLE;
+			canUseDma = 1;
+
+			mmc_dma_start(mmc, mmc_base, data->src,
+					data->blocksize, data->blocks, 1);
+		}
+#endif
+#ifdef CONFIG_OMAP_MMC_USE_DMA_READS
+		if ((data->flags & MMC_DATA_READ) &&
+		    !((((unsigned)data->dest) |
+		       (data->blocksize * data->blocks)) &
+		      (CONFIG_OMAP_MMC_DMA_ALIGN - 1))) {
+			flags = (flags &~ DE_DISABLE) | DE_ENABLE;
+			canUseDma = 1;
+
+			mmc_dma_start(mmc, mmc_base, data->dest,
+					data->blocksize, data->blocks, 0);
 		}
-#else
-		canUseDma = 0;
 #endif
 	}
 
@@ -336,14 +365,17 @@ static int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 		mmc_stat = readl(&mmc_base->stat);
 		if (get_timer(0) - start > MAX_RETRY_MS) {
 			printf("%s : timeout: No status update\n", __func__);
-			return TIMEOUT;
+			mmc_stat = IE_CTO;
 		}
 	} while (!mmc_stat);
 
-	if ((mmc_stat & IE_CTO) != 0)
-		return TIMEOUT;
-	else if ((mmc_stat & ERRI_MASK) != 0)
-		return -1;
+	if ((mmc_stat & (IE_CTO | ERRI_MASK)) != 0) {
+#ifdef OMAP_MMC_USE_SDMA
+		if (canUseDma)
+			mmc_dma_stop();
+#endif
+		return (mmc_stat & IE_CTO) ? TIMEOUT : -1;
+	}
 
 	if (mmc_stat & CC_MASK) {
 		writel(CC_MASK, &mmc_base->stat);
@@ -361,19 +393,31 @@ static int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 	}
 
 	if (data && (data->flags & MMC_DATA_READ)) {
+#ifdef CONFIG_OMAP_MMC_USE_DMA_READS
+		if (canUseDma) {
+			unsigned long dst = (unsigned long)data->dest;
+			int ret;
+
+			ret = mmc_dma_wait_for_transfer_complete(mmc, mmc_base,
+					data->dest, data->blocksize,
+					data->blocks);
+			/* drop anything speculatively fetched meanwhile */
+			invalidate_dcache_range(dst, dst +
+					data->blocksize * data->blocks);
+			return ret;
+		}
+#endif
 		mmc_read_data(mmc_base,	data->dest,
 				data->blocksize * data->blocks);
 	} else if (data && (data->flags & MMC_DATA_WRITE)) {
-	
-		if (canUseDma) {
 #ifdef CONFIG_OMAP_MMC_USE_DMA_WRITES
-			return mmc_dma_wait_for_transfer_complete(mmc, mmc_base, data->src,
-					data->blocksize, data->blocks);
+		if (canUseDma)
+			return mmc_dma_wait_for_transfer_complete(mmc, mmc_base,
+					data->src, data->blocksize,
+					data->blocks);
 #endif
-		} else {
-			return mmc_write_data(mmc_base, data->src,
-					data->blocksize * data->blocks);
-		}
+		return mmc_write_data(mmc_base, data->src,
+				data->blocksize * data->blocks);
 	}
 
 	/* If this is an erase, wait for it to complete.  Add a fixed
@@ -515,7 +559,7 @@ static int mmc_write_data(hsmmc_t *mmc_base, const char *buf, unsigned int size)
 	return 0;
 }
 
-#ifdef CONFIG_OMAP_MMC_USE_DMA_WRITES
+#ifdef OMAP_MMC_USE_SDMA
 static void mmc_dma_start(struct mmc* mmc, hsmmc_t *mmc_base, const char *buf, unsigned int blkSiz, unsigned int numBlk, int write)
 {
 	/*
@@ -604,7 +648,7 @@ static int mmc_dma_wait_for_transfer_complete(struct mmc* mmc, hsmmc_t *mmc_base
 {
 	omap_sdma* sdma = OMAP_SDMA;
 	omap_sdma_channel* chan = sdma->channels + OMAP_DMA_CHANNEL_NUM;
-	unsigned mmc_stat;
+	unsigned mmc_stat, csr;
 	ulong start;
 	int ret = 0;
 
@@ -633,9 +677,43 @@ static int mmc_dma_wait_for_transfer_complete(struct mmc* mmc, hsmmc_t *mmc_base
 		}
 	}
 
-	writel(0, &chan->ccr);
+	/*
+	 * TC only says the controller is done with the card; on reads the
+	 * channel may still be writing the last burst out of the fifo.
+	 * Let it finish before it is disabled and the buffer invalidated.
+	 */
+	start = get_timer(0);
+	while (!ret) {
+		csr = readl(&chan->csr);
+
+		if (csr & CSR_ERR_MASK) {
+			printf("%s: sdma error, csr 0x%x\n", __func__, csr);
+			ret = 1;
+			break;
+		}
+
+		if (csr & CSR_BLOCK)
+			break;
+
+		if (get_timer(0) - start > MAX_RETRY_MS) {
+			printf("%s: timed out waiting for sdma, csr 0x%x\n",
+					__func__, csr);
+			ret = TIMEOUT;
+			break;
+		}
+	}
+
+	mmc_dma_stop();
 	return ret;
 }
+
+static void mmc_dma_stop(void)
+{
+	omap_sdma* sdma = OMAP_SDMA;
+	omap_sdma_channel* chan = sdma->channels + OMAP_DMA_CHANNEL_NUM;
+
+	writel(0, &chan->ccr);
+}
 #endif
 
 static void mmc_set_ios(struct mmc *mmc)
@@ -667,6 +745,14 @@ static void mmc_set_ios(struct mmc *mmc)
 		break;
 	}
 
+#if defined(CONFIG_OMAP44XX)
+	/* dual data rate, on top of 52MHz high speed timing */
+	if (mmc->ddr_mode)
+		writel(readl(&mmc_base->con) | DDR_ENABLE, &mmc_base->con);
+	else
+		writel(readl(&mmc_base->con) & ~DDR_ENABLE, &mmc_base->con);
+#endif
+
 	/* configure clock with 96Mhz system clock.
 	 */
 	if (mmc->clock != 0) {
@@ -717,7 +803,8 @@ int omap_mmc_init(int dev_index)
 		return 1;
 	}
 	mmc->voltages = MMC_VDD_32_33 | MMC_VDD_33_34 | MMC_VDD_165_195;
-	mmc->host_caps = MMC_MODE_4BIT | MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_HC;
+	mmc->host_caps = MMC_MODE_4BIT | MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_HC |
+				MMC_MODE_AUTO_CMD12;
 
 	mmc->f_min = 400000;
 	mmc->f_max = 52000000;
@@ -726,6 +813,9 @@ int omap_mmc_init(int dev_index)
 
 #if defined(CONFIG_OMAP44XX)
 	mmc->host_caps |= MMC_MODE_8BIT;
+#ifdef CONFIG_OMAP_MMC_DDR
+	mmc->host_caps |= MMC_MODE_DDR_52MHz;
+#endif
 #endif
 
 #if defined(CONFIG_OMAP34XX)
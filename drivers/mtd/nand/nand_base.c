@@ -1120,6 +1120,23 @@ static uint8_t *nand_transfer_oob(struct nand_chip *chip, uint8_t *oob,
 	return NULL;
 }
 
+/*
+ * Cache reads only work with the page read functions which stream the
+ * page out of the cache register in one go, without column changes.
+ */
+static int nand_can_cache_read(struct nand_chip *chip,
+			       struct mtd_oob_ops *ops)
+{
+	if (!NAND_HAS_CACHEREAD(chip) ||
+	    chip->ecc.read_page_raw != nand_read_page_raw)
+		return 0;
+	if (ops->mode == MTD_OOB_RAW)
+		return 1;
+	return chip->ecc.read_page == nand_read_page_hwecc ||
+	       chip->ecc.read_page == nand_read_page_swecc ||
+	       chip->ecc.read_page == nand_read_page_raw;
+}
+
 /**
  * nand_do_read_ops - [Internal] Read data with ECC
  *
@@ -1138,11 +1155,13 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
 	int sndcmd = 1;
 	int ret = 0;
+	int use_cache, cache = 0, more;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
 	uint8_t *bufpoi, *oob, *buf;
 
 	stats = mtd->ecc_stats;
+	use_cache = nand_can_cache_read(chip, ops);
 
 	chipnr = (int)(from >> chip->chip_shift);
 	chip->select_chip(mtd, chipnr);
@@ -1161,13 +1180,37 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		bytes = min(mtd->writesize - col, readlen);
 		aligned = (bytes == mtd->writesize);
 
+		/*
+		 * With read cache the chip fetches the next page of the
+		 * block into its data register while we read this one
+		 * out of the cache register.
+		 */
+		more = use_cache && readlen - bytes >= mtd->writesize &&
+			((page + 1) & blkcheck);
+
 		/* Is the current page in the buffer ? */
-		if (realpage != chip->pagebuf || oob) {
+		if (realpage != chip->pagebuf || oob || cache) {
 			bufpoi = aligned ? buf : chip->buffers->databuf;
 
-			if (likely(sndcmd)) {
+			if (cache) {
+				/* This page was fetched by the last 31h */
+				if (more) {
+					chip->cmdfunc(mtd,
+						NAND_CMD_READCACHESEQ, -1, -1);
+				} else {
+					chip->cmdfunc(mtd,
+						NAND_CMD_READCACHEEND, -1, -1);
+					cache = 0;
+					sndcmd = 1;
+				}
+			} else if (likely(sndcmd)) {
 				chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
 				sndcmd = 0;
+				if (aligned && more) {
+					chip->cmdfunc(mtd,
+						NAND_CMD_READCACHESEQ, -1, -1);
+					cache = 1;
+				}
 			}
 
 			/* Now read the page into the buffer */
@@ -1245,10 +1288,14 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		/* Check, if the chip supports auto page increment
 		 * or if we have hit a block boundary.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!cache && (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
+	/* Do not leave the chip in the middle of a cache read */
+	if (cache)
+		chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
+
 	ops->retlen = ops->len - (size_t) readlen;
 	if (oob)
 		ops->oobretlen = ops->ooblen - oobreadlen;
@@ -1729,6 +1776,62 @@ static void nand_write_page_syndrome(struct mtd_info *mtd,
 		chip->write_buf(mtd, oob, i);
 }
 
+/*
+ * Wait for a cache program to get all the way into the array.  The
+ * ready line and the READY status bit only tell that the cache register
+ * is free again.
+ */
+static void nand_wait_array_ready(struct mtd_info *mtd, struct nand_chip *chip)
+{
+	u32 timeo = (CONFIG_SYS_HZ * 20) / 1000;
+	u32 time_start = get_timer(0);
+
+	chip->cmdfunc(mtd, NAND_CMD_STATUS, -1, -1);
+	while (!(chip->read_byte(mtd) & NAND_STATUS_TRUE_READY)) {
+		if (get_timer(time_start) > timeo)
+			break;
+	}
+}
+
+/*
+ * Program a page in each of two blocks that sit in different planes
+ * (blocks 2n and 2n+1) at once: the first page goes in with the
+ * multi-plane command, the second one starts the program of both.
+ * Whole blocks only, the oob is left to the ecc layer.
+ */
+static int nand_write_2plane(struct mtd_info *mtd, struct nand_chip *chip,
+			     const uint8_t *buf, int page, int raw)
+{
+	int pages = 1 << (chip->phys_erase_shift - chip->page_shift);
+	const uint8_t *buf1 = buf + mtd->erasesize;
+	int i, status;
+
+	for (i = 0; i < pages; i++) {
+		chip->cmdfunc(mtd, NAND_CMD_SEQIN, 0x00, page + i);
+		if (unlikely(raw))
+			chip->ecc.write_page_raw(mtd, chip, buf);
+		else
+			chip->ecc.write_page(mtd, chip, buf);
+		chip->cmdfunc(mtd, NAND_CMD_MULTIPROG, -1, -1);
+
+		chip->cmdfunc(mtd, NAND_CMD_SEQIN, 0x00, page + pages + i);
+		if (unlikely(raw))
+			chip->ecc.write_page_raw(mtd, chip, buf1);
+		else
+			chip->ecc.write_page(mtd, chip, buf1);
+		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
+
+		/* FAIL is set if either of the two pages failed */
+		status = chip->waitfunc(mtd, chip);
+		if (status & NAND_STATUS_FAIL)
+			return -EIO;
+
+		buf += mtd->writesize;
+		buf1 += mtd->writesize;
+	}
+	return 0;
+}
+
 /**
  * nand_write_page - [REPLACEABLE] write one page
  * @mtd:	MTD device structure
@@ -1750,16 +1853,24 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	else
 		chip->ecc.write_page(mtd, chip, buf);
 
-	/*
-	 * Cached progamming disabled for now, Not sure if its worth the
-	 * trouble. The speed gain is not very impressive. (2.3->2.6Mib/s)
-	 */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	/* The read back below would break up a cache program sequence */
 	cached = 0;
+#endif
 
 	if (!cached || !(chip->options & NAND_CACHEPRG)) {
 
 		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+
+		/*
+		 * The result of the page before, if it was cached; the
+		 * caller tells by the state which of the two failed
+		 */
+		if (chip->state == FL_CACHEDPRG &&
+		    (status & NAND_STATUS_FAIL_N1))
+			return -EIO;
+		chip->state = FL_WRITING;
 		/*
 		 * See if operation failed and additional status checks are
 		 * available
@@ -1771,8 +1882,19 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 		if (status & NAND_STATUS_FAIL)
 			return -EIO;
 	} else {
+		/*
+		 * The chip is ready for the next page as soon as this one
+		 * has moved on to the data register.  By then the page
+		 * programmed before is done, its result is in FAIL_N1.
+		 */
 		chip->cmdfunc(mtd, NAND_CMD_CACHEDPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+		if (chip->state == FL_CACHEDPRG &&
+		    (status & NAND_STATUS_FAIL_N1)) {
+			nand_wait_array_ready(mtd, chip);
+			return -EIO;
+		}
+		chip->state = FL_CACHEDPRG;
 	}
 
 #ifdef CONFIG_MTD_NAND_VERIFY_WRITE
@@ -1836,6 +1958,27 @@ static uint8_t *nand_fill_oob(struct nand_chip *chip, uint8_t *oob,
 
 #define NOTALIGNED(x)	(x & (chip->subpagesize - 1)) != 0
 
+/*
+ * Whether the write goes on with two whole blocks, starting with an
+ * even one, that can be programmed in two-plane mode.
+ */
+static int nand_can_write_2plane(struct mtd_info *mtd, struct nand_chip *chip,
+				 struct mtd_oob_ops *ops, int realpage,
+				 int column, uint32_t writelen)
+{
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	return 0;
+#else
+	int pairmask = (2 << (chip->phys_erase_shift - chip->page_shift)) - 1;
+
+	if (!NAND_HAS_2PLANEPROG(chip) || ops->oobbuf ||
+	    chip->write_page != nand_write_page)
+		return 0;
+	return !column && !(realpage & pairmask) &&
+		writelen >= 2 * mtd->erasesize;
+#endif
+}
+
 /**
  * nand_do_write_ops - [Internal] NAND write with ECC
  * @mtd:	MTD device structure
@@ -1890,26 +2033,44 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 		WATCHDOG_RESET();
 
 		int bytes = mtd->writesize;
-		int cached = writelen > bytes && page != blockmask;
+		int cached = writelen > bytes &&
+			(page & blockmask) != blockmask;
+		int pages = 1;
 		uint8_t *wbuf = buf;
 
-		/* Partial page write ? */
-		if (unlikely(column || writelen < (mtd->writesize - 1))) {
-			cached = 0;
-			bytes = min_t(int, bytes - column, (int) writelen);
-			chip->pagebuf = -1;
-			memset(chip->buffers->databuf, 0xff, mtd->writesize);
-			memcpy(&chip->buffers->databuf[column], buf, bytes);
-			wbuf = chip->buffers->databuf;
-		}
+		if (nand_can_write_2plane(mtd, chip, ops, realpage,
+					  column, writelen)) {
+			pages = 2 * (blockmask + 1);
+			bytes = 2 * mtd->erasesize;
+			ret = nand_write_2plane(mtd, chip, buf, page,
+						(ops->mode == MTD_OOB_RAW));
+		} else {
+			/* Partial page write ? */
+			if (unlikely(column ||
+				     writelen < (mtd->writesize - 1))) {
+				cached = 0;
+				bytes = min_t(int, bytes - column,
+					      (int) writelen);
+				chip->pagebuf = -1;
+				memset(chip->buffers->databuf, 0xff,
+				       mtd->writesize);
+				memcpy(&chip->buffers->databuf[column], buf,
+				       bytes);
+				wbuf = chip->buffers->databuf;
+			}
 
-		if (unlikely(oob))
-			oob = nand_fill_oob(chip, oob, ops);
+			if (unlikely(oob))
+				oob = nand_fill_oob(chip, oob, ops);
 
-		ret = chip->write_page(mtd, chip, wbuf, page, cached,
-				       (ops->mode == MTD_OOB_RAW));
-		if (ret)
+			ret = chip->write_page(mtd, chip, wbuf, page, cached,
+					       (ops->mode == MTD_OOB_RAW));
+		}
+		if (ret) {
+			/* A cache program failed the page before this one */
+			if (chip->state == FL_CACHEDPRG)
+				writelen += mtd->writesize;
 			break;
+		}
 
 		writelen -= bytes;
 		if (!writelen)
@@ -1917,7 +2078,7 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 		column = 0;
 		buf += bytes;
-		realpage++;
+		realpage += pages;
 
 		page = realpage & chip->pagemask;
 		/* Check, if we cross a chip boundary */
@@ -2493,6 +2654,28 @@ static int nand_flash_detect_onfi(struct mtd_info *mtd,
 
 	return 1;
 }
+
+/*
+ * Take the pipelined operations the parameter page advertises.  Two-plane
+ * program is only used on chips with exactly two planes, where the plane
+ * is the lowest block address bit.
+ */
+static void nand_onfi_options(struct nand_chip *chip)
+{
+	struct nand_onfi_params *p = &chip->onfi_params;
+	int opt_cmd = le16_to_cpu(p->opt_cmd);
+
+	if (!chip->onfi_version)
+		return;
+
+	if (opt_cmd & ONFI_OPT_CMD_CACHE_PROG)
+		chip->options |= NAND_CACHEPRG;
+	if (opt_cmd & ONFI_OPT_CMD_CACHE_READ)
+		chip->options |= NAND_CACHERD;
+	if ((le16_to_cpu(p->features) & ONFI_FEATURE_MULTI_PLANE) &&
+	    (p->interleaved_bits & 0x0f) == 1)
+		chip->options |= NAND_2PLANEPRG;
+}
 #else
 static inline int nand_flash_detect_onfi(struct mtd_info *mtd,
 					struct nand_chip *chip,
@@ -2500,6 +2683,10 @@ static inline int nand_flash_detect_onfi(struct mtd_info *mtd,
 {
 	return 0;
 }
+
+static inline void nand_onfi_options(struct nand_chip *chip)
+{
+}
 #endif
 
 static void nand_flash_detect_non_onfi(struct mtd_info *mtd,
@@ -2663,6 +2850,8 @@ static const struct nand_flash_dev *nand_get_flash_type(struct mtd_info *mtd,
 	if (*maf_id != NAND_MFR_SAMSUNG && !type->pagesize)
 		chip->options &= ~NAND_SAMSUNG_LP_OPTIONS;
 
+	nand_onfi_options(chip);
+
 	/* Check for AND chips with 4 page planes */
 	if (chip->options & NAND_4PAGE_ARRAY)
 		chip->erase_cmd = multi_erase_cmd;
@@ -2673,6 +2862,11 @@ static const struct nand_flash_dev *nand_get_flash_type(struct mtd_info *mtd,
 	if (mtd->writesize > 512 && chip->cmdfunc == nand_command)
 		chip->cmdfunc = nand_command_lp;
 
+	/* Only our own command function knows the pipelined commands */
+	if (chip->cmdfunc != nand_command_lp)
+		chip->options &= ~(NAND_CACHEPRG | NAND_CACHERD |
+				   NAND_2PLANEPRG);
+
 	MTDDEBUG (MTD_DEBUG_LEVEL0, "NAND device: Manufacturer ID:"
 		  " 0x%02x, Chip ID: 0x%02x (%s %s)\n", *maf_id, *dev_id,
 		  nand_manuf_ids[maf_idx].name, type->name);
@@ -2952,6 +3146,11 @@ int nand_scan_tail(struct mtd_info *mtd)
 	/* propagate ecc.layout to mtd_info */
 	mtd->ecclayout = chip->ecc.layout;
 
+#ifdef CONFIG_SYS_NAND_USE_FLASH_BBT
+	/* Keep the bad block table on flash, it is not rebuilt every boot */
+	chip->options |= NAND_USE_FLASH_BBT;
+#endif
+
 	/* Check, if we should skip the bad block table scan */
 	if (chip->options & NAND_SKIP_BBTSCAN)
 		chip->options |= NAND_BBT_SCANNED;
@@ -249,6 +249,23 @@ static int scan_read_raw(struct mtd_info *mtd, uint8_t *buf, loff_t offs,
 	return mtd->read_oob(mtd, offs, &ops);
 }
 
+/*
+ * Scan read the oob of a page only
+ */
+static int scan_read_oob(struct mtd_info *mtd, uint8_t *buf, loff_t offs)
+{
+	struct mtd_oob_ops ops;
+
+	ops.mode = MTD_OOB_RAW;
+	ops.ooboffs = 0;
+	ops.ooblen = mtd->oobsize;
+	ops.oobbuf = buf;
+	ops.datbuf = NULL;
+	ops.len = 0;
+
+	return mtd->read_oob(mtd, offs, &ops);
+}
+
 /*
  * Scan write data with oob to flash
  */
@@ -285,8 +302,8 @@ static int read_abs_bbts(struct mtd_info *mtd, uint8_t *buf,
 
 	/* Read the primary version, if available */
 	if (td->options & NAND_BBT_VERSION) {
-		scan_read_raw(mtd, buf, (loff_t)td->pages[0] <<
-				this->page_shift, mtd->writesize);
+		scan_read_oob(mtd, buf + mtd->writesize,
+			      (loff_t)td->pages[0] << this->page_shift);
 		td->version[0] = buf[mtd->writesize + td->veroffs];
 		printk(KERN_DEBUG "Bad block table at page %d, version 0x%02X\n",
 		       td->pages[0], td->version[0]);
@@ -294,8 +311,8 @@ static int read_abs_bbts(struct mtd_info *mtd, uint8_t *buf,
 
 	/* Read the mirror version, if available */
 	if (md && (md->options & NAND_BBT_VERSION)) {
-		scan_read_raw(mtd, buf, (loff_t)md->pages[0] <<
-				this->page_shift, mtd->writesize);
+		scan_read_oob(mtd, buf + mtd->writesize,
+			      (loff_t)md->pages[0] << this->page_shift);
 		md->version[0] = buf[mtd->writesize + md->veroffs];
 		printk(KERN_DEBUG "Bad block table at page %d, version 0x%02X\n",
 		       md->pages[0], md->version[0]);
@@ -356,6 +373,35 @@ static int scan_block_fast(struct mtd_info *mtd, struct nand_bbt_descr *bd,
 	return 0;
 }
 
+/*
+ * Scan a given block for the marker bytes only.  Like nand_block_bad(),
+ * this reads just those bytes of the oob instead of the whole of it
+ * through mtd->read_oob.  The chip is selected by the caller.
+ */
+static int scan_block_marker(struct mtd_info *mtd, struct nand_bbt_descr *bd,
+			     loff_t offs, uint8_t *buf, int len)
+{
+	struct nand_chip *this = mtd->priv;
+	int page = (int)(offs >> this->page_shift) & this->pagemask;
+	int col = bd->offs, skew = 0, n = bd->len;
+	int j;
+
+	/* A 16 bit bus only transfers whole words */
+	if (this->options & NAND_BUSWIDTH_16) {
+		skew = col & 0x01;
+		col -= skew;
+		n = (skew + n + 1) & ~0x01;
+	}
+
+	for (j = 0; j < len; j++) {
+		this->cmdfunc(mtd, NAND_CMD_READOOB, col, page + j);
+		this->read_buf(mtd, buf, n);
+		if (memcmp(buf + skew, bd->pattern, bd->len))
+			return 1;
+	}
+	return 0;
+}
+
 /**
  * create_bbt - [GENERIC] Create a bad block table by scanning the device
  * @mtd:	MTD device structure
@@ -372,12 +418,19 @@ static int create_bbt(struct mtd_info *mtd, uint8_t *buf,
 {
 	struct nand_chip *this = mtd->priv;
 	int i, numblocks, len, scanlen;
-	int startblock;
+	int startblock, fast, chipnr = -1;
 	loff_t from;
 	size_t readlen;
 
 	MTDDEBUG (MTD_DEBUG_LEVEL0, "Scanning device for bad blocks\n");
 
+	/*
+	 * The marker bytes can be read directly, unless the ecc layout
+	 * interleaves the oob with the data.
+	 */
+	fast = !(bd->options & NAND_BBT_SCANALLPAGES) &&
+		this->ecc.mode != NAND_ECC_HW_SYNDROME;
+
 	if (bd->options & NAND_BBT_SCANALLPAGES)
 		len = 1 << (this->bbt_erase_shift - this->page_shift);
 	else {
@@ -418,9 +471,16 @@ static int create_bbt(struct mtd_info *mtd, uint8_t *buf,
 	for (i = startblock; i < numblocks;) {
 		int ret;
 
+		if (fast && chipnr != (int)(from >> this->chip_shift)) {
+			chipnr = (int)(from >> this->chip_shift);
+			this->select_chip(mtd, chipnr);
+		}
+
 		if (bd->options & NAND_BBT_SCANALLPAGES)
 			ret = scan_block_full(mtd, bd, from, buf, readlen,
 					      scanlen, len);
+		else if (fast)
+			ret = scan_block_marker(mtd, bd, from, buf, len);
 		else
 			ret = scan_block_fast(mtd, bd, from, buf, len);
 
@@ -438,6 +498,8 @@ static int create_bbt(struct mtd_info *mtd, uint8_t *buf,
 		i += 2;
 		from += (1 << this->bbt_erase_shift);
 	}
+	if (fast)
+		this->select_chip(mtd, -1);
 	return 0;
 }
 
@@ -499,8 +561,11 @@ static int search_bbt(struct mtd_info *mtd, uint8_t *buf, struct nand_bbt_descr
 			int actblock = startblock + dir * block;
 			loff_t offs = (loff_t)actblock << this->bbt_erase_shift;
 
-			/* Read first page */
-			scan_read_raw(mtd, buf, offs, mtd->writesize);
+			/* Read first page, its oob unless we check it is empty */
+			if (td->options & NAND_BBT_SCANEMPTY)
+				scan_read_raw(mtd, buf, offs, mtd->writesize);
+			else
+				scan_read_oob(mtd, buf + mtd->writesize, offs);
 			if (!check_pattern(buf, scanlen, mtd->writesize, td)) {
 				td->pages[i] = actblock << blocktopage;
 				if (td->options & NAND_BBT_VERSION) {
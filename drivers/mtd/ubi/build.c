@@ -453,17 +453,18 @@ static void uif_close(struct ubi_device *ubi)
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  *
- * Note, currently this is the only method to attach UBI devices. Hopefully in
- * the future we'll have more scalable attaching methods and avoid full media
- * scanning. But even in this case scanning will be needed as a fall-back
- * attaching method if there are some on-flash table corruptions.
+ * If there is a usable fastmap, the scanning information is taken from it and
+ * only the physical eraseblocks it does not describe are scanned. Otherwise
+ * the whole media is scanned.
  */
 static int attach_by_scanning(struct ubi_device *ubi)
 {
 	int err;
 	struct ubi_scan_info *si;
 
-	si = ubi_scan(ubi);
+	si = ubi_scan_fastmap(ubi);
+	if (!si)
+		si = ubi_scan(ubi);
 	if (IS_ERR(si))
 		return PTR_ERR(si);
 
@@ -485,6 +486,9 @@ static int attach_by_scanning(struct ubi_device *ubi)
 		goto out_wl;
 
 	ubi_scan_destroy_si(si);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	ubi->fm_attached = 1;
+#endif
 	return 0;
 
 out_wl:
@@ -864,6 +868,9 @@ out_free:
 	vfree(ubi->peb_buf2);
 #ifdef CONFIG_MTD_UBI_DEBUG
 	vfree(ubi->dbg_peb_buf);
+#endif
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	kfree(ubi->fm_checked);
 #endif
 	kfree(ubi);
 	return err;
@@ -927,6 +934,9 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	vfree(ubi->peb_buf2);
 #ifdef CONFIG_MTD_UBI_DEBUG
 	vfree(ubi->dbg_peb_buf);
+#endif
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	kfree(ubi->fm_checked);
 #endif
 	ubi_msg("mtd%d is detached from ubi%d", ubi->mtd->index, ubi->ubi_num);
 	kfree(ubi);
@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI fastmap unit.
+ *
+ * A fastmap is a snapshot of the scanning information - erase counters, the
+ * free and to-be-erased physical eraseblocks and the EBA table of every
+ * volume - which Linux stores in a few physical eraseblocks. Its super block
+ * (the anchor) lives in one of the first %UBI_FM_MAX_START physical
+ * eraseblocks. This unit reads the fastmap and turns it into a &struct
+ * ubi_scan_info object, so attaching only has to read the headers of the
+ * first %UBI_FM_MAX_START PEBs, the fastmap itself and the PEBs the fastmap
+ * does not describe (the pools, which may have been written after the fastmap
+ * was taken, and bad PEBs) instead of those of every PEB.
+ *
+ * U-Boot does not write fastmaps. Instead, the fastmap is invalidated by
+ * erasing its anchor before UBI changes anything it describes: before the
+ * first VID header is written, and before the first PEB is erased once
+ * attaching is over. The next attach then falls back to full scanning.
+ *
+ * A logical eraseblock may have been unmapped after the fastmap was taken, so
+ * the VID header of a physical eraseblock which the fastmap EBA table points
+ * to is checked the first time the logical eraseblock is accessed.
+ */
+
+#include <ubi_uboot.h>
+#include "ubi.h"
+
+/* What the fastmap says about a physical eraseblock */
+enum {
+	FM_PEB_UNKNOWN = 0,
+	FM_PEB_FREE,
+	FM_PEB_USED,
+	FM_PEB_SCRUB,
+	FM_PEB_ERASE,
+	FM_PEB_MAPPED,
+	FM_PEB_FASTMAP,
+};
+
+/**
+ * struct fm_peb - fastmap information about a physical eraseblock.
+ * @state: one of the %FM_PEB_* constants
+ * @ec: erase counter
+ */
+struct fm_peb {
+	int state;
+	int ec;
+};
+
+/**
+ * add_to_list - add physical eraseblock to a list.
+ * @si: scanning information
+ * @pnum: physical eraseblock number to add
+ * @ec: erase counter of the physical eraseblock
+ * @list: the list to add to
+ *
+ * Returns zero in case of success and %-ENOMEM in case of failure.
+ */
+static int add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+		       struct list_head *list)
+{
+	struct ubi_scan_leb *seb;
+
+	seb = kmalloc(sizeof(struct ubi_scan_leb), GFP_KERNEL);
+	if (!seb)
+		return -ENOMEM;
+
+	seb->pnum = pnum;
+	seb->ec = ec;
+	list_add_tail(&seb->u.list, list);
+	return 0;
+}
+
+/**
+ * find_anchor - find the newest fastmap super block.
+ * @ubi: UBI device description object
+ *
+ * This function returns the physical eraseblock holding the fastmap super
+ * block with the highest sequence number, %-ENOENT if there is none, or a
+ * negative error code in case of failure.
+ */
+static int find_anchor(struct ubi_device *ubi)
+{
+	int err, pnum, anchor = -ENOENT;
+	unsigned long long sqnum, max_sqnum = 0;
+	struct ubi_vid_hdr *vid_hdr;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	for (pnum = 0; pnum < UBI_FM_MAX_START && pnum < ubi->peb_count;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_free;
+		if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 0);
+		if (err < 0)
+			goto out_free;
+		if (err && err != UBI_IO_BITFLIPS)
+			continue;
+
+		sqnum = be64_to_cpu(vid_hdr->sqnum);
+		if (be32_to_cpu(vid_hdr->vol_id) == UBI_FM_SB_VOLUME_ID &&
+		    (anchor < 0 || sqnum > max_sqnum)) {
+			anchor = pnum;
+			max_sqnum = sqnum;
+		}
+	}
+	err = anchor;
+
+out_free:
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
+/**
+ * read_fastmap - read and check a fastmap.
+ * @ubi: UBI device description object
+ * @anchor: physical eraseblock holding the fastmap super block
+ * @size: the fastmap size is returned here
+ *
+ * This function returns a buffer containing the whole fastmap, starting
+ * with the super block, or %NULL if the fastmap cannot be used.
+ */
+static void *read_fastmap(struct ubi_device *ubi, int anchor, int *size)
+{
+	int err, i, pnum, used_blocks;
+	uint32_t crc;
+	struct ubi_fm_sb sb, *fmsb;
+	struct ubi_vid_hdr *vid_hdr;
+	void *buf = NULL;
+
+	err = ubi_io_read_data(ubi, &sb, anchor, 0, sizeof(struct ubi_fm_sb));
+	if (err && err != UBI_IO_BITFLIPS)
+		return NULL;
+
+	if (be32_to_cpu(sb.magic) != UBI_FM_SB_MAGIC) {
+		ubi_warn("bad fastmap super block magic at PEB %d", anchor);
+		return NULL;
+	}
+
+	if (sb.version != UBI_FM_FMT_VERSION) {
+		ubi_warn("fastmap version is %d, this UBI version supports %d",
+			 sb.version, UBI_FM_FMT_VERSION);
+		return NULL;
+	}
+
+	used_blocks = be32_to_cpu(sb.used_blocks);
+	if (used_blocks < 1 || used_blocks > UBI_FM_MAX_BLOCKS ||
+	    be32_to_cpu(sb.block_loc[0]) != anchor) {
+		ubi_warn("bad fastmap super block at PEB %d", anchor);
+		return NULL;
+	}
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return NULL;
+
+	*size = used_blocks * ubi->leb_size;
+	buf = vmalloc(*size);
+	if (!buf)
+		goto out_free;
+
+	for (i = 0; i < used_blocks; i++) {
+		pnum = be32_to_cpu(sb.block_loc[i]);
+		if (pnum < 0 || pnum >= ubi->peb_count)
+			goto out_bad;
+
+		if (i > 0) {
+			err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 0);
+			if (err && err != UBI_IO_BITFLIPS)
+				goto out_bad;
+			if (be32_to_cpu(vid_hdr->vol_id) !=
+			    UBI_FM_DATA_VOLUME_ID)
+				goto out_bad;
+		}
+
+		err = ubi_io_read_data(ubi, buf + i * ubi->leb_size, pnum, 0,
+				       ubi->leb_size);
+		if (err && err != UBI_IO_BITFLIPS)
+			goto out_bad;
+	}
+
+	fmsb = buf;
+	crc = be32_to_cpu(fmsb->data_crc);
+	fmsb->data_crc = 0;
+	if (crc32(UBI_CRC32_INIT, buf, *size) != crc) {
+		ubi_warn("bad fastmap data CRC");
+		goto out_bad;
+	}
+
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return buf;
+
+out_bad:
+	ubi_warn("cannot read fastmap at PEB %d", anchor);
+	vfree(buf);
+	buf = NULL;
+out_free:
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return buf;
+}
+
+/**
+ * read_ec_list - read a fastmap list of erase counters.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pebs: fastmap information about every physical eraseblock
+ * @fm: fastmap buffer
+ * @pos: position of the list in @fm, advanced past it on return
+ * @size: size of @fm
+ * @count: number of records in the list
+ * @state: the %FM_PEB_* state of the listed physical eraseblocks
+ *
+ * Free and to-be-erased physical eraseblocks are added to the corresponding
+ * scanning information lists. Returns zero in case of success, %-EINVAL if
+ * the list is inconsistent and %-ENOMEM if there is no memory.
+ */
+static int read_ec_list(struct ubi_device *ubi, struct ubi_scan_info *si,
+			struct fm_peb *pebs, const void *fm, int *pos,
+			int size, int count, int state)
+{
+	int err, i, pnum, ec;
+	const struct ubi_fm_ec *fmec = fm + *pos;
+
+	if (count < 0 || count > ubi->peb_count ||
+	    *pos + count * sizeof(struct ubi_fm_ec) > size)
+		return -EINVAL;
+	*pos += count * sizeof(struct ubi_fm_ec);
+
+	for (i = 0; i < count; i++) {
+		pnum = be32_to_cpu(fmec[i].pnum);
+		ec = be32_to_cpu(fmec[i].ec);
+
+		if (pnum < 0 || pnum >= ubi->peb_count ||
+		    pebs[pnum].state != FM_PEB_UNKNOWN ||
+		    ec < 0 || ec > UBI_MAX_ERASECOUNTER)
+			return -EINVAL;
+
+		pebs[pnum].state = state;
+		pebs[pnum].ec = ec;
+
+		if (state == FM_PEB_FREE) {
+			err = add_to_list(si, pnum, ec, &si->free);
+			if (err)
+				return err;
+		} else if (state == FM_PEB_ERASE) {
+			err = add_to_list(si, pnum, ec, &si->erase);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * read_volumes - add the volumes described by a fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pebs: fastmap information about every physical eraseblock
+ * @fm: fastmap buffer
+ * @pos: position of the first volume header in @fm
+ * @size: size of @fm
+ * @vol_count: number of volumes
+ *
+ * Every mapped logical eraseblock is added to the scanning information as if
+ * its VID header had been read from the flash, with a zero sequence number so
+ * that any copy found in the pools takes precedence. Returns zero in case of
+ * success, %-EINVAL if the fastmap is inconsistent and %-ENOMEM if there is no
+ * memory.
+ */
+static int read_volumes(struct ubi_device *ubi, struct ubi_scan_info *si,
+			struct fm_peb *pebs, const void *fm, int pos,
+			int size, int vol_count)
+{
+	int err, i, lnum, pnum, vol_id, reserved_pebs;
+	const struct ubi_fm_volhdr *fmvhdr;
+	const struct ubi_fm_eba *fmeba;
+	struct ubi_vid_hdr vid_hdr;
+
+	if (vol_count < 0 || vol_count > UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT)
+		return -EINVAL;
+
+	for (i = 0; i < vol_count; i++) {
+		if (pos + sizeof(struct ubi_fm_volhdr) +
+		    sizeof(struct ubi_fm_eba) > size)
+			return -EINVAL;
+
+		fmvhdr = fm + pos;
+		pos += sizeof(struct ubi_fm_volhdr);
+		fmeba = fm + pos;
+		pos += sizeof(struct ubi_fm_eba);
+
+		if (be32_to_cpu(fmvhdr->magic) != UBI_FM_VHDR_MAGIC ||
+		    be32_to_cpu(fmeba->magic) != UBI_FM_EBA_MAGIC)
+			return -EINVAL;
+
+		reserved_pebs = be32_to_cpu(fmeba->reserved_pebs);
+		if (reserved_pebs < 0 || reserved_pebs > ubi->peb_count ||
+		    pos + reserved_pebs * sizeof(__be32) > size)
+			return -EINVAL;
+		pos += reserved_pebs * sizeof(__be32);
+
+		vol_id = be32_to_cpu(fmvhdr->vol_id);
+		if ((vol_id < 0 || vol_id >= UBI_MAX_VOLUMES) &&
+		    vol_id != UBI_LAYOUT_VOLUME_ID)
+			return -EINVAL;
+
+		memset(&vid_hdr, 0, sizeof(struct ubi_vid_hdr));
+		vid_hdr.vol_id = fmvhdr->vol_id;
+		vid_hdr.data_pad = fmvhdr->data_pad;
+		if (vol_id == UBI_LAYOUT_VOLUME_ID)
+			vid_hdr.compat = UBI_LAYOUT_VOLUME_COMPAT;
+
+		if (fmvhdr->vol_type == UBI_STATIC_VOLUME) {
+			vid_hdr.vol_type = UBI_VID_STATIC;
+			vid_hdr.used_ebs = fmvhdr->used_ebs;
+			vid_hdr.data_size = fmvhdr->last_eb_bytes;
+		} else if (fmvhdr->vol_type == UBI_DYNAMIC_VOLUME)
+			vid_hdr.vol_type = UBI_VID_DYNAMIC;
+		else
+			return -EINVAL;
+
+		for (lnum = 0; lnum < reserved_pebs; lnum++) {
+			pnum = be32_to_cpu(fmeba->pnum[lnum]);
+			if (pnum < 0)
+				continue;
+
+			if (pnum >= ubi->peb_count ||
+			    (pebs[pnum].state != FM_PEB_USED &&
+			     pebs[pnum].state != FM_PEB_SCRUB))
+				return -EINVAL;
+
+			vid_hdr.lnum = cpu_to_be32(lnum);
+			err = ubi_scan_add_used(ubi, si, pnum, pebs[pnum].ec,
+					&vid_hdr,
+					pebs[pnum].state == FM_PEB_SCRUB);
+			if (err)
+				return err;
+
+			pebs[pnum].state = FM_PEB_MAPPED;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * ubi_scan_fastmap - attach using the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function looks for a fastmap and, if there is a usable one, returns
+ * the scanning information it describes, completed by scanning the physical
+ * eraseblocks the fastmap does not cover. It returns %NULL if there is no
+ * fastmap or it cannot be used for any reason, in which case the caller
+ * has to fall back to full scanning.
+ */
+struct ubi_scan_info *ubi_scan_fastmap(struct ubi_device *ubi)
+{
+	int err, i, anchor, size, pos, pnum, count, used_blocks, ec;
+	unsigned long long sqnum;
+	void *fm;
+	int *scan = NULL;
+	struct fm_peb *pebs = NULL;
+	struct ubi_scan_info *si = NULL;
+	struct ubi_fm_sb *fmsb;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_scan_pool *fmpl[2];
+
+	ubi->fm_pnum = -1;
+
+	anchor = find_anchor(ubi);
+	if (anchor < 0) {
+		dbg_bld("no fastmap found");
+		return NULL;
+	}
+
+	fm = read_fastmap(ubi, anchor, &size);
+	if (!fm)
+		return NULL;
+
+	err = -EINVAL;
+	pos = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) +
+	      2 * sizeof(struct ubi_fm_scan_pool);
+	if (pos > size)
+		goto out;
+
+	fmsb = fm;
+	fmhdr = fm + sizeof(struct ubi_fm_sb);
+	fmpl[0] = fm + sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr);
+	fmpl[1] = fmpl[0] + 1;
+	if (be32_to_cpu(fmhdr->magic) != UBI_FM_HDR_MAGIC)
+		goto out;
+
+	err = -ENOMEM;
+	si = ubi_scan_alloc_si();
+	pebs = kzalloc(ubi->peb_count * sizeof(struct fm_peb), GFP_KERNEL);
+	scan = kmalloc(ubi->peb_count * sizeof(int), GFP_KERNEL);
+	ubi->fm_checked = kzalloc(ubi->peb_count, GFP_KERNEL);
+	if (!si || !pebs || !scan || !ubi->fm_checked)
+		goto out;
+
+	si->is_empty = 0;
+	si->min_ec = UBI_MAX_ERASECOUNTER;
+
+	/* The fastmap itself is left alone */
+	used_blocks = be32_to_cpu(fmsb->used_blocks);
+	for (i = 0; i < used_blocks; i++) {
+		pnum = be32_to_cpu(fmsb->block_loc[i]);
+		ec = be32_to_cpu(fmsb->block_ec[i]);
+		err = -EINVAL;
+		if (pebs[pnum].state != FM_PEB_UNKNOWN ||
+		    ec < 0 || ec > UBI_MAX_ERASECOUNTER)
+			goto out;
+		pebs[pnum].state = FM_PEB_FASTMAP;
+		pebs[pnum].ec = ec;
+
+		err = add_to_list(si, pnum, pebs[pnum].ec, &si->alien);
+		if (err)
+			goto out;
+		si->alien_peb_count += 1;
+	}
+
+	err = read_ec_list(ubi, si, pebs, fm, &pos, size,
+			   be32_to_cpu(fmhdr->free_peb_count), FM_PEB_FREE);
+	if (!err)
+		err = read_ec_list(ubi, si, pebs, fm, &pos, size,
+				   be32_to_cpu(fmhdr->used_peb_count),
+				   FM_PEB_USED);
+	if (!err)
+		err = read_ec_list(ubi, si, pebs, fm, &pos, size,
+				   be32_to_cpu(fmhdr->scrub_peb_count),
+				   FM_PEB_SCRUB);
+	if (!err)
+		err = read_ec_list(ubi, si, pebs, fm, &pos, size,
+				   be32_to_cpu(fmhdr->erase_peb_count),
+				   FM_PEB_ERASE);
+	if (!err)
+		err = read_volumes(ubi, si, pebs, fm, pos, size,
+				   be32_to_cpu(fmhdr->vol_count));
+	if (err)
+		goto out;
+
+	/* Pool PEBs were free when the fastmap was taken */
+	err = -EINVAL;
+	for (i = 0; i < 2; i++) {
+		int j, pool_size = be16_to_cpu(fmpl[i]->size);
+
+		if (be32_to_cpu(fmpl[i]->magic) != UBI_FM_POOL_MAGIC ||
+		    pool_size > be16_to_cpu(fmpl[i]->max_size) ||
+		    pool_size > UBI_FM_MAX_POOL_SIZE)
+			goto out;
+
+		for (j = 0; j < pool_size; j++) {
+			pnum = be32_to_cpu(fmpl[i]->pebs[j]);
+			if (pnum < 0 || pnum >= ubi->peb_count ||
+			    pebs[pnum].state != FM_PEB_UNKNOWN)
+				goto out;
+		}
+	}
+
+	/*
+	 * Scan whatever the fastmap does not describe: the pools, bad PEBs
+	 * and used PEBs no volume maps. Only the PEBs taken from the EBA
+	 * tables need their mapping checked later. Scanning accounts for the
+	 * erase counters of the PEBs it reads, the fastmap for the others.
+	 */
+	count = 0;
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (pebs[pnum].state != FM_PEB_MAPPED)
+			ubi->fm_checked[pnum] = 1;
+		if (pebs[pnum].state == FM_PEB_UNKNOWN ||
+		    pebs[pnum].state == FM_PEB_USED ||
+		    pebs[pnum].state == FM_PEB_SCRUB) {
+			scan[count++] = pnum;
+			continue;
+		}
+
+		ec = pebs[pnum].ec;
+		si->ec_sum += ec;
+		si->ec_count += 1;
+		if (ec > si->max_ec)
+			si->max_ec = ec;
+		if (ec < si->min_ec)
+			si->min_ec = ec;
+	}
+
+	err = ubi_scan_pebs(ubi, si, scan, count);
+	if (err)
+		goto out;
+
+	sqnum = be64_to_cpu(fmsb->sqnum);
+	if (si->max_sqnum < sqnum)
+		si->max_sqnum = sqnum;
+	if (si->min_ec > si->max_ec)
+		si->min_ec = si->max_ec;
+	ubi_scan_set_mean_ec(si);
+
+	ubi->fm_pnum = anchor;
+	ubi->fm_ec = pebs[anchor].ec;
+	ubi_msg("attaching by fastmap at PEB %d, scanned %d of %d PEBs",
+		anchor, count, ubi->peb_count);
+
+	kfree(scan);
+	kfree(pebs);
+	vfree(fm);
+	return si;
+
+out:
+	if (err == -EINVAL)
+		ubi_warn("bad fastmap at PEB %d, scan the device", anchor);
+	if (si)
+		ubi_scan_destroy_si(si);
+	kfree(ubi->fm_checked);
+	ubi->fm_checked = NULL;
+	kfree(scan);
+	kfree(pebs);
+	vfree(fm);
+	return NULL;
+}
+
+/**
+ * ubi_fm_check_mapping - check a mapping taken from the fastmap.
+ * @ubi: UBI device description object
+ * @vol: volume description object
+ * @lnum: logical eraseblock number
+ * @pnum: physical eraseblock the logical eraseblock is mapped to
+ *
+ * This function makes sure physical eraseblock @pnum still holds logical
+ * eraseblock @lnum the first time it is accessed. If the logical eraseblock
+ * was unmapped after the fastmap was taken, it is unmapped here too and
+ * @pnum is set to %UBI_LEB_UNMAPPED. The caller has to hold the LEB lock.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubi_fm_check_mapping(struct ubi_device *ubi, struct ubi_volume *vol,
+			 int lnum, int *pnum)
+{
+	int err;
+	struct ubi_vid_hdr *vid_hdr;
+
+	if (!ubi->fm_checked || ubi->fm_checked[*pnum])
+		return 0;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	err = ubi_io_read_vid_hdr(ubi, *pnum, vid_hdr, 0);
+	if (err < 0)
+		goto out_free;
+
+	if (err == UBI_IO_PEB_FREE || err == UBI_IO_BAD_VID_HDR) {
+		dbg_bld("LEB %d:%d is no longer in PEB %d", vol->vol_id, lnum,
+			*pnum);
+		vol->eba_tbl[lnum] = UBI_LEB_UNMAPPED;
+		err = ubi_wl_put_peb(ubi, *pnum, 0);
+		*pnum = UBI_LEB_UNMAPPED;
+		goto out_free;
+	}
+
+	if (be32_to_cpu(vid_hdr->vol_id) != vol->vol_id ||
+	    be32_to_cpu(vid_hdr->lnum) != lnum) {
+		ubi_err("fastmap maps LEB %d:%d to PEB %d holding LEB %d:%d",
+			vol->vol_id, lnum, *pnum, be32_to_cpu(vid_hdr->vol_id),
+			be32_to_cpu(vid_hdr->lnum));
+		ubi_ro_mode(ubi);
+		err = -EINVAL;
+		goto out_free;
+	}
+
+	ubi->fm_checked[*pnum] = 1;
+	err = 0;
+
+out_free:
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
+/**
+ * ubi_fm_invalidate - make the fastmap unusable.
+ * @ubi: UBI device description object
+ * @erasing: non-zero if called because a physical eraseblock is being erased
+ *
+ * This function has to be called before UBI changes anything the fastmap
+ * describes. It erases the fastmap anchor, so the next attach scans the
+ * device. Erasures done while attaching only touch physical eraseblocks the
+ * fastmap already lists for erasure, so they are let through. Returns zero in
+ * case of success and a negative error code in case of failure.
+ */
+int ubi_fm_invalidate(struct ubi_device *ubi, int erasing)
+{
+	int err, pnum = ubi->fm_pnum;
+
+	if (pnum < 0 || (erasing && !ubi->fm_attached))
+		return 0;
+
+	/* Erasing the anchor comes back here */
+	ubi->fm_pnum = -1;
+
+	dbg_bld("invalidate fastmap at PEB %d", pnum);
+	err = ubi_scan_erase_peb(ubi, NULL, pnum, ubi->fm_ec + 1);
+	if (err) {
+		ubi_err("cannot invalidate fastmap at PEB %d, error %d",
+			pnum, err);
+		ubi->fm_pnum = pnum;
+	}
+
+	return err;
+}
@@ -55,7 +55,10 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si);
 #define paranoid_check_si(ubi, si) 0
 #endif
 
-/* Temporary variables used during scanning */
+/*
+ * Temporary variables used during scanning. Both headers are read into one
+ * buffer, @vidh points inside the buffer @ech points to.
+ */
 static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
 
@@ -758,7 +761,7 @@ struct ubi_scan_leb *ubi_scan_get_free_peb(struct ubi_device *ubi,
 static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum)
 {
 	long long uninitialized_var(ec);
-	int err, bitflips = 0, vol_id, ec_corr = 0;
+	int err, bitflips = 0, vol_id, ec_corr = 0, uninitialized_var(vid_err);
 
 	dbg_bld("scan PEB %d", pnum);
 
@@ -775,7 +778,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum
 		return 0;
 	}
 
-	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	err = ubi_io_read_hdrs(ubi, pnum, ech, &vid_err, 0);
 	if (err < 0)
 		return err;
 	else if (err == UBI_IO_BITFLIPS)
@@ -821,7 +824,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum
 
 	/* OK, we've done with the EC header, let's look at the VID header */
 
-	err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+	err = vid_err;
 	if (err < 0)
 		return err;
 	else if (err == UBI_IO_BITFLIPS)
@@ -853,7 +856,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si, int pnum
 			err = add_to_list(si, pnum, ec, &si->corr);
 			if (err)
 				return err;
-			break;
+			goto adjust_mean_ec;
 
 		case UBI_COMPAT_RO:
 			ubi_msg("read-only compatible internal volume %d:%d"
@@ -897,23 +900,17 @@ adjust_mean_ec:
 }
 
 /**
- * ubi_scan - scan an MTD device.
- * @ubi: UBI device description object
+ * ubi_scan_alloc_si - allocate an empty scanning information object.
  *
- * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * This function returns the new object or %NULL if there is no memory.
  */
-struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+struct ubi_scan_info *ubi_scan_alloc_si(void)
 {
-	int err, pnum;
-	struct rb_node *rb1, *rb2;
-	struct ubi_scan_volume *sv;
-	struct ubi_scan_leb *seb;
 	struct ubi_scan_info *si;
 
 	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
 	if (!si)
-		return ERR_PTR(-ENOMEM);
+		return NULL;
 
 	INIT_LIST_HEAD(&si->corr);
 	INIT_LIST_HEAD(&si->free);
@@ -921,36 +918,62 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	INIT_LIST_HEAD(&si->alien);
 	si->volumes = RB_ROOT;
 	si->is_empty = 1;
+	return si;
+}
 
-	err = -ENOMEM;
-	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
-	if (!ech)
-		goto out_si;
+/**
+ * ubi_scan_pebs - scan a number of physical eraseblocks.
+ * @ubi: UBI device description object
+ * @si: scanning information to add the results to
+ * @pnums: physical eraseblocks to scan, or %NULL to scan PEBs 0 to @count - 1
+ * @count: how many physical eraseblocks to scan
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+int ubi_scan_pebs(struct ubi_device *ubi, struct ubi_scan_info *si,
+		  const int *pnums, int count)
+{
+	int err = 0, i, pnum;
 
-	vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
-	if (!vidh)
-		goto out_ech;
+	ech = kzalloc(ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize, GFP_KERNEL);
+	if (!ech)
+		return -ENOMEM;
+	vidh = (void *)ech + ubi->vid_hdr_offset;
 
-	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+	for (i = 0; i < count; i++) {
 		cond_resched();
 
+		pnum = pnums ? pnums[i] : i;
 		dbg_msg("process PEB %d", pnum);
 		err = process_eb(ubi, si, pnum);
 		if (err < 0)
-			goto out_vidh;
+			break;
 	}
 
-	dbg_msg("scanning is finished");
+	kfree(ech);
+	return err < 0 ? err : 0;
+}
+
+/**
+ * ubi_scan_set_mean_ec - calculate the mean erase counter.
+ * @si: scanning information
+ *
+ * This function calculates the mean erase counter of the erase counters
+ * accounted so far and assigns it to all the physical eraseblocks whose erase
+ * counter is unknown.
+ */
+void ubi_scan_set_mean_ec(struct ubi_scan_info *si)
+{
+	struct rb_node *rb1, *rb2;
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
 
-	/* Calculate mean erase counter */
 	if (si->ec_count) {
 		do_div(si->ec_sum, si->ec_count);
 		si->mean_ec = si->ec_sum;
 	}
 
-	if (si->is_empty)
-		ubi_msg("empty MTD device detected");
-
 	/*
 	 * In case of unknown erase counter we use the mean erase counter
 	 * value.
@@ -973,23 +996,44 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	list_for_each_entry(seb, &si->erase, u.list)
 		if (seb->ec == UBI_SCAN_UNKNOWN_EC)
 			seb->ec = si->mean_ec;
+}
+
+/**
+ * ubi_scan - scan an MTD device.
+ * @ubi: UBI device description object
+ *
+ * This function does full scanning of an MTD device and returns complete
+ * information about it. In case of failure, an error code is returned.
+ */
+struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+{
+	int err;
+	struct ubi_scan_info *si;
+
+	si = ubi_scan_alloc_si();
+	if (!si)
+		return ERR_PTR(-ENOMEM);
+
+	err = ubi_scan_pebs(ubi, si, NULL, ubi->peb_count);
+	if (err)
+		goto out_si;
+
+	dbg_msg("scanning is finished");
+
+	if (si->is_empty)
+		ubi_msg("empty MTD device detected");
+
+	ubi_scan_set_mean_ec(si);
 
 	err = paranoid_check_si(ubi, si);
 	if (err) {
 		if (err > 0)
 			err = -EINVAL;
-		goto out_vidh;
+		goto out_si;
 	}
 
-	ubi_free_vid_hdr(ubi, vidh);
-	kfree(ech);
-
 	return si;
 
-out_vidh:
-	ubi_free_vid_hdr(ubi, vidh);
-out_ech:
-	kfree(ech);
 out_si:
 	ubi_scan_destroy_si(si);
 	return ERR_PTR(err);
@@ -342,6 +342,13 @@ struct ubi_wl_entry;
  * @buf_mutex: proptects @peb_buf1 and @peb_buf2
  * @dbg_peb_buf: buffer of PEB size used for debugging
  * @dbg_buf_mutex: proptects @dbg_peb_buf
+ *
+ * @fm_pnum: fastmap anchor PEB the device was attached from, or %-1
+ * @fm_ec: erase counter of @fm_pnum
+ * @fm_checked: one flag per PEB, set if the mapping of the LEB the PEB holds
+ *              does not need to be checked (see 'ubi_fm_check_mapping()')
+ * @fm_attached: set once attaching is over, after which any erasure makes the
+ *               fastmap stale
  */
 struct ubi_device {
 	struct cdev cdev;
@@ -424,6 +431,12 @@ struct ubi_device {
 	void *dbg_peb_buf;
 	struct mutex dbg_buf_mutex;
 #endif
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	int fm_pnum;
+	int fm_ec;
+	unsigned char *fm_checked;
+	int fm_attached;
+#endif
 };
 
 extern struct kmem_cache *ubi_wl_entry_slab;
@@ -471,6 +484,18 @@ void ubi_gluebi_updated(struct ubi_volume *vol);
 #define ubi_gluebi_updated(vol)
 #endif
 
+/* fastmap.c */
+#ifdef CONFIG_MTD_UBI_FASTMAP
+struct ubi_scan_info *ubi_scan_fastmap(struct ubi_device *ubi);
+int ubi_fm_check_mapping(struct ubi_device *ubi, struct ubi_volume *vol,
+			 int lnum, int *pnum);
+int ubi_fm_invalidate(struct ubi_device *ubi, int erasing);
+#else
+#define ubi_scan_fastmap(ubi) NULL
+#define ubi_fm_check_mapping(ubi, vol, lnum, pnum) 0
+#define ubi_fm_invalidate(ubi, erasing) 0
+#endif
+
 /* eba.c */
 int ubi_eba_unmap_leb(struct ubi_device *ubi, struct ubi_volume *vol,
 		      int lnum);
@@ -511,6 +536,8 @@ int ubi_io_write_ec_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_ec_hdr *ec_hdr);
 int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_hdr *vid_hdr, int verbose);
+int ubi_io_read_hdrs(struct ubi_device *ubi, int pnum, void *buf,
+		     int *vid_err, int verbose);
 int ubi_io_write_vid_hdr(struct ubi_device *ubi, int pnum,
 			 struct ubi_vid_hdr *vid_hdr);
 
@@ -76,11 +76,18 @@
 	 AX_MEDIUM_AC | AX_MEDIUM_RE)
 
 /* AX88772 & AX88178 RX_CTL values */
+#define AX_RX_CTL_MFB_2048		0x0000
+#define AX_RX_CTL_MFB_16384		0x0300
 #define AX_RX_CTL_SO			0x0080
 #define AX_RX_CTL_AB			0x0008
 
+/*
+ * Let the chip pack as many frames as fit in 16KiB into one bulk
+ * transfer, so a burst is drained by one transfer instead of overflowing
+ * the chip's FIFO while we turn around between 2KiB reads.
+ */
 #define AX_DEFAULT_RX_CTL	\
-	(AX_RX_CTL_SO | AX_RX_CTL_AB)
+	(AX_RX_CTL_MFB_16384 | AX_RX_CTL_SO | AX_RX_CTL_AB)
 
 /* GPIO 2 toggles */
 #define AX_GPIO_GPO2EN		0x10	/* GPIO2 Output enable */
@@ -94,7 +101,7 @@
 #define USB_BULK_SEND_TIMEOUT 5000
 #define USB_BULK_RECV_TIMEOUT 5000
 
-#define AX_RX_URB_SIZE 2048
+#define AX_RX_URB_SIZE 16384
 #define PHY_CONNECT_TIMEOUT 5000
 
 /* local vars */
@@ -452,7 +459,8 @@ static int asix_send(struct eth_device *eth, volatile void *packet, int length)
 static int asix_recv(struct eth_device *eth)
 {
 	struct ueth_data *dev = (struct ueth_data *)eth->priv;
-	static unsigned char  recv_buf[AX_RX_URB_SIZE];
+	static unsigned char  recv_buf[AX_RX_URB_SIZE]
+		__attribute__((aligned(PKTALIGN)));
 	unsigned char *buf_ptr;
 	int err;
 	int actual_len;
@@ -137,7 +137,6 @@
 #define USB_BULK_SEND_TIMEOUT 5000
 #define USB_BULK_RECV_TIMEOUT 5000
 
-#define AX_RX_URB_SIZE 2048
 #define PHY_CONNECT_TIMEOUT 5000
 
 #define TURBO_MODE
@@ -700,7 +699,9 @@ static int smsc95xx_send(struct eth_device *eth, volatile void* packet,
 static int smsc95xx_recv(struct eth_device *eth)
 {
 	struct ueth_data *dev = (struct ueth_data *)eth->priv;
-	static unsigned char  recv_buf[AX_RX_URB_SIZE];
+	/* large enough for a whole TURBO_MODE burst */
+	static unsigned char  recv_buf[DEFAULT_HS_BURST_CAP_SIZE]
+		__attribute__((aligned(PKTALIGN)));
 	unsigned char *buf_ptr;
 	int err;
 	int actual_len;
@@ -711,16 +712,16 @@ static int smsc95xx_recv(struct eth_device *eth)
 	err = usb_bulk_msg(dev->pusb_dev,
 				usb_rcvbulkpipe(dev->pusb_dev, dev->ep_in),
 				(void *)recv_buf,
-				AX_RX_URB_SIZE,
+				dev->rx_urb_size,
 				&actual_len,
 				USB_BULK_RECV_TIMEOUT);
-	debug("Rx: len = %u, actual = %u, err = %d\n", AX_RX_URB_SIZE,
+	debug("Rx: len = %u, actual = %u, err = %d\n", dev->rx_urb_size,
 	      actual_len, err);
 	if (err != 0) {
 		debug("Rx: failed to receive\n");
 		return -1;
 	}
-	if (actual_len > AX_RX_URB_SIZE) {
+	if (actual_len > dev->rx_urb_size) {
 		debug("Rx: received too many bytes %d\n", actual_len);
 		return -1;
 	}
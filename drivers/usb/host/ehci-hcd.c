@@ -217,11 +217,6 @@ static int handshake(uint32_t *ptr, uint32_t mask, uint32_t done, int usec)
 	return -1;
 }
 
-static void ehci_free(void *p, size_t sz)
-{
-
-}
-
 static int ehci_reset(void)
 {
 	uint32_t cmd;
@@ -251,35 +246,42 @@ out:
 	return ret;
 }
 
-static void *ehci_alloc(size_t sz, size_t align)
+/* There is only ever one QH in flight, so it is static */
+static struct QH *ehci_alloc_qh(void)
 {
 	static struct QH qh __attribute__((aligned(32)));
-	static struct qTD td[3] __attribute__((aligned (32)));
-	static int ntds;
-	void *p;
-
-	switch (sz) {
-	case sizeof(struct QH):
-		p = &qh;
-		ntds = 0;
-		break;
-	case sizeof(struct qTD):
-		if (ntds == 3) {
-			debug("out of TDs\n");
-			return NULL;
-		}
-		p = &td[ntds];
-		ntds++;
-		break;
-	default:
-		debug("unknown allocation size\n");
+
+	memset(&qh, 0, sizeof(qh));
+	return &qh;
+}
+
+/* The qTDs of one transfer, which can be long */
+static struct qTD *ehci_alloc_qtds(int n)
+{
+	struct qTD *qtd;
+
+	qtd = memalign(32, n * sizeof(struct qTD));
+	if (qtd == NULL) {
+		debug("unable to allocate %d qTDs\n", n);
 		return NULL;
 	}
 
-	memset(p, 0, sz);
-	return p;
+	memset(qtd, 0, n * sizeof(struct qTD));
+	return qtd;
+}
+
+static void ehci_free_qtds(struct qTD *qtd)
+{
+	free(qtd);
 }
 
+/*
+ * A qTD has five page pointers, so it covers at least 16 KiB of any
+ * buffer and up to 20 KiB of a page aligned one.
+ */
+#define QTD_MIN_BYTES	(4 * 4096)
+#define QTD_MAX_BYTES	(5 * 4096)
+
 static int ehci_td_buffer(struct qTD *td, void *buf, size_t sz)
 {
 	uint32_t addr, delta, next;
@@ -307,20 +309,39 @@ static int ehci_td_buffer(struct qTD *td, void *buf, size_t sz)
 	return 0;
 }
 
+/* Whether a short packet retired a DATA qTD, which ends the transfer */
+static int ehci_short_read(volatile struct qTD *qtd, int n)
+{
+	uint32_t token;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		token = hc32_to_cpu(qtd[i].qt_token);
+		if (token & 0x80)
+			return 0;
+		if ((token >> 16) & 0x7fff)
+			return 1;
+	}
+	return 0;
+}
+
 static int
 ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		   int length, struct devrequest *req)
 {
 	struct QH *qh;
-	struct qTD *td;
+	struct qTD *qtd = NULL;
+	struct qTD *td, *dummy, *short_td;
 	volatile struct qTD *vtd;
 	unsigned long ts;
 	uint32_t *tdp;
 	uint32_t endpt, token, usbsts;
 	uint32_t c, toggle;
 	uint32_t cmd;
-	int timeout;
+	int ntds, data_td = 0, data_tds = 0;
+	int timeout, done;
 	int ret = 0;
+	int i;
 
 	debug("dev=%p, pipe=%lx, buffer=%p, length=%d, req=%p\n", dev, pipe,
 	      buffer, length, req);
@@ -331,11 +352,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		      le16_to_cpu(req->value), le16_to_cpu(req->value),
 		      le16_to_cpu(req->index));
 
-	qh = ehci_alloc(sizeof(struct QH), 32);
-	if (qh == NULL) {
-		debug("unable to allocate QH\n");
-		return -1;
-	}
+	qh = ehci_alloc_qh();
 	qh->qh_link = cpu_to_hc32((uint32_t)&qh_list | QH_LINK_TYPE_QH);
 	c = (usb_pipespeed(pipe) != USB_SPEED_HIGH &&
 	     usb_pipeendpoint(pipe) == 0) ? 1 : 0;
@@ -354,6 +371,28 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	qh->qh_endpt2 = cpu_to_hc32(endpt);
 	qh->qh_overlay.qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
 
+	/*
+	 * Count the qTDs: SETUP and ACK for control transfers, and enough
+	 * DATA qTDs to cover the buffer.
+	 */
+	ntds = (req != NULL) ? 2 : 0;
+	if (length > 0 || req == NULL)
+		ntds += max(1, (length + QTD_MIN_BYTES - 1) / QTD_MIN_BYTES);
+	/*
+	 * One more qTD, never active: a short packet in any DATA qTD but
+	 * the last makes the HC go to the alternate next qTD.  For control
+	 * transfers that is the status qTD, otherwise the dummy, where the
+	 * QH stops.
+	 */
+	qtd = ehci_alloc_qtds(ntds + 1);
+	if (qtd == NULL)
+		goto fail;
+	dummy = &qtd[ntds];
+	dummy->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
+	dummy->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
+	short_td = (req != NULL) ? &qtd[ntds - 1] : dummy;
+	ntds = 0;
+
 	td = NULL;
 	tdp = &qh->qh_overlay.qt_next;
 
@@ -361,11 +400,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	    usb_gettoggle(dev, usb_pipeendpoint(pipe), usb_pipeout(pipe));
 
 	if (req != NULL) {
-		td = ehci_alloc(sizeof(struct qTD), 32);
-		if (td == NULL) {
-			debug("unable to allocate SETUP td\n");
-			goto fail;
-		}
+		td = &qtd[ntds++];
 		td->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
 		td->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
 		token = (0 << 31) |
@@ -374,7 +409,6 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		td->qt_token = cpu_to_hc32(token);
 		if (ehci_td_buffer(td, req, sizeof(*req)) != 0) {
 			debug("unable construct SETUP td\n");
-			ehci_free(td, sizeof(*td));
 			goto fail;
 		}
 		*tdp = cpu_to_hc32((uint32_t) td);
@@ -383,38 +417,55 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	}
 
 	if (length > 0 || req == NULL) {
-		td = ehci_alloc(sizeof(struct qTD), 32);
-		if (td == NULL) {
-			debug("unable to allocate DATA td\n");
-			goto fail;
-		}
-		td->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
-		td->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
-		token = (toggle << 31) |
-		    (length << 16) |
-		    ((req == NULL ? 1 : 0) << 15) |
-		    (0 << 12) |
-		    (3 << 10) |
-		    ((usb_pipein(pipe) ? 1 : 0) << 8) | (0x80 << 0);
-		td->qt_token = cpu_to_hc32(token);
-		if (ehci_td_buffer(td, buffer, length) != 0) {
-			debug("unable construct DATA td\n");
-			ehci_free(td, sizeof(*td));
-			goto fail;
-		}
-		*tdp = cpu_to_hc32((uint32_t) td);
-		tdp = &td->qt_next;
+		uint8_t *buf_ptr = buffer;
+		int left = length;
+		int xfr_bytes;
+		int maxpacket = usb_maxpacket(dev, pipe);
+
+		data_td = ntds;
+		do {
+			/*
+			 * Fill the qTD's page pointers.  Unless this is the
+			 * last qTD, stop at a packet boundary so that the
+			 * transfer has no short packet in the middle.
+			 */
+			xfr_bytes = QTD_MAX_BYTES - ((uint32_t)buf_ptr & 4095);
+			if (left > xfr_bytes)
+				xfr_bytes -= xfr_bytes % maxpacket;
+			else
+				xfr_bytes = left;
+
+			td = &qtd[ntds++];
+			td->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
+			td->qt_altnext = cpu_to_hc32((uint32_t)short_td);
+			token = (toggle << 31) |
+			    (xfr_bytes << 16) |
+			    ((req == NULL ? 1 : 0) << 15) |
+			    (0 << 12) |
+			    (3 << 10) |
+			    ((usb_pipein(pipe) ? 1 : 0) << 8) | (0x80 << 0);
+			td->qt_token = cpu_to_hc32(token);
+			if (ehci_td_buffer(td, buf_ptr, xfr_bytes) != 0) {
+				debug("unable construct DATA td\n");
+				goto fail;
+			}
+			*tdp = cpu_to_hc32((uint32_t) td);
+			tdp = &td->qt_next;
+
+			/* the QH takes each qTD's toggle (DTC is set) */
+			if ((xfr_bytes / maxpacket) & 1)
+				toggle ^= 1;
+			buf_ptr += xfr_bytes;
+			left -= xfr_bytes;
+		} while (left > 0);
+		data_tds = ntds - data_td;
 	}
 
 	if (req != NULL) {
-		td = ehci_alloc(sizeof(struct qTD), 32);
-		if (td == NULL) {
-			debug("unable to allocate ACK td\n");
-			goto fail;
-		}
+		td = &qtd[ntds++];
 		td->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
 		td->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
-		token = (toggle << 31) |
+		token = (1 << 31) |
 		    (0 << 16) |
 		    (1 << 15) |
 		    (0 << 12) |
@@ -429,6 +480,11 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 
 	/* Flush dcache */
 	ehci_flush_dcache(&qh_list);
+#if defined(CONFIG_EHCI_DCACHE)
+	flush_dcache_range((u32)dummy, (u32)(dummy + 1));
+	if (length > 0)
+		flush_dcache_range((u32)buffer, (u32)buffer + length);
+#endif
 
 	usbsts = ehci_readl(&hcor->or_usbsts);
 	ehci_writel(&hcor->or_usbsts, (usbsts & 0x3f));
@@ -448,18 +504,31 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	/* Wait for TDs to be processed. */
 	ts = get_timer(0);
 	vtd = td;
-	timeout = USB_TIMEOUT_MS(pipe);
+	/*
+	 * A single request can move many MiB; allow for devices as slow as
+	 * 1 MiB/s (full speed behind a TT) on top of the usual timeout.
+	 */
+	timeout = USB_TIMEOUT_MS(pipe) + (length >> 10);
+	done = 0;
 	do {
 		/* Invalidate dcache */
 		ehci_invalidate_dcache(&qh_list);
 		token = hc32_to_cpu(vtd->qt_token);
-		if (!(token & 0x80))
+		/*
+		 * Done at the last qTD, or earlier when an error halts the
+		 * QH or a short bulk read sends it to the dummy.
+		 */
+		done = !(token & 0x80) ||
+		       (hc32_to_cpu(qh->qh_overlay.qt_token) & 0x40) ||
+		       (req == NULL &&
+			ehci_short_read(&qtd[data_td], data_tds));
+		if (done)
 			break;
 		WATCHDOG_RESET();
 	} while (get_timer(ts) < timeout);
 
 	/* Check that the TD processing happened */
-	if (token & 0x80) {
+	if (!done) {
 		printf("EHCI timed out on TD - token=%#x\n", token);
 	}
 
@@ -477,7 +546,17 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 
 	qh_list.qh_link = cpu_to_hc32((uint32_t)&qh_list | QH_LINK_TYPE_QH);
 
+	/*
+	 * The last qTD the HC retired holds the status and the next toggle;
+	 * the overlay may have moved on to the dummy already.
+	 */
 	token = hc32_to_cpu(qh->qh_overlay.qt_token);
+	for (i = ntds - 1; done && i >= 0; i--) {
+		if (!(hc32_to_cpu(qtd[i].qt_token) & 0x80)) {
+			token = hc32_to_cpu(qtd[i].qt_token);
+			break;
+		}
+	}
 	if (!(token & 0x80)) {
 		debug("TOKEN=%#x\n", token);
 		switch (token & 0xfc) {
@@ -504,7 +583,16 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 				dev->status |= USB_ST_STALLED;
 			break;
 		}
-		dev->act_len = length - ((token >> 16) & 0x7fff);
+		/* the bytes left over in every DATA qTD */
+		dev->act_len = length;
+		for (i = data_td; i < data_td + data_tds; i++)
+			dev->act_len -=
+				(hc32_to_cpu(qtd[i].qt_token) >> 16) & 0x7fff;
+#if defined(CONFIG_EHCI_DCACHE)
+		if (usb_pipein(pipe) && dev->act_len > 0)
+			invalidate_dcache_range((u32)buffer,
+						(u32)buffer + dev->act_len);
+#endif
 	} else {
 		dev->act_len = 0;
 		debug("dev=%u, usbsts=%#x, p[1]=%#x, p[2]=%#x\n",
@@ -513,16 +601,12 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		      ehci_readl(&hcor->or_portsc[1]));
 	}
 
+	ehci_free_qtds(qtd);
 	return (dev->status != USB_ST_NOT_PROC) ? 0 : -1;
 
 fail:
-	td = (void *)hc32_to_cpu(qh->qh_overlay.qt_next);
-	while (td != (void *)QT_NEXT_TERMINATE) {
-		qh->qh_overlay.qt_next = td->qt_next;
-		ehci_free(td, sizeof(*td));
-		td = (void *)hc32_to_cpu(qh->qh_overlay.qt_next);
-	}
-	ehci_free(qh, sizeof(*qh));
+	if (qtd != NULL)
+		ehci_free_qtds(qtd);
 	return -1;
 }
 
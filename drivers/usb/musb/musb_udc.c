@@ -119,6 +119,99 @@ static struct urb *ep0_urb;
 struct usb_endpoint_instance *ep0_endpoint;
 static struct usb_device_instance *udc_device;
 static int enabled;
+/* rx endpoints holding a packet that did not fit in the current urb */
+static u16 rx_pending;
+
+/*
+ * DMA channels.  Any channel can serve any endpoint in either direction;
+ * one is claimed per transfer and given back when the transfer is done.
+ * rx_dma[] and tx_dma[] hold the channel + 1 an endpoint is using, or 0.
+ */
+#ifdef CONFIG_MUSB_DMA_CHANNELS
+#define MUSB_DMA_CHANNELS	CONFIG_MUSB_DMA_CHANNELS
+#else
+#define MUSB_DMA_CHANNELS	8
+#endif
+
+static u8 dma_claimed;
+static u8 rx_dma[MAX_ENDPOINT + 1];
+static u8 tx_dma[MAX_ENDPOINT + 1];
+
+static int musb_dma_claim(void)
+{
+	int ch;
+
+	for (ch = 0; ch < MUSB_DMA_CHANNELS; ch++) {
+		if (!(dma_claimed & (1 << ch))) {
+			dma_claimed |= (1 << ch);
+			return ch;
+		}
+	}
+	return -1;
+}
+
+static void musb_dma_release(int ch)
+{
+	writew(0, &musbr->dma[ch].ctrl);
+	dma_claimed &= ~(1 << ch);
+}
+
+static void musb_dma_control(int ch, unsigned int ep, u16 mode)
+{
+	/* transfers are word aligned and, except for a last short
+	 * packet, a multiple of 16 bytes, so burst mode 3 is fine.
+	 */
+	writew(MUSB_DMA_CNTL_BURST_MODE_3 | MUSB_DMA_CNTL_END_POINT(ep) |
+	       mode | MUSB_DMA_CNTL_ENABLE, &musbr->dma[ch].ctrl);
+}
+
+static void musb_dma_start(int ch, unsigned int ep, void *buf, u32 count,
+			   u16 mode)
+{
+	writel((u32)buf, &musbr->dma[ch].address);
+	writel(count, &musbr->dma[ch].count);
+	musb_dma_control(ch, ep, mode);
+}
+
+static int musb_dma_error(int ch)
+{
+	return readw(&musbr->dma[ch].ctrl) & MUSB_DMA_CNTL_ERR;
+}
+
+static u32 musb_dma_count(int ch)
+{
+	return readl(&musbr->dma[ch].count);
+}
+
+/* Stop every channel, e.g. on bus reset; the transfers are lost */
+static void musb_dma_reset(void)
+{
+	unsigned int ep;
+	u16 csr;
+
+	for (ep = 1; ep <= MAX_ENDPOINT; ep++) {
+		if (rx_dma[ep]) {
+			csr = readw(&musbr->ep[ep].epN.rxcsr);
+			csr &= ~(MUSB_RXCSR_AUTOCLEAR | MUSB_RXCSR_DMAENAB |
+				 MUSB_RXCSR_DMAMODE);
+			writew(csr, &musbr->ep[ep].epN.rxcsr);
+		}
+		if (tx_dma[ep]) {
+			csr = readw(&musbr->ep[ep].epN.txcsr);
+			csr &= ~(MUSB_TXCSR_AUTOSET | MUSB_TXCSR_DMAENAB |
+				 MUSB_TXCSR_DMAMODE);
+			writew(csr, &musbr->ep[ep].epN.txcsr);
+			if (udc_device)
+				GET_ENDPOINT(udc_device, ep)->last = 0;
+		}
+		rx_dma[ep] = 0;
+		tx_dma[ep] = 0;
+	}
+	/* all of them, earlier boot stages may have used any */
+	for (ep = 0; ep < 8; ep++)
+		writew(0, &musbr->dma[ep].ctrl);
+	dma_claimed = 0;
+}
 
 #ifdef MUSB_DEBUG
 static void musb_db_regs(void)
@@ -221,6 +314,8 @@ static void musb_peri_reset(void)
 	/* Sync sw and hw addresses */
 	writeb(udc_device->address, &musbr->faddr);
 
+	rx_pending = 0;
+	musb_dma_reset();
 	SET_EP0_STATE(IDLE);
 }
 
@@ -680,12 +775,22 @@ static void musb_peri_ep0(void)
 }
 
 #ifdef CONFIG_MUSB_DMA_MODE1
-static int read_fifo_dma_mode1(unsigned int ep, u32 count, u8 *buf)
+/*
+ * Receive a whole transfer of count bytes into buf with a mode 1 DMA.
+ * The controller moves the full packets by itself and we return right
+ * away; musb_peri_rx_dma_poll() finishes the transfer, including a last
+ * short packet, and sets the urb's actual_length.  The cache is cleaned
+ * and invalidated here, before the DMA starts; the gadget must leave buf
+ * alone until the transfer is done and not invalidate it afterwards.
+ */
+static int rx_dma_mode1_start(unsigned int ep, u32 count, u8 *buf)
 {
-	int rc = -1;
 	u16 peri_rxcsr;
-	u16 dma_control;
-	u16 peri_rxcount;
+	int ch;
+
+	ch = musb_dma_claim();
+	if (ch < 0)
+		return -1;
 
 	/* for large transfers, where speed matters most, it's
 	 * more efficient to flush the entire dcache using
@@ -702,78 +807,76 @@ static int read_fifo_dma_mode1(unsigned int ep, u32 count, u8 *buf)
 	peri_rxcsr |= MUSB_RXCSR_DMAENAB;
 	writew(peri_rxcsr, &musbr->ep[ep].epN.rxcsr);
 
-	/* hard coded for dma channel 1 for now */
-
-	/* set the address */
-	writel((u32)buf, &musbr->dma[0].address);
-	/* set the transfer size */
-	writel(count, &musbr->dma[0].count);
+	musb_dma_start(ch, ep, buf, count,
+		       MUSB_DMA_CNTL_MODE_1 | MUSB_DMA_CNTL_WRITE);
+	rx_dma[ep] = ch + 1;
+	return 0;
+}
 
-	/* set the control parts.  we already checked that
-	 * the size is a multiple of 16 so we can use
-	 * burst mode of 16 bytes.
-	 */
-	dma_control = (MUSB_DMA_CNTL_BURST_MODE_3 |
-		       MUSB_DMA_CNTL_END_POINT(ep) |
-		       MUSB_DMA_CNTL_MODE_1 |
-		       MUSB_DMA_CNTL_WRITE |
-		       MUSB_DMA_CNTL_ENABLE);
-	writew(dma_control, &musbr->dma[0].ctrl);
+static void musb_peri_rx_dma_poll(unsigned int ep)
+{
+	struct usb_endpoint_instance *endpoint = GET_ENDPOINT(udc_device, ep);
+	int ch = rx_dma[ep] - 1;
+	int rc = 0;
+	u16 peri_rxcsr;
+	u16 peri_rxcount;
+	u32 remaining;
 
-	while (1) {
-		if (readw(&musbr->dma[0].ctrl) & MUSB_DMA_CNTL_ERR) {
-			serial_printf("dma error\n");
-			break;
-		}
-		if (readl(&musbr->dma[0].count) < epinfo[(ep - 1) * 2].epsize) {
-			rc = 0;
-			break;
-		}
+	if (musb_dma_error(ch)) {
+		serial_printf("dma error\n");
+		rc = -1;
+		goto out;
 	}
 
+	/* still full packets to come */
+	remaining = musb_dma_count(ch);
+	if (remaining >= epinfo[(ep - 1) * 2].epsize)
+		return;
+
 	/* handle last short packet, if any, using dma mode 0 */
-	if (rc) {
-		goto out;
-	}
+	if (remaining) {
+		peri_rxcsr = readw(&musbr->ep[ep].epN.rxcsr);
+		if (!(peri_rxcsr & MUSB_RXCSR_RXPKTRDY))
+			return;
 
-	if (readl(&musbr->dma[0].count)) {
 		/* reset for mode0 */
-		peri_rxcsr = readw(&musbr->ep[ep].epN.rxcsr);
 		peri_rxcsr &= ~(MUSB_RXCSR_AUTOCLEAR | MUSB_RXCSR_DMAMODE);
 		writew(peri_rxcsr, &musbr->ep[ep].epN.rxcsr);
 
 		/* first read of rxcount may not be right */
 		while (1) {
 			peri_rxcount = readw(&musbr->ep[ep].epN.rxcount);
-			if (peri_rxcount == readl(&musbr->dma[0].count)) {
+			if (peri_rxcount == remaining)
 				break;
-			}
 		}
 
-		dma_control = (MUSB_DMA_CNTL_BURST_MODE_3 |
-			       MUSB_DMA_CNTL_END_POINT(ep) |
-			       MUSB_DMA_CNTL_WRITE |
-			       MUSB_DMA_CNTL_ENABLE);
-		writew(dma_control, &musbr->dma[0].ctrl);
+		musb_dma_control(ch, ep, MUSB_DMA_CNTL_WRITE);
 
 		while (1) {
-			if (readw(&musbr->dma[0].ctrl) & MUSB_DMA_CNTL_ERR) {
+			if (musb_dma_error(ch)) {
 				serial_printf("dma error\n");
 				rc = -1;
 				break;
 			}
-			if (readl(&musbr->dma[0].count) == 0) {
+			if (musb_dma_count(ch) == 0)
 				break;
-			}
 		}
 	}
 out:
 	/* clear DMAENAB and do the rx_ack */
+	peri_rxcsr = readw(&musbr->ep[ep].epN.rxcsr);
 	peri_rxcsr &= ~(MUSB_RXCSR_AUTOCLEAR | MUSB_RXCSR_DMAENAB |
 			MUSB_RXCSR_DMAMODE | MUSB_RXCSR_RXPKTRDY);
 	writew(peri_rxcsr, &musbr->ep[ep].epN.rxcsr);
-	writew(0, &musbr->dma[0].ctrl);
-	return rc;
+	musb_dma_release(ch);
+	rx_dma[ep] = 0;
+
+	/* update actual_length to indicate success; any error is
+	 * not generally recoverable so the urb is just left as is
+	 */
+	if (!rc && endpoint && endpoint->rcv_urb)
+		endpoint->rcv_urb->actual_length =
+			endpoint->rcv_urb->buffer_length;
 }
 #endif
 
@@ -795,7 +898,7 @@ static int read_fifo_dma(unsigned int ep, u32 count, u8 *buf)
 {
 	int rc = -1;
 	u16 peri_rxcsr;
-	u16 dma_control;
+	int ch;
 
 	if (count > sizeof(dma_buffer)) {
 		serial_printf("count %d > sizeof(dma_buffer) %d\n",
@@ -803,34 +906,25 @@ static int read_fifo_dma(unsigned int ep, u32 count, u8 *buf)
 		return rc;
 	}
 
+	/* all channels busy, let the caller use pio */
+	ch = musb_dma_claim();
+	if (ch < 0)
+		return rc;
+
 	peri_rxcsr = readw(&musbr->ep[ep].epN.rxcsr);
 	peri_rxcsr &= ~MUSB_RXCSR_AUTOCLEAR;
 	peri_rxcsr |= MUSB_RXCSR_DMAENAB;
 	writew(peri_rxcsr, &musbr->ep[ep].epN.rxcsr);
 
-	/* hard coded for dma channel 1 for now */
-
-	/* set the address */
-	writel((u32)dma_buffer, &musbr->dma[0].address);
-	/* set the transfer size */
-	writel(count, &musbr->dma[0].count);
-
-	/* set the control parts.  we already checked that
-	 * the size is a multiple of 16 so we can use
-	 * burst mode of 16 bytes.
-	 */
-	dma_control = (MUSB_DMA_CNTL_BURST_MODE_3 |
-		       MUSB_DMA_CNTL_END_POINT(ep) |
-		       MUSB_DMA_CNTL_WRITE |
-		       MUSB_DMA_CNTL_ENABLE);
-	writew(dma_control, &musbr->dma[0].ctrl);
+	/* a single packet, so just wait for it */
+	musb_dma_start(ch, ep, dma_buffer, count, MUSB_DMA_CNTL_WRITE);
 
 	while (1) {
-		if (readw(&musbr->dma[0].ctrl) & MUSB_DMA_CNTL_ERR) {
+		if (musb_dma_error(ch)) {
 			serial_printf("dma error\n");
 			break;
 		}
-		if (readl(&musbr->dma[0].count) == 0) {
+		if (musb_dma_count(ch) == 0) {
 			rc = 0;
 			break;
 		}
@@ -840,6 +934,7 @@ static int read_fifo_dma(unsigned int ep, u32 count, u8 *buf)
 	peri_rxcsr &= ~(MUSB_RXCSR_AUTOCLEAR | MUSB_RXCSR_DMAENAB |
 			MUSB_RXCSR_RXPKTRDY);
 	writew(peri_rxcsr, &musbr->ep[ep].epN.rxcsr);
+	musb_dma_release(ch);
 
 	if (rc == 0) {
 		invalidate_dcache_range((u32)dma_buffer,
@@ -854,9 +949,15 @@ static void musb_peri_rx_ep(unsigned int ep)
 	struct usb_endpoint_instance *endpoint;
 	struct urb *urb;
 
-	if (!(readw(&musbr->ep[ep].epN.rxcsr) & MUSB_RXCSR_RXPKTRDY))
+	/* a mode 1 dma owns the endpoint until it is done */
+	if (rx_dma[ep])
 		return;
 
+	if (!(readw(&musbr->ep[ep].epN.rxcsr) & MUSB_RXCSR_RXPKTRDY)) {
+		rx_pending &= ~(1 << ep);
+		return;
+	}
+
 	endpoint = GET_ENDPOINT(udc_device, ep);
 	if (endpoint == NULL) {
 		if (debug_level > 0)
@@ -876,18 +977,17 @@ static void musb_peri_rx_ep(unsigned int ep)
 
 #ifdef CONFIG_MUSB_DMA_MODE1
 	/* we use mode1 only if the buffer address satisfies the
-	 * alignment requirements for DMA, and is not the
-	 * default size (that's our hint that it's been
-	 * set to be the length of the actual transfer)
+	 * alignment requirements for DMA, and the gadget has set
+	 * the urb to the length of the whole transfer.  Transfers
+	 * shorter than a packet are left to the fifo reader.
 	 */
-	if ((urb->buffer_length != sizeof(urb->buffer_data)) &&
-	    (((unsigned)urb->buffer & 0x3) == 0)) {
-		if (!read_fifo_dma_mode1(ep, urb->buffer_length, urb->buffer)) {
-			/* update actual_length to indicate success */
-			urb->actual_length = urb->buffer_length;
-		}
-		/* any error is not generally recoverable so we just return */
-		return;
+	if (urb->whole &&
+	    (urb->buffer_length >= endpoint->rcv_packetSize) &&
+	    (((unsigned)urb->buffer & 0x3) == 0) &&
+	    (urb->actual_length == 0)) {
+		/* if no channel is free, fall back to the fifo reader */
+		if (!rx_dma_mode1_start(ep, urb->buffer_length, urb->buffer))
+			return;
 	}
 #endif
 	do {
@@ -918,12 +1018,19 @@ static void musb_peri_rx_ep(unsigned int ep)
 			usbd_rcv_complete(endpoint, peri_rxcount, 0);
 
 		} else {
+			/* leave the packet in the fifo, the host is
+			 * NAKed until the gadget hands us a new buffer.
+			 * udc_irq() retries the endpoint from then on.
+			 */
 			if (debug_level > 0)
-				serial_printf("ERROR : %s %d no space "
+				serial_printf("INFO : %s %d no space "
 					      "in rcv buffer\n",
 					      __PRETTY_FUNCTION__, ep);
+			rx_pending |= (1 << ep);
+			return;
 		}
 	} while (readw(&musbr->ep[ep].epN.rxcsr) & MUSB_RXCSR_RXPKTRDY);
+	rx_pending &= ~(1 << ep);
 }
 
 static void musb_peri_rx(u16 intr)
@@ -940,23 +1047,114 @@ static void musb_peri_rx(u16 intr)
 	}
 }
 
+#ifdef CONFIG_MUSB_DMA_TX
+/*
+ * Send the full packets of a bulk-IN transfer with a mode 1 DMA.  With
+ * AUTOSET the controller sends each packet as soon as it is in the fifo;
+ * musb_peri_tx_dma_poll() completes the transfer once the last of them
+ * has left the fifo, and sends the short tail, if any, itself.
+ */
+static int tx_dma_mode1_start(struct usb_endpoint_instance *endpoint,
+			      unsigned int ep, u8 *data, u32 length)
+{
+	u16 peri_txcsr;
+	int ch;
+
+	ch = musb_dma_claim();
+	if (ch < 0)
+		return -1;
+
+	flush_dcache_range((unsigned long)data, (unsigned long)data + length);
+
+	peri_txcsr = readw(&musbr->ep[ep].epN.txcsr);
+	peri_txcsr |= (MUSB_TXCSR_AUTOSET | MUSB_TXCSR_DMAENAB);
+	writew(peri_txcsr, &musbr->ep[ep].epN.txcsr);
+	peri_txcsr |= MUSB_TXCSR_DMAMODE;
+	writew(peri_txcsr, &musbr->ep[ep].epN.txcsr);
+
+	musb_dma_start(ch, ep, data, length,
+		       MUSB_DMA_CNTL_MODE_1 | MUSB_DMA_CNTL_READ);
+	tx_dma[ep] = ch + 1;
+
+	/* keeps callers from queueing another write meanwhile */
+	endpoint->last = length;
+	return 0;
+}
+
+static void musb_peri_tx_dma_poll(unsigned int ep)
+{
+	struct usb_endpoint_instance *endpoint = GET_ENDPOINT(udc_device, ep);
+	int ch = tx_dma[ep] - 1;
+	u16 peri_txcsr;
+
+	if (musb_dma_error(ch)) {
+		serial_printf("dma error\n");
+	} else {
+		if (musb_dma_count(ch))
+			return;
+		/* wait for the last packet to leave the fifo */
+		if (readw(&musbr->ep[ep].epN.txcsr) & MUSB_TXCSR_TXPKTRDY)
+			return;
+	}
+
+	peri_txcsr = readw(&musbr->ep[ep].epN.txcsr);
+	peri_txcsr &= ~(MUSB_TXCSR_AUTOSET | MUSB_TXCSR_DMAENAB);
+	writew(peri_txcsr, &musbr->ep[ep].epN.txcsr);
+	peri_txcsr &= ~MUSB_TXCSR_DMAMODE;
+	writew(peri_txcsr, &musbr->ep[ep].epN.txcsr);
+	musb_dma_release(ch);
+	tx_dma[ep] = 0;
+
+	/* an error is not recoverable either, so move on regardless */
+	usbd_tx_complete(endpoint);
+
+	/* Mode 1 need not raise the endpoint interrupt that musb_peri_tx()
+	 * would send the rest from, so send the short tail, or the next
+	 * queued urb, from here.
+	 */
+	if (endpoint && endpoint->tx_urb &&
+	    (endpoint->tx_urb->actual_length > endpoint->sent))
+		udc_endpoint_write(endpoint);
+}
+#endif
+
+/* Poll the DMA transfers in flight; there are no DMA interrupts */
+static void musb_peri_dma(void)
+{
+	unsigned int ep;
+
+	for (ep = 1; ep <= MAX_ENDPOINT; ep++) {
+#ifdef CONFIG_MUSB_DMA_MODE1
+		if (rx_dma[ep])
+			musb_peri_rx_dma_poll(ep);
+#endif
+#ifdef CONFIG_MUSB_DMA_TX
+		if (tx_dma[ep])
+			musb_peri_tx_dma_poll(ep);
+#endif
+	}
+}
+
 static void musb_peri_tx(u16 intr)
 {
+	struct usb_endpoint_instance *endpoint;
+	unsigned int ep;
+
 	/* Check for EP0 */
 	if (0x01 & intr)
 		musb_peri_ep0_tx();
 
-	/*
-	 * Use this in the future when handling epN tx
-	 *
-	 * u8 ep;
-	 *
-	 * for (ep = 1; ep < 16; ep++) {
-	 *	if ((1 << ep) & intr) {
-	 *		/ * handle tx for this endpoint * /
-	 *	}
-	 * }
+	/* The fifo is free again: keep going with the current urb, or
+	 * the next one queued on the endpoint.
 	 */
+	for (ep = 1; ep <= MAX_ENDPOINT; ep++) {
+		if (!((1 << ep) & intr) || tx_dma[ep])
+			continue;
+		endpoint = GET_ENDPOINT(udc_device, ep);
+		if (endpoint && endpoint->tx_urb && !endpoint->last &&
+		    endpoint->tx_urb->actual_length > endpoint->sent)
+			udc_endpoint_write(endpoint);
+	}
 }
 
 void udc_irq(void)
@@ -1024,6 +1222,10 @@ void udc_irq(void)
 			intrrx = readw(&musbr->intrrx);
 			intrtx = readw(&musbr->intrtx);
 #endif /* CONFIG_USB_AM35X */
+			musb_peri_dma();
+
+			/* packets left behind for lack of rcv buffer space */
+			intrrx |= rx_pending;
 			if (intrrx)
 				musb_peri_rx(intrrx);
 
@@ -1077,21 +1279,32 @@ int udc_endpoint_write(struct usb_endpoint_instance *endpoint)
 		if (debug_level > 1)
 			musb_print_txcsr(peri_txcsr);
 
-		/* Check if a packet is waiting to be sent */
-		if (!(peri_txcsr & MUSB_TXCSR_TXPKTRDY)) {
+		/* Check if a packet is waiting to be sent, or a dma is
+		 * still feeding the fifo
+		 */
+		if (!(peri_txcsr & MUSB_TXCSR_TXPKTRDY) && !tx_dma[ep]) {
 			u32 length;
 			u8 *data;
 			struct urb *urb = endpoint->tx_urb;
 			unsigned int remaining_packet = urb->actual_length -
 				endpoint->sent;
 
+			data = (u8 *) urb->buffer + endpoint->sent;
+
+#ifdef CONFIG_MUSB_DMA_TX
+			/* dma the full packets when there are several */
+			length = remaining_packet -
+				(remaining_packet % endpoint->tx_packetSize);
+			if ((length > endpoint->tx_packetSize) &&
+			    (((unsigned)data & 0x3) == 0) &&
+			    !tx_dma_mode1_start(endpoint, ep, data, length))
+				return ret;
+#endif
 			if (endpoint->tx_packetSize < remaining_packet)
 				length = endpoint->tx_packetSize;
 			else
 				length = remaining_packet;
 
-			data = (u8 *) urb->buffer + endpoint->sent;
-
 			/* common musb fifo function */
 			write_fifo(ep, length, data);
 
@@ -1145,7 +1358,12 @@ void udc_setup_ep(struct usb_device_instance *device, unsigned int id,
 
 void udc_disconnect(void)
 {
-	/* noop */
+	u8 power;
+
+	/* drop off the bus so that the host sees the device go away */
+	power = readb(&musbr->power);
+	power &= ~MUSB_POWER_SOFTCONN;
+	writeb(power, &musbr->power);
 }
 
 void udc_enable(struct usb_device_instance *device)
@@ -1182,7 +1400,6 @@ int udc_init(void)
 {
 	int ret;
 	int ep_loop;
-	int dma_channel;
 
 	ret = musb_platform_init();
 	if (ret < 0)
@@ -1201,8 +1418,7 @@ int udc_init(void)
 	/* Clear DMA controllers, especially if any might
 	 * have been usd in earlier stage bootloaders.
 	 */
-	for (dma_channel = 0; dma_channel < 8; dma_channel++)
-		writew(0, &musbr->dma[dma_channel].ctrl);
+	musb_dma_reset();
 
 	ret = 0;
 end:
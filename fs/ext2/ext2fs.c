@@ -64,6 +64,19 @@ extern int ext2fs_devread (int sector, int byte_offset, int byte_len,
 /* The size of an ext2 block in bytes.  */
 #define EXT2_BLOCK_SIZE(data)	   (1 << LOG2_BLOCK_SIZE(data))
 
+/* Incompatible features we know about.  */
+#define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+
+/* The inode's block map is an extent tree.  */
+#define EXT4_EXTENTS_FL		0x00080000
+
+#define EXT4_EXT_MAGIC		0xf30a
+/* Longer extents are preallocated but unwritten, and read as zeroes.  */
+#define EXT4_EXT_INIT_MAX_LEN	32768
+/* Deepest extent tree we follow, not counting the root in the inode.  */
+#define EXT4_EXT_MAX_DEPTH	5
+
 /* The ext2 superblock.  */
 struct ext2_sblock {
 	uint32_t total_inodes;
@@ -101,6 +114,17 @@ struct ext2_sblock {
 	char volume_name[16];
 	char last_mounted_on[64];
 	uint32_t compression_info;
+	uint8_t prealloc_blocks;
+	uint8_t prealloc_dir_blocks;
+	uint16_t reserved_gdt_blocks;
+	uint8_t journal_uuid[16];
+	uint32_t journal_inode;
+	uint32_t journal_dev;
+	uint32_t last_orphan;
+	uint32_t hash_seed[4];
+	uint8_t default_hash_version;
+	uint8_t journal_backup_type;
+	uint16_t descriptor_size;	/* ext4 64bit only */
 };
 
 /* The ext2 blockgroup.  */
@@ -144,6 +168,29 @@ struct ext2_inode {
 	uint32_t osd2[3];
 };
 
+/* The ext4 extent tree: a header followed by index or leaf entries.  */
+struct ext4_extent_header {
+	uint16_t magic;
+	uint16_t entries;
+	uint16_t max;
+	uint16_t depth;		/* 0 for a leaf */
+	uint32_t generation;
+};
+
+struct ext4_extent_idx {
+	uint32_t block;		/* first file block covered */
+	uint32_t leaf_lo;	/* next tree level */
+	uint16_t leaf_hi;
+	uint16_t unused;
+};
+
+struct ext4_extent {
+	uint32_t block;		/* first file block */
+	uint16_t len;
+	uint16_t start_hi;
+	uint32_t start_lo;	/* first disk block */
+};
+
 /* The header of an ext2 directory entry.  */
 struct ext2_dirent {
 	uint32_t inode;
@@ -179,6 +226,10 @@ uint32_t *indir2_block = NULL;
 int indir2_size = 0;
 int indir2_blkno = -1;
 static unsigned int inode_size;
+/* Last extent tree node read at each level below the inode.  */
+static char *ext4_ext_block = NULL;
+static int ext4_ext_size = 0;
+static int ext4_ext_blkno[EXT4_EXT_MAX_DEPTH];
 
 
 static int ext2fs_blockgroup
@@ -186,12 +237,19 @@ static int ext2fs_blockgroup
 	unsigned int blkno;
 	unsigned int blkoff;
 	unsigned int desc_per_blk;
+	unsigned int desc_size = sizeof(struct ext2_block_group);
+
+	/* ext4 with 64bit block numbers has larger descriptors.  */
+	if ((__le32_to_cpu(data->sblock.feature_incompat) &
+	     EXT4_FEATURE_INCOMPAT_64BIT) &&
+	    __le16_to_cpu(data->sblock.descriptor_size) > desc_size)
+		desc_size = __le16_to_cpu(data->sblock.descriptor_size);
 
-	desc_per_blk = EXT2_BLOCK_SIZE(data) / sizeof(struct ext2_block_group);
+	desc_per_blk = EXT2_BLOCK_SIZE(data) / desc_size;
 
 	blkno = __le32_to_cpu(data->sblock.first_data_block) + 1 +
 	group / desc_per_blk;
-	blkoff = (group % desc_per_blk) * sizeof(struct ext2_block_group);
+	blkoff = (group % desc_per_blk) * desc_size;
 #ifdef DEBUG
 	printf ("ext2fs read %d group descriptor (blkno %d blkoff %d)\n",
 		group, blkno, blkoff);
@@ -250,7 +308,148 @@ void ext2fs_free_node (ext2fs_node_t node, ext2fs_node_t currroot) {
 }
 
 
-static int ext2fs_read_block (ext2fs_node_t node, int fileblock) {
+/*
+ * Count how many entries of a block list, starting at idx, map to
+ * consecutive disk blocks (or are all holes).
+ */
+static int ext2fs_block_run (uint32_t *list, int idx, int n) {
+	uint32_t first = __le32_to_cpu (list[idx]);
+	uint32_t next;
+	int run = 1;
+
+	while (idx + run < n) {
+		next = __le32_to_cpu (list[idx + run]);
+		if (first ? next != first + run : next != 0)
+			break;
+		run++;
+	}
+	return (run);
+}
+
+
+/*
+ * Read the extent tree node at disk block blkno, which sits at the
+ * given level below the root kept in the inode.  The last node read
+ * at each level is kept, so walking a file in order reads each node
+ * once.
+ */
+static struct ext4_extent_header *ext4fs_read_ext_node
+	(struct ext2_data *data, int level, int blkno) {
+	int blksz = EXT2_BLOCK_SIZE (data);
+	int i;
+
+	if (ext4_ext_size != blksz) {
+		free (ext4_ext_block);
+		ext4_ext_block = (char *) malloc (blksz * EXT4_EXT_MAX_DEPTH);
+		if (ext4_ext_block == NULL) {
+			printf ("** ext4fs read extent node malloc failed. **\n");
+			ext4_ext_size = 0;
+			return (NULL);
+		}
+		ext4_ext_size = blksz;
+		for (i = 0; i < EXT4_EXT_MAX_DEPTH; i++)
+			ext4_ext_blkno[i] = -1;
+	}
+
+	if (ext4_ext_blkno[level] != blkno) {
+		if (ext2fs_devread (blkno << LOG2_EXT2_BLOCK_SIZE (data), 0,
+				    blksz, ext4_ext_block + level * blksz) == 0) {
+			printf ("** ext4fs read extent node failed. **\n");
+			ext4_ext_blkno[level] = -1;
+			return (NULL);
+		}
+		ext4_ext_blkno[level] = blkno;
+	}
+	return ((struct ext4_extent_header *) (ext4_ext_block + level * blksz));
+}
+
+
+/*
+ * ext2fs_read_block() for inodes mapped by an extent tree.  The whole
+ * rest of the extent is returned in one go through *run.
+ */
+static int ext4fs_read_extent (ext2fs_node_t node, int fileblock, int *run) {
+	struct ext4_extent_header *hdr;
+	struct ext4_extent_idx *idx;
+	struct ext4_extent *ext;
+	unsigned int start, len;
+	int entries, level, i;
+	int uninit = 0;
+
+	hdr = (struct ext4_extent_header *) node->inode.b.blocks.dir_blocks;
+	for (level = 0; ; level++) {
+		if (__le16_to_cpu (hdr->magic) != EXT4_EXT_MAGIC) {
+			printf ("** ext4fs bad extent header. **\n");
+			return (-1);
+		}
+		entries = __le16_to_cpu (hdr->entries);
+		if (hdr->depth == 0)
+			break;
+
+		if (entries == 0 || level == EXT4_EXT_MAX_DEPTH) {
+			printf ("** ext4fs bad extent index. **\n");
+			return (-1);
+		}
+		idx = (struct ext4_extent_idx *) (hdr + 1);
+		for (i = 0; i < entries - 1; i++)
+			if (__le32_to_cpu (idx[i + 1].block) > fileblock)
+				break;
+		if (idx[i].leaf_hi) {
+			printf ("** ext4fs block above 2^32. **\n");
+			return (-1);
+		}
+		hdr = ext4fs_read_ext_node (node->data, level,
+					    __le32_to_cpu (idx[i].leaf_lo));
+		if (hdr == NULL)
+			return (-1);
+	}
+
+	/* Find the last extent starting at or before fileblock.  */
+	ext = (struct ext4_extent *) (hdr + 1);
+	for (i = entries - 1; i >= 0; i--)
+		if (__le32_to_cpu (ext[i].block) <= fileblock)
+			break;
+
+	*run = 1;
+	if (i < 0) {
+		/* Hole before the first extent.  */
+		if (entries)
+			*run = __le32_to_cpu (ext[0].block) - fileblock;
+		return (0);
+	}
+
+	start = __le32_to_cpu (ext[i].block);
+	len = __le16_to_cpu (ext[i].len);
+	if (len > EXT4_EXT_INIT_MAX_LEN) {
+		len -= EXT4_EXT_INIT_MAX_LEN;
+		uninit = 1;
+	}
+
+	if (fileblock >= start + len) {
+		/* Hole after this extent.  */
+		if (i + 1 < entries)
+			*run = __le32_to_cpu (ext[i + 1].block) - fileblock;
+		return (0);
+	}
+
+	*run = start + len - fileblock;
+	if (uninit)
+		return (0);
+	if (ext[i].start_hi) {
+		printf ("** ext4fs block above 2^32. **\n");
+		return (-1);
+	}
+	return (__le32_to_cpu (ext[i].start_lo) + fileblock - start);
+}
+
+
+/*
+ * Map fileblock to a disk block (0 for a hole).  *run is set to the
+ * number of file blocks from fileblock on that follow on contiguously
+ * on disk, or are holes too, as far as can be told from the map block
+ * already at hand.
+ */
+static int ext2fs_read_block (ext2fs_node_t node, int fileblock, int *run) {
 	struct ext2_data *data = node->data;
 	struct ext2_inode *inode = &node->inode;
 	int blknr;
@@ -258,9 +457,14 @@ static int ext2fs_read_block (ext2fs_node_t node, int fileblock) {
 	int log2_blksz = LOG2_EXT2_BLOCK_SIZE (data);
 	int status;
 
+	if (__le32_to_cpu (inode->flags) & EXT4_EXTENTS_FL)
+		return (ext4fs_read_extent (node, fileblock, run));
+
 	/* Direct blocks.  */
 	if (fileblock < INDIRECT_BLOCKS) {
 		blknr = __le32_to_cpu (inode->b.blocks.dir_blocks[fileblock]);
+		*run = ext2fs_block_run (inode->b.blocks.dir_blocks,
+					 fileblock, INDIRECT_BLOCKS);
 	}
 	/* Indirect.  */
 	else if (fileblock < (INDIRECT_BLOCKS + (blksz / 4))) {
@@ -292,7 +496,7 @@ static int ext2fs_read_block (ext2fs_node_t node, int fileblock) {
 						 (char *) indir1_block);
 			if (status == 0) {
 				printf ("** ext2fs read block (indir 1) failed. **\n");
-				return (0);
+				return (-1);
 			}
 			indir1_blkno =
 				__le32_to_cpu (inode->b.blocks.
@@ -300,6 +504,8 @@ static int ext2fs_read_block (ext2fs_node_t node, int fileblock) {
 		}
 		blknr = __le32_to_cpu (indir1_block
 				       [fileblock - INDIRECT_BLOCKS]);
+		*run = ext2fs_block_run (indir1_block,
+					 fileblock - INDIRECT_BLOCKS, blksz / 4);
 	}
 	/* Double indirect.  */
 	else if (fileblock <
@@ -376,6 +582,8 @@ static int ext2fs_read_block (ext2fs_node_t node, int fileblock) {
 				__le32_to_cpu (indir1_block[rblock / perblock]) << log2_blksz;
 		}
 		blknr = __le32_to_cpu (indir2_block[rblock % perblock]);
+		*run = ext2fs_block_run (indir2_block, rblock % perblock,
+					 perblock);
 	}
 	/* Tripple indirect.  */
 	else {
@@ -396,55 +604,53 @@ int ext2fs_read_file
 	int log2blocksize = LOG2_EXT2_BLOCK_SIZE (node->data);
 	int blocksize = 1 << (log2blocksize + DISK_SECTOR_BITS);
 	unsigned int filesize = __le32_to_cpu(node->inode.size);
+	unsigned int end;
+	int run;
 
 	/* Adjust len so it we can't read past the end of the file.  */
 	if (len > filesize) {
 		len = filesize;
 	}
-	blockcnt = ((len + pos) + blocksize - 1) / blocksize;
-
-	for (i = pos / blocksize; i < blockcnt; i++) {
+	end = pos + len;
+	blockcnt = (end + blocksize - 1) / blocksize;
+
+	/*
+	 * Each pass handles a run of file blocks that are contiguous on
+	 * disk (or all holes), so large files go out as a few big reads.
+	 */
+	for (i = pos / blocksize; i < blockcnt; i += run) {
 		int blknr;
-		int blockoff = pos % blocksize;
-		int blockend = blocksize;
+		unsigned int first, last;
+		int skipfirst;
 
-		int skipfirst = 0;
-
-		blknr = ext2fs_read_block (node, i);
+		blknr = ext2fs_read_block (node, i, &run);
 		if (blknr < 0) {
 			return (-1);
 		}
 		blknr = blknr << log2blocksize;
-
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) % blocksize;
-
-			/* The last portion is exactly blocksize.  */
-			if (!blockend) {
-				blockend = blocksize;
-			}
+		if (run > blockcnt - i) {
+			run = blockcnt - i;
 		}
 
-		/* First block.  */
-		if (i == pos / blocksize) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
+		/* Byte range of the file covered by this run.  */
+		first = max((unsigned int)i * blocksize, (unsigned int)pos);
+		last = min((unsigned int)(i + run) * blocksize, end);
+		skipfirst = first - i * blocksize;
 
 		/* If the block number is 0 this block is not stored on disk but
 		   is zero filled instead.  */
 		if (blknr) {
 			int status;
 
-			status = ext2fs_devread (blknr, skipfirst, blockend, buf);
+			status = ext2fs_devread (blknr, skipfirst,
+						 last - first, buf);
 			if (status == 0) {
 				return (-1);
 			}
 		} else {
-			memset (buf, 0, blocksize - skipfirst);
+			memset (buf, 0, last - first);
 		}
-		buf += blocksize - skipfirst;
+		buf += last - first;
 	}
 	return (len);
 }
@@ -822,6 +1028,11 @@ int ext2fs_close (void
 		indir2_size = 0;
 		indir2_blkno = -1;
 	}
+	if (ext4_ext_block != NULL) {
+		free (ext4_ext_block);
+		ext4_ext_block = NULL;
+		ext4_ext_size = 0;
+	}
 	return (0);
 }
 
@@ -184,6 +184,8 @@ static __u32 get_fatent (fsdata *mydata, __u32 entry)
 	__u32 off16, offset;
 	__u32 ret = 0x00;
 	__u16 val1, val2;
+	__u8 *fatbuf;
+	int i, lru;
 
 	switch (mydata->fatsize) {
 	case 32:
@@ -207,10 +209,21 @@ static __u32 get_fatent (fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%04x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
+	/*
+	 * Look for the block of FAT entries in the cache, reading it over
+	 * the least recently used one if it is not there.  Several windows
+	 * let a fragmented chain hop about the FAT without rereading it.
+	 */
+	for (i = 0, lru = 0; i < FATBUFWINDOWS; i++) {
+		if (mydata->fatbufnum[i] == bufnum)
+			break;
+		if (mydata->fatbufused[i] < mydata->fatbufused[lru])
+			lru = i;
+	}
+
+	if (i == FATBUFWINDOWS) {
 		__u32 getsize = FATBUFSIZE / FS_BLOCK_SIZE;
-		__u8 *bufptr = mydata->fatbuf;
+		__u8 *bufptr = mydata->fatbuf[lru];
 		__u32 fatlength = mydata->fatlength;
 		__u32 startblock = bufnum * FATBUFBLOCKS;
 
@@ -221,43 +234,47 @@ static __u32 get_fatent (fsdata *mydata, __u32 entry)
 			getsize = fatlength;
 		if (disk_read(startblock, getsize, bufptr) < 0) {
 			debug("Error reading FAT blocks\n");
+			mydata->fatbufnum[lru] = -1;
 			return ret;
 		}
-		mydata->fatbufnum = bufnum;
+		mydata->fatbufnum[lru] = bufnum;
+		i = lru;
 	}
+	mydata->fatbufused[i] = ++mydata->fatbuftick;
+	fatbuf = mydata->fatbuf[i];
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *) fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *) fatbuf)[offset]);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
 
 		switch (offset & 0x3) {
 		case 0:
-			ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *) fatbuf)[off16]);
 			ret &= 0xfff;
 			break;
 		case 1:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xf000;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x00ff;
 			ret = (val2 << 4) | (val1 >> 12);
 			break;
 		case 2:
-			val1 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			val1 = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			val1 &= 0xff00;
-			val2 = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16 + 1]);
+			val2 = FAT2CPU16(((__u16 *)fatbuf)[off16 + 1]);
 			val2 &= 0x000f;
 			ret = (val2 << 8) | (val1 >> 8);
 			break;
 		case 3:
-			ret = FAT2CPU16(((__u16 *)mydata->fatbuf)[off16]);
+			ret = FAT2CPU16(((__u16 *)fatbuf)[off16]);
 			ret = (ret & 0xfff0) >> 4;
 			break;
 		default:
@@ -315,6 +332,9 @@ get_cluster (fsdata *mydata, __u32 clustnum, __u8 *buffer,
 /*
  * Read at most 'maxsize' bytes from the file associated with 'dentptr'
  * into 'buffer'.
+ * The cluster chain is first resolved into runs of consecutive clusters,
+ * up to CONFIG_FAT_MAX_RUNS at a time, and each run is then read with a
+ * single disk_read(), so FAT lookups and data reads are not interleaved.
  * Return the number of bytes read or -1 on fatal errors.
  */
 static long
@@ -324,8 +344,13 @@ get_contents (fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 	unsigned long filesize = FAT2CPU32(dentptr->size), gotsize = 0;
 	unsigned int bytesperclust = mydata->clust_size * SECTOR_SIZE;
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
-	unsigned long actsize;
+	__u32 newclust;
+	unsigned long actsize, mapped;
+	struct {
+		__u32 start;
+		__u32 count;
+	} runs[CONFIG_FAT_MAX_RUNS];
+	int nruns, i, bad = 0;
 
 	debug("Filesize: %ld bytes\n", filesize);
 
@@ -334,62 +359,56 @@ get_contents (fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 
 	debug("%ld bytes\n", filesize);
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
+	while (gotsize < filesize && !bad) {
+		/* Map the next part of the cluster chain into runs */
+		runs[0].start = curclust;
+		runs[0].count = 0;
+		nruns = 1;
+		mapped = gotsize;
+		for (;;) {
+			runs[nruns - 1].count++;
+			mapped += bytesperclust;
+			if (mapped >= filesize)
+				break;
+
+			newclust = get_fatent(mydata, curclust);
 			if (CHECK_CLUST(newclust, mydata->fatsize)) {
 				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return gotsize;
+				printf("Invalid FAT entry\n");
+				bad = 1;
+				break;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* actsize >= file size */
-		actsize -= bytesperclust;
-
-		/* get remaining clusters */
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
+			curclust = newclust;
+			if (newclust == runs[nruns - 1].start +
+					runs[nruns - 1].count)
+				continue;
+			if (nruns == CONFIG_FAT_MAX_RUNS)
+				break;
+			runs[nruns].start = newclust;
+			runs[nruns].count = 0;
+			nruns++;
 		}
 
-		/* get remaining bytes */
-		gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-		actsize = filesize;
-		if (get_cluster(mydata, endclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		gotsize += actsize;
-		return gotsize;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
+		/* Read them, the last one possibly only in part */
+		for (i = 0; i < nruns; i++) {
+			actsize = runs[i].count * bytesperclust;
+			if (actsize > filesize - gotsize)
+				actsize = filesize - gotsize;
+
+			debug("run %d: clusters %u-%u, %lu bytes\n", i,
+			      runs[i].start, runs[i].start + runs[i].count - 1,
+			      actsize);
+			if (get_cluster(mydata, runs[i].start, buffer,
+					actsize) != 0) {
+				printf("Error reading cluster\n");
+				return -1;
+			}
+			gotsize += actsize;
+			buffer += actsize;
 		}
-		gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
+	}
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return gotsize;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return gotsize;
 }
 
 #ifdef CONFIG_SUPPORT_VFAT
@@ -808,7 +827,11 @@ do_fat_read (const char *filename, void *buffer, unsigned long maxsize,
 					(mydata->clust_size * 2);
 	}
 
-	mydata->fatbufnum = -1;
+	for (j = 0; j < FATBUFWINDOWS; j++) {
+		mydata->fatbufnum[j] = -1;
+		mydata->fatbufused[j] = 0;
+	}
+	mydata->fatbuftick = 0;
 
 #ifdef CONFIG_SUPPORT_VFAT
 	debug("VFAT Support enabled\n");
@@ -93,9 +93,10 @@
  *   if there are multiple copies of fragments for a certain file offset.
  *
  * The fragment sorting feature must be enabled by CONFIG_SYS_JFFS2_SORT_FRAGMENTS.
- * Sorting is done while adding fragments to the lists, which is more or less a
- * bubble sort. This takes a lot of time, and is most probably not an issue if
- * the boot filesystem is always mounted readonly.
+ * Sorting is done while adding fragments to the lists. Nodes are hashed by
+ * inode number (parent inode for dirents), so each insertion only has to be
+ * compared against the nodes of the same inode. This is most probably not an
+ * issue if the boot filesystem is always mounted readonly.
  *
  * You should define it if the boot filesystem is mounted writable, and updates
  * to the boot files are done by copying files to that filesystem.
@@ -167,45 +168,92 @@ static struct part_info *current_part;
 #endif
 #define NAND_CACHE_SIZE (NAND_CACHE_PAGES*NAND_PAGE_SIZE)
 
-static u8* nand_cache = NULL;
-static u32 nand_cache_off = (u32)-1;
+/*
+ * Number of independent cache windows.  The scan reads summaries at the
+ * end of each erase block while sorting and loading jump back to nodes
+ * seen earlier, so a single window keeps getting thrown away.
+ */
+#ifndef NAND_CACHE_WINDOWS
+#define NAND_CACHE_WINDOWS 4
+#endif
 
-static int read_nand_cached(u32 off, u32 size, u_char *buf)
+static struct nand_cache_window {
+	u8 *buf;
+	u32 off;
+	u32 stamp;		/* last use, 0 if the window holds no data */
+} nand_cache[NAND_CACHE_WINDOWS];
+static u32 nand_cache_clock;
+
+static void nand_cache_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < NAND_CACHE_WINDOWS; i++)
+		nand_cache[i].stamp = 0;
+}
+
+static struct nand_cache_window *nand_cache_fill(u32 off)
 {
 	struct mtdids *id = current_part->dev->id;
-	u32 bytes_read = 0;
+	struct nand_cache_window *w = &nand_cache[0];
 	size_t retlen;
+	int i;
+
+	/* reuse the least recently used window */
+	for (i = 1; i < NAND_CACHE_WINDOWS; i++)
+		if (nand_cache[i].stamp < w->stamp)
+			w = &nand_cache[i];
+
+	if (!w->buf) {
+		/* This memory never gets freed but 'cause
+		   it's a bootloader, nobody cares */
+		w->buf = malloc(NAND_CACHE_SIZE);
+		if (!w->buf) {
+			printf("read_nand_cached: can't alloc cache size %d bytes\n",
+			       NAND_CACHE_SIZE);
+			return NULL;
+		}
+	}
+
+	w->off = off & NAND_PAGE_MASK;
+	w->stamp = 0;
+	retlen = NAND_CACHE_SIZE;
+	if (nand_read(&nand_info[id->num], w->off,
+				&retlen, w->buf) != 0 ||
+			retlen != NAND_CACHE_SIZE) {
+		printf("read_nand_cached: error reading nand off %#x size %d bytes\n",
+				w->off, NAND_CACHE_SIZE);
+		return NULL;
+	}
+	return w;
+}
+
+static int read_nand_cached(u32 off, u32 size, u_char *buf)
+{
+	struct nand_cache_window *w;
+	u32 bytes_read = 0;
 	int cpy_bytes;
+	int i;
 
 	while (bytes_read < size) {
-		if ((off + bytes_read < nand_cache_off) ||
-		    (off + bytes_read >= nand_cache_off+NAND_CACHE_SIZE)) {
-			nand_cache_off = (off + bytes_read) & NAND_PAGE_MASK;
-			if (!nand_cache) {
-				/* This memory never gets freed but 'cause
-				   it's a bootloader, nobody cares */
-				nand_cache = malloc(NAND_CACHE_SIZE);
-				if (!nand_cache) {
-					printf("read_nand_cached: can't alloc cache size %d bytes\n",
-					       NAND_CACHE_SIZE);
-					return -1;
-				}
-			}
-
-			retlen = NAND_CACHE_SIZE;
-			if (nand_read(&nand_info[id->num], nand_cache_off,
-						&retlen, nand_cache) != 0 ||
-					retlen != NAND_CACHE_SIZE) {
-				printf("read_nand_cached: error reading nand off %#x size %d bytes\n",
-						nand_cache_off, NAND_CACHE_SIZE);
-				return -1;
+		w = NULL;
+		for (i = 0; i < NAND_CACHE_WINDOWS; i++) {
+			if (nand_cache[i].stamp &&
+			    off + bytes_read >= nand_cache[i].off &&
+			    off + bytes_read < nand_cache[i].off + NAND_CACHE_SIZE) {
+				w = &nand_cache[i];
+				break;
 			}
 		}
-		cpy_bytes = nand_cache_off + NAND_CACHE_SIZE - (off + bytes_read);
+		if (!w && !(w = nand_cache_fill(off + bytes_read)))
+			return -1;
+		w->stamp = ++nand_cache_clock;
+
+		cpy_bytes = w->off + NAND_CACHE_SIZE - (off + bytes_read);
 		if (cpy_bytes > size - bytes_read)
 			cpy_bytes = size - bytes_read;
 		memcpy(buf + bytes_read,
-		       nand_cache + off + bytes_read - nand_cache_off,
+		       w->buf + off + bytes_read - w->off,
 		       cpy_bytes);
 		bytes_read += cpy_bytes;
 	}
@@ -540,57 +588,78 @@ add_node(struct b_list *list)
 	return b;
 }
 
+/*
+ * Add a node to a list.  The list itself is kept in scan order and is only
+ * walked as a whole; lookups by inode go through the hash buckets, where
+ * nodes sharing a key are kept in the order the readers expect.
+ */
 static struct b_node *
-insert_node(struct b_list *list, u32 offset)
+insert_node(struct b_list *list, u32 offset, u32 key)
 {
-	struct b_node *new;
-#ifdef CONFIG_SYS_JFFS2_SORT_FRAGMENTS
-	struct b_node *b, *prev;
-#endif
+	struct b_node *new, *b, *prev;
+	struct b_hash *h;
 
 	if (!(new = add_node(list))) {
 		putstr("add_node failed!\r\n");
 		return NULL;
 	}
 	new->offset = offset;
+	new->key = key;
+	new->datacrc = CRC_UNKNOWN;
+
+	new->next = (struct b_node *) NULL;
+	if (list->listTail != NULL) {
+		list->listTail->next = new;
+		list->listTail = new;
+	} else {
+		list->listTail = list->listHead = new;
+	}
 
+	h = &list->listHash[key % JFFS2_HASH_SIZE];
+	b = NULL;
+	prev = h->tail;
 #ifdef CONFIG_SYS_JFFS2_SORT_FRAGMENTS
-	if (list->listTail != NULL && list->listCompare(new, list->listTail))
-		prev = list->listTail;
-	else if (list->listLast != NULL && list->listCompare(new, list->listLast))
-		prev = list->listLast;
-	else
-		prev = NULL;
-
-	for (b = (prev ? prev->next : list->listHead);
-	     b != NULL && list->listCompare(new, b);
-	     prev = b, b = b->next) {
-		list->listLoops++;
-	}
-	if (b != NULL)
-		list->listLast = prev;
-
-	if (b != NULL) {
-		new->next = b;
-		if (prev != NULL)
-			prev->next = new;
-		else
-			list->listHead = new;
-	} else
-#endif
-	{
-		new->next = (struct b_node *) NULL;
-		if (list->listTail != NULL) {
-			list->listTail->next = new;
-			list->listTail = new;
-		} else {
-			list->listTail = list->listHead = new;
+	/* versions mostly ascend in scan order, so try appending first */
+	if (prev != NULL && (prev->key != key || !list->listCompare(new, prev))) {
+		for (prev = NULL, b = h->head;
+		     b != NULL && (b->key != key || list->listCompare(new, b));
+		     prev = b, b = b->hnext) {
+			list->listLoops++;
 		}
 	}
+#endif
+	new->hnext = b;
+	if (prev != NULL)
+		prev->hnext = new;
+	else
+		h->head = new;
+	if (b == NULL)
+		h->tail = new;
 
 	return new;
 }
 
+/* Walk the nodes of a list carrying the given key */
+static struct b_node *
+first_node(struct b_list *list, u32 key)
+{
+	struct b_node *b = list->listHash[key % JFFS2_HASH_SIZE].head;
+
+	while (b != NULL && b->key != key)
+		b = b->hnext;
+	return b;
+}
+
+static struct b_node *
+next_node(struct b_node *b)
+{
+	u32 key = b->key;
+
+	for (b = b->hnext; b != NULL && b->key != key; b = b->hnext)
+		;
+	return b;
+}
+
 #ifdef CONFIG_SYS_JFFS2_SORT_FRAGMENTS
 /* Sort data entries with the latest version last, so that if there
  * is overlapping data the latest version will be used.
@@ -707,7 +776,7 @@ jffs2_1pass_read_inode(struct b_lists *pL, u32 inode, char *dest)
 	 * This shouldn't cause trouble when loading kernel images, so
 	 * we will live with it.
 	 */
-	for (b = pL->frag.listHead; b != NULL; b = b->next) {
+	for (b = first_node(&pL->frag, inode); b != NULL; b = next_node(b)) {
 		jNode = (struct jffs2_raw_inode *) get_fl_mem(b->offset,
 			sizeof(struct jffs2_raw_inode), pL->readbuf);
 		if ((inode == jNode->ino)) {
@@ -721,7 +790,7 @@ jffs2_1pass_read_inode(struct b_lists *pL, u32 inode, char *dest)
 	}
 #endif
 
-	for (b = pL->frag.listHead; b != NULL; b = b->next) {
+	for (b = first_node(&pL->frag, inode); b != NULL; b = next_node(b)) {
 		jNode = (struct jffs2_raw_inode *) get_node_mem(b->offset,
 								pL->readbuf);
 		if ((inode == jNode->ino)) {
@@ -832,7 +901,7 @@ jffs2_1pass_find_inode(struct b_lists * pL, const char *name, u32 pino)
 
 	counter = 0;
 	/* we need to search all and return the inode with the highest version */
-	for(b = pL->dir.listHead; b; b = b->next, counter++) {
+	for (b = first_node(&pL->dir, pino); b; b = next_node(b), counter++) {
 		jDir = (struct jffs2_raw_dirent *) get_node_mem(b->offset,
 								pL->readbuf);
 		if ((pino == jDir->pino) && (len == jDir->nsize) &&
@@ -954,14 +1023,14 @@ jffs2_1pass_list_inodes(struct b_lists * pL, u32 pino)
 	struct b_node *b;
 	struct jffs2_raw_dirent *jDir;
 
-	for (b = pL->dir.listHead; b; b = b->next) {
+	for (b = first_node(&pL->dir, pino); b; b = next_node(b)) {
 		jDir = (struct jffs2_raw_dirent *) get_node_mem(b->offset,
 								pL->readbuf);
 		if ((pino == jDir->pino) && (jDir->ino)) { /* ino=0 -> unlink */
 			u32 i_version = 0;
 			struct jffs2_raw_inode ojNode;
 			struct jffs2_raw_inode *jNode, *i = NULL;
-			struct b_node *b2 = pL->frag.listHead;
+			struct b_node *b2 = first_node(&pL->frag, jDir->ino);
 
 			while (b2) {
 				jNode = (struct jffs2_raw_inode *)
@@ -979,7 +1048,7 @@ jffs2_1pass_list_inodes(struct b_lists * pL, u32 pino)
 							       sizeof(*i),
 							       NULL);
 				}
-				b2 = b2->next;
+				b2 = next_node(b2);
 			}
 
 			dump_inode(pL, jDir, i);
@@ -1091,7 +1160,7 @@ jffs2_1pass_resolve_inode(struct b_lists * pL, u32 ino)
 		return jDirFoundIno;
 
 	/* it's a soft link so we follow it again. */
-	b2 = pL->frag.listHead;
+	b2 = first_node(&pL->frag, jDirFoundIno);
 	while (b2) {
 		jNode = (struct jffs2_raw_inode *) get_node_mem(b2->offset,
 								pL->readbuf);
@@ -1109,7 +1178,7 @@ jffs2_1pass_resolve_inode(struct b_lists * pL, u32 ino)
 			put_fl_mem(jNode, pL->readbuf);
 			break;
 		}
-		b2 = b2->next;
+		b2 = next_node(b2);
 		put_fl_mem(jNode, pL->readbuf);
 	}
 	/* ok so the name of the new file to find is in tmp */
@@ -1256,7 +1325,9 @@ static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 							(u32)part->offset +
 							offset +
 							sum_get_unaligned32(
-								&spi->offset));
+								&spi->offset),
+							sum_get_unaligned32(
+								&spi->inode));
 						if (ret == NULL)
 							return -1;
 					}
@@ -1273,7 +1344,9 @@ static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 							(u32) part->offset +
 							offset +
 							sum_get_unaligned32(
-								&spd->offset));
+								&spd->offset),
+							sum_get_unaligned32(
+								&spd->pino));
 						if (ret == NULL)
 							return -1;
 					}
@@ -1640,7 +1713,8 @@ jffs2_1pass_build_lists(struct part_info * part)
 				       break;
 
 				if (insert_node(&pL->frag, (u32) part->offset +
-						ofs) == NULL) {
+						ofs, ((struct jffs2_raw_inode *)
+							node)->ino) == NULL) {
 					free(buf);
 					jffs2_free_cache(part);
 					return 0;
@@ -1670,7 +1744,8 @@ jffs2_1pass_build_lists(struct part_info * part)
 				if (! (counterN%100))
 					puts ("\b\b.  ");
 				if (insert_node(&pL->dir, (u32) part->offset +
-						ofs) == NULL) {
+						ofs, ((struct jffs2_raw_dirent *)
+							node)->pino) == NULL) {
 					free(buf);
 					jffs2_free_cache(part);
 					return 0;
@@ -1774,6 +1849,11 @@ jffs2_get_list(struct part_info * part, const char *who)
 	/* copy requested part_info struct pointer to global location */
 	current_part = part;
 
+#if defined(CONFIG_JFFS2_NAND) && defined(CONFIG_CMD_NAND)
+	/* the flash may have been rewritten since the last command */
+	nand_cache_invalidate();
+#endif
+
 	if (jffs2_1pass_rescan_needed(part)) {
 		if (!jffs2_1pass_build_lists(part)) {
 			printf("%s: Failed to scan JFFSv2 file structure\n", who);
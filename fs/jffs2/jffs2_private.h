@@ -4,22 +4,34 @@
 #include <jffs2/jffs2.h>
 
 
+/* number of hash buckets used to index each b_list by inode number */
+#ifndef JFFS2_HASH_SIZE
+#define JFFS2_HASH_SIZE	256
+#endif
+
 struct b_node {
 	u32 offset;
+	u32 key;		/* ino for fragments, pino for dirents */
 	struct b_node *next;
+	struct b_node *hnext;	/* next node in the same hash bucket */
 	enum { CRC_UNKNOWN = 0, CRC_OK, CRC_BAD } datacrc;
 };
 
+struct b_hash {
+	struct b_node *head;
+	struct b_node *tail;
+};
+
 struct b_list {
 	struct b_node *listTail;
 	struct b_node *listHead;
 #ifdef CONFIG_SYS_JFFS2_SORT_FRAGMENTS
-	struct b_node *listLast;
 	int (*listCompare)(struct b_node *new, struct b_node *node);
 	u32 listLoops;
 #endif
 	u32 listCount;
 	struct mem_block *listMemBase;
+	struct b_hash listHash[JFFS2_HASH_SIZE];
 };
 
 struct b_lists {
@@ -676,6 +676,78 @@ error:
 	return err;
 }
 
+/*
+ * Read up to @count whole blocks starting at @block straight into @addr,
+ * using one UBI read for all the data nodes which sit next to each other in
+ * the same LEB. Returns the number of blocks filled in, holes included, or a
+ * negative error code.
+ */
+static int read_blocks_bulk(struct ubifs_info *c, struct inode *inode,
+			    struct bu_info *bu, void *addr,
+			    unsigned int block, unsigned int count)
+{
+	int err, i, len, dlen, out_len;
+	unsigned int next = block, n;
+	struct ubifs_data_node *dn;
+	void *buf;
+
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+
+	if (bu->cnt) {
+		err = ubifs_tnc_bulk_read(c, bu);
+		if (err)
+			return err;
+	}
+
+	buf = bu->buf;
+	for (i = 0; i < bu->cnt; i++) {
+		n = key_block(c, &bu->zbranch[i].key);
+		if (n >= block + count)
+			break;
+
+		/* Blocks without a data node are holes */
+		memset(addr + (next - block) * UBIFS_BLOCK_SIZE, 0,
+		       (n - next) * UBIFS_BLOCK_SIZE);
+
+		dn = buf;
+		len = le32_to_cpu(dn->size);
+		if (len <= 0 || len > UBIFS_BLOCK_SIZE)
+			goto dump;
+
+		dlen = le32_to_cpu(dn->ch.len) - UBIFS_DATA_NODE_SZ;
+		out_len = UBIFS_BLOCK_SIZE;
+		err = ubifs_decompress(&dn->data, dlen,
+				       addr + (n - block) * UBIFS_BLOCK_SIZE,
+				       &out_len, le16_to_cpu(dn->compr_type));
+		if (err || len != out_len)
+			goto dump;
+
+		if (len < UBIFS_BLOCK_SIZE)
+			memset(addr + (n - block) * UBIFS_BLOCK_SIZE + len, 0,
+			       UBIFS_BLOCK_SIZE - len);
+
+		next = n + 1;
+		buf += ALIGN(bu->zbranch[i].len, 8);
+	}
+
+	if (bu->eof && i == bu->cnt) {
+		/* No more data nodes, the rest of the file is a hole */
+		memset(addr + (next - block) * UBIFS_BLOCK_SIZE, 0,
+		       (block + count - next) * UBIFS_BLOCK_SIZE);
+		next = block + count;
+	}
+
+	return next - block;
+
+dump:
+	ubifs_err("bad data node (block %u, inode %lu)", n, inode->i_ino);
+	dbg_dump_node(c, dn);
+	return -EINVAL;
+}
+
 int ubifs_load(char *filename, u32 addr, u32 size)
 {
 	struct ubifs_info *c = ubifs_sb->s_fs_info;
@@ -687,6 +759,7 @@ int ubifs_load(char *filename, u32 addr, u32 size)
 	int count;
 	int last_block_size = 0;
 	char buf [10];
+	struct bu_info *bu = &c->bu;
 
 	c->ubi = ubi_open_volume(c->vi.ubi_num, c->vi.vol_id, UBI_READONLY);
 	/* ubifs_findfile will resolve symlinks, so we know that we get
@@ -721,7 +794,39 @@ int ubifs_load(char *filename, u32 addr, u32 size)
 	page.addr = (void *)addr;
 	page.index = 0;
 	page.inode = inode;
-	for (i = 0; i < count; i++) {
+
+	/*
+	 * Whole blocks are bulk-read where possible, the partial last block and
+	 * blocks which cannot be bulk-read go through do_readpage().
+	 */
+	bu->buf_len = c->max_bu_buf_len;
+	bu->buf = malloc(bu->buf_len);
+	i = 0;
+	while (bu->buf && i < (size >> UBIFS_BLOCK_SHIFT)) {
+		int ret;
+
+		ret = read_blocks_bulk(c, inode, bu, page.addr, i,
+				       (size >> UBIFS_BLOCK_SHIFT) - i);
+		if (ret < 0) {
+			err = ret;
+			break;
+		}
+
+		if (ret == 0) {
+			err = do_readpage(c, inode, &page, 0);
+			if (err)
+				break;
+			ret = 1;
+		}
+
+		i += ret;
+		page.addr += ret * PAGE_SIZE;
+		page.index += ret;
+	}
+	free(bu->buf);
+	bu->buf = NULL;
+
+	for (; !err && i < count; i++) {
 		/*
 		 * Make sure to not read beyond the requested size
 		 */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#ifndef _BLKCACHE_H
+#define _BLKCACHE_H
+
+#include <part.h>
+
+struct blkcache_stats {
+	ulong hits;		/* lookups satisfied from the cache */
+	ulong misses;		/* lookups that went to the device */
+	ulong fills;		/* device reads made to fill an entry */
+	ulong bypass;		/* large reads passed straight through */
+	ulong invalidates;	/* entries dropped by writes and erases */
+};
+
+#ifdef CONFIG_BLOCK_CACHE
+/*
+ * Route dev_desc's block_read/write/erase through the cache.  Safe to
+ * call again for the same device (e.g. after a rescan); any blocks
+ * cached for it are dropped.
+ */
+void blkcache_attach(block_dev_desc_t *dev_desc);
+
+/* Drop cached blocks for dev_desc, or for every device if NULL */
+void blkcache_invalidate(block_dev_desc_t *dev_desc);
+
+void blkcache_get_stats(struct blkcache_stats *stats);
+void blkcache_reset_stats(void);
+void blkcache_print(void);
+#else
+static inline void blkcache_attach(block_dev_desc_t *dev_desc) {}
+static inline void blkcache_invalidate(block_dev_desc_t *dev_desc) {}
+#endif
+
+#endif /* _BLKCACHE_H */
@@ -657,6 +657,8 @@ int	init_timebase (void);
 
 /* lib/gunzip.c */
 int gunzip(void *, int, unsigned char *, unsigned long *);
+int gunzip_crc(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
+						uint32_t *crc);
 int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 						int stoponerr, int offset);
 
@@ -123,12 +123,15 @@
 #define CONFIG_MIN_PARTITION_NUM	1
 #define CONFIG_MMC_DEV			0
 #define CONFIG_OMAP_MMC_USE_DMA_WRITES
+#define CONFIG_OMAP_MMC_USE_DMA_READS
+#define CONFIG_OMAP_MMC_DDR
 
 /* USB */
 #define CONFIG_MUSB_UDC			1
 #define CONFIG_USB_OMAP3		1
 #define CONFIG_MUSB_RXFIFO_DOUBLE	1
 #define CONFIG_MUSB_DMA_MODE1		1
+#define CONFIG_MUSB_DMA_TX		1
 
 /* Disable some non-essential dpll and clock setup because it
  * increases power consumption and heat significantly.  We'll let
@@ -171,6 +174,12 @@
  * since they overlap).
  */
 #define CONFIG_FASTBOOT_RAMCONSOLE_START (OMAP44XX_DRAM_ADDR_SPACE_START + SZ_512M)
+/* Check the boot image SHA1 id while booti loads it */
+#define CONFIG_SHA1
+/* partition_hash_*() and "fastboot oem hash" */
+#define CONFIG_HASH
+#define CONFIG_CRC32_SLICE_BY_8
+#define CONFIG_FASTBOOT_BOOTI_VERIFY
 
 /* device to use */
 #define FASTBOOT_BLKDEV                 "mmc0"
@@ -184,6 +193,9 @@
 #define CONFIG_USBD_MANUFACTURER	"Google"
 #define CONFIG_USBD_PRODUCT_NAME	"Tungsten"
 
+/* "ums mmc 0" exports the eMMC for flashing from a host */
+#define CONFIG_CMD_UMS
+
 /* Flash */
 #define CONFIG_SYS_NO_FLASH	1
 
@@ -53,6 +53,17 @@
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+/* Number of FATBUFSIZE windows of the FAT cached by get_fatent() */
+#ifndef CONFIG_FAT_CACHE_WINDOWS
+#define CONFIG_FAT_CACHE_WINDOWS	4
+#endif
+#define FATBUFWINDOWS	CONFIG_FAT_CACHE_WINDOWS
+
+/* Cluster runs get_contents() resolves from the FAT before reading */
+#ifndef CONFIG_FAT_MAX_RUNS
+#define CONFIG_FAT_MAX_RUNS	32
+#endif
+
 
 /* Filesystem identifiers */
 #define FAT12_SIGN	"FAT12   "
@@ -181,14 +192,16 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	fatbuf[FATBUFSIZE]; /* Current FAT buffer */
+	__u8	fatbuf[FATBUFWINDOWS][FATBUFSIZE]; /* Cached FAT windows */
 	int	fatsize;	/* Size of FAT in bits */
 	__u16	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
 	__u16	rootdir_sect;	/* Start sector of root directory */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	short	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	int	fatbufnum[FATBUFWINDOWS]; /* Used by get_fatent, init to -1 */
+	__u32	fatbufused[FATBUFWINDOWS]; /* fatbuftick at last use */
+	__u32	fatbuftick;
 } fsdata;
 
 typedef int	(file_detectfs_func)(void);
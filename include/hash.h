@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#ifdef CONFIG_MD5
+#include <u-boot/md5.h>
+#endif
+#ifdef CONFIG_SHA1
+#include <sha1.h>
+#endif
+#ifdef CONFIG_SHA256
+#include <sha256.h>
+#endif
+
+/* Largest digest of any algorithm below, in bytes */
+#define HASH_MAX_DIGEST_SIZE	32
+
+/* Bytes hashed between watchdog resets by hash_block_wd() and friends */
+#ifndef CONFIG_HASH_CHUNK_SIZE
+#define CONFIG_HASH_CHUNK_SIZE	(64 * 1024)
+#endif
+
+struct hash_algo;
+
+/*
+ * Streaming digest state.  Set up with hash_init(), feed with
+ * hash_update() as often as needed, then read out with hash_final().
+ */
+struct hash_ctx {
+	const struct hash_algo *algo;
+	union {
+#ifdef CONFIG_MD5
+		struct MD5Context md5;
+#endif
+#ifdef CONFIG_SHA1
+		sha1_context sha1;
+#endif
+#ifdef CONFIG_SHA256
+		sha256_context sha256;
+#endif
+		uint32_t crc32;
+		void *priv;		/* for hash_engine_find() engines */
+	} u;
+};
+
+struct hash_algo {
+	const char *name;	/* "crc32", "md5", "sha1", "sha256" */
+	int digest_size;	/* in bytes */
+	void (*init)(struct hash_ctx *ctx);
+	void (*update)(struct hash_ctx *ctx, const void *buf,
+		       unsigned int len);
+	void (*final)(struct hash_ctx *ctx, unsigned char *digest);
+};
+
+#ifdef CONFIG_HASH
+/*
+ * Look up an algorithm by name; NULL if it is not built in.  An
+ * algorithm offered by hash_engine_find() is preferred over the
+ * software one of the same name.
+ */
+const struct hash_algo *hash_find_algo(const char *name);
+
+/*
+ * Hook for hash accelerators.  The default returns NULL for everything;
+ * a driver that can do some algorithm faster overrides it and returns
+ * its own hash_algo, which may keep its state behind ctx->u.priv.
+ */
+const struct hash_algo *hash_engine_find(const char *name);
+
+/* Returns 0, or -EINVAL if algo_name is not built in */
+int hash_init(struct hash_ctx *ctx, const char *algo_name);
+void hash_update(struct hash_ctx *ctx, const void *buf, unsigned int len);
+/* Writes hash_digest_size(ctx) bytes to digest */
+void hash_final(struct hash_ctx *ctx, unsigned char *digest);
+
+static inline int hash_digest_size(const struct hash_ctx *ctx)
+{
+	return ctx->algo->digest_size;
+}
+
+/*
+ * Feed len bytes of buf to each of the n contexts in ctxs, chunk_sz
+ * bytes at a time, resetting the watchdog after every chunk.  Each
+ * chunk goes through all the contexts while it is still in the cache,
+ * so several digests of the same data cost a single pass over memory.
+ */
+void hash_update_wd(struct hash_ctx *ctxs, int n, const void *buf,
+		    unsigned int len, unsigned int chunk_sz);
+
+/*
+ * One-shot digest of a buffer, resetting the watchdog every chunk_sz
+ * bytes.  Returns the digest size, or -EINVAL if algo_name is not
+ * built in.
+ */
+int hash_block_wd(const char *algo_name, const void *buf, unsigned int len,
+		  unsigned char *digest, unsigned int chunk_sz);
+
+/* Print a digest as lower case hex into str (2 * len + 1 bytes) */
+void hash_to_str(const unsigned char *digest, int len, char *str);
+#endif /* CONFIG_HASH */
+
+#endif /* _HASH_H */
@@ -56,6 +56,7 @@
 #include <fdt_support.h>
 #define CONFIG_MD5		/* FIT images need MD5 support */
 #define CONFIG_SHA1		/* and SHA1 */
+#define CONFIG_HASH		/* through the hash layer */
 #endif
 
 /*
@@ -247,6 +248,8 @@ typedef struct bootm_headers {
 #endif
 
 	int		verify;		/* getenv("verify")[0] != 'n' */
+	int		dcrc_deferred;	/* legacy data CRC is checked while
+					 * the kernel is copied/uncompressed */
 
 #define	BOOTM_STATE_START	(0x00000001)
 #define	BOOTM_STATE_LOADOS	(0x00000002)
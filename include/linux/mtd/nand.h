@@ -94,6 +94,9 @@ extern void nand_wait_ready(struct mtd_info *mtd);
 #define NAND_CMD_READSTART	0x30
 #define NAND_CMD_RNDOUTSTART	0xE0
 #define NAND_CMD_CACHEDPROG	0x15
+#define NAND_CMD_READCACHESEQ	0x31
+#define NAND_CMD_READCACHEEND	0x3f
+#define NAND_CMD_MULTIPROG	0x11
 
 /* Extended commands for AG-AND device */
 /*
@@ -177,6 +180,10 @@ typedef enum {
 #define NAND_NO_READRDY		0x00000100
 /* Chip does not allow subpage writes */
 #define NAND_NO_SUBPAGE_WRITE	0x00000200
+/* Chip has read cache (sequential) function */
+#define NAND_CACHERD		0x00000400
+/* Chip can program a page in each of two planes at once */
+#define NAND_2PLANEPRG		0x00000800
 
 
 /* Options valid for Samsung large page devices */
@@ -188,6 +195,8 @@ typedef enum {
 #define NAND_MUST_PAD(chip) (!(chip->options & NAND_NO_PADDING))
 #define NAND_HAS_CACHEPROG(chip) ((chip->options & NAND_CACHEPRG))
 #define NAND_HAS_COPYBACK(chip) ((chip->options & NAND_COPYBACK))
+#define NAND_HAS_CACHEREAD(chip) ((chip->options & NAND_CACHERD))
+#define NAND_HAS_2PLANEPROG(chip) ((chip->options & NAND_2PLANEPRG))
 /* Large page NAND with SOFT_ECC should support subpage reads */
 #define NAND_SUBPAGE_READ(chip) ((chip->ecc.mode == NAND_ECC_SOFT) \
 					&& (chip->page_shift > 9))
@@ -281,6 +290,11 @@ struct nand_onfi_params {
 
 #define ONFI_CRC_BASE	0x4F4E
 
+/* ONFI features and optional commands */
+#define ONFI_FEATURE_MULTI_PLANE	(1 << 3)
+#define ONFI_OPT_CMD_CACHE_PROG		(1 << 0)
+#define ONFI_OPT_CMD_CACHE_READ		(1 << 1)
+
 
 /**
  * struct nand_hw_control - Control structure for hardware controller (e.g ECC generator) shared among independent devices
@@ -46,6 +46,10 @@
 #define MMC_MODE_8BIT		0x200
 #define MMC_MODE_SPI		0x400
 #define MMC_MODE_HC		0x800
+/* host sends STOP_TRANSMISSION itself at the end of a multi-block transfer */
+#define MMC_MODE_AUTO_CMD12	0x1000
+#define MMC_MODE_DDR_52MHz	0x2000
+#define MMC_MODE_HS200		0x4000
 
 #define SD_DATA_4BIT	0x00040000
 
@@ -151,6 +155,7 @@
  */
 
 #define EXT_CSD_PART_CONF	179	/* R/W */
+#define EXT_CSD_ERASED_MEM_CONT	181	/* RO */
 #define EXT_CSD_BUS_WIDTH	183	/* R/W */
 #define EXT_CSD_HS_TIMING	185	/* R/W */
 #define EXT_CSD_CARD_TYPE	196	/* RO */
@@ -167,10 +172,20 @@
 
 #define EXT_CSD_CARD_TYPE_26	(1 << 0)	/* Card can run at 26MHz */
 #define EXT_CSD_CARD_TYPE_52	(1 << 1)	/* Card can run at 52MHz */
+#define EXT_CSD_CARD_TYPE_DDR_1_8V	(1 << 2)	/* 52MHz DDR, 1.8V or 3V I/O */
+#define EXT_CSD_CARD_TYPE_DDR_1_2V	(1 << 3)	/* 52MHz DDR, 1.2V I/O */
+#define EXT_CSD_CARD_TYPE_HS200_1_8V	(1 << 4)	/* 200MHz SDR, 1.8V I/O */
+#define EXT_CSD_CARD_TYPE_HS200_1_2V	(1 << 5)	/* 200MHz SDR, 1.2V I/O */
 
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
 #define EXT_CSD_BUS_WIDTH_8	2	/* Card is in 8 bit mode */
+#define EXT_CSD_BUS_WIDTH_4_DDR	5	/* Card is in 4 bit DDR mode */
+#define EXT_CSD_BUS_WIDTH_8_DDR	6	/* Card is in 8 bit DDR mode */
+
+#define EXT_CSD_TIMING_LEGACY	0	/* Backwards compatible timing */
+#define EXT_CSD_TIMING_HS	1	/* High speed */
+#define EXT_CSD_TIMING_HS200	2	/* HS200 */
 
 #define R1_ILLEGAL_COMMAND		(1 << 22)
 #define R1_APP_CMD			(1 << 5)
@@ -284,6 +299,7 @@ struct mmc {
 	uint f_max;
 	int high_capacity;
 	uint bus_width;
+	uint ddr_mode;
 	uint clock;
 	uint card_caps;
 	uint host_caps;
@@ -304,6 +320,8 @@ struct mmc {
 			struct mmc_cmd *cmd, struct mmc_data *data);
 	void (*set_ios)(struct mmc *mmc);
 	int (*init)(struct mmc *mmc);
+	/* required for HS200; returns 0 once a sampling point is found */
+	int (*execute_tuning)(struct mmc *mmc);
 	uint b_max;
 };
 
@@ -67,7 +67,15 @@
 # define PKTBUFSRX	4
 #endif
 
-#define PKTALIGN	32
+/*
+ * Receive buffers are DMA targets: keep each of them on its own cache
+ * line(s) so invalidating one never discards data of its neighbour.
+ */
+#if defined(CONFIG_SYS_CACHELINE_SIZE) && (CONFIG_SYS_CACHELINE_SIZE > 32)
+# define PKTALIGN	CONFIG_SYS_CACHELINE_SIZE
+#else
+# define PKTALIGN	32
+#endif
 
 typedef ulong		IPaddr_t;
 
@@ -213,6 +221,7 @@ typedef struct {
 #define PROT_VLAN	0x8100		/* IEEE 802.1q protocol		*/
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -388,7 +397,7 @@ extern int		NetRestartWrap;		/* Tried all network devices	*/
 #endif
 
 typedef enum { BOOTP, RARP, ARP, TFTP, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	       TFTPSRV } proto_t;
+	       TFTPSRV, WGET } proto_t;
 
 /* from net/net.c */
 extern char	BootFile[128];			/* Boot File name		*/
@@ -431,6 +440,9 @@ extern int	NetSetEther(volatile uchar *, uchar *, uint);
 /* Set IP header */
 extern void	NetSetIP(volatile uchar *, IPaddr_t, int, int, int);
 
+/* Set IP header (without the UDP part) for protocol proto, len bytes of data */
+extern void	NetSetIPHeader(volatile uchar *, IPaddr_t dest, int proto, int len);
+
 /* Checksum */
 extern int	NetCksumOk(uchar *, int);	/* Return true if cksum OK	*/
 extern uint	NetCksum(uchar *, int);		/* Calculate the checksum	*/
@@ -445,6 +457,9 @@ extern void	NetSendPacket(volatile uchar *, int);
 /* Transmit UDP packet, performing ARP request if needed */
 extern int	NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport, int len);
 
+/* Transmit the len byte IP frame in "NetTxPacket", performing ARP request if needed */
+extern int	NetSendIPPacket(uchar *ether, IPaddr_t dest, int len);
+
 /* Processes a received packet */
 extern void	NetReceive(volatile uchar *, int);
 
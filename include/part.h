@@ -26,6 +26,9 @@
 #include <ide.h>
 #include <jffs2/load_kernel.h>
 
+/* see hash.h, which needs image.h's FIT defines and so comes later */
+struct hash_ctx;
+
 typedef struct block_dev_desc {
 	int		if_type;	/* type of the interface */
 	int		dev;		/* device number */
@@ -34,6 +37,7 @@ typedef struct block_dev_desc {
 	unsigned char	lun;		/* target LUN */
 	unsigned char	type;		/* device type */
 	unsigned char	removable;	/* removable device */
+	unsigned char	erase_is_zero;	/* erased blocks read back as zeros */
 #ifdef CONFIG_LBA48
 	unsigned char	lba48;		/* device can use 48bit addr (ATA/ATAPI v7) */
 #endif
@@ -128,14 +132,32 @@ int partition_erase_blks(block_dev_desc_t *dev, disk_partition_t *partition,
 				lbaint_t *blkcnt);
 int partition_erase_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
 				loff_t *bytecnt);
-#ifdef CONFIG_MD5
+#ifdef CONFIG_HASH
+/*
+ * Hash *blkcnt blocks from blk_start into ctx, reading through buffer
+ * (or a malloc'd one if buffer is NULL).  *blkcnt is updated with the
+ * number of blocks actually hashed.
+ */
+void partition_hash_helper(block_dev_desc_t *dev, lbaint_t blk_start,
+				lbaint_t *blkcnt, struct hash_ctx *ctx,
+				void *buffer, unsigned long buflen);
+/* algo is a hash_find_algo() name; digest gets its digest_size bytes */
+int partition_hash_blks(block_dev_desc_t *dev, disk_partition_t *partition,
+				lbaint_t *blkcnt, const char *algo,
+				unsigned char *digest);
+int partition_hash_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
+				loff_t *bytecnt, const char *algo,
+				unsigned char *digest, void *buffer,
+				unsigned long buflen);
+#endif /* CONFIG_HASH */
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 void partition_md5_helper(block_dev_desc_t *dev, lbaint_t blk_start,
 				lbaint_t *blkcnt, unsigned char md5[16]);
 int partition_md5_blks(block_dev_desc_t *dev, disk_partition_t *partition,
 				lbaint_t *blkcnt, unsigned char md5[16]);
 int partition_md5_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
 				loff_t *bytecnt, unsigned char md5[16]);
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 int partition_read_blks(block_dev_desc_t *dev, disk_partition_t *partition,
 				lbaint_t *blkcnt, void *buffer);
 int partition_read_bytes(block_dev_desc_t *dev, disk_partition_t *partition,
@@ -188,7 +210,22 @@ static inline int partition_erase_blks(block_dev_desc_t *dev,
 static inline int partition_erase_bytes(block_dev_desc_t *dev,
 				disk_partition_t *partition,
 				loff_t *bytecnt) { return -ENODEV; }
-#ifdef CONFIG_MD5
+#ifdef CONFIG_HASH
+static inline void partition_hash_helper(block_dev_desc_t *dev,
+				lbaint_t blk_start, lbaint_t *blkcnt,
+				struct hash_ctx *ctx, void *buffer,
+				unsigned long buflen) { *blkcnt = 0; }
+static inline int partition_hash_blks(block_dev_desc_t *dev,
+				disk_partition_t *partition, lbaint_t *blkcnt,
+				const char *algo, unsigned char *digest)
+				{ return -ENODEV; }
+static inline int partition_hash_bytes(block_dev_desc_t *dev,
+				disk_partition_t *partition, loff_t *bytecnt,
+				const char *algo, unsigned char *digest,
+				void *buffer, unsigned long buflen)
+				{ return -ENODEV; }
+#endif /* CONFIG_HASH */
+#if defined(CONFIG_MD5) && defined(CONFIG_HASH)
 static inline void partition_md5_helper(block_dev_desc_t *dev,
 				lbaint_t blk_start, lbaint_t *blkcnt,
 				unsigned char md5[16]) { *blkcnt = 0; }
@@ -198,7 +235,7 @@ static inline int partition_md5_blks(block_dev_desc_t *dev,
 static inline int partition_md5_bytes(block_dev_desc_t *dev,
 				disk_partition_t *partition, loff_t *bytecnt,
 				unsigned char md5[16]) { return -ENODEV; }
-#endif /* CONFIG_MD5 */
+#endif /* CONFIG_MD5 && CONFIG_HASH */
 static inline int partition_read_blks(block_dev_desc_t *dev,
 				disk_partition_t *partition, lbaint_t *blkcnt,
 				void *buffer) { return -ENODEV; }
@@ -165,6 +165,7 @@ void usb_event_poll(void);
 block_dev_desc_t *usb_stor_get_dev(int index);
 int usb_stor_scan(int mode);
 int usb_stor_info(void);
+void usb_stor_show_speed(struct usb_device *dev);
 
 #endif
 
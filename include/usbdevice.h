@@ -489,6 +489,7 @@ struct urb {
 
 	urb_send_status_t status;
 	int data;
+	int whole;	/* buffer_length is that of the whole OUT transfer */
 
 	u16 buffer_data[URB_BUF_SIZE];	/* data received (OUT) or being sent (IN) */
 };
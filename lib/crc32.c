@@ -162,6 +162,18 @@ const uint32_t * ZEXPORT get_crc_table()
 }
 #endif
 
+/*
+ * Slice-by-8: fold eight input bytes per step using eight 1 KiB tables
+ * instead of one byte per step.  The tables are const so crc32() still
+ * works before relocation, when .bss cannot be written.  Little endian
+ * only; big endian targets keep the byte-wise loop.
+ */
+#if defined(CONFIG_CRC32_SLICE_BY_8) && !defined(DYNAMIC_CRC_TABLE) && \
+	__BYTE_ORDER == __LITTLE_ENDIAN
+#define CRC32_SLICE_BY_8
+#include "crc32_table8.h"
+#endif
+
 /* ========================================================================= */
 # if __BYTE_ORDER == __LITTLE_ENDIAN
 #  define DO_CRC(x) crc = tab[(crc ^ (x)) & 255] ^ (crc >> 8)
@@ -193,6 +205,24 @@ uint32_t ZEXPORT crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
 	 b = (uint32_t *)p;
     }
 
+#ifdef CRC32_SLICE_BY_8
+    rem_len = len & 7;
+    len = len >> 3;
+    for (; len; --len) {
+	 uint32_t lo = *b++ ^ crc;
+	 uint32_t hi = *b++;
+
+	 crc = crc_table8[7][lo & 255] ^
+	       crc_table8[6][(lo >> 8) & 255] ^
+	       crc_table8[5][(lo >> 16) & 255] ^
+	       crc_table8[4][lo >> 24] ^
+	       crc_table8[3][hi & 255] ^
+	       crc_table8[2][(hi >> 8) & 255] ^
+	       crc_table8[1][(hi >> 16) & 255] ^
+	       crc_table8[0][hi >> 24];
+    }
+    --b;
+#else
     rem_len = len & 3;
     len = len >> 2;
     for (--b; len; --len) {
@@ -203,6 +233,7 @@ uint32_t ZEXPORT crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
 	 DO_CRC(0);
 	 DO_CRC(0);
     }
+#endif
     len = rem_len;
     /* And the last few bytes */
     if (len) {
@@ -221,6 +252,87 @@ uint32_t ZEXPORT crc32 (uint32_t crc, const Bytef *p, uInt len)
      return crc32_no_comp(crc ^ 0xffffffffL, p, len) ^ 0xffffffffL;
 }
 
+/* =========================================================================
+ * GF(2) matrix helpers, from crc32_combine() in zlib-1.2.5.
+ */
+#define GF2_DIM 32	/* dimension of GF(2) vectors (length of CRC) */
+
+local uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+
+    while (vec) {
+	if (vec & 1)
+	    sum ^= *mat;
+	vec >>= 1;
+	mat++;
+    }
+    return sum;
+}
+
+local void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+    int n;
+
+    for (n = 0; n < GF2_DIM; n++)
+	square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/*
+ * Return the crc32 of the data whose crc32 is 'crc' followed by 'len'
+ * zero bytes.  This takes O(log(len)) time and does not need the zero
+ * bytes in memory, which makes it cheap to account for large holes.
+ */
+uint32_t ZEXPORT crc32_zeros (uint32_t crc, uint64_t len)
+{
+    uint32_t even[GF2_DIM];	/* even-power-of-two zeros operator */
+    uint32_t odd[GF2_DIM];	/* odd-power-of-two zeros operator */
+    uint32_t row;
+    int n;
+
+    if (len == 0)
+	return crc;
+
+    /* work on the crc register rather than the complemented crc */
+    crc ^= 0xffffffffL;
+
+    /* put operator for one zero bit in odd */
+    odd[0] = 0xedb88320L;	/* CRC-32 polynomial */
+    row = 1;
+    for (n = 1; n < GF2_DIM; n++) {
+	odd[n] = row;
+	row <<= 1;
+    }
+
+    /* put operator for two zero bits in even */
+    gf2_matrix_square(even, odd);
+
+    /* put operator for four zero bits in odd */
+    gf2_matrix_square(odd, even);
+
+    /* apply len zeros to crc (first square will put the operator for one
+       zero byte, eight zero bits, in even) */
+    do {
+	/* apply zeros operator for this bit of len */
+	gf2_matrix_square(even, odd);
+	if (len & 1)
+	    crc = gf2_matrix_times(even, crc);
+	len >>= 1;
+
+	/* if no more bits set, then done */
+	if (len == 0)
+	    break;
+
+	/* another iteration of the loop with odd and even swapped */
+	gf2_matrix_square(odd, even);
+	if (len & 1)
+	    crc = gf2_matrix_times(odd, crc);
+	len >>= 1;
+    } while (len != 0);
+
+    return crc ^ 0xffffffffL;
+}
+
 /*
  * Calculate the crc32 checksum triggering the watchdog every 'chunk_sz' bytes
  * of input.
@@ -56,7 +56,8 @@ void zfree(void *x, void *addr, unsigned nb)
 	free (addr);
 }
 
-int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
+/* Returns the offset of the deflate stream in a gzip image, or -1 */
+static int gunzip_header(unsigned char *src, unsigned long len)
 {
 	int i, flags;
 
@@ -77,14 +78,88 @@ int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
 			;
 	if ((flags & HEAD_CRC) != 0)
 		i += 2;
-	if (i >= *lenp) {
+	if (i >= len) {
 		puts ("Error: gunzip out of data in header\n");
 		return (-1);
 	}
+	return i;
+}
+
+int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp)
+{
+	int i = gunzip_header(src, *lenp);
+
+	if (i < 0)
+		return -1;
 
 	return zunzip(dst, dstlen, src, lenp, 1, i);
 }
 
+#ifndef CONFIG_GUNZIP_CRC_CHUNK
+#define CONFIG_GUNZIP_CRC_CHUNK	(64 * 1024)
+#endif
+
+/*
+ * Like gunzip(), but also returns in *crc the crc32 of all *lenp input
+ * bytes, header and trailer included.  Each chunk of input is summed
+ * just before inflate() reads it, while it is still in cache, so the
+ * compressed data is only streamed from memory once.
+ */
+int gunzip_crc(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
+						uint32_t *crc)
+{
+	unsigned char *in, *end = src + *lenp;
+	uint32_t c;
+	z_stream s;
+	int i, r;
+
+	i = gunzip_header(src, *lenp);
+	if (i < 0)
+		return -1;
+
+	s.zalloc = zalloc;
+	s.zfree = zfree;
+
+	r = inflateInit2(&s, -MAX_WBITS);
+	if (r != Z_OK) {
+		printf ("Error: inflateInit2() returned %d\n", r);
+		return -1;
+	}
+
+	c = crc32(0, src, i);
+	in = src + i;
+	s.next_in = in;
+	s.avail_in = 0;
+	s.next_out = dst;
+	s.avail_out = dstlen;
+	do {
+		if (!s.avail_in && in < end) {
+			uInt n = min((ulong)(end - in),
+					(ulong)CONFIG_GUNZIP_CRC_CHUNK);
+
+			c = crc32(c, in, n);
+			s.next_in = in;
+			s.avail_in = n;
+			in += n;
+			WATCHDOG_RESET();
+		}
+		r = inflate(&s, Z_NO_FLUSH);
+	} while (r == Z_OK);
+
+	if (r != Z_STREAM_END) {
+		printf("Error: inflate() returned %d\n", r);
+		inflateEnd(&s);
+		return -1;
+	}
+
+	/* the gzip trailer and anything else inflate() did not need */
+	*crc = crc32(c, in, end - in);
+	*lenp = s.next_out - (unsigned char *) dst;
+	inflateEnd(&s);
+
+	return 0;
+}
+
 /*
  * Uncompress blocks compressed with zlib without headers
  */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * Common init/update/final interface over the CRC32, MD5, SHA1 and
+ * SHA256 implementations, so callers can hash a stream of buffers
+ * without caring which algorithm they were asked for.
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <hash.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+
+/* Digest is the big endian CRC, as FIT images store it */
+static void hash_crc32_init(struct hash_ctx *ctx)
+{
+	ctx->u.crc32 = 0;
+}
+
+static void hash_crc32_update(struct hash_ctx *ctx, const void *buf,
+			      unsigned int len)
+{
+	ctx->u.crc32 = crc32(ctx->u.crc32, buf, len);
+}
+
+static void hash_crc32_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	put_unaligned_be32(ctx->u.crc32, digest);
+}
+
+#ifdef CONFIG_MD5
+static void hash_md5_init(struct hash_ctx *ctx)
+{
+	MD5Init(&ctx->u.md5);
+}
+
+static void hash_md5_update(struct hash_ctx *ctx, const void *buf,
+			    unsigned int len)
+{
+	MD5Update(&ctx->u.md5, buf, len);
+}
+
+static void hash_md5_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	MD5Final(digest, &ctx->u.md5);
+}
+#endif
+
+#ifdef CONFIG_SHA1
+static void hash_sha1_init(struct hash_ctx *ctx)
+{
+	sha1_starts(&ctx->u.sha1);
+}
+
+static void hash_sha1_update(struct hash_ctx *ctx, const void *buf,
+			     unsigned int len)
+{
+	sha1_update(&ctx->u.sha1, (unsigned char *)buf, len);
+}
+
+static void hash_sha1_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	sha1_finish(&ctx->u.sha1, digest);
+}
+#endif
+
+#ifdef CONFIG_SHA256
+static void hash_sha256_init(struct hash_ctx *ctx)
+{
+	sha256_starts(&ctx->u.sha256);
+}
+
+static void hash_sha256_update(struct hash_ctx *ctx, const void *buf,
+			       unsigned int len)
+{
+	sha256_update(&ctx->u.sha256, (uint8_t *)buf, len);
+}
+
+static void hash_sha256_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	sha256_finish(&ctx->u.sha256, digest);
+}
+#endif
+
+static const struct hash_algo hash_algos[] = {
+	{ "crc32", 4, hash_crc32_init, hash_crc32_update, hash_crc32_final },
+#ifdef CONFIG_MD5
+	{ "md5", 16, hash_md5_init, hash_md5_update, hash_md5_final },
+#endif
+#ifdef CONFIG_SHA1
+	{ "sha1", 20, hash_sha1_init, hash_sha1_update, hash_sha1_final },
+#endif
+#ifdef CONFIG_SHA256
+	{ "sha256", SHA256_SUM_LEN, hash_sha256_init, hash_sha256_update,
+	  hash_sha256_final },
+#endif
+};
+
+static const struct hash_algo *__hash_engine_find(const char *name)
+{
+	return NULL;
+}
+const struct hash_algo *hash_engine_find(const char *name)
+	__attribute__((weak, alias("__hash_engine_find")));
+
+const struct hash_algo *hash_find_algo(const char *name)
+{
+	const struct hash_algo *algo;
+	int i;
+
+	algo = hash_engine_find(name);
+	if (algo)
+		return algo;
+
+	for (i = 0; i < ARRAY_SIZE(hash_algos); i++)
+		if (!strcmp(name, hash_algos[i].name))
+			return &hash_algos[i];
+	return NULL;
+}
+
+int hash_init(struct hash_ctx *ctx, const char *algo_name)
+{
+	ctx->algo = hash_find_algo(algo_name);
+	if (!ctx->algo)
+		return -EINVAL;
+
+	ctx->algo->init(ctx);
+	return 0;
+}
+
+void hash_update(struct hash_ctx *ctx, const void *buf, unsigned int len)
+{
+	ctx->algo->update(ctx, buf, len);
+}
+
+void hash_final(struct hash_ctx *ctx, unsigned char *digest)
+{
+	ctx->algo->final(ctx, digest);
+}
+
+void hash_update_wd(struct hash_ctx *ctxs, int n, const void *buf,
+		    unsigned int len, unsigned int chunk_sz)
+{
+	const unsigned char *p = buf;
+	unsigned int chunk;
+	int i;
+
+	while (len) {
+		chunk = min(len, chunk_sz);
+		for (i = 0; i < n; i++)
+			hash_update(&ctxs[i], p, chunk);
+		p += chunk;
+		len -= chunk;
+		WATCHDOG_RESET();
+	}
+}
+
+int hash_block_wd(const char *algo_name, const void *buf, unsigned int len,
+		  unsigned char *digest, unsigned int chunk_sz)
+{
+	struct hash_ctx ctx;
+
+	if (hash_init(&ctx, algo_name))
+		return -EINVAL;
+
+	hash_update_wd(&ctx, 1, buf, len, chunk_sz);
+	hash_final(&ctx, digest);
+	return hash_digest_size(&ctx);
+}
+
+void hash_to_str(const unsigned char *digest, int len, char *str)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		sprintf(str + 2 * i, "%02x", digest[i]);
+	str[2 * len] = '\0';
+}
@@ -63,7 +63,7 @@ void sha256_starts(sha256_context * ctx)
 void sha256_process(sha256_context * ctx, uint8_t data[64])
 {
 	uint32_t temp1, temp2;
-	uint32_t W[64];
+	uint32_t W[16];
 	uint32_t A, B, C, D, E, F, G, H;
 
 	GET_UINT32_BE(W[0], data, 0);
@@ -83,7 +83,7 @@ void sha256_process(sha256_context * ctx, uint8_t data[64])
 	GET_UINT32_BE(W[14], data, 56);
 	GET_UINT32_BE(W[15], data, 60);
 
-#define SHR(x,n) ((x & 0xFFFFFFFF) >> n)
+#define SHR(x,n) (x >> n)
 #define ROTR(x,n) (SHR(x,n) | (x << (32 - n)))
 
 #define S0(x) (ROTR(x, 7) ^ ROTR(x,18) ^ SHR(x, 3))
@@ -95,10 +95,15 @@ void sha256_process(sha256_context * ctx, uint8_t data[64])
 #define F0(x,y,z) ((x & y) | (z & (x | y)))
 #define F1(x,y,z) (z ^ (x & (y ^ z)))
 
-#define R(t)					\
-(						\
-	W[t] = S1(W[t - 2]) + W[t - 7] +	\
-		S0(W[t - 15]) + W[t - 16]	\
+/*
+ * Only the last 16 schedule words are live at any time, so keep them in
+ * a ring rather than expanding all 64 up front; that is a quarter of
+ * the stack traffic and lets the compiler keep more of it in registers.
+ */
+#define R(t)						\
+(							\
+	W[t & 15] += S1(W[(t - 2) & 15]) +		\
+		W[(t - 7) & 15] + S0(W[(t - 15) & 15])	\
 )
 
 #define P(a,b,c,d,e,f,g,h,x,K) {		\
@@ -15,13 +15,14 @@
  *    reentrant and should be faster). Use only strsep() in new code, please.
  */
 
+#include <config.h>
 #include <linux/types.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
 #include <malloc.h>
 
 
-#if 0 /* not used - was: #ifndef __HAVE_ARCH_STRNICMP */
+#if defined(CONFIG_CMD_WGET) && !defined(__HAVE_ARCH_STRNICMP)
 /**
  * strnicmp - Case insensitive, length-limited string comparison
  * @s1: One string
@@ -71,6 +71,15 @@
  *			- own IP address
  *	We want:	- network time
  *	Next step:	none
+ *
+ * WGET:
+ *
+ *	Prerequisites:	- own ethernet address
+ *			- own IP address
+ *			- HTTP server IP address
+ *			- name of bootfile
+ *	We want:	- load the boot file over HTTP
+ *	Next step:	none
  */
 
 
@@ -97,6 +106,10 @@
 #if defined(CONFIG_CMD_DNS)
 #include "dns.h"
 #endif
+#if defined(CONFIG_CMD_WGET)
+#include "tcp.h"
+#include "wget.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -479,6 +492,11 @@ restart:
 		case DNS:
 			DnsStart();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			WgetStart();
+			break;
 #endif
 		default:
 			break;
@@ -524,6 +542,10 @@ restart:
 		 *	Abort if ctrl-c was pressed.
 		 */
 		if (ctrlc()) {
+#if defined(CONFIG_CMD_WGET)
+			/* or its segments reach wget during the next NetLoop */
+			tcp_reset();
+#endif
 			eth_halt();
 			puts("\nAbort\n");
 			return -1;
@@ -736,6 +758,37 @@ NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport, int len)
 	return 0;	/* transmitted */
 }
 
+/*
+ * Send a complete frame already built in NetTxPacket.  If the ethernet
+ * address of dest is still unknown, the frame is parked until the ARP
+ * reply fills in ether and the destination address of the frame.
+ */
+int
+NetSendIPPacket(uchar *ether, IPaddr_t dest, int len)
+{
+	if (memcmp(ether, NetEtherNullAddr, 6) == 0) {
+
+		debug("sending ARP for %08lx\n", dest);
+
+		NetArpWaitPacketIP = dest;
+		NetArpWaitPacketMAC = ether;
+
+		memcpy(NetArpWaitTxPacket, (uchar *)NetTxPacket, len);
+		NetArpWaitTxPacketSize = len;
+
+		/* and do the ARP request */
+		NetArpWaitTry = 1;
+		NetArpWaitTimerStart = get_timer(0);
+		ArpRequest();
+		return 1;	/* waiting */
+	}
+
+	memcpy(((Ethernet_t *)NetTxPacket)->et_dest, ether, 6);
+	(void) eth_send(NetTxPacket, len);
+
+	return 0;	/* transmitted */
+}
+
 #if defined(CONFIG_CMD_PING)
 static ushort PingSeqNo;
 
@@ -1685,7 +1738,14 @@ NetReceive(volatile uchar *inpkt, int len)
 			default:
 				return;
 			}
-		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
+		}
+#if defined(CONFIG_CMD_WGET)
+		else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive(ip, src_ip, len);
+			return;
+		}
+#endif
+		else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
 
@@ -1783,6 +1843,9 @@ static int net_check_prereq(proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 	case TFTP:
 		if (NetServerIP == 0) {
@@ -1901,6 +1964,27 @@ NetSetEther(volatile uchar *xet, uchar * addr, uint prot)
 	}
 }
 
+void
+NetSetIPHeader(volatile uchar *xip, IPaddr_t dest, int proto, int len)
+{
+	IP_t *ip = (IP_t *)xip;
+
+	/* IP_HDR_SIZE / 4 (not including UDP) */
+	ip->ip_hl_v  = 0x45;
+	ip->ip_tos   = 0;
+	ip->ip_len   = htons(IP_HDR_SIZE_NO_UDP + len);
+	ip->ip_id    = htons(NetIPID++);
+	ip->ip_off   = htons(IP_FLAGS_DFRAG);	/* Don't fragment */
+	ip->ip_ttl   = 255;
+	ip->ip_p     = proto;
+	ip->ip_sum   = 0;
+	/* already in network byte order */
+	NetCopyIP((void *)&ip->ip_src, &NetOurIP);
+	/* - "" - */
+	NetCopyIP((void *)&ip->ip_dst, &dest);
+	ip->ip_sum   = ~NetCksum((uchar *)ip, IP_HDR_SIZE_NO_UDP / 2);
+}
+
 void
 NetSetIP(volatile uchar *xip, IPaddr_t dest, int dport, int sport, int len)
 {
@@ -1918,24 +2002,11 @@ NetSetIP(volatile uchar *xip, IPaddr_t dest, int dport, int sport, int len)
 	 *	Construct an IP and UDP header.
 	 *	(need to set no fragment bit - XXX)
 	 */
-	/* IP_HDR_SIZE / 4 (not including UDP) */
-	ip->ip_hl_v  = 0x45;
-	ip->ip_tos   = 0;
-	ip->ip_len   = htons(IP_HDR_SIZE + len);
-	ip->ip_id    = htons(NetIPID++);
-	ip->ip_off   = htons(IP_FLAGS_DFRAG);	/* Don't fragment */
-	ip->ip_ttl   = 255;
-	ip->ip_p     = 17;		/* UDP */
-	ip->ip_sum   = 0;
-	/* already in network byte order */
-	NetCopyIP((void *)&ip->ip_src, &NetOurIP);
-	/* - "" - */
-	NetCopyIP((void *)&ip->ip_dst, &dest);
+	NetSetIPHeader(xip, dest, IPPROTO_UDP, 8 + len);
 	ip->udp_src  = htons(sport);
 	ip->udp_dst  = htons(dport);
 	ip->udp_len  = htons(8 + len);
 	ip->udp_xsum = 0;
-	ip->ip_sum   = ~NetCksum((uchar *)ip, IP_HDR_SIZE_NO_UDP / 2);
 }
 
 void copy_filename(char *dst, const char *src, int size)
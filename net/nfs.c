@@ -22,6 +22,13 @@
  * possible, maximum 16 steps). There is no clearing of ".."'s inside the
  * path, so please DON'T DO THAT. thx. */
 
+/* NOTE 4: NFSv3 is used when the server registers it with the portmapper,
+ * otherwise we fall back to NFSv2.  With v3 the read size is taken from
+ * the server's FSINFO rtmax, bounded by NFS_READ_SIZE_MAX.  Once the first
+ * block has arrived, up to NFS_READ_WINDOW READ calls are kept in flight;
+ * replies are matched to their call by XID and stored at their own offset,
+ * so they may come back in any order. */
+
 #include <common.h>
 #include <command.h>
 #include <net.h>
@@ -32,14 +39,33 @@
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
 #define NFS_RETRY_COUNT 30
 #define NFS_TIMEOUT 2000UL
+#define NFS_HASH_SIZE (NFS_READ_SIZE/2*10)	/* bytes per "loading" hash */
+
+/* reply was not for one of our outstanding calls; ignore it */
+#define NFS_RPC_DROP 124
 
 static int fs_mounted = 0;
 static unsigned long rpc_id = 0;
-static int nfs_offset = -1;
-static int nfs_len;
+static int nfs_version;		/* 3, or 2 if the server lacks v3 */
 
-static char dirfh[NFS_FHSIZE];	/* file handle of directory */
-static char filefh[NFS_FHSIZE]; /* file handle of kernel image */
+static char dirfh[NFS3_FHSIZE];	/* file handle of directory */
+static unsigned dirfh_len;
+static char filefh[NFS3_FHSIZE]; /* file handle of kernel image */
+static unsigned filefh_len;
+
+/* One outstanding READ call; id 0 means the slot is free */
+struct nfs_read_slot {
+	unsigned long id;
+	ulong offset;
+	unsigned len;
+};
+static struct nfs_read_slot nfs_reads[NFS_READ_WINDOW];
+static int nfs_window;		/* slots in use: 1 until the first reply */
+static unsigned nfs_rsize;
+static ulong nfs_next_offset;	/* next file offset to ask for */
+static ulong nfs_eof;		/* file size once known, else ~0 */
+static ulong nfs_received;
+static ulong nfs_hashes;
 
 static int	NfsDownloadState;
 static IPaddr_t NfsServerIP;
@@ -55,6 +81,7 @@ static int	NfsState;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 static char default_filename[64];
 static char *nfs_filename;
@@ -167,7 +194,7 @@ static long *rpc_add_credentials (long *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void
+static unsigned long
 rpc_req (int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 {
 	struct rpc_t pkt;
@@ -181,7 +208,10 @@ rpc_req (int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 	pkt.u.call.type = htonl(MSG_CALL);
 	pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
 	pkt.u.call.prog = htonl(rpc_prog);
-	pkt.u.call.vers = htonl(2);	/* portmapper is version 2 */
+	if (rpc_prog == PROG_PORTMAP)
+		pkt.u.call.vers = htonl(2);	/* portmapper is version 2 */
+	else
+		pkt.u.call.vers = htonl(nfs_version);	/* MOUNT v3 goes with v3 */
 	pkt.u.call.proc = htonl(rpc_proc);
 	p = (uint32_t *)&(pkt.u.call.data);
 
@@ -200,6 +230,34 @@ rpc_req (int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 		sport = NfsSrvNfsPort;
 
 	NetSendUDPPacket (NetServerEther, NfsServerIP, sport, NfsOurPort, pktlen);
+	return id;
+}
+
+/* Append a file handle: fixed size in v2, counted opaque in v3 */
+static uint32_t *
+nfs_add_fh (uint32_t *p, const char *fh, unsigned fhlen)
+{
+	if (nfs_version == 2) {
+		memcpy (p, fh, NFS_FHSIZE);
+		return p + NFS_FHSIZE / 4;
+	}
+
+	*p++ = htonl(fhlen);
+	if (fhlen & 3) *(p + fhlen / 4) = 0;
+	memcpy (p, fh, fhlen);
+	return p + (fhlen + 3) / 4;
+}
+
+/* Skip an NFSv3 post_op_attr, returning the fattr3 (or NULL) in attr */
+static uint32_t *
+nfs3_skip_attr (uint32_t *p, uint32_t **attr)
+{
+	if (*p++) {
+		*attr = p;
+		return p + 21;
+	}
+	*attr = NULL;
+	return p;
 }
 
 /**************************************************************************
@@ -286,8 +344,7 @@ nfs_readlink_req (void)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials ((long *)p);
 
-	memcpy (p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh (p, filefh, filefh_len);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -310,8 +367,7 @@ nfs_lookup_req (char *fname)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials ((long *)p);
 
-	memcpy (p, dirfh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh (p, dirfh, dirfh_len);
 	*p++ = htonl(fnamelen);
 	if (fnamelen & 3) *(p + fnamelen / 4) = 0;
 	memcpy (p, fname, fnamelen);
@@ -319,14 +375,16 @@ nfs_lookup_req (char *fname)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req (PROG_NFS, NFS_LOOKUP, data, len);
+	/* v3 renumbered LOOKUP; its old number 4 is ACCESS there */
+	rpc_req (PROG_NFS, nfs_version == 3 ? NFS3PROC_LOOKUP : NFS_LOOKUP,
+		 data, len);
 }
 
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void
-nfs_read_req (int offset, int readlen)
+static unsigned long
+nfs_read_req (ulong offset, unsigned readlen)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -335,15 +393,83 @@ nfs_read_req (int offset, int readlen)
 	p = &(data[0]);
 	p = (uint32_t *)rpc_add_credentials ((long *)p);
 
-	memcpy (p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = nfs_add_fh (p, filefh, filefh_len);
+	if (nfs_version == 3)
+		*p++ = 0;		/* offset is 64 bits in v3 */
 	*p++ = htonl(offset);
 	*p++ = htonl(readlen);
-	*p++ = 0;
+	if (nfs_version == 2)
+		*p++ = 0;		/* totalcount, unused */
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req (PROG_NFS, NFS_READ, data, len);
+	return rpc_req (PROG_NFS, NFS_READ, data, len);
+}
+
+/**************************************************************************
+NFS3_FSINFO - Ask the server for its preferred transfer sizes
+**************************************************************************/
+static void
+nfs_fsinfo_req (void)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+
+	p = &(data[0]);
+	p = (uint32_t *)rpc_add_credentials ((long *)p);
+
+	p = nfs_add_fh (p, filefh, filefh_len);
+
+	len = (uint32_t *)p - (uint32_t *)&(data[0]);
+
+	rpc_req (PROG_NFS, NFS3PROC_FSINFO, data, len);
+}
+
+/**************************************************************************
+Keep the READ window full.  With resend set, calls that are still
+outstanding are sent again (with a new XID) as well.
+**************************************************************************/
+static void
+nfs_read_fill (int resend)
+{
+	struct nfs_read_slot *s;
+
+	for (s = nfs_reads; s < nfs_reads + nfs_window; s++) {
+		if (s->id) {
+			if (resend)
+				s->id = nfs_read_req (s->offset, s->len);
+			continue;
+		}
+		if (nfs_next_offset >= nfs_eof)
+			continue;
+		s->offset = nfs_next_offset;
+		s->len = nfs_rsize;
+		s->id = nfs_read_req (s->offset, s->len);
+		nfs_next_offset += nfs_rsize;
+	}
+}
+
+static int
+nfs_read_busy (void)
+{
+	int i;
+
+	for (i = 0; i < nfs_window; i++)
+		if (nfs_reads[i].id)
+			return 1;
+	return 0;
+}
+
+static void
+nfs_read_start (void)
+{
+	memset (nfs_reads, 0, sizeof(nfs_reads));
+	nfs_window = 1;
+	nfs_next_offset = 0;
+	nfs_eof = ~0UL;
+	nfs_received = 0;
+	nfs_hashes = 0;
 }
 
 /**************************************************************************
@@ -357,10 +483,10 @@ NfsSend (void)
 
 	switch (NfsState) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
-		rpc_lookup_req (PROG_MOUNT, 1);
+		rpc_lookup_req (PROG_MOUNT, nfs_version == 3 ? 3 : 1);
 		break;
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
-		rpc_lookup_req (PROG_NFS, 2);
+		rpc_lookup_req (PROG_NFS, nfs_version);
 		break;
 	case STATE_MOUNT_REQ:
 		nfs_mount_req (nfs_path);
@@ -371,8 +497,11 @@ NfsSend (void)
 	case STATE_LOOKUP_REQ:
 		nfs_lookup_req (nfs_filename);
 		break;
+	case STATE_FSINFO_REQ:
+		nfs_fsinfo_req ();
+		break;
 	case STATE_READ_REQ:
-		nfs_read_req (nfs_offset, nfs_len);
+		nfs_read_fill (1);
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req ();
@@ -394,7 +523,7 @@ rpc_lookup_reply (int prog, uchar *pkt, unsigned len)
 	debug("%s\n", __func__);
 
 	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
-		return -1;
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -424,7 +553,7 @@ nfs_mount_reply (uchar *pkt, unsigned len)
 	memcpy ((unsigned char *)&rpc_pkt, pkt, len);
 
 	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
-		return -1;
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -433,8 +562,16 @@ nfs_mount_reply (uchar *pkt, unsigned len)
 		return -1;
 	}
 
+	if (nfs_version == 3) {
+		dirfh_len = ntohl(rpc_pkt.u.reply.data[1]);
+		if (dirfh_len > NFS3_FHSIZE)
+			return -1;
+		memcpy (dirfh, rpc_pkt.u.reply.data + 2, dirfh_len);
+	} else {
+		dirfh_len = NFS_FHSIZE;
+		memcpy (dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	}
 	fs_mounted = 1;
-	memcpy (dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
 
 	return 0;
 }
@@ -449,7 +586,7 @@ nfs_umountall_reply (uchar *pkt, unsigned len)
 	memcpy ((unsigned char *)&rpc_pkt, pkt, len);
 
 	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
-		return -1;
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -473,7 +610,41 @@ nfs_lookup_reply (uchar *pkt, unsigned len)
 	memcpy ((unsigned char *)&rpc_pkt, pkt, len);
 
 	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
+		return -NFS_RPC_DROP;
+
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0]) {
 		return -1;
+	}
+
+	if (nfs_version == 3) {
+		filefh_len = ntohl(rpc_pkt.u.reply.data[1]);
+		if (filefh_len > NFS3_FHSIZE)
+			return -1;
+		memcpy (filefh, rpc_pkt.u.reply.data + 2, filefh_len);
+	} else {
+		filefh_len = NFS_FHSIZE;
+		memcpy (filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	}
+
+	return 0;
+}
+
+static int
+nfs_fsinfo_reply (uchar *pkt, unsigned len)
+{
+	struct rpc_t rpc_pkt;
+	uint32_t *p, *attr;
+	unsigned rtmax;
+
+	debug("%s\n", __func__);
+
+	memcpy ((unsigned char *)&rpc_pkt, pkt, len);
+
+	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -482,7 +653,10 @@ nfs_lookup_reply (uchar *pkt, unsigned len)
 		return -1;
 	}
 
-	memcpy (filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	p = nfs3_skip_attr (rpc_pkt.u.reply.data + 1, &attr);
+	rtmax = ntohl(p[0]);
+	if (rtmax)
+		nfs_rsize = min(rtmax, (unsigned)NFS_READ_SIZE_MAX);
 
 	return 0;
 }
@@ -491,6 +665,8 @@ static int
 nfs_readlink_reply (uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	uint32_t *p, *attr;
+	char *target;
 	int rlen;
 
 	debug("%s\n", __func__);
@@ -498,7 +674,7 @@ nfs_readlink_reply (uchar *pkt, unsigned len)
 	memcpy ((unsigned char *)&rpc_pkt, pkt, len);
 
 	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
-		return -1;
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -507,33 +683,51 @@ nfs_readlink_reply (uchar *pkt, unsigned len)
 		return -1;
 	}
 
-	rlen = ntohl (rpc_pkt.u.reply.data[1]); /* new path length */
+	p = rpc_pkt.u.reply.data + 1;
+	if (nfs_version == 3)
+		p = nfs3_skip_attr (p, &attr);
+	rlen = ntohl (p[0]); /* new path length */
+	target = (char *)&p[1];
+	if (rlen < 0 || rlen + strlen(nfs_path) + 2 > sizeof(nfs_path_buff))
+		return -1;
 
-	if (*((char *)&(rpc_pkt.u.reply.data[2])) != '/') {
+	if (*target != '/') {
 		int pathlen;
 		strcat (nfs_path, "/");
 		pathlen = strlen(nfs_path);
-		memcpy (nfs_path+pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		memcpy (nfs_path+pathlen, target, rlen);
 		nfs_path[pathlen + rlen] = 0;
 	} else {
-		memcpy (nfs_path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		memcpy (nfs_path, target, rlen);
 		nfs_path[rlen] = 0;
 	}
 	return 0;
 }
 
+/* The RPC header plus the largest NFSv3 READ result ahead of the data */
+#define NFS_READ_HDR_SIZE ((6 + 26) * sizeof(uint32_t))
+
 static int
 nfs_read_reply (uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
+	struct nfs_read_slot *s;
+	uint32_t *p, *attr;
+	unsigned long id;
+	ulong size;
+	unsigned rlen, hlen;
+	int eof;
 
 	debug("%s\n", __func__);
 
-	memcpy ((uchar *)&rpc_pkt, pkt, sizeof(rpc_pkt.u.reply));
+	memcpy ((uchar *)&rpc_pkt, pkt, min(len, (unsigned)NFS_READ_HDR_SIZE));
 
-	if (ntohl(rpc_pkt.u.reply.id) != rpc_id)
-		return -1;
+	id = ntohl(rpc_pkt.u.reply.id);
+	for (s = nfs_reads; s < nfs_reads + nfs_window; s++)
+		if (s->id == id)
+			break;
+	if (s == nfs_reads + nfs_window)
+		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -548,18 +742,46 @@ nfs_read_reply (uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);;
 	}
 
-	if ((nfs_offset!=0) && !((nfs_offset) % (NFS_READ_SIZE/2*10*HASHES_PER_LINE))) {
-		puts ("\n\t ");
+	if (nfs_version == 3) {
+		p = nfs3_skip_attr (rpc_pkt.u.reply.data + 1, &attr);
+		rlen = ntohl(p[0]);
+		eof = ntohl(p[1]);
+		p += 3;		/* count, eof, opaque length */
+	} else {
+		size = ntohl(rpc_pkt.u.reply.data[6]);	/* fattr.size */
+		rlen = ntohl(rpc_pkt.u.reply.data[18]);
+		eof = s->offset + rlen >= size;
+		p = rpc_pkt.u.reply.data + 19;
 	}
-	if (!(nfs_offset % ((NFS_READ_SIZE/2)*10))) {
+	hlen = (uchar *)p - (uchar *)&rpc_pkt;
+	if (rlen > s->len || hlen + rlen > len)
+		return -NFS_RPC_DROP;	/* truncated, wait for a resend */
+
+	if (store_block (pkt + hlen, s->offset, rlen))
+		return -9999;
+
+	nfs_received += rlen;
+	while (nfs_hashes < nfs_received / NFS_HASH_SIZE) {
+		if (nfs_hashes && !(nfs_hashes % HASHES_PER_LINE))
+			puts ("\n\t ");
 		putc ('#');
+		nfs_hashes++;
 	}
 
-	rlen = ntohl(rpc_pkt.u.reply.data[18]);
-	if ( store_block ((uchar *)pkt+sizeof(rpc_pkt.u.reply), nfs_offset, rlen) )
-		return -9999;
+	if (eof || !rlen) {
+		if (s->offset + rlen < nfs_eof)
+			nfs_eof = s->offset + rlen;
+		s->id = 0;
+	} else if (rlen < s->len) {
+		/* short read, ask for the rest of this block */
+		s->offset += rlen;
+		s->len -= rlen;
+		s->id = nfs_read_req (s->offset, s->len);
+	} else {
+		s->id = 0;
+	}
 
-	return rlen;
+	return 0;
 }
 
 /**************************************************************************
@@ -590,19 +812,37 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 
 	switch (NfsState) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
-		rpc_lookup_reply (PROG_MOUNT, pkt, len);
+		if (rpc_lookup_reply (PROG_MOUNT, pkt, len) == -NFS_RPC_DROP)
+			break;
+		if (nfs_version == 3 && !NfsSrvMountPort) {
+			debug("No MOUNT v3, falling back to NFSv2\n");
+			nfs_version = 2;
+			NfsSend ();
+			break;
+		}
 		NfsState = STATE_PRCLOOKUP_PROG_NFS_REQ;
 		NfsSend ();
 		break;
 
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
-		rpc_lookup_reply (PROG_NFS, pkt, len);
+		if (rpc_lookup_reply (PROG_NFS, pkt, len) == -NFS_RPC_DROP)
+			break;
+		if (nfs_version == 3 && !NfsSrvNfsPort) {
+			debug("No NFSv3, falling back to NFSv2\n");
+			nfs_version = 2;
+			NfsState = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+			NfsSend ();
+			break;
+		}
 		NfsState = STATE_MOUNT_REQ;
 		NfsSend ();
 		break;
 
 	case STATE_MOUNT_REQ:
-		if (nfs_mount_reply(pkt, len)) {
+		rlen = nfs_mount_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
+		if (rlen) {
 			puts ("*** ERROR: Cannot mount\n");
 			/* just to be sure... */
 			NfsState = STATE_UMOUNT_REQ;
@@ -614,7 +854,10 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		break;
 
 	case STATE_UMOUNT_REQ:
-		if (nfs_umountall_reply(pkt, len)) {
+		rlen = nfs_umountall_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
+		if (rlen) {
 			puts ("*** ERROR: Cannot umount\n");
 			NetState = NETLOOP_FAIL;
 		} else {
@@ -624,20 +867,40 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		break;
 
 	case STATE_LOOKUP_REQ:
-		if (nfs_lookup_reply(pkt, len)) {
+		rlen = nfs_lookup_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
+		if (rlen) {
 			puts ("*** ERROR: File lookup fail\n");
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend ();
+		} else if (nfs_version == 3) {
+			nfs_rsize = NFS_READ_SIZE;
+			NfsState = STATE_FSINFO_REQ;
+			NfsSend ();
 		} else {
 			NfsState = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_rsize = NFS_READ_SIZE;
+			nfs_read_start ();
 			NfsSend ();
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		/* without a usable answer, nfs_rsize stays NFS_READ_SIZE */
+		if (nfs_fsinfo_reply(pkt, len) == -NFS_RPC_DROP)
+			break;
+		debug("NFSv3 read size %u\n", nfs_rsize);
+		NfsState = STATE_READ_REQ;
+		nfs_read_start ();
+		NfsSend ();
+		break;
+
 	case STATE_READLINK_REQ:
-		if (nfs_readlink_reply(pkt, len)) {
+		rlen = nfs_readlink_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
+		if (rlen) {
 			puts ("*** ERROR: Symlink fail\n");
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend ();
@@ -653,17 +916,24 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply (pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
 		NetSetTimeout (NFS_TIMEOUT, NfsTimeout);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			NfsSend ();
+		if (!rlen) {
+			NfsTimeoutCount = 0;
+			nfs_window = NFS_READ_WINDOW;
+			nfs_read_fill (0);
+			if (!nfs_read_busy ()) {
+				NfsDownloadState = NETLOOP_SUCCESS;
+				NfsState = STATE_UMOUNT_REQ;
+				NfsSend ();
+			}
 		}
 		else if ((rlen == -NFSERR_ISDIR)||(rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			NfsState = STATE_READLINK_REQ;
 			NfsSend ();
 		} else {
-			if ( ! rlen ) NfsDownloadState = NETLOOP_SUCCESS;
 			NfsState = STATE_UMOUNT_REQ;
 			NfsSend ();
 		}
@@ -677,6 +947,9 @@ NfsStart (void)
 {
 	debug("%s\n", __func__);
 	NfsDownloadState = NETLOOP_FAIL;
+	nfs_version = 3;
+	NfsSrvMountPort = 0;	/* 0 until the portmapper knows better */
+	NfsSrvNfsPort = 0;
 
 	NfsServerIP = NetServerIP;
 	nfs_path = (char *)nfs_path_buff;
@@ -28,7 +28,13 @@
 #define NFS_READLINK    5
 #define NFS_READ        6
 
+#define NFS3PROC_LOOKUP		3
+#define NFS3PROC_READLINK	5
+#define NFS3PROC_READ		6
+#define NFS3PROC_FSINFO		19
+
 #define NFS_FHSIZE      32
+#define NFS3_FHSIZE     64
 
 #define NFSERR_PERM     1
 #define NFSERR_NOENT    2
@@ -47,6 +53,32 @@
 #define NFS_READ_SIZE 1024 /* biggest power of two that fits Ether frame */
 #endif
 
+/* Upper bound for the NFSv3 read size; the server's FSINFO rtmax may
+ * lower it.  Without CONFIG_IP_DEFRAG this is the frame-sized
+ * NFS_READ_SIZE, with it half of the reassembly buffer, which leaves
+ * room for the RPC and NFSv3 reply headers.
+ */
+#if defined(CONFIG_NFS_READ_SIZE_MAX)
+#define NFS_READ_SIZE_MAX CONFIG_NFS_READ_SIZE_MAX
+#elif defined(CONFIG_IP_DEFRAG)
+#ifndef CONFIG_NET_MAXDEFRAG
+#define CONFIG_NET_MAXDEFRAG 16384
+#endif
+#define NFS_READ_SIZE_MAX (CONFIG_NET_MAXDEFRAG / 2)
+#else
+#define NFS_READ_SIZE_MAX NFS_READ_SIZE
+#endif
+
+/* Number of READ calls kept in flight once the file is being read.
+ * Every reply is one datagram of up to the read size, so the
+ * Ethernet receive buffers must be able to hold a window's worth.
+ */
+#ifdef CONFIG_NFS_READ_WINDOW
+#define NFS_READ_WINDOW CONFIG_NFS_READ_WINDOW
+#else
+#define NFS_READ_WINDOW 4
+#endif
+
 #define NFS_MAXLINKDEPTH 16
 
 struct rpc_t {
@@ -0,0 +1,407 @@
+/*
+ * Minimal TCP client for U-Boot
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * One active connection at a time, just enough to pull a file off a web
+ * server: we send a short request and then receive a lot of data.
+ *
+ * - received data is handed to the user in order and in place; a
+ *   segment beyond a hole is dropped and answered with a duplicate ACK
+ *   so the sender retransmits quickly (no SACK, no reassembly queue)
+ * - the data is consumed as it arrives, so the advertised window is
+ *   constant and slides along with every ACK
+ * - ACKs are delayed: one for every second segment, or at the next tick
+ * - only one segment of our own data is in flight, retransmitted with
+ *   an exponential backoff
+ */
+
+#include <common.h>
+#include <command.h>
+#include <net.h>
+
+#include "tcp.h"
+
+/* Receive window we advertise; bursts larger than the rx ring get lost */
+#ifdef CONFIG_TCP_WINDOW
+#define TCP_WINDOW		CONFIG_TCP_WINDOW
+#else
+#define TCP_WINDOW		(PKTBUFSRX * TCP_MSS)
+#endif
+
+#define TCP_TICK		100UL	/* ms, delayed ACK granularity	*/
+#define TCP_RTO_INIT		1000UL	/* ms				*/
+#define TCP_RTO_MAX		8000UL	/* ms				*/
+#define TCP_IDLE_TIMEOUT	30000UL	/* ms without a segment		*/
+#ifndef	CONFIG_NET_RETRY_COUNT
+# define TCP_RETRIES		8
+#else
+# define TCP_RETRIES		(CONFIG_NET_RETRY_COUNT * 2)
+#endif
+
+/* Default MSS if the server does not send the option (RFC 1122) */
+#define TCP_DEFAULT_MSS		536
+
+#define SEQ_LT(a, b)		((long)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)		((long)((a) - (b)) <= 0)
+
+#define TCP_CLOSED		0
+#define TCP_SYN_SENT		1
+#define TCP_ESTABLISHED		2
+
+static int	tcp_state = TCP_CLOSED;
+static struct tcp_handler *tcp_user;
+
+static IPaddr_t	tcp_remote_ip;
+static uchar	tcp_remote_ether[6];
+static int	tcp_remote_port;
+static int	tcp_our_port;
+static unsigned	tcp_peer_mss;
+
+static ulong	tcp_iss;	/* our initial sequence number		*/
+static ulong	tcp_snd_una;	/* oldest unacknowledged byte		*/
+static ulong	tcp_snd_nxt;	/* next byte we send			*/
+static ulong	tcp_rcv_nxt;	/* next byte we expect			*/
+
+/* our one unacknowledged segment */
+static uchar	tcp_tx_buf[TCP_MSS];
+static unsigned	tcp_tx_len;
+static ulong	tcp_tx_time;
+static ulong	tcp_rto;
+static int	tcp_retries;
+
+static int	tcp_ack_pending;	/* segments received but not ACKed */
+static ulong	tcp_rx_time;
+
+static void tcp_tick(void);
+
+/*
+ * One's complement sum over the pseudo header and the segment, a valid
+ * received segment sums up to 0xffff.
+ */
+static ushort
+tcp_cksum(IPaddr_t src, IPaddr_t dst, uchar *seg, unsigned len)
+{
+	ushort pseudo[6];
+	ulong xsum;
+
+	NetCopyIP(&pseudo[0], &src);
+	NetCopyIP(&pseudo[2], &dst);
+	pseudo[4] = htons(IPPROTO_TCP);
+	pseudo[5] = htons(len);
+
+	xsum = NetCksum((uchar *)pseudo, 6);
+	xsum += NetCksum(seg, len / 2);
+	if (len & 1) {
+		ushort last = 0;
+
+		*(uchar *)&last = seg[len - 1];
+		xsum += last;
+	}
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+	return xsum;
+}
+
+static void
+tcp_send_segment(ulong seq, uchar flags, const uchar *data, unsigned len)
+{
+	uchar *pkt = (uchar *)NetTxPacket;
+	uchar *ip;
+	TCP_t *th;
+	unsigned hlen = TCP_HDR_SIZE;
+	ulong tmp;
+
+	pkt += NetSetEther(pkt, tcp_remote_ether, PROT_IP);
+	ip = pkt;
+	th = (TCP_t *)(ip + IP_HDR_SIZE_NO_UDP);
+
+	if (flags & TCP_SYN) {
+		uchar *opt = (uchar *)th + TCP_HDR_SIZE;
+
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		hlen += 4;
+	}
+
+	th->tcp_src = htons(tcp_our_port);
+	th->tcp_dst = htons(tcp_remote_port);
+	tmp = htonl(seq);
+	NetCopyLong(&th->tcp_seq, &tmp);
+	tmp = (flags & TCP_ACK) ? htonl(tcp_rcv_nxt) : 0;
+	NetCopyLong(&th->tcp_ack, &tmp);
+	th->tcp_hlen = (hlen / 4) << 4;
+	th->tcp_flags = flags;
+	th->tcp_win = htons(TCP_WINDOW);
+	th->tcp_urp = 0;
+	if (len)
+		memcpy((uchar *)th + hlen, data, len);
+
+	th->tcp_xsum = 0;
+	th->tcp_xsum = ~tcp_cksum(NetOurIP, tcp_remote_ip, (uchar *)th,
+				  hlen + len);
+	NetSetIPHeader(ip, tcp_remote_ip, IPPROTO_TCP, hlen + len);
+
+	if (flags & TCP_ACK)
+		tcp_ack_pending = 0;
+
+	NetSendIPPacket(tcp_remote_ether, tcp_remote_ip,
+			(ip - (uchar *)NetTxPacket) + IP_HDR_SIZE_NO_UDP +
+			hlen + len);
+}
+
+static void
+tcp_send_ack(void)
+{
+	tcp_send_segment(tcp_snd_nxt, TCP_ACK, NULL, 0);
+}
+
+static void
+tcp_send_rst(void)
+{
+	if (tcp_state == TCP_ESTABLISHED)
+		tcp_send_segment(tcp_snd_nxt, TCP_RST | TCP_ACK, NULL, 0);
+}
+
+static void
+tcp_abort(const char *why)
+{
+	printf("\nTCP connection %s\n", why);
+	tcp_state = TCP_CLOSED;
+	tcp_user->closed(1);
+}
+
+static void
+tcp_parse_mss(TCP_t *th, unsigned hlen)
+{
+	uchar *opt = (uchar *)th + TCP_HDR_SIZE;
+	uchar *end = (uchar *)th + hlen;
+
+	while (opt < end && *opt != TCP_OPT_EOL) {
+		if (*opt == TCP_OPT_NOP) {
+			opt++;
+			continue;
+		}
+		if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+			break;
+		if (opt[0] == TCP_OPT_MSS && opt[1] == 4) {
+			tcp_peer_mss = (opt[2] << 8) | opt[3];
+			if (tcp_peer_mss > TCP_MSS)
+				tcp_peer_mss = TCP_MSS;
+		}
+		opt += opt[1];
+	}
+}
+
+void
+tcp_connect(IPaddr_t dest, int dport, struct tcp_handler *h)
+{
+	tcp_user = h;
+	tcp_remote_ip = dest;
+	tcp_remote_port = dport;
+	tcp_our_port = 1024 + (get_timer(0) % 3072);
+	memset(tcp_remote_ether, 0, 6);
+	tcp_peer_mss = TCP_DEFAULT_MSS;
+
+	tcp_iss = get_timer(0) << 10;
+	tcp_snd_una = tcp_iss;
+	tcp_snd_nxt = tcp_iss + 1;
+	tcp_rcv_nxt = 0;
+	tcp_tx_len = 0;
+	tcp_ack_pending = 0;
+	tcp_retries = 0;
+	tcp_rto = TCP_RTO_INIT;
+	tcp_tx_time = tcp_rx_time = get_timer(0);
+	tcp_state = TCP_SYN_SENT;
+
+	debug("TCP connect to %pI4:%d from port %d\n",
+	      &tcp_remote_ip, tcp_remote_port, tcp_our_port);
+	tcp_send_segment(tcp_iss, TCP_SYN, NULL, 0);
+	NetSetTimeout(TCP_TICK, tcp_tick);
+}
+
+int
+tcp_send(const void *data, unsigned len)
+{
+	if (tcp_state != TCP_ESTABLISHED || tcp_tx_len ||
+	    len > tcp_peer_mss)
+		return -1;
+
+	memcpy(tcp_tx_buf, data, len);
+	tcp_tx_len = len;
+	tcp_snd_nxt += len;
+	tcp_tx_time = get_timer(0);
+	tcp_send_segment(tcp_snd_una, TCP_ACK | TCP_PSH, tcp_tx_buf, len);
+	return 0;
+}
+
+void
+tcp_close(void)
+{
+	if (tcp_state == TCP_ESTABLISHED)
+		tcp_send_segment(tcp_snd_nxt, TCP_FIN | TCP_ACK, NULL, 0);
+	tcp_state = TCP_CLOSED;
+}
+
+void
+tcp_reset(void)
+{
+	tcp_send_rst();
+	tcp_state = TCP_CLOSED;
+}
+
+static void
+tcp_tick(void)
+{
+	ulong now = get_timer(0);
+
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (tcp_ack_pending)
+		tcp_send_ack();
+
+	if ((tcp_state == TCP_SYN_SENT || tcp_tx_len) &&
+	    now - tcp_tx_time >= tcp_rto) {
+		if (++tcp_retries > TCP_RETRIES) {
+			tcp_abort("timed out");
+			return;
+		}
+		puts("T ");
+		tcp_tx_time = now;
+		tcp_rto = min(tcp_rto * 2, TCP_RTO_MAX);
+		if (tcp_state == TCP_SYN_SENT)
+			tcp_send_segment(tcp_iss, TCP_SYN, NULL, 0);
+		else
+			tcp_send_segment(tcp_snd_una, TCP_ACK | TCP_PSH,
+					 tcp_tx_buf, tcp_tx_len);
+	} else if (tcp_state == TCP_ESTABLISHED &&
+		   now - tcp_rx_time >= TCP_IDLE_TIMEOUT) {
+		/* tell the server, in case it is still there */
+		tcp_send_rst();
+		tcp_abort("timed out");
+		return;
+	}
+
+	NetSetTimeout(TCP_TICK, tcp_tick);
+}
+
+void
+tcp_receive(IP_t *ip, IPaddr_t sip, unsigned len)
+{
+	TCP_t *th = (TCP_t *)((uchar *)ip + IP_HDR_SIZE_NO_UDP);
+	unsigned seglen = len - IP_HDR_SIZE_NO_UDP;
+	unsigned hlen, dlen;
+	ulong seq, ack;
+	uchar *data;
+	long diff;
+
+	if (tcp_state == TCP_CLOSED || len < IP_HDR_SIZE_NO_UDP + TCP_HDR_SIZE)
+		return;
+	if (sip != tcp_remote_ip ||
+	    ntohs(th->tcp_src) != tcp_remote_port ||
+	    ntohs(th->tcp_dst) != tcp_our_port)
+		return;
+	if (tcp_cksum(sip, NetReadIP(&ip->ip_dst), (uchar *)th, seglen) !=
+	    0xffff) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+	hlen = (th->tcp_hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || hlen > seglen)
+		return;
+
+	seq = ntohl(NetReadLong(&th->tcp_seq));
+	ack = ntohl(NetReadLong(&th->tcp_ack));
+	data = (uchar *)th + hlen;
+	dlen = seglen - hlen;
+	tcp_rx_time = get_timer(0);
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if (!(th->tcp_flags & TCP_ACK) || ack != tcp_iss + 1)
+			return;
+		if (th->tcp_flags & TCP_RST) {
+			tcp_abort("refused");
+			return;
+		}
+		if (!(th->tcp_flags & TCP_SYN))
+			return;
+
+		tcp_parse_mss(th, hlen);
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_retries = 0;
+		tcp_rto = TCP_RTO_INIT;
+		tcp_state = TCP_ESTABLISHED;
+		debug("TCP established, peer mss %u\n", tcp_peer_mss);
+
+		tcp_send_ack();
+		tcp_user->connected();
+		return;
+	}
+
+	/* TCP_ESTABLISHED */
+	if (th->tcp_flags & TCP_RST) {
+		if (seq == tcp_rcv_nxt)
+			tcp_abort("reset");
+		return;
+	}
+	if (!(th->tcp_flags & TCP_ACK))
+		return;
+
+	if (SEQ_LT(tcp_snd_una, ack) && SEQ_LEQ(ack, tcp_snd_nxt)) {
+		tcp_snd_una = ack;
+		if (tcp_snd_una == tcp_snd_nxt) {
+			tcp_tx_len = 0;
+			tcp_retries = 0;
+			tcp_rto = TCP_RTO_INIT;
+		}
+	}
+
+	if (!dlen && !(th->tcp_flags & TCP_FIN))
+		return;
+
+	diff = (long)(seq - tcp_rcv_nxt);
+	if (diff > 0) {
+		/* a segment got lost, ask for it again */
+		tcp_send_ack();
+		return;
+	}
+	if (diff < 0) {
+		/* retransmission of data we already have, keep the new part */
+		if (-diff > dlen ||
+		    (-diff == dlen && !(th->tcp_flags & TCP_FIN))) {
+			tcp_send_ack();
+			return;
+		}
+		data -= diff;
+		dlen += diff;
+	}
+
+	if (dlen) {
+		tcp_rcv_nxt += dlen;
+		tcp_user->receive(data, dlen);
+		/* the user may have closed the connection */
+		if (tcp_state != TCP_ESTABLISHED)
+			return;
+	}
+
+	if (th->tcp_flags & TCP_FIN) {
+		/* the server is done; so are we */
+		tcp_rcv_nxt++;
+		tcp_send_segment(tcp_snd_nxt, TCP_FIN | TCP_ACK, NULL, 0);
+		tcp_state = TCP_CLOSED;
+		tcp_user->closed(0);
+		return;
+	}
+
+	if (++tcp_ack_pending >= 2)
+		tcp_send_ack();
+}
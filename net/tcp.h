@@ -0,0 +1,73 @@
+/*
+ * Minimal TCP client for U-Boot
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+/*
+ * TCP header.  The 32-bit fields are not aligned in received frames,
+ * access them with NetReadLong() / NetCopyLong().
+ */
+typedef struct {
+	ushort		tcp_src;	/* source port			*/
+	ushort		tcp_dst;	/* destination port		*/
+	ulong		tcp_seq;	/* sequence number		*/
+	ulong		tcp_ack;	/* acknowledgement number	*/
+	uchar		tcp_hlen;	/* header length (words) << 4	*/
+	uchar		tcp_flags;	/* TCP_xxx			*/
+	ushort		tcp_win;	/* receive window		*/
+	ushort		tcp_xsum;	/* checksum			*/
+	ushort		tcp_urp;	/* urgent pointer		*/
+} TCP_t;
+
+#define TCP_HDR_SIZE	(sizeof(TCP_t))
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+#define TCP_OPT_EOL	0
+#define TCP_OPT_NOP	1
+#define TCP_OPT_MSS	2
+
+/* Largest segment we send and accept: one unfragmented ethernet frame */
+#define TCP_MSS		(1500 - IP_HDR_SIZE_NO_UDP - TCP_HDR_SIZE)
+
+/*
+ * Callbacks of the (single) connection's user.  receive() is handed the
+ * in-order payload in place in the receive buffer.  closed() is called
+ * once, with err 0 when the server closed the connection normally and
+ * non-zero after a reset or when the connection timed out.
+ */
+struct tcp_handler {
+	void	(*connected)(void);
+	void	(*receive)(uchar *data, unsigned len);
+	void	(*closed)(int err);
+};
+
+/* Open a connection to dest:dport; the handler is told how it went */
+extern void	tcp_connect(IPaddr_t dest, int dport, struct tcp_handler *h);
+
+/* Queue len bytes (at most TCP_MSS) for sending; one segment in flight */
+extern int	tcp_send(const void *data, unsigned len);
+
+/* Send our FIN; no more callbacks are made after this */
+extern void	tcp_close(void);
+
+/* Drop the connection, if any, with a RST; no more callbacks are made */
+extern void	tcp_reset(void);
+
+/* Called by NetReceive() for every TCP packet, len is the IP length */
+extern void	tcp_receive(IP_t *ip, IPaddr_t sip, unsigned len);
+
+#endif /* __TCP_H__ */
@@ -70,6 +70,10 @@ static int	TftpTimeoutCount;
 static ulong	TftpBlock;
 /* last packet sequence number received */
 static ulong	TftpLastBlock;
+/* last packet sequence number acknowledged */
+static ulong	TftpLastAck;
+/* TftpLastBlock was acknowledged again for a resent window */
+static int	TftpDupAcked;
 /* count of sequence number wraparounds */
 static ulong	TftpBlockWrap;
 /* memory offset due to wrapping */
@@ -120,8 +124,30 @@ extern flash_info_t flash_info[];
 #define TFTP_MTU_BLOCKSIZE 1468
 #endif
 
+/* Largest block we can receive: one unfragmented frame unless defragmenting */
+#ifdef CONFIG_IP_DEFRAG
+#ifndef CONFIG_NET_MAXDEFRAG
+#define CONFIG_NET_MAXDEFRAG 16384
+#endif
+#define TFTP_MAX_BLOCKSIZE (CONFIG_NET_MAXDEFRAG - 8 - 4)
+#else
+#define TFTP_MAX_BLOCKSIZE 1468
+#endif
+
+/*
+ * RFC 7440 windowsize: the server sends this many blocks before waiting
+ * for an ACK.  1 is plain lock-step TFTP and the option is not sent.
+ */
+#ifdef CONFIG_TFTP_WINDOWSIZE
+#define TFTP_WINDOWSIZE CONFIG_TFTP_WINDOWSIZE
+#else
+#define TFTP_WINDOWSIZE 1
+#endif
+
 static unsigned short TftpBlkSize = TFTP_BLOCK_SIZE;
 static unsigned short TftpBlkSizeOption = TFTP_MTU_BLOCKSIZE;
+static unsigned short TftpWindowSize = 1;
+static unsigned short TftpWindowSizeOption = TFTP_WINDOWSIZE;
 
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
@@ -192,6 +218,7 @@ store_block(unsigned block, uchar *src, unsigned len)
 
 static void TftpSend(void);
 static void TftpTimeout(void);
+static void TftpAckResent(void);
 
 /**********************************************************************/
 
@@ -239,6 +266,9 @@ TftpSend(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, TftpBlkSizeOption, 0);
+		if (TftpWindowSizeOption > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, TftpWindowSizeOption, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!ProhibitMcast
@@ -269,6 +299,7 @@ TftpSend(void)
 		*s++ = htons(TftpBlock);
 		pkt = (uchar *)s;
 		len = pkt - xp;
+		TftpLastAck = TftpBlock;
 		break;
 
 	case STATE_TOO_LARGE:
@@ -365,6 +396,16 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 				debug("Blocksize ack: %s, %d\n",
 					(char *)pkt+i+8, TftpBlkSize);
 			}
+			if (strcmp((char *)pkt+i, "windowsize") == 0) {
+				TftpWindowSize = (unsigned short)
+					simple_strtoul((char *)pkt+i+11, NULL,
+						       10);
+				if (TftpWindowSize == 0 ||
+				    TftpWindowSize > TftpWindowSizeOption)
+					TftpWindowSize = 1;
+				debug("Windowsize ack: %s, %d\n",
+					(char *)pkt+i+11, TftpWindowSize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				TftpTsize = simple_strtoul((char *)pkt+i+6,
@@ -388,35 +429,6 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 		len -= 2;
 		TftpBlock = ntohs(*(ushort *)pkt);
 
-		/*
-		 * RFC1350 specifies that the first data packet will
-		 * have sequence number 1. If we receive a sequence
-		 * number of 0 this means that there was a wrap
-		 * around of the (16 bit) counter.
-		 */
-		if (TftpBlock == 0) {
-			TftpBlockWrap++;
-			TftpBlockWrapOffset +=
-				TftpBlkSize * TFTP_SEQUENCE_SIZE;
-			printf("\n\t %lu MB received\n\t ",
-				TftpBlockWrapOffset>>20);
-		}
-#ifdef CONFIG_TFTP_TSIZE
-		else if (TftpTsize) {
-			while (TftpNumchars <
-			       NetBootFileXferSize * 50 / TftpTsize) {
-				putc('#');
-				TftpNumchars++;
-			}
-		}
-#endif
-		else {
-			if (((TftpBlock - 1) % 10) == 0)
-				putc('#');
-			else if ((TftpBlock % (10 * HASHES_PER_LINE)) == 0)
-				puts("\n\t ");
-		}
-
 		if (TftpState == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
 
@@ -426,6 +438,8 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 			TftpState = STATE_DATA;
 			TftpRemotePort = src;
 			TftpLastBlock = 0;
+			TftpLastAck = 0;
+			TftpDupAcked = 0;
 			TftpBlockWrap = 0;
 			TftpBlockWrapOffset = 0;
 
@@ -446,20 +460,75 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 
 		if (TftpBlock == TftpLastBlock) {
 			/*
-			 *	Same block again; ignore it.
+			 *	Same block again.
+			 */
+#ifdef CONFIG_MCAST_TFTP
+			if (!Multicast)
+#endif
+			TftpAckResent();
+			break;
+		}
+
+#ifdef CONFIG_MCAST_TFTP
+		if (!Multicast)
+#endif
+		if (TftpBlock != ((TftpLastBlock + 1) & 0xffff)) {
+			/*
+			 *	A block we have already: see TftpAckResent().
+			 *	A block of the window was lost or reordered:
+			 *	acknowledge the last one we have, once, so
+			 *	the server restarts the window right after it.
 			 */
+			int resent =
+				((TftpLastBlock - TftpBlock) & 0xffff) < 0x8000;
+
+			TftpBlock = TftpLastBlock;
+			if (resent)
+				TftpAckResent();
+			else if (TftpLastAck != TftpLastBlock)
+				TftpSend();
 			break;
 		}
 
+		/*
+		 * RFC1350 specifies that the first data packet will
+		 * have sequence number 1. If we receive a sequence
+		 * number of 0 this means that there was a wrap
+		 * around of the (16 bit) counter.
+		 */
+		if (TftpBlock == 0) {
+			TftpBlockWrap++;
+			TftpBlockWrapOffset +=
+				TftpBlkSize * TFTP_SEQUENCE_SIZE;
+			printf("\n\t %lu MB received\n\t ",
+				TftpBlockWrapOffset>>20);
+		}
+#ifdef CONFIG_TFTP_TSIZE
+		else if (TftpTsize) {
+			while (TftpNumchars <
+			       NetBootFileXferSize * 50 / TftpTsize) {
+				putc('#');
+				TftpNumchars++;
+			}
+		}
+#endif
+		else {
+			if (((TftpBlock - 1) % 10) == 0)
+				putc('#');
+			else if ((TftpBlock % (10 * HASHES_PER_LINE)) == 0)
+				puts("\n\t ");
+		}
+
 		TftpLastBlock = TftpBlock;
+		TftpDupAcked = 0;
 		TftpTimeoutCountMax = TIMEOUT_COUNT;
 		NetSetTimeout(TftpTimeoutMSecs, TftpTimeout);
 
 		store_block(TftpBlock - 1, pkt + 2, len);
 
 		/*
-		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	Acknowledge the last block of each window, which will
+		 *	prompt the remote for the next one.
 		 */
 #ifdef CONFIG_MCAST_TFTP
 		/* if I am the MasterClient, actively calculate what my next
@@ -485,8 +554,13 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 				TftpLastBlock = TftpBlock;
 			}
 		}
+		if (Multicast || len < TftpBlkSize ||
+		    ((TftpBlock - TftpLastAck) & 0xffff) >= TftpWindowSize)
+#else
+		if (len < TftpBlkSize ||
+		    ((TftpBlock - TftpLastAck) & 0xffff) >= TftpWindowSize)
 #endif
-		TftpSend();
+			TftpSend();
 
 #ifdef CONFIG_MCAST_TFTP
 		if (Multicast) {
@@ -544,6 +618,24 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 }
 
 
+/*
+ * A block we have already came in again.  With a window larger than one
+ * the server is resending a window whose closing ack was lost: ack the
+ * last block we have, once for the whole window rather than once per
+ * block.  With a window of one, ignore it, as RFC1350 says; our own
+ * timeout resends the ack.
+ */
+static void
+TftpAckResent(void)
+{
+	if (TftpWindowSize <= 1 || TftpDupAcked)
+		return;
+
+	TftpDupAcked = 1;
+	TftpBlock = TftpLastBlock;
+	TftpSend();
+}
+
 static void
 TftpTimeout(void)
 {
@@ -574,6 +666,17 @@ TftpStart(void)
 	ep = getenv("tftpblocksize");
 	if (ep != NULL)
 		TftpBlkSizeOption = simple_strtol(ep, NULL, 10);
+	if (TftpBlkSizeOption > TFTP_MAX_BLOCKSIZE) {
+		printf("TFTP blocksize %d too large, using %d\n",
+			TftpBlkSizeOption, TFTP_MAX_BLOCKSIZE);
+		TftpBlkSizeOption = TFTP_MAX_BLOCKSIZE;
+	}
+
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL)
+		TftpWindowSizeOption = simple_strtol(ep, NULL, 10);
+	if (TftpWindowSizeOption < 1)
+		TftpWindowSizeOption = 1;
 
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
@@ -586,8 +689,8 @@ TftpStart(void)
 		TftpTimeoutMSecs = 1000;
 	}
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-		TftpBlkSizeOption, TftpTimeoutMSecs);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+		TftpBlkSizeOption, TftpWindowSizeOption, TftpTimeoutMSecs);
 
 	TftpRemoteIP = NetServerIP;
 	if (BootFile[0] == '\0') {
@@ -668,8 +771,9 @@ TftpStart(void)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(NetServerEther, 0, 6);
-	/* Revert TftpBlkSize to dflt */
+	/* Revert TftpBlkSize and TftpWindowSize to dflt */
 	TftpBlkSize = TFTP_BLOCK_SIZE;
+	TftpWindowSize = 1;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -700,8 +804,9 @@ TftpStartServer(void)
 	TftpTimeoutMSecs = TIMEOUT;
 	NetSetTimeout(TftpTimeoutMSecs, TftpTimeout);
 
-	/* Revert TftpBlkSize to dflt */
+	/* Revert TftpBlkSize and TftpWindowSize to dflt */
 	TftpBlkSize = TFTP_BLOCK_SIZE;
+	TftpWindowSize = 1;
 	TftpBlock = 0;
 	TftpOurPort = WELL_KNOWN_PORT;
 
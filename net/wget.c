@@ -0,0 +1,337 @@
+/*
+ * HTTP file download for U-Boot
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * A plain HTTP/1.1 GET over the TCP client in tcp.c.  The body goes to
+ * load_addr, or through a window at load_addr into a block device
+ * partition.  Only "Content-Length" and close-delimited bodies are
+ * understood, which is what static file servers send.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <net.h>
+
+#include "tcp.h"
+#include "wget.h"
+
+/* Staging window for partition writes, a multiple of the block size */
+#ifdef CONFIG_WGET_WINDOW_SIZE
+#define WGET_WINDOW_SIZE	CONFIG_WGET_WINDOW_SIZE
+#else
+#define WGET_WINDOW_SIZE	(1 << 20)
+#endif
+
+#define WGET_HDR_MAX		1024
+/* One hash mark per this many bytes, HASHES_PER_LINE marks per line */
+#define WGET_HASH_SIZE		(64 << 10)
+#define HASHES_PER_LINE		65
+
+#define STATE_HEADERS		1
+#define STATE_BODY		2
+#define STATE_DONE		3
+
+static IPaddr_t	WgetServerIP;
+static int	WgetServerPort;
+static char	wget_path[sizeof(BootFile)];
+
+static int	WgetState;
+static char	WgetHdr[WGET_HDR_MAX + 1];
+static unsigned	WgetHdrLen;
+static int	WgetHaveLength;
+static ulong	WgetLength;
+static ulong	WgetOffset;
+static ulong	WgetHashes;
+
+static block_dev_desc_t *WgetDev;
+static disk_partition_t WgetPtn;
+static ulong	WgetFill;	/* bytes in the staging window */
+static lbaint_t	WgetBlkDone;	/* blocks written to the partition */
+
+void
+WgetSetPartition(block_dev_desc_t *dev, disk_partition_t *ptn)
+{
+	WgetDev = dev;
+	if (ptn)
+		WgetPtn = *ptn;
+}
+
+static void
+WgetFail(const char *msg)
+{
+	printf("\nwget: %s\n", msg);
+	WgetState = STATE_DONE;
+	tcp_close();
+	NetState = NETLOOP_FAIL;
+}
+
+/* Write the staging window to the partition, right after the last one */
+static int
+WgetFlush(void)
+{
+	disk_partition_t ptn = WgetPtn;
+	loff_t num_bytes = WgetFill;
+	int err;
+
+	if (!WgetFill)
+		return 0;
+
+	ptn.start += WgetBlkDone;
+	ptn.size -= WgetBlkDone;
+	err = partition_write_bytes(WgetDev, &ptn, &num_bytes,
+				    (void *)load_addr);
+	if (err) {
+		printf("\nwget: writing '%s' failed at block %lu, error=%d\n",
+		       WgetPtn.name, (ulong)WgetBlkDone, err);
+		return err;
+	}
+	WgetBlkDone += WgetFill / WgetDev->blksz;
+	WgetFill = 0;
+	return 0;
+}
+
+static int
+WgetStore(uchar *src, unsigned len)
+{
+	if (WgetDev) {
+		while (len) {
+			unsigned n = min(len,
+				(unsigned)(WGET_WINDOW_SIZE - WgetFill));
+
+			memcpy((void *)(load_addr + WgetFill), src, n);
+			WgetFill += n;
+			WgetOffset += n;
+			src += n;
+			len -= n;
+			if (WgetFill == WGET_WINDOW_SIZE && WgetFlush())
+				return -1;
+		}
+	} else {
+		memcpy((void *)(load_addr + WgetOffset), src, len);
+		WgetOffset += len;
+	}
+	NetBootFileXferSize = WgetOffset;
+
+	while (WgetHashes < WgetOffset / WGET_HASH_SIZE) {
+		putc('#');
+		if ((++WgetHashes % HASHES_PER_LINE) == 0)
+			puts("\n\t ");
+	}
+	return 0;
+}
+
+static void
+WgetDone(void)
+{
+	if (WgetDev && WgetFlush()) {
+		WgetFail("write failed");
+		return;
+	}
+	puts("\ndone\n");
+	WgetState = STATE_DONE;
+	tcp_close();
+	NetState = NETLOOP_SUCCESS;
+}
+
+/* Parse the status line and the headers we care about */
+static int
+WgetParseHeaders(void)
+{
+	char *line = WgetHdr;
+	char *eol;
+	ulong status;
+
+	if (strncmp(line, "HTTP/1.", 7) || !(line = strchr(line, ' '))) {
+		WgetFail("bad HTTP response");
+		return -1;
+	}
+	status = simple_strtoul(line + 1, NULL, 10);
+	if (status != 200) {
+		eol = strstr(line, "\r\n");
+		*eol = '\0';
+		printf("\nwget: server replied%s\n", line);
+		WgetFail("not retrying");
+		return -1;
+	}
+
+	while ((line = strstr(line, "\r\n")) != NULL) {
+		line += 2;
+		if (!strnicmp(line, "Content-Length:", 15)) {
+			WgetLength = simple_strtoul(line + 15, NULL, 10);
+			WgetHaveLength = 1;
+		} else if (!strnicmp(line, "Transfer-Encoding:", 18)) {
+			eol = strstr(line, "\r\n");
+			*eol = '\0';
+			if (strstr(line, "chunked")) {
+				WgetFail("chunked transfer encoding not supported");
+				return -1;
+			}
+			*eol = '\r';
+		}
+	}
+
+	if (WgetHaveLength) {
+		printf(" Size is 0x%lx Bytes = ", WgetLength);
+		print_size(WgetLength, "\n\t ");
+	}
+	/* in blocks: the partition's size in bytes may not fit a ulong */
+	if (WgetDev && WgetHaveLength &&
+	    DIV_ROUND_UP(WgetLength, WgetDev->blksz) > WgetPtn.size) {
+		WgetFail("file does not fit into the partition");
+		return -1;
+	}
+	return 0;
+}
+
+static void
+WgetReceive(uchar *data, unsigned len)
+{
+	if (WgetState == STATE_HEADERS) {
+		unsigned old = WgetHdrLen;
+		unsigned n = min(len, WGET_HDR_MAX - WgetHdrLen);
+		char *end;
+
+		memcpy(WgetHdr + WgetHdrLen, data, n);
+		WgetHdrLen += n;
+		WgetHdr[WgetHdrLen] = '\0';
+
+		end = strstr(WgetHdr, "\r\n\r\n");
+		if (!end) {
+			if (WgetHdrLen == WGET_HDR_MAX)
+				WgetFail("HTTP header too long");
+			return;
+		}
+		end[2] = '\0';
+
+		/* whatever follows the headers is the start of the body */
+		n = (end + 4 - WgetHdr) - old;
+		data += n;
+		len -= n;
+
+		if (WgetParseHeaders())
+			return;
+		WgetState = STATE_BODY;
+	}
+
+	if (WgetState != STATE_BODY)
+		return;
+
+	if (WgetHaveLength && len > WgetLength - WgetOffset)
+		len = WgetLength - WgetOffset;
+	if (len && WgetStore(data, len)) {
+		WgetFail("write failed");
+		return;
+	}
+	if (WgetHaveLength && WgetOffset == WgetLength)
+		WgetDone();
+}
+
+static void
+WgetConnected(void)
+{
+	char req[TCP_MSS];
+	int len;
+
+	if (strlen(wget_path) + 128 > sizeof(req)) {
+		WgetFail("file name too long");
+		return;
+	}
+	len = sprintf(req, "GET %s HTTP/1.1\r\n"
+		      "Host: %pI4\r\n"
+		      "User-Agent: U-Boot\r\n"
+		      "Connection: close\r\n\r\n",
+		      wget_path, &WgetServerIP);
+	if (tcp_send(req, len))
+		WgetFail("cannot send request");
+}
+
+static void
+WgetClosed(int err)
+{
+	if (WgetState == STATE_DONE)
+		return;
+	if (err)
+		WgetFail("connection failed");
+	else if (WgetState == STATE_BODY && !WgetHaveLength)
+		WgetDone();
+	else
+		WgetFail("connection closed early");
+}
+
+static struct tcp_handler wget_handler = {
+	.connected	= WgetConnected,
+	.receive	= WgetReceive,
+	.closed		= WgetClosed,
+};
+
+void
+WgetStart(void)
+{
+	char *ep;
+	char *p;
+
+	WgetServerIP = NetServerIP;
+	WgetServerPort = HTTP_SERVICE_PORT;
+	ep = getenv("httpdstport");
+	if (ep != NULL)
+		WgetServerPort = simple_strtol(ep, NULL, 10);
+
+	if (BootFile[0] == '\0') {
+		puts("*** ERROR: no file name given\n");
+		NetState = NETLOOP_FAIL;
+		return;
+	}
+	p = strchr(BootFile, ':');
+	if (p != NULL) {
+		WgetServerIP = string_to_ip(BootFile);
+		p++;
+	} else {
+		p = BootFile;
+	}
+	if (*p == '/')
+		strcpy(wget_path, p);
+	else
+		sprintf(wget_path, "/%.*s", (int)sizeof(wget_path) - 2, p);
+
+#if defined(CONFIG_NET_MULTI)
+	printf("Using %s device\n", eth_get_name());
+#endif
+	printf("HTTP from server %pI4"
+		"; our IP address is %pI4", &WgetServerIP, &NetOurIP);
+
+	/* Check if we need to send across this subnet */
+	if (NetOurGatewayIP && NetOurSubnetMask) {
+		IPaddr_t OurNet	    = NetOurIP	   & NetOurSubnetMask;
+		IPaddr_t ServerNet  = WgetServerIP & NetOurSubnetMask;
+
+		if (OurNet != ServerNet)
+			printf("; sending through gateway %pI4",
+			       &NetOurGatewayIP);
+	}
+	printf("\nFilename '%s'.", wget_path);
+	if (WgetDev)
+		printf("\nWriting to partition '%s' through 0x%lx\n",
+		       WgetPtn.name, load_addr);
+	else
+		printf("\nLoad address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	WgetState = STATE_HEADERS;
+	WgetHdrLen = 0;
+	WgetHaveLength = 0;
+	WgetLength = 0;
+	WgetOffset = 0;
+	WgetHashes = 0;
+	WgetFill = 0;
+	WgetBlkDone = 0;
+
+	/* a connection an aborted wget left behind must not feed this one */
+	tcp_reset();
+	tcp_connect(WgetServerIP, WgetServerPort, &wget_handler);
+}
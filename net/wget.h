@@ -0,0 +1,28 @@
+/*
+ * HTTP file download for U-Boot
+ *
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+#include <part.h>
+
+#define HTTP_SERVICE_PORT	80
+
+/* Begin an HTTP GET of BootFile to load_addr */
+extern void	WgetStart(void);
+
+/*
+ * Write the next download to this partition instead of leaving it in
+ * memory; load_addr is used as the staging window.  NULL turns it off.
+ */
+extern void	WgetSetPartition(block_dev_desc_t *dev, disk_partition_t *ptn);
+
+#endif /* __WGET_H__ */
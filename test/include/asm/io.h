@@ -0,0 +1,14 @@
+/* Shadows the target's <asm/io.h> in host tests; see common.h */
+#ifndef _TEST_ASM_IO_H
+#define _TEST_ASM_IO_H
+
+#include <common.h>
+
+#define readb(a)		(*(volatile u8 *)(a))
+#define readw(a)		(*(volatile u16 *)(a))
+#define readl(a)		(*(volatile u32 *)(a))
+#define writeb(v, a)		(*(volatile u8 *)(a) = (v))
+#define writew(v, a)		(*(volatile u16 *)(a) = (v))
+#define writel(v, a)		(*(volatile u32 *)(a) = (v))
+
+#endif /* _TEST_ASM_IO_H */
@@ -0,0 +1,7 @@
+/* Shadows the target's <asm/types.h> in host tests; see common.h */
+#ifndef _TEST_ASM_TYPES_H
+#define _TEST_ASM_TYPES_H
+
+#include <common.h>
+
+#endif /* _TEST_ASM_TYPES_H */
@@ -0,0 +1,9 @@
+/* Shadows the target's <asm/unaligned.h> in host tests; see common.h */
+#ifndef _TEST_ASM_UNALIGNED_H
+#define _TEST_ASM_UNALIGNED_H
+
+#include <common.h>
+#include <linux/unaligned/be_byteshift.h>
+#include <linux/unaligned/le_byteshift.h>
+
+#endif /* _TEST_ASM_UNALIGNED_H */
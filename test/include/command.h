@@ -0,0 +1,25 @@
+/* Shadows the target's <command.h> in host tests; see common.h */
+#ifndef _TEST_COMMAND_H
+#define _TEST_COMMAND_H
+
+#include <common.h>
+
+struct cmd_tbl_s {
+	char		*name;
+	int		maxargs;
+	int		repeatable;
+	int		(*cmd)(struct cmd_tbl_s *, int, int, char * const []);
+	char		*usage;
+	char		*help;
+};
+
+typedef struct cmd_tbl_s	cmd_tbl_t;
+
+int cmd_usage(const cmd_tbl_t *cmdtp);
+
+/* the test calls the command through __u_boot_cmd_<name>.cmd */
+#define U_BOOT_CMD(name, maxargs, rep, cmd, usage, help)		\
+	cmd_tbl_t __u_boot_cmd_##name = { #name, maxargs, rep, cmd,	\
+					  usage, help }
+
+#endif /* _TEST_COMMAND_H */
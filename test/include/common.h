@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * Stand-in for the U-Boot environment when target code is built into a
+ * host test program.  Only what the code under test uses is here; the
+ * headers in this directory shadow the real ones of the same name.
+ */
+#ifndef _TEST_COMMON_H
+#define _TEST_COMMON_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef unsigned char		uchar;
+typedef uint8_t			u8;
+typedef uint16_t		u16;
+typedef uint32_t		u32;
+typedef unsigned long long	u64;
+typedef int8_t			s8;
+typedef int16_t			s16;
+typedef int32_t			s32;
+typedef long long		s64;
+typedef uint8_t			__u8;
+typedef uint16_t		__u16;
+typedef uint32_t		__u32;
+typedef unsigned long long	__u64;
+typedef int32_t			__s32;
+typedef uint16_t		__le16;
+typedef uint32_t		__le32;
+typedef uint64_t		__le64;
+typedef uint16_t		__be16;
+typedef uint32_t		__be32;
+typedef uint64_t		__be64;
+typedef unsigned long		phys_addr_t;
+typedef unsigned int		gfp_t;
+/* the target's loff_t is 64 bits everywhere */
+#define loff_t			long long
+
+typedef struct bd_info {
+	int bi_dummy;
+} bd_t;
+
+#define _SIZE_T			/* keeps linux/stddef.h off linux/types.h */
+
+#ifndef min
+#define min(x, y)		((x) < (y) ? (x) : (y))
+#define max(x, y)		((x) > (y) ? (x) : (y))
+#endif
+/* as in linux/mtd/compat.h, which some target headers bring in too */
+#define min_t(type,x,y) \
+	({ type __x = (x); type __y = (y); __x < __y ? __x: __y; })
+#define max_t(type,x,y) \
+	({ type __x = (x); type __y = (y); __x > __y ? __x: __y; })
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define container_of(ptr, type, member) ({			\
+	const typeof(((type *)0)->member) *__mptr = (ptr);	\
+	(type *)((char *)__mptr - offsetof(type, member)); })
+
+/* the host's lldiv() returns a struct */
+#define lldiv(n, d)		((unsigned long long)(n) / (d))
+#define do_div(n, base) ({				\
+	uint32_t __rem = (n) % (base);			\
+	(n) /= (base);					\
+	__rem; })
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#ifdef DEBUG
+#define debug(fmt, args...)	printf(fmt, ##args)
+#else
+#define debug(fmt, args...)	do { } while (0)
+#endif
+
+#define __be32_to_cpu(x)	__builtin_bswap32(x)
+#define be32_to_cpu(x)		__builtin_bswap32(x)
+#define cpu_to_be32(x)		__builtin_bswap32(x)
+#define be64_to_cpu(x)		__builtin_bswap64(x)
+#define cpu_to_be64(x)		__builtin_bswap64(x)
+#define be16_to_cpu(x)		__builtin_bswap16(x)
+#define cpu_to_be16(x)		__builtin_bswap16(x)
+#define le32_to_cpu(x)		(x)
+#define cpu_to_le32(x)		(x)
+#define le16_to_cpu(x)		(x)
+#define cpu_to_le16(x)		(x)
+
+/* time only moves when the code under test waits; see test_clock */
+extern unsigned long long test_clock_us;
+
+static inline void udelay(unsigned long us)
+{
+	test_clock_us += us;
+}
+
+static inline unsigned long get_timer(unsigned long base)
+{
+	return test_clock_us / 1000 - base;
+}
+
+#include <watchdog.h>
+
+static inline int ctrlc(void)
+{
+	return 0;
+}
+
+#define serial_printf		printf
+
+extern ulong load_addr;
+char *getenv(const char *name);
+ulong simple_strtoul(const char *cp, char **endp, unsigned int base);
+
+void flush_dcache_range(unsigned long start, unsigned long stop);
+void invalidate_dcache_range(unsigned long start, unsigned long stop);
+
+#include <part.h>
+
+#endif /* _TEST_COMMON_H */
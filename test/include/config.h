@@ -0,0 +1,7 @@
+/* Shadows the target's <config.h> in host tests; see common.h */
+#ifndef _TEST_CONFIG_H
+#define _TEST_CONFIG_H
+
+#include <common.h>
+
+#endif /* _TEST_CONFIG_H */
@@ -0,0 +1,7 @@
+/* Shadows the target's <div64.h> in host tests; see common.h */
+#ifndef _TEST_DIV64_H
+#define _TEST_DIV64_H
+
+#include <common.h>
+
+#endif /* _TEST_DIV64_H */
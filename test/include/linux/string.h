@@ -0,0 +1,7 @@
+/* Shadows the target's <linux/string.h> in host tests; see common.h */
+#ifndef _TEST_LINUX_STRING_H
+#define _TEST_LINUX_STRING_H
+
+#include <common.h>
+
+#endif /* _TEST_LINUX_STRING_H */
@@ -0,0 +1,7 @@
+/* Shadows the target's <linux/types.h> in host tests; see common.h */
+#ifndef _TEST_LINUX_TYPES_H
+#define _TEST_LINUX_TYPES_H
+
+#include <common.h>
+
+#endif /* _TEST_LINUX_TYPES_H */
@@ -0,0 +1,7 @@
+/* Shadows the target's <malloc.h> in host tests; see common.h */
+#ifndef _TEST_MALLOC_H
+#define _TEST_MALLOC_H
+
+#include <common.h>
+
+#endif /* _TEST_MALLOC_H */
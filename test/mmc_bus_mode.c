@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * eMMC bus mode selection in drivers/mmc/mmc.c, run through
+ * mmc_startup() against a model card.  Each case gives the card's
+ * EXT_CSD, the host capabilities and the faults on the link, and the
+ * mode the fallback ladder must settle on.
+ */
+#define CONFIG_GENERIC_MMC
+
+#include "../drivers/mmc/mmc.c"
+
+unsigned long long test_clock_us;
+
+/* link faults: data read at these settings comes back corrupt */
+#define BAD_8BIT	(1 << 0)	/* DAT4-7 broken */
+#define BAD_4BIT	(1 << 1)	/* DAT1-3 broken */
+#define BAD_DDR		(1 << 2)	/* no DDR sampling */
+#define BAD_TUNING	(1 << 3)	/* HS200 tuning fails */
+#define REJECT_DDR	(1 << 4)	/* card refuses the DDR bus widths */
+
+static struct {
+	u8 ext_csd[512];
+	int csd_vers;			/* CSD_STRUCTURE spec version */
+	int faults;
+	int switches;			/* CMD6 seen */
+	int ext_csd_reads;		/* CMD8 seen */
+	int blocklen_in_ddr;		/* CMD16 seen in DDR mode */
+} card;
+
+static void card_setup(int csd_vers, u8 card_type, int faults)
+{
+	memset(&card, 0, sizeof(card));
+	card.csd_vers = csd_vers;
+	card.faults = faults;
+	card.ext_csd[EXT_CSD_REV] = 5;
+	card.ext_csd[EXT_CSD_CARD_TYPE] = card_type;
+	card.ext_csd[EXT_CSD_SEC_CNT + 1] = 0x80;	/* 16 MiB */
+}
+
+static int link_corrupts(struct mmc *mmc)
+{
+	if ((card.faults & BAD_8BIT) && (mmc->bus_width == 8))
+		return 1;
+	if ((card.faults & BAD_4BIT) && (mmc->bus_width >= 4))
+		return 1;
+	if ((card.faults & BAD_DDR) && mmc->ddr_mode)
+		return 1;
+	return 0;
+}
+
+static int card_switch(u8 index, u8 value)
+{
+	u8 type = card.ext_csd[EXT_CSD_CARD_TYPE];
+
+	card.switches++;
+	if (index == EXT_CSD_BUS_WIDTH) {
+		if ((value == EXT_CSD_BUS_WIDTH_4_DDR) ||
+		    (value == EXT_CSD_BUS_WIDTH_8_DDR)) {
+			if ((card.faults & REJECT_DDR) ||
+			    !(type & EXT_CSD_CARD_TYPE_DDR_1_8V))
+				return COMM_ERR;
+		}
+	} else if (index == EXT_CSD_HS_TIMING) {
+		if ((value == EXT_CSD_TIMING_HS200) &&
+		    !(type & EXT_CSD_CARD_TYPE_HS200_1_8V))
+			return COMM_ERR;
+	}
+	card.ext_csd[index] = value;
+	return 0;
+}
+
+static int card_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
+			 struct mmc_data *data)
+{
+	memset(cmd->response, 0, sizeof(cmd->response));
+
+	switch (cmd->cmdidx) {
+	case MMC_CMD_SEND_CSD:
+		/* CSD_STRUCTURE/SPEC_VERS, TRAN_SPEED 20 MHz, 512 byte blocks */
+		cmd->response[0] = (card.csd_vers << 26) | (0x5 << 3) | 0x2;
+		cmd->response[1] = 9 << 16;
+		cmd->response[3] = 9 << 22;
+		break;
+	case MMC_CMD_SEND_STATUS:
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA | (4 << 9);
+		break;
+	case MMC_CMD_SWITCH:
+		if (mmc_host_is_spi(mmc) || (card.csd_vers < 4))
+			return UNUSABLE_ERR;
+		return card_switch((cmd->cmdarg >> 16) & 0xff,
+				   (cmd->cmdarg >> 8) & 0xff);
+	case MMC_CMD_SEND_EXT_CSD:
+		if (mmc_host_is_spi(mmc) || (card.csd_vers < 4))
+			return UNUSABLE_ERR;
+		card.ext_csd_reads++;
+		memcpy(data->dest, card.ext_csd, 512);
+		if (link_corrupts(mmc))
+			data->dest[EXT_CSD_SEC_CNT] ^= 0x5a;
+		break;
+	case MMC_CMD_SET_BLOCKLEN:
+		if (mmc->ddr_mode)
+			card.blocklen_in_ddr++;
+		break;
+	}
+	return 0;
+}
+
+static void host_set_ios(struct mmc *mmc)
+{
+}
+
+static int host_execute_tuning(struct mmc *mmc)
+{
+	return (card.faults & BAD_TUNING) ? TIMEOUT : 0;
+}
+
+#define HOST_ALL	(MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT | \
+			 MMC_MODE_8BIT | MMC_MODE_DDR_52MHz | MMC_MODE_HS200)
+#define HOST_SDR	(MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT | \
+			 MMC_MODE_8BIT)
+
+#define TYPE_52		(EXT_CSD_CARD_TYPE_26 | EXT_CSD_CARD_TYPE_52)
+#define TYPE_DDR	(TYPE_52 | EXT_CSD_CARD_TYPE_DDR_1_8V)
+#define TYPE_HS200	(TYPE_DDR | EXT_CSD_CARD_TYPE_HS200_1_8V)
+
+static const struct test_case {
+	const char *name;
+	int csd_vers;
+	u8 card_type;
+	uint host_caps;
+	int tuning;			/* host has execute_tuning */
+	int faults;
+	/* expected */
+	uint width;
+	uint ddr;
+	uint clock;
+	u8 ext_csd_width;
+	u8 timing;
+} cases[] = {
+	{ "DDR card, DDR host", 4, TYPE_DDR, HOST_ALL, 0, 0,
+	  8, 1, 52000000, EXT_CSD_BUS_WIDTH_8_DDR, EXT_CSD_TIMING_HS },
+	{ "DDR card, SDR host", 4, TYPE_DDR, HOST_SDR, 0, 0,
+	  8, 0, 52000000, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS },
+	{ "DDR card, 4-bit host", 4, TYPE_DDR,
+	  HOST_ALL & ~MMC_MODE_8BIT, 0, 0,
+	  4, 1, 52000000, EXT_CSD_BUS_WIDTH_4_DDR, EXT_CSD_TIMING_HS },
+	{ "DDR broken on the board", 4, TYPE_DDR, HOST_ALL, 0, BAD_DDR,
+	  8, 0, 52000000, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS },
+	{ "DAT4-7 broken", 4, TYPE_DDR, HOST_ALL, 0, BAD_8BIT,
+	  4, 1, 52000000, EXT_CSD_BUS_WIDTH_4_DDR, EXT_CSD_TIMING_HS },
+	{ "DAT4-7 and DDR broken", 4, TYPE_DDR, HOST_ALL, 0,
+	  BAD_8BIT | BAD_DDR,
+	  4, 0, 52000000, EXT_CSD_BUS_WIDTH_4, EXT_CSD_TIMING_HS },
+	{ "DAT1-7 broken", 4, TYPE_DDR, HOST_ALL, 0, BAD_8BIT | BAD_4BIT,
+	  1, 0, 52000000, EXT_CSD_BUS_WIDTH_1, EXT_CSD_TIMING_HS },
+	{ "card refuses DDR widths", 4, TYPE_DDR, HOST_ALL, 0, REJECT_DDR,
+	  8, 0, 52000000, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS },
+	{ "HS200 card, tuning host", 4, TYPE_HS200, HOST_ALL, 1, 0,
+	  8, 0, 200000000, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS200 },
+	{ "HS200 card, tuning fails", 4, TYPE_HS200, HOST_ALL, 1, BAD_TUNING,
+	  8, 1, 52000000, EXT_CSD_BUS_WIDTH_8_DDR, EXT_CSD_TIMING_HS },
+	{ "HS200 card, host cannot tune", 4, TYPE_HS200, HOST_ALL, 0, 0,
+	  8, 1, 52000000, EXT_CSD_BUS_WIDTH_8_DDR, EXT_CSD_TIMING_HS },
+	{ "HS200 card, DAT4-7 broken", 4, TYPE_HS200, HOST_ALL, 1, BAD_8BIT,
+	  4, 0, 200000000, EXT_CSD_BUS_WIDTH_4, EXT_CSD_TIMING_HS200 },
+	{ "26 MHz card", 4, EXT_CSD_CARD_TYPE_26, HOST_ALL, 0, 0,
+	  8, 0, 26000000, EXT_CSD_BUS_WIDTH_8, EXT_CSD_TIMING_HS },
+	{ "MMC 3.x card, no EXT_CSD", 3, 0, HOST_ALL, 0, 0,
+	  1, 0, 20000000, 0, 0 },
+	{ "SPI host", 4, TYPE_DDR, HOST_ALL | MMC_MODE_SPI, 0, 0,
+	  1, 0, 20000000, 0, 0 },
+};
+
+static int run_case(const struct test_case *tc)
+{
+	struct mmc mmc;
+	int err, fail = 0;
+
+	card_setup(tc->csd_vers, tc->card_type, tc->faults);
+
+	memset(&mmc, 0, sizeof(mmc));
+	strcpy(mmc.name, "model");
+	mmc.send_cmd = card_send_cmd;
+	mmc.set_ios = host_set_ios;
+	if (tc->tuning)
+		mmc.execute_tuning = host_execute_tuning;
+	mmc.host_caps = tc->host_caps;
+	mmc.f_min = 400000;
+	mmc.f_max = 200000000;
+	mmc.version = MMC_VERSION_UNKNOWN;
+	mmc.bus_width = 1;
+
+	printf("--- %s\n", tc->name);
+	err = mmc_startup(&mmc);
+	if (err) {
+		printf("FAIL %s: mmc_startup() returned %d\n", tc->name, err);
+		return 1;
+	}
+
+#define CHECK(what, got, want)						\
+	if ((got) != (want)) {						\
+		printf("FAIL %s: %s is %u, expected %u\n", tc->name,	\
+		       what, (uint)(got), (uint)(want));		\
+		fail = 1;						\
+	}
+	CHECK("bus width", mmc.bus_width, tc->width);
+	CHECK("ddr mode", mmc.ddr_mode, tc->ddr);
+	CHECK("clock", mmc.clock, tc->clock);
+	CHECK("card bus width", card.ext_csd[EXT_CSD_BUS_WIDTH],
+	      tc->ext_csd_width);
+	CHECK("card timing", card.ext_csd[EXT_CSD_HS_TIMING], tc->timing);
+	if ((tc->csd_vers < 4) || (tc->host_caps & MMC_MODE_SPI)) {
+		CHECK("CMD6 count", card.switches, 0);
+		CHECK("CMD8 count", card.ext_csd_reads, 0);
+	}
+
+	/* the block length is fixed at 512 in DDR, CMD16 is illegal */
+	mmc_set_blocklen(&mmc, 512);
+	CHECK("CMD16 in DDR", card.blocklen_in_ddr, 0);
+#undef CHECK
+
+	return fail;
+}
+
+int main(void)
+{
+	int i, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++)
+		failed += run_case(&cases[i]);
+
+	printf("mmc_bus_mode: %d of %d cases failed\n", failed,
+	       (int)ARRAY_SIZE(cases));
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,748 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * Cache read (31h/3Fh), cache program (15h) and two-plane program (11h)
+ * in drivers/mtd/nand/nand_base.c, run against a model of an ONFI chip
+ * behind the generic command function.  The model keeps the chip's
+ * registers and timing: a page read or program only overlaps with the
+ * bus transfer of another page when the command sequence allows it, so
+ * the time on test_clock_us tells whether the pipelining happened.  It
+ * also checks the sequences themselves: no command while busy, no cache
+ * read across a block, two-plane pairs in the same page of an even/odd
+ * block pair, and nothing left running when a call returns.
+ */
+#define CONFIG_SYS_HZ			1000
+#define CONFIG_SYS_NAND_MAX_CHIPS	1
+#define CONFIG_SYS_NAND_ONFI_DETECTION
+#define CONFIG_SYS_NAND_QUIET_TEST
+
+#include "../drivers/mtd/nand/nand_base.c"
+#include "../drivers/mtd/nand/nand_ecc.c"
+#include "../drivers/mtd/nand/nand_ids.c"
+
+unsigned long long test_clock_us;
+
+int nand_default_bbt(struct mtd_info *mtd)
+{
+	return 0;
+}
+
+int nand_isbad_bbt(struct mtd_info *mtd, loff_t offs, int allowbbt)
+{
+	return 0;
+}
+
+int nand_update_bbt(struct mtd_info *mtd, loff_t offs)
+{
+	return 0;
+}
+
+/* geometry: 2 KiB pages, 64 pages a block, 64 blocks in two planes */
+#define PAGE_SIZE_B	2048
+#define OOB_SIZE	64
+#define RAW_SIZE	(PAGE_SIZE_B + OOB_SIZE)
+#define BLOCK_PAGES	64
+#define BLOCKS		64
+#define PAGES		(BLOCKS * BLOCK_PAGES)
+#define BLOCK_SIZE	(BLOCK_PAGES * PAGE_SIZE_B)
+
+/* timing, in ns */
+#define T_R		25000		/* array to data register */
+#define T_PROG		200000		/* data register to array */
+#define T_BERS		2000000		/* block erase */
+#define T_RCBSY		3000		/* data register to cache register */
+#define T_CBSY		3000		/* cache register to data register */
+#define T_DBSY		500		/* first page of a two-plane program */
+#define T_RC		25		/* one byte over the bus */
+
+static struct {
+	u8 array[PAGES][RAW_SIZE];
+	u8 cache[RAW_SIZE];		/* cache register, what the bus sees */
+	u8 data[RAW_SIZE];		/* data register, next to the array */
+	u8 plane[RAW_SIZE];		/* first page of a two-plane program */
+
+	unsigned long long now;		/* ns, mirrored into test_clock_us */
+	unsigned long long busy;	/* ready line low until */
+	unsigned long long array_busy;	/* array operation running until */
+
+	int cmd;			/* last command latched */
+	u8 addr[5];
+	int naddr;
+	int col;			/* bus position in the cache register */
+
+	int read_seq;			/* in a cache read, data has page */
+	int data_page;
+	int plane_page;			/* 11h pending for this page, or -1 */
+	int cached_page;		/* 15h program running for page, or -1 */
+	int fail, fail_n1;
+
+	const u8 *out;			/* READID, PARAM and STATUS output */
+	int out_len;
+
+	int bad_page;			/* fails to program, or -1 */
+	int errors;			/* protocol violations */
+
+	/* commands seen */
+	int n_read, n_cacheseq, n_cacheend;
+	int n_seqin, n_prog, n_cachedprog, n_multiprog;
+
+	struct nand_onfi_params onfi[3];
+	u8 id[8];
+} chip;
+
+#define VIOLATION(fmt, args...)	do {				\
+		printf("  chip: " fmt "\n", ##args);		\
+		chip.errors++;					\
+	} while (0)
+
+static void chip_time(unsigned long long ns)
+{
+	chip.now += ns;
+	test_clock_us = chip.now / 1000;
+}
+
+/* bring the model's clock up to the host's, which udelay() moves */
+static void chip_sync(void)
+{
+	if (chip.now < test_clock_us * 1000)
+		chip.now = test_clock_us * 1000;
+}
+
+static void chip_wait_busy(void)
+{
+	chip_sync();
+	if (chip.now < chip.busy)
+		chip_time(chip.busy - chip.now);
+}
+
+static void chip_wait_array(void)
+{
+	chip_wait_busy();
+	if (chip.now < chip.array_busy)
+		chip_time(chip.array_busy - chip.now);
+}
+
+static u16 onfi_crc(const u8 *p, int len)
+{
+	u16 crc = ONFI_CRC_BASE;
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x8000) ? 0x8005 : 0);
+	}
+	return crc;
+}
+
+static void chip_setup(int opt_cmd, int planes)
+{
+	struct nand_onfi_params *p = &chip.onfi[0];
+	int i;
+
+	memset(&chip, 0, sizeof(chip));
+	memset(chip.array, 0xff, sizeof(chip.array));
+	chip.plane_page = -1;
+	chip.cached_page = -1;
+	chip.bad_page = -1;
+
+	chip.id[0] = NAND_MFR_MICRON;
+	chip.id[1] = 0xf1;
+
+	memcpy(p->sig, "ONFI", 4);
+	p->revision = cpu_to_le16(1 << 2);
+	p->features = cpu_to_le16(planes > 1 ? ONFI_FEATURE_MULTI_PLANE : 0);
+	p->opt_cmd = cpu_to_le16(opt_cmd);
+	memcpy(p->model, "MODEL CHIP", 10);
+	p->byte_per_page = cpu_to_le32(PAGE_SIZE_B);
+	p->spare_bytes_per_page = cpu_to_le16(OOB_SIZE);
+	p->pages_per_block = cpu_to_le32(BLOCK_PAGES);
+	p->blocks_per_lun = cpu_to_le32(BLOCKS);
+	p->lun_count = 1;
+	p->addr_cycles = 0x22;
+	p->interleaved_bits = planes == 4 ? 2 : planes == 2 ? 1 : 0;
+	p->crc = cpu_to_le16(onfi_crc((u8 *)p, 254));
+	for (i = 1; i < 3; i++)
+		chip.onfi[i] = chip.onfi[0];
+}
+
+static int row_addr(void)
+{
+	return chip.addr[2] | (chip.addr[3] << 8);
+}
+
+static int col_addr(void)
+{
+	return chip.addr[0] | (chip.addr[1] << 8);
+}
+
+static void page_program(int page, const u8 *buf)
+{
+	int i;
+
+	if (page == chip.bad_page) {
+		chip.fail = 1;
+		return;
+	}
+	/* a program only ever clears bits */
+	for (i = 0; i < RAW_SIZE; i++)
+		chip.array[page][i] &= buf[i];
+}
+
+static void chip_command(int cmd)
+{
+	static u8 status;
+	int page, i;
+
+	if (cmd != NAND_CMD_STATUS && cmd != NAND_CMD_RESET) {
+		chip_sync();
+		if (chip.now < chip.busy)
+			VIOLATION("command %02xh while busy", cmd);
+	}
+	if (chip.read_seq && cmd != NAND_CMD_READCACHESEQ &&
+	    cmd != NAND_CMD_READCACHEEND && cmd != NAND_CMD_STATUS &&
+	    cmd != NAND_CMD_RNDOUT && cmd != NAND_CMD_RNDOUTSTART) {
+		VIOLATION("command %02xh in a cache read", cmd);
+		chip.read_seq = 0;
+	}
+
+	switch (cmd) {
+	case NAND_CMD_RESET:
+		chip.read_seq = 0;
+		chip.plane_page = -1;
+		chip.cached_page = -1;
+		chip.array_busy = chip.now;
+		chip.busy = chip.now + 5000;
+		break;
+
+	case NAND_CMD_STATUS:
+		chip_sync();
+		status = NAND_STATUS_WP;
+		if (chip.now >= chip.busy)
+			status |= NAND_STATUS_READY;
+		if (chip.now >= chip.array_busy)
+			status |= NAND_STATUS_TRUE_READY;
+		if (chip.fail)
+			status |= NAND_STATUS_FAIL;
+		if (chip.fail_n1)
+			status |= NAND_STATUS_FAIL_N1;
+		chip.out = &status;
+		chip.out_len = -1;	/* repeats */
+		break;
+
+	case NAND_CMD_READSTART:
+		page = row_addr();
+		chip.n_read++;
+		chip_wait_array();
+		chip.cached_page = -1;
+		memcpy(chip.data, chip.array[page], RAW_SIZE);
+		memcpy(chip.cache, chip.data, RAW_SIZE);
+		chip.data_page = page;
+		chip.col = col_addr();
+		chip.out = NULL;
+		chip.busy = chip.now + T_R;
+		break;
+
+	case NAND_CMD_READCACHESEQ:
+		chip.n_cacheseq++;
+		page = chip.data_page + 1;
+		if (!(page % BLOCK_PAGES) || page >= PAGES)
+			VIOLATION("cache read into page %d crosses a block",
+				  page);
+		/* this page to the bus, fetch the next one meanwhile */
+		chip_wait_array();
+		memcpy(chip.cache, chip.data, RAW_SIZE);
+		memcpy(chip.data, chip.array[page % PAGES], RAW_SIZE);
+		chip.data_page = page;
+		chip.read_seq = 1;
+		chip.col = 0;
+		chip.out = NULL;
+		chip.busy = chip.now + T_RCBSY;
+		chip.array_busy = chip.now + T_R;
+		break;
+
+	case NAND_CMD_READCACHEEND:
+		chip.n_cacheend++;
+		if (!chip.read_seq)
+			VIOLATION("3Fh outside of a cache read");
+		chip_wait_array();
+		memcpy(chip.cache, chip.data, RAW_SIZE);
+		chip.read_seq = 0;
+		chip.col = 0;
+		chip.out = NULL;
+		chip.busy = chip.now + T_RCBSY;
+		break;
+
+	case NAND_CMD_RNDOUTSTART:
+		chip.col = col_addr();
+		chip.out = NULL;
+		break;
+
+	case NAND_CMD_SEQIN:
+		chip.n_seqin++;
+		memset(chip.cache, 0xff, RAW_SIZE);
+		break;
+
+	case NAND_CMD_MULTIPROG:
+		chip.n_multiprog++;
+		if (chip.plane_page != -1)
+			VIOLATION("11h twice");
+		chip_wait_array();
+		chip.plane_page = row_addr();
+		memcpy(chip.plane, chip.cache, RAW_SIZE);
+		chip.busy = chip.now + T_DBSY;
+		break;
+
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_PAGEPROG:
+		page = row_addr();
+		if (chip.plane_page != -1) {
+			int a = chip.plane_page, b = page;
+
+			if (cmd == NAND_CMD_CACHEDPROG ||
+			    (a / BLOCK_PAGES) % 2 != 0 ||
+			    b / BLOCK_PAGES != a / BLOCK_PAGES + 1 ||
+			    a % BLOCK_PAGES != b % BLOCK_PAGES)
+				VIOLATION("two-plane pages %d and %d", a, b);
+		}
+		/* the page programmed before has to finish first */
+		chip_wait_array();
+		chip.fail_n1 = chip.fail;
+		chip.fail = 0;
+		if (chip.plane_page != -1)
+			page_program(chip.plane_page, chip.plane);
+		page_program(page, chip.cache);
+		chip.plane_page = -1;
+
+		if (cmd == NAND_CMD_CACHEDPROG) {
+			chip.n_cachedprog++;
+			chip.cached_page = page;
+			chip.array_busy = chip.now + T_CBSY + T_PROG;
+			chip.busy = chip.now + T_CBSY;
+		} else {
+			chip.n_prog++;
+			chip.cached_page = -1;
+			chip.array_busy = chip.now + T_PROG;
+			chip.busy = chip.array_busy;
+		}
+		break;
+
+	case NAND_CMD_ERASE2:
+		page = row_addr() & ~(BLOCK_PAGES - 1);
+		chip_wait_array();
+		for (i = 0; i < BLOCK_PAGES; i++)
+			memset(chip.array[page + i], 0xff, RAW_SIZE);
+		chip.fail = 0;
+		chip.busy = chip.array_busy = chip.now + T_BERS;
+		break;
+
+	case NAND_CMD_READID:
+	case NAND_CMD_PARAM:
+	case NAND_CMD_READ0:
+	case NAND_CMD_RNDIN:
+	case NAND_CMD_RNDOUT:
+	case NAND_CMD_ERASE1:
+		break;
+
+	default:
+		VIOLATION("unknown command %02xh", cmd);
+	}
+	chip.cmd = cmd;
+	chip.naddr = 0;
+}
+
+static void chip_address(u8 byte)
+{
+	if (chip.naddr < sizeof(chip.addr))
+		chip.addr[chip.naddr++] = byte;
+
+	switch (chip.cmd) {
+	case NAND_CMD_READID:
+		chip.out = byte == 0x20 ? (u8 *)"ONFI" : chip.id;
+		chip.out_len = byte == 0x20 ? 4 : sizeof(chip.id);
+		break;
+	case NAND_CMD_PARAM:
+		chip.out = (u8 *)chip.onfi;
+		chip.out_len = sizeof(chip.onfi);
+		chip.busy = chip.now + T_R;
+		break;
+	case NAND_CMD_ERASE1:
+		/* erase takes row addresses only */
+		if (chip.naddr == 2) {
+			chip.addr[2] = chip.addr[0];
+			chip.addr[3] = chip.addr[1];
+		}
+		break;
+	case NAND_CMD_SEQIN:
+	case NAND_CMD_RNDIN:
+		if (chip.naddr == 2)
+			chip.col = col_addr();
+		break;
+	}
+}
+
+static void model_cmd_ctrl(struct mtd_info *mtd, int dat, unsigned int ctrl)
+{
+	if (dat == NAND_CMD_NONE)
+		return;
+	if (ctrl & NAND_CLE)
+		chip_command(dat);
+	else if (ctrl & NAND_ALE)
+		chip_address(dat);
+}
+
+static int model_dev_ready(struct mtd_info *mtd)
+{
+	/* the host polls the ready line until it goes high */
+	chip_wait_busy();
+	return 1;
+}
+
+static void bus_check(const char *what)
+{
+	chip_sync();
+	if (chip.now < chip.busy)
+		VIOLATION("%s while busy", what);
+}
+
+static uint8_t model_read_byte(struct mtd_info *mtd)
+{
+	u8 byte;
+
+	chip_time(T_RC);
+	if (chip.out) {
+		if (chip.cmd == NAND_CMD_STATUS) {
+			chip_time(1000);	/* a status poll */
+			chip_command(NAND_CMD_STATUS);
+		} else {
+			bus_check("data out");
+		}
+		byte = *chip.out;
+		if (chip.out_len > 0) {
+			chip.out++;
+			if (!--chip.out_len)
+				chip.out = NULL;
+		}
+		return byte;
+	}
+	bus_check("data out");
+	return chip.cache[chip.col++ % RAW_SIZE];
+}
+
+static void model_read_buf(struct mtd_info *mtd, uint8_t *buf, int len)
+{
+	while (len--)
+		*buf++ = model_read_byte(mtd);
+}
+
+static void model_write_buf(struct mtd_info *mtd, const uint8_t *buf, int len)
+{
+	bus_check("data in");
+	chip_time((unsigned long long)len * T_RC);
+	while (len--)
+		chip.cache[chip.col++ % RAW_SIZE] = *buf++;
+}
+
+static int model_verify_buf(struct mtd_info *mtd, const uint8_t *buf, int len)
+{
+	bus_check("data out");
+	chip_time((unsigned long long)len * T_RC);
+	return memcmp(chip.cache + chip.col, buf, len) ? -EFAULT : 0;
+}
+
+static void model_select_chip(struct mtd_info *mtd, int chipnr)
+{
+}
+
+static struct mtd_info mtd;
+static struct nand_chip nand;
+
+static int nand_setup(int opt_cmd, int planes)
+{
+	chip_setup(opt_cmd, planes);
+	test_clock_us = 0;
+
+	memset(&mtd, 0, sizeof(mtd));
+	memset(&nand, 0, sizeof(nand));
+	mtd.priv = &nand;
+	nand.cmd_ctrl = model_cmd_ctrl;
+	nand.dev_ready = model_dev_ready;
+	nand.read_byte = model_read_byte;
+	nand.read_buf = model_read_buf;
+	nand.write_buf = model_write_buf;
+	nand.verify_buf = model_verify_buf;
+	nand.select_chip = model_select_chip;
+	nand.ecc.mode = NAND_ECC_SOFT;
+	nand.options = NAND_SKIP_BBTSCAN;
+
+	if (nand_scan(&mtd, 1))
+		return -1;
+	chip.errors = 0;
+	return 0;
+}
+
+/* start a measurement: idle chip, zero time, no commands counted */
+static void chip_restart(void)
+{
+	test_clock_us = 0;
+	chip.now = chip.busy = chip.array_busy = 0;
+	chip.n_read = chip.n_cacheseq = chip.n_cacheend = 0;
+	chip.n_seqin = chip.n_prog = chip.n_cachedprog = 0;
+	chip.n_multiprog = 0;
+}
+
+static u8 wbuf[4 * BLOCK_SIZE], rbuf[4 * BLOCK_SIZE];
+
+static void pattern(u8 *buf, int len, int seed)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (i * 7 + seed + (i >> 11)) & 0xff;
+}
+
+/* the whole test chip, written without going through the code */
+static void chip_fill(int seed)
+{
+	int page, i;
+
+	pattern(wbuf, sizeof(wbuf), seed);
+	nand_setup(ONFI_OPT_CMD_CACHE_READ | ONFI_OPT_CMD_CACHE_PROG, 2);
+	for (page = 0; page < 4 * BLOCK_PAGES; page++) {
+		u8 *raw = chip.array[page];
+
+		memcpy(raw, wbuf + page * PAGE_SIZE_B, PAGE_SIZE_B);
+		memset(raw + PAGE_SIZE_B, 0xff, OOB_SIZE);
+		for (i = 0; i < nand.ecc.steps; i++)
+			nand_calculate_ecc(&mtd, raw + i * nand.ecc.size,
+				raw + PAGE_SIZE_B +
+				nand.ecc.layout->eccpos[i * nand.ecc.bytes]);
+	}
+}
+
+static int failed;
+
+#define CHECK(what, got, want) do {					\
+		if ((got) != (want)) {					\
+			printf("FAIL %s: %s is %lld, expected %lld\n",	\
+			       name, what, (long long)(got),		\
+			       (long long)(want));			\
+			failed++;					\
+		}							\
+	} while (0)
+
+static void check_idle(const char *name)
+{
+	CHECK("violations", chip.errors, 0);
+	CHECK("cache read left open", chip.read_seq, 0);
+	CHECK("two-plane program left open", chip.plane_page, -1);
+	chip_sync();
+	CHECK("array busy on return", chip.now < chip.array_busy, 0);
+}
+
+static void test_detect(void)
+{
+	static const struct {
+		const char *name;
+		int opt_cmd, planes;
+		uint options;
+	} cases[] = {
+		{ "detect: cache read/program, 2 planes",
+		  ONFI_OPT_CMD_CACHE_READ | ONFI_OPT_CMD_CACHE_PROG, 2,
+		  NAND_CACHERD | NAND_CACHEPRG | NAND_2PLANEPRG },
+		{ "detect: cache read only, 1 plane",
+		  ONFI_OPT_CMD_CACHE_READ, 1, NAND_CACHERD },
+		{ "detect: cache program, 4 planes",
+		  ONFI_OPT_CMD_CACHE_PROG, 4, NAND_CACHEPRG },
+		{ "detect: nothing", 0, 2, NAND_2PLANEPRG },
+	};
+	const uint mask = NAND_CACHERD | NAND_CACHEPRG | NAND_2PLANEPRG;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		const char *name = cases[i].name;
+
+		printf("--- %s\n", name);
+		if (nand_setup(cases[i].opt_cmd, cases[i].planes)) {
+			printf("FAIL %s: nand_scan() failed\n", name);
+			failed++;
+			continue;
+		}
+		CHECK("options", nand.options & mask, cases[i].options);
+		CHECK("ONFI version", nand.onfi_version, 20);
+	}
+}
+
+/* read len bytes at from, with and without cache read */
+static void test_read(const char *name, loff_t from, size_t len,
+		      int reads, int seqs, int ends)
+{
+	unsigned long long t_cache, t_plain;
+	size_t retlen;
+	int ret;
+
+	printf("--- %s\n", name);
+	chip_fill(0x11);
+
+	chip_restart();
+	memset(rbuf, 0, len);
+	ret = nand_read(&mtd, from, len, &retlen, rbuf);
+	t_cache = chip.now;
+	CHECK("nand_read()", ret, 0);
+	CHECK("retlen", retlen, len);
+	CHECK("data", memcmp(rbuf, wbuf + from, len), 0);
+	CHECK("00h-30h", chip.n_read, reads);
+	CHECK("31h", chip.n_cacheseq, seqs);
+	CHECK("3Fh", chip.n_cacheend, ends);
+	check_idle(name);
+
+	/* the same read, page by page */
+	nand.options &= ~NAND_CACHERD;
+	nand.pagebuf = -1;
+	chip_restart();
+	ret = nand_read(&mtd, from, len, &retlen, rbuf);
+	t_plain = chip.now;
+	CHECK("nand_read() without cache", ret, 0);
+	CHECK("data without cache", memcmp(rbuf, wbuf + from, len), 0);
+
+	printf("    %llu us, %llu us page by page\n", t_cache / 1000,
+	       t_plain / 1000);
+	if (seqs && t_cache >= t_plain) {
+		printf("FAIL %s: cache read is not faster\n", name);
+		failed++;
+	}
+}
+
+static void erase_chip(void)
+{
+	struct erase_info ei;
+
+	memset(&ei, 0, sizeof(ei));
+	ei.mtd = &mtd;
+	ei.addr = 0;
+	ei.len = 4 * BLOCK_SIZE;
+	nand_erase(&mtd, &ei);
+}
+
+/* write len bytes at to, with and without the pipelined programs */
+static void test_write(const char *name, loff_t to, size_t len,
+		       int seqins, int progs, int cached, int multi)
+{
+	unsigned long long t_fast, t_plain;
+	size_t retlen;
+	int ret;
+
+	printf("--- %s\n", name);
+	nand_setup(ONFI_OPT_CMD_CACHE_READ | ONFI_OPT_CMD_CACHE_PROG, 2);
+	pattern(wbuf, sizeof(wbuf), 0x5a);
+
+	chip_restart();
+	ret = nand_write(&mtd, to, len, &retlen, wbuf);
+	t_fast = chip.now;
+	CHECK("nand_write()", ret, 0);
+	CHECK("retlen", retlen, len);
+	CHECK("80h", chip.n_seqin, seqins);
+	CHECK("10h", chip.n_prog, progs);
+	CHECK("15h", chip.n_cachedprog, cached);
+	CHECK("11h", chip.n_multiprog, multi);
+	check_idle(name);
+
+	nand.pagebuf = -1;
+	ret = nand_read(&mtd, to, len, &retlen, rbuf);
+	CHECK("read back", ret, 0);
+	CHECK("data", memcmp(rbuf, wbuf, len), 0);
+
+	/* the same write, page by page */
+	erase_chip();
+	nand.options &= ~(NAND_CACHEPRG | NAND_2PLANEPRG);
+	chip_restart();
+	ret = nand_write(&mtd, to, len, &retlen, wbuf);
+	t_plain = chip.now;
+	CHECK("nand_write() page by page", ret, 0);
+
+	printf("    %llu us, %llu us page by page\n", t_fast / 1000,
+	       t_plain / 1000);
+	if ((cached || multi) && t_fast >= t_plain) {
+		printf("FAIL %s: pipelined program is not faster\n", name);
+		failed++;
+	}
+}
+
+/* a page that fails to program must fail the write, in every mode */
+static void test_write_fail(const char *name, loff_t to, size_t len,
+			    int bad_page)
+{
+	size_t retlen;
+	int ret;
+
+	printf("--- %s\n", name);
+	nand_setup(ONFI_OPT_CMD_CACHE_READ | ONFI_OPT_CMD_CACHE_PROG, 2);
+	pattern(wbuf, sizeof(wbuf), 0x3c);
+	chip.bad_page = bad_page;
+
+	ret = nand_write(&mtd, to, len, &retlen, wbuf);
+	CHECK("nand_write()", ret, -EIO);
+	if (retlen > (bad_page - (int)(to / PAGE_SIZE_B)) * PAGE_SIZE_B) {
+		printf("FAIL %s: retlen %zu covers the bad page %d\n",
+		       name, retlen, bad_page);
+		failed++;
+	}
+	check_idle(name);
+}
+
+int main(void)
+{
+	test_detect();
+
+	test_read("read: one block", 0, BLOCK_SIZE, 1, 63, 1);
+	test_read("read: across a block", 60 * PAGE_SIZE_B, 8 * PAGE_SIZE_B,
+		  2, 6, 2);
+	test_read("read: two pages", 5 * PAGE_SIZE_B, 2 * PAGE_SIZE_B,
+		  1, 1, 1);
+	test_read("read: one page", 5 * PAGE_SIZE_B, PAGE_SIZE_B, 1, 0, 0);
+	test_read("read: unaligned start", 5 * PAGE_SIZE_B + 100,
+		  3 * PAGE_SIZE_B, 3, 1, 1);
+	test_read("read: last page of a block", 63 * PAGE_SIZE_B,
+		  2 * PAGE_SIZE_B, 2, 0, 0);
+
+	test_write("write: one block", 0, BLOCK_SIZE,
+		   BLOCK_PAGES, 1, BLOCK_PAGES - 1, 0);
+	test_write("write: two blocks, even start", 0, 2 * BLOCK_SIZE,
+		   2 * BLOCK_PAGES, BLOCK_PAGES, 0, BLOCK_PAGES);
+	test_write("write: two blocks, odd start", BLOCK_SIZE,
+		   2 * BLOCK_SIZE, 2 * BLOCK_PAGES, 2, 2 * BLOCK_PAGES - 2,
+		   0);
+	test_write("write: three blocks", 0, 3 * BLOCK_SIZE,
+		   3 * BLOCK_PAGES, BLOCK_PAGES + 1,
+		   BLOCK_PAGES - 1, BLOCK_PAGES);
+	test_write("write: one page", PAGE_SIZE_B, PAGE_SIZE_B, 1, 1, 0, 0);
+
+	test_write_fail("fail: cached page", 0, BLOCK_SIZE, 10);
+	test_write_fail("fail: last page of a cache program", 0, BLOCK_SIZE,
+			BLOCK_PAGES - 1);
+	test_write_fail("fail: first page of a cache program", 0,
+			BLOCK_SIZE, 0);
+	test_write_fail("fail: two-plane, first block", 0, 2 * BLOCK_SIZE, 7);
+	test_write_fail("fail: two-plane, second block", 0, 2 * BLOCK_SIZE,
+			BLOCK_PAGES + 7);
+
+	printf("nand_cache: %d checks failed\n", failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,838 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * Attaching UBI from a fastmap, on a RAM-backed MTD device.  The image is
+ * written through the UBI I/O unit, with a fastmap laid out the way Linux
+ * writes it, and the scanning information ubi_scan_fastmap() builds from it
+ * is held against what ubi_scan() finds on the same flash.  Then every
+ * check the parser makes is tripped in turn, each of which has to send the
+ * caller back to full scanning, and the later checks of a stale fastmap
+ * mapping and the invalidation of the fastmap are run.
+ *
+ * scan.c, io.c, fastmap.c, crc32.c and lib/rbtree.c are linked in as they
+ * are; ubi_wl_put_peb() is the only stand-in.
+ */
+#include <common.h>
+#include <ubi_uboot.h>
+#include "../drivers/mtd/ubi/ubi.h"
+
+unsigned long long test_clock_us;
+
+/* the flash: 128 PEBs of 16 KiB with 512 byte pages */
+#define PEBS		128
+#define PEB_SIZE	(16 << 10)
+#define PAGE		512
+
+static u8 flash[PEBS][PEB_SIZE];
+static int bad[PEBS];
+static int hdr_reads[PEBS];		/* reads of the EC header */
+static int vid_reads[PEBS];		/* reads of the VID header alone */
+static int erases[PEBS];
+
+static int ram_read(struct mtd_info *mtd, loff_t from, size_t len,
+		    size_t *retlen, u_char *buf)
+{
+	int pnum = from / PEB_SIZE, off = from % PEB_SIZE;
+
+	if (off == 0)
+		hdr_reads[pnum]++;
+	else if (off == PAGE)
+		vid_reads[pnum]++;
+	memcpy(buf, &flash[pnum][off], len);
+	*retlen = len;
+	return 0;
+}
+
+static int ram_write(struct mtd_info *mtd, loff_t to, size_t len,
+		     size_t *retlen, const u_char *buf)
+{
+	memcpy(&flash[to / PEB_SIZE][to % PEB_SIZE], buf, len);
+	*retlen = len;
+	return 0;
+}
+
+static int ram_erase(struct mtd_info *mtd, struct erase_info *instr)
+{
+	int pnum = instr->addr / PEB_SIZE;
+
+	memset(flash[pnum], 0xff, PEB_SIZE);
+	erases[pnum]++;
+	instr->state = MTD_ERASE_DONE;
+	mtd_erase_callback(instr);
+	return 0;
+}
+
+static int ram_isbad(struct mtd_info *mtd, loff_t ofs)
+{
+	return bad[ofs / PEB_SIZE];
+}
+
+static int ram_markbad(struct mtd_info *mtd, loff_t ofs)
+{
+	bad[ofs / PEB_SIZE] = 1;
+	return 0;
+}
+
+static struct mtd_info mtd = {
+	.name		= "ram",
+	.flags		= MTD_WRITEABLE,
+	.size		= PEBS * PEB_SIZE,
+	.erasesize	= PEB_SIZE,
+	.writesize	= PAGE,
+	.read		= ram_read,
+	.write		= ram_write,
+	.erase		= ram_erase,
+	.block_isbad	= ram_isbad,
+	.block_markbad	= ram_markbad,
+};
+
+static struct ubi_device ubi;
+
+/* the UBI device as io_init() in build.c sets it up */
+static void ubi_setup(void)
+{
+	unsigned char *checked = ubi.fm_checked;
+
+	free(ubi.peb_buf1);
+	free(checked);
+	memset(&ubi, 0, sizeof(ubi));
+	ubi.mtd = &mtd;
+	ubi.peb_size = PEB_SIZE;
+	ubi.peb_count = PEBS;
+	ubi.flash_size = PEBS * PEB_SIZE;
+	ubi.bad_allowed = 1;
+	ubi.min_io_size = PAGE;
+	ubi.hdrs_min_io_size = PAGE;
+	ubi.ec_hdr_alsize = ALIGN(UBI_EC_HDR_SIZE, PAGE);
+	ubi.vid_hdr_alsize = ALIGN(UBI_VID_HDR_SIZE, PAGE);
+	ubi.vid_hdr_offset = ubi.vid_hdr_aloffset = ubi.ec_hdr_alsize;
+	ubi.leb_start = ALIGN(ubi.vid_hdr_offset + UBI_VID_HDR_SIZE, PAGE);
+	ubi.leb_size = PEB_SIZE - ubi.leb_start;
+	ubi.peb_buf1 = malloc(PEB_SIZE);
+	ubi.fm_pnum = -1;
+}
+
+/* the wear-levelling unit, which gets the PEBs of stale mappings back */
+static int put_pnum = -1;
+
+int ubi_wl_put_peb(struct ubi_device *ubi, int pnum, int torture)
+{
+	put_pnum = pnum;
+	return 0;
+}
+
+/*
+ * The image.  Every PEB has a role, and what the fastmap says about it
+ * follows from the role.
+ */
+enum {
+	R_FREE = 0,	/* EC header only, on the free list */
+	R_FM,		/* fastmap block */
+	R_MAPPED,	/* a LEB the fastmap EBA table points to */
+	R_SCRUB,	/* the same, on the scrub list */
+	R_USED,	/* a LEB, on the used list but in no EBA table */
+	R_ERASE,	/* on the erase list, with a corrupted VID header */
+	R_POOL,		/* in a pool, written after the fastmap */
+	R_EMPTY,	/* in a pool, never even got an EC header */
+	R_BAD,
+};
+
+#define VOL_DYN		0
+#define VOL_STATIC	1
+#define LAYOUT		UBI_LAYOUT_VOLUME_ID
+#define FM_SQNUM	1000
+#define STATIC_LAST	100	/* bytes in the last LEB of VOL_STATIC */
+
+static struct peb {
+	int role;
+	int vol_id;
+	int lnum;
+	unsigned long long sqnum;
+} pebs[PEBS] = {
+	[0]	= { R_FM },
+	[1]	= { R_FM },
+	[2]	= { R_MAPPED, LAYOUT, 0, 1 },
+	[3]	= { R_MAPPED, LAYOUT, 1, 2 },
+	[5]	= { R_ERASE },		/* an older fastmap anchor */
+	[10]	= { R_MAPPED, VOL_DYN, 0, 110 },
+	[11]	= { R_MAPPED, VOL_DYN, 1, 111 },
+	[12]	= { R_MAPPED, VOL_DYN, 2, 112 },
+	[13]	= { R_MAPPED, VOL_DYN, 3, 113 },
+	[14]	= { R_MAPPED, VOL_DYN, 4, 114 },
+	[15]	= { R_SCRUB, VOL_DYN, 5, 115 },
+	[20]	= { R_MAPPED, VOL_STATIC, 0, 120 },
+	[21]	= { R_MAPPED, VOL_STATIC, 1, 121 },
+	[22]	= { R_MAPPED, VOL_STATIC, 2, 122 },
+	[30]	= { R_USED, VOL_DYN, 7, 900 },
+	[100]	= { R_ERASE },
+	[101]	= { R_ERASE },
+	[102]	= { R_ERASE },
+	[103]	= { R_ERASE },
+	[104]	= { R_POOL, VOL_DYN, 2, 2000 },	/* newer than PEB 12 */
+	[105]	= { R_POOL, VOL_DYN, 8, 2001 },
+	[106]	= { R_POOL, -1 },		/* still free */
+	[107]	= { R_EMPTY },
+	[110]	= { R_BAD },
+};
+
+static const int pool[2][2] = { { 104, 105 }, { 106, 107 } };
+
+static int peb_ec(int pnum)
+{
+	return 3 + (pnum * 7) % 11;
+}
+
+static void write_vid_hdr(int pnum, int vol_id, int lnum,
+			  unsigned long long sqnum)
+{
+	struct ubi_vid_hdr *vid_hdr = ubi_zalloc_vid_hdr(&ubi, GFP_KERNEL);
+
+	vid_hdr->vol_type = UBI_VID_DYNAMIC;
+	vid_hdr->vol_id = cpu_to_be32(vol_id);
+	vid_hdr->lnum = cpu_to_be32(lnum);
+	vid_hdr->sqnum = cpu_to_be64(sqnum);
+	if (vol_id == LAYOUT)
+		vid_hdr->compat = UBI_LAYOUT_VOLUME_COMPAT;
+	else if (vol_id >= UBI_INTERNAL_VOL_START)
+		vid_hdr->compat = UBI_COMPAT_DELETE;
+	if (vol_id == VOL_STATIC) {
+		vid_hdr->vol_type = UBI_VID_STATIC;
+		vid_hdr->used_ebs = cpu_to_be32(3);
+		vid_hdr->data_size = cpu_to_be32(lnum == 2 ? STATIC_LAST :
+						 ubi.leb_size);
+	}
+	ubi_io_write_vid_hdr(&ubi, pnum, vid_hdr);
+	ubi_free_vid_hdr(&ubi, vid_hdr);
+}
+
+static void write_ec_hdr(int pnum)
+{
+	struct ubi_ec_hdr *ec_hdr = calloc(1, ubi.ec_hdr_alsize);
+
+	ec_hdr->ec = cpu_to_be64(peb_ec(pnum));
+	ubi_io_write_ec_hdr(&ubi, pnum, ec_hdr);
+	free(ec_hdr);
+}
+
+/* The fastmap data, from the super block to the last EBA table */
+static u8 fm[2 * PEB_SIZE];
+static int fm_pos;
+
+static void *fm_put(int len)
+{
+	void *p = fm + fm_pos;
+
+	fm_pos += len;
+	return p;
+}
+
+static void fm_put_list(int role)
+{
+	struct ubi_fm_ec *fmec;
+	int pnum;
+
+	for (pnum = 0; pnum < PEBS; pnum++)
+		if (pebs[pnum].role == role) {
+			fmec = fm_put(sizeof(*fmec));
+			fmec->pnum = cpu_to_be32(pnum);
+			fmec->ec = cpu_to_be32(peb_ec(pnum));
+		}
+}
+
+static int count_role(int role)
+{
+	int pnum, n = 0;
+
+	for (pnum = 0; pnum < PEBS; pnum++)
+		n += pebs[pnum].role == role;
+	return n;
+}
+
+static void fm_put_volume(int vol_id, int reserved, int type)
+{
+	struct ubi_fm_volhdr *fmvhdr = fm_put(sizeof(*fmvhdr));
+	struct ubi_fm_eba *fmeba = fm_put(sizeof(*fmeba));
+	__be32 *pnums = fm_put(reserved * sizeof(__be32));
+	int pnum, lnum;
+
+	fmvhdr->magic = cpu_to_be32(UBI_FM_VHDR_MAGIC);
+	fmvhdr->vol_id = cpu_to_be32(vol_id);
+	fmvhdr->vol_type = type;
+	if (type == UBI_STATIC_VOLUME) {
+		fmvhdr->used_ebs = cpu_to_be32(3);
+		fmvhdr->last_eb_bytes = cpu_to_be32(STATIC_LAST);
+	}
+	fmeba->magic = cpu_to_be32(UBI_FM_EBA_MAGIC);
+	fmeba->reserved_pebs = cpu_to_be32(reserved);
+
+	for (lnum = 0; lnum < reserved; lnum++)
+		pnums[lnum] = cpu_to_be32(-1);
+	for (pnum = 0; pnum < PEBS; pnum++)
+		if ((pebs[pnum].role == R_MAPPED ||
+		     pebs[pnum].role == R_SCRUB) &&
+		    pebs[pnum].vol_id == vol_id)
+			pnums[pebs[pnum].lnum] = cpu_to_be32(pnum);
+}
+
+/*
+ * Write the image.  @corrupt, if given, gets to change the fastmap before
+ * its CRC is calculated.
+ */
+static int fm_bad_crc;
+
+static void build_image(void (*corrupt)(void))
+{
+	struct ubi_fm_sb *fmsb;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_scan_pool *fmpl;
+	int pnum, i, j;
+
+	ubi_setup();
+	memset(flash, 0xff, sizeof(flash));
+	memset(bad, 0, sizeof(bad));
+
+	for (pnum = 0; pnum < PEBS; pnum++) {
+		struct peb *p = &pebs[pnum];
+
+		switch (p->role) {
+		case R_BAD:
+			bad[pnum] = 1;
+			continue;
+		case R_EMPTY:
+			continue;
+		}
+		write_ec_hdr(pnum);
+
+		switch (p->role) {
+		case R_MAPPED:
+		case R_SCRUB:
+		case R_USED:
+			write_vid_hdr(pnum, p->vol_id, p->lnum, p->sqnum);
+			break;
+		case R_POOL:
+			if (p->vol_id >= 0)
+				write_vid_hdr(pnum, p->vol_id, p->lnum,
+					      p->sqnum);
+			break;
+		case R_ERASE:
+			/* an erasure that did not finish */
+			write_vid_hdr(pnum, UBI_FM_SB_VOLUME_ID, 0, 500);
+			if (pnum != 5)
+				flash[pnum][PAGE + 8] ^= 0xff;
+			break;
+		}
+	}
+
+	/* the fastmap, two blocks long */
+	memset(fm, 0, sizeof(fm));
+	fm_pos = 0;
+	fmsb = fm_put(sizeof(*fmsb));
+	fmsb->magic = cpu_to_be32(UBI_FM_SB_MAGIC);
+	fmsb->version = UBI_FM_FMT_VERSION;
+	fmsb->used_blocks = cpu_to_be32(2);
+	for (i = 0; i < 2; i++) {
+		fmsb->block_loc[i] = cpu_to_be32(i);
+		fmsb->block_ec[i] = cpu_to_be32(peb_ec(i));
+	}
+	fmsb->sqnum = cpu_to_be64(FM_SQNUM);
+
+	fmhdr = fm_put(sizeof(*fmhdr));
+	fmhdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	fmhdr->free_peb_count = cpu_to_be32(count_role(R_FREE));
+	fmhdr->used_peb_count = cpu_to_be32(count_role(R_MAPPED) +
+					    count_role(R_USED));
+	fmhdr->scrub_peb_count = cpu_to_be32(count_role(R_SCRUB));
+	fmhdr->bad_peb_count = cpu_to_be32(count_role(R_BAD));
+	fmhdr->erase_peb_count = cpu_to_be32(count_role(R_ERASE));
+	fmhdr->vol_count = cpu_to_be32(3);
+
+	for (i = 0; i < 2; i++) {
+		fmpl = fm_put(sizeof(*fmpl));
+		fmpl->magic = cpu_to_be32(UBI_FM_POOL_MAGIC);
+		fmpl->size = cpu_to_be16(ARRAY_SIZE(pool[i]));
+		fmpl->max_size = cpu_to_be16(16);
+		for (j = 0; j < ARRAY_SIZE(pool[i]); j++)
+			fmpl->pebs[j] = cpu_to_be32(pool[i][j]);
+	}
+
+	/* the used list takes the mapped PEBs and the unmapped one */
+	fm_put_list(R_FREE);
+	for (pnum = 0; pnum < PEBS; pnum++)
+		if (pebs[pnum].role == R_MAPPED || pebs[pnum].role == R_USED) {
+			struct ubi_fm_ec *fmec = fm_put(sizeof(*fmec));
+
+			fmec->pnum = cpu_to_be32(pnum);
+			fmec->ec = cpu_to_be32(peb_ec(pnum));
+		}
+	fm_put_list(R_SCRUB);
+	fm_put_list(R_ERASE);
+
+	fm_put_volume(LAYOUT, UBI_LAYOUT_VOLUME_EBS, UBI_DYNAMIC_VOLUME);
+	fm_put_volume(VOL_DYN, 10, UBI_DYNAMIC_VOLUME);
+	fm_put_volume(VOL_STATIC, 3, UBI_STATIC_VOLUME);
+
+	if (corrupt)
+		corrupt();
+	fmsb->data_crc = 0;
+	fmsb->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, fm,
+					   2 * ubi.leb_size) ^ fm_bad_crc);
+
+	write_vid_hdr(0, UBI_FM_SB_VOLUME_ID, 0, FM_SQNUM);
+	write_vid_hdr(1, UBI_FM_DATA_VOLUME_ID, 0, FM_SQNUM);
+	for (i = 0; i < 2; i++)
+		ubi_io_write_data(&ubi, fm + i * ubi.leb_size, i, 0,
+				  ubi.leb_size);
+
+	memset(hdr_reads, 0, sizeof(hdr_reads));
+	memset(vid_reads, 0, sizeof(vid_reads));
+	memset(erases, 0, sizeof(erases));
+}
+
+static int failed;
+
+#define CHECK(cond, fmt, args...)	do {				\
+		if (!(cond)) {						\
+			printf("FAIL %s:%d: " fmt "\n", __func__,	\
+			       __LINE__, ##args);			\
+			failed++;					\
+		}							\
+	} while (0)
+
+/*
+ * Where each PEB ends up: the LEB it holds, or one of the lists.  The
+ * erase, corrupted and alien lists all keep the PEB out of use until it
+ * is erased, and which of them it lands on is the only thing the fastmap
+ * is allowed to change.
+ */
+#define WHERE_NONE	0
+#define WHERE_FREE	1
+#define WHERE_GONE	2
+#define WHERE_LEB	3
+
+struct where {
+	int where;
+	int vol_id;
+	int lnum;
+	int ec;
+	int scrub;
+};
+
+static void si_where(struct ubi_scan_info *si, struct where *w)
+{
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
+	struct rb_node *rb1, *rb2;
+
+	memset(w, 0, PEBS * sizeof(*w));
+	list_for_each_entry(seb, &si->free, u.list)
+		w[seb->pnum] = (struct where){ WHERE_FREE, 0, 0, seb->ec };
+	list_for_each_entry(seb, &si->erase, u.list)
+		w[seb->pnum] = (struct where){ WHERE_GONE };
+	list_for_each_entry(seb, &si->corr, u.list)
+		w[seb->pnum] = (struct where){ WHERE_GONE };
+	list_for_each_entry(seb, &si->alien, u.list)
+		w[seb->pnum] = (struct where){ WHERE_GONE };
+	ubi_rb_for_each_entry(rb1, sv, &si->volumes, rb)
+		ubi_rb_for_each_entry(rb2, seb, &sv->root, u.rb)
+			w[seb->pnum] = (struct where){ WHERE_LEB, sv->vol_id,
+					seb->lnum, seb->ec, seb->scrub };
+}
+
+static void compare_volumes(struct ubi_scan_info *fm_si,
+			    struct ubi_scan_info *si)
+{
+	struct ubi_scan_volume *sv, *fm_sv;
+	struct rb_node *rb;
+
+	CHECK(fm_si->vols_found == si->vols_found, "%d volumes, scan found %d",
+	      fm_si->vols_found, si->vols_found);
+	CHECK(fm_si->highest_vol_id == si->highest_vol_id,
+	      "highest volume %d, scan found %d", fm_si->highest_vol_id,
+	      si->highest_vol_id);
+
+	ubi_rb_for_each_entry(rb, sv, &si->volumes, rb) {
+		fm_sv = ubi_scan_find_sv(fm_si, sv->vol_id);
+		CHECK(fm_sv, "volume %d missing", sv->vol_id);
+		if (!fm_sv)
+			continue;
+		CHECK(fm_sv->highest_lnum == sv->highest_lnum &&
+		      fm_sv->leb_count == sv->leb_count &&
+		      fm_sv->vol_type == sv->vol_type &&
+		      fm_sv->used_ebs == sv->used_ebs &&
+		      fm_sv->last_data_size == sv->last_data_size &&
+		      fm_sv->data_pad == sv->data_pad &&
+		      fm_sv->compat == sv->compat,
+		      "volume %d differs from the scanned one", sv->vol_id);
+	}
+}
+
+/* A good fastmap gives what scanning the whole device gives */
+static void test_attach(void)
+{
+	struct ubi_scan_info *fm_si, *si;
+	struct where fm_w[PEBS], w[PEBS];
+	int pnum, ec_count = 0;
+	long long ec_sum = 0;
+
+	build_image(NULL);
+	fm_si = ubi_scan_fastmap(&ubi);
+	CHECK(fm_si, "fastmap not used");
+	if (!fm_si)
+		return;
+	CHECK(ubi.fm_pnum == 0 && ubi.fm_ec == peb_ec(0),
+	      "attached from PEB %d, EC %d", ubi.fm_pnum, ubi.fm_ec);
+
+	/* only the pools and the PEBs no EBA table maps are scanned */
+	for (pnum = 0; pnum < PEBS; pnum++) {
+		int role = pebs[pnum].role;
+		int want = role == R_POOL || role == R_EMPTY || role == R_USED;
+
+		CHECK(hdr_reads[pnum] == want, "PEB %d scanned %d times",
+		      pnum, hdr_reads[pnum]);
+		CHECK(pnum < UBI_FM_MAX_START || vid_reads[pnum] == 0,
+		      "VID header of PEB %d read", pnum);
+	}
+
+	/* the mappings the fastmap gave have to be checked on first use */
+	for (pnum = 0; pnum < PEBS; pnum++) {
+		int role = pebs[pnum].role;
+		int want = !(role == R_MAPPED || role == R_SCRUB);
+
+		CHECK(ubi.fm_checked[pnum] == want,
+		      "PEB %d checked flag %d", pnum, ubi.fm_checked[pnum]);
+	}
+
+	si_where(fm_si, fm_w);
+	CHECK(fm_w[15].where == WHERE_LEB && fm_w[15].scrub,
+	      "PEB 15 not to be scrubbed");
+	CHECK(fm_w[104].where == WHERE_LEB && fm_w[104].lnum == 2,
+	      "pool copy of LEB 2 lost");
+
+	/* erase counters: every PEB with an EC header, once */
+	for (pnum = 0; pnum < PEBS; pnum++)
+		if (pebs[pnum].role != R_BAD && pebs[pnum].role != R_EMPTY) {
+			ec_sum += peb_ec(pnum);
+			ec_count++;
+		}
+	CHECK(fm_si->ec_count == ec_count, "%d erase counters, expected %d",
+	      fm_si->ec_count, ec_count);
+	CHECK(fm_si->mean_ec == (int)(ec_sum / ec_count),
+	      "mean EC %d, expected %d", fm_si->mean_ec,
+	      (int)(ec_sum / ec_count));
+
+	/* the same flash, fully scanned */
+	si = ubi_scan(&ubi);
+	CHECK(!IS_ERR(si), "scanning failed");
+	if (IS_ERR(si)) {
+		ubi_scan_destroy_si(fm_si);
+		return;
+	}
+	si_where(si, w);
+	for (pnum = 0; pnum < PEBS; pnum++) {
+		/* scanning cannot know what to scrub */
+		w[pnum].scrub = fm_w[pnum].scrub;
+		CHECK(!memcmp(&fm_w[pnum], &w[pnum], sizeof(w[pnum])),
+		      "PEB %d: fastmap says %d %d:%d EC %d, scan %d %d:%d "
+		      "EC %d", pnum, fm_w[pnum].where, fm_w[pnum].vol_id,
+		      fm_w[pnum].lnum, fm_w[pnum].ec, w[pnum].where,
+		      w[pnum].vol_id, w[pnum].lnum, w[pnum].ec);
+	}
+	compare_volumes(fm_si, si);
+	CHECK(fm_si->bad_peb_count == si->bad_peb_count,
+	      "%d bad PEBs, scan found %d", fm_si->bad_peb_count,
+	      si->bad_peb_count);
+	CHECK(fm_si->max_sqnum == si->max_sqnum, "max sqnum %llu, scan %llu",
+	      fm_si->max_sqnum, si->max_sqnum);
+	/* scanning leaves min_ec alone, nothing uses it */
+	CHECK(fm_si->max_ec == si->max_ec && fm_si->mean_ec == si->mean_ec,
+	      "EC max %d mean %d, scan max %d mean %d", fm_si->max_ec,
+	      fm_si->mean_ec, si->max_ec, si->mean_ec);
+
+	ubi_scan_destroy_si(si);
+	ubi_scan_destroy_si(fm_si);
+}
+
+/* Mappings which went stale after the fastmap was taken */
+static void test_check_mapping(void)
+{
+	struct ubi_scan_info *si;
+	struct ubi_volume vol;
+	struct where w[PEBS];
+	int eba_tbl[10], lnum, pnum, err;
+
+	build_image(NULL);
+	/* LEB 3 was unmapped, and LEB 4 moved on to hold LEB 9 */
+	ubi_io_sync_erase(&ubi, 13, 0);
+	write_ec_hdr(13);
+	ubi_io_sync_erase(&ubi, 14, 0);
+	write_ec_hdr(14);
+	write_vid_hdr(14, VOL_DYN, 9, 3000);
+
+	si = ubi_scan_fastmap(&ubi);
+	CHECK(si, "fastmap not used");
+	if (!si)
+		return;
+
+	memset(&vol, 0, sizeof(vol));
+	vol.vol_id = VOL_DYN;
+	vol.eba_tbl = eba_tbl;
+	si_where(si, w);
+	for (lnum = 0; lnum < 10; lnum++)
+		eba_tbl[lnum] = UBI_LEB_UNMAPPED;
+	for (pnum = 0; pnum < PEBS; pnum++)
+		if (w[pnum].where == WHERE_LEB && w[pnum].vol_id == VOL_DYN)
+			eba_tbl[w[pnum].lnum] = pnum;
+
+	pnum = eba_tbl[0];
+	err = ubi_fm_check_mapping(&ubi, &vol, 0, &pnum);
+	CHECK(!err && pnum == 10 && ubi.fm_checked[10],
+	      "LEB 0: error %d, PEB %d", err, pnum);
+	memset(vid_reads, 0, sizeof(vid_reads));
+	err = ubi_fm_check_mapping(&ubi, &vol, 0, &pnum);
+	CHECK(!err && !vid_reads[10], "LEB 0 checked twice");
+
+	pnum = eba_tbl[3];
+	err = ubi_fm_check_mapping(&ubi, &vol, 3, &pnum);
+	CHECK(!err && pnum == UBI_LEB_UNMAPPED &&
+	      eba_tbl[3] == UBI_LEB_UNMAPPED && put_pnum == 13,
+	      "LEB 3: error %d, PEB %d, put PEB %d", err, pnum, put_pnum);
+
+	pnum = eba_tbl[4];
+	err = ubi_fm_check_mapping(&ubi, &vol, 4, &pnum);
+	CHECK(err == -EINVAL && ubi.ro_mode, "LEB 4: error %d", err);
+
+	/* no fastmap, nothing to check */
+	ubi_scan_destroy_si(si);
+	free(ubi.fm_checked);
+	ubi.fm_checked = NULL;
+	pnum = 14;
+	CHECK(!ubi_fm_check_mapping(&ubi, &vol, 4, &pnum) && pnum == 14,
+	      "mapping checked without a fastmap");
+}
+
+/* The fastmap is erased before UBI changes anything it describes */
+static void test_invalidate(void)
+{
+	struct ubi_scan_info *si;
+
+	build_image(NULL);
+	si = ubi_scan_fastmap(&ubi);
+	CHECK(si, "fastmap not used");
+	if (!si)
+		return;
+
+	/* erasures while attaching are on the fastmap erase list */
+	ubi_io_sync_erase(&ubi, 100, 0);
+	CHECK(erases[100] == 1 && !erases[0] && ubi.fm_pnum == 0,
+	      "fastmap invalidated while attaching");
+
+	ubi.fm_attached = 1;
+	write_vid_hdr(106, VOL_DYN, 9, 3000);
+	CHECK(erases[0] == 1 && ubi.fm_pnum == -1,
+	      "fastmap not invalidated by a VID header write");
+	CHECK(be64_to_cpu(((struct ubi_ec_hdr *)flash[0])->ec) ==
+	      peb_ec(0) + 1, "EC of the old anchor not incremented");
+
+	ubi_io_sync_erase(&ubi, 101, 0);
+	CHECK(erases[0] == 1, "fastmap invalidated twice");
+	ubi_scan_destroy_si(si);
+
+	/* the next attach finds no fastmap it may use */
+	ubi_setup();
+	si = ubi_scan_fastmap(&ubi);
+	CHECK(!si && ubi.fm_pnum == -1, "stale fastmap used");
+	if (si)
+		ubi_scan_destroy_si(si);
+}
+
+/* Every way the fastmap can be inconsistent */
+static struct ubi_fm_sb *sb(void)
+{
+	return (void *)fm;
+}
+
+static struct ubi_fm_hdr *hdr(void)
+{
+	return (void *)fm + sizeof(struct ubi_fm_sb);
+}
+
+static struct ubi_fm_scan_pool *pl(int i)
+{
+	return (struct ubi_fm_scan_pool *)(hdr() + 1) + i;
+}
+
+static struct ubi_fm_ec *list(int i)
+{
+	return (struct ubi_fm_ec *)(pl(2)) + i;
+}
+
+/* the volume headers follow the lists */
+static struct ubi_fm_volhdr *volhdr(int vol)
+{
+	int n = count_role(R_FREE) + count_role(R_MAPPED) +
+		count_role(R_USED) + count_role(R_SCRUB) +
+		count_role(R_ERASE);
+	static const int reserved[] = { UBI_LAYOUT_VOLUME_EBS, 10 };
+	void *p = list(n);
+	int i;
+
+	for (i = 0; i < vol; i++)
+		p += sizeof(struct ubi_fm_volhdr) + sizeof(struct ubi_fm_eba) +
+		     reserved[i] * sizeof(__be32);
+	return p;
+}
+
+static struct ubi_fm_eba *eba(int vol)
+{
+	return (void *)(volhdr(vol) + 1);
+}
+
+static void c_crc(void)		{ fm_bad_crc = 1; }
+static void c_sb_magic(void)	{ sb()->magic = 0; }
+static void c_version(void)	{ sb()->version = 2; }
+static void c_no_blocks(void)	{ sb()->used_blocks = 0; }
+static void c_many_blocks(void)
+{
+	sb()->used_blocks = cpu_to_be32(UBI_FM_MAX_BLOCKS + 1);
+}
+static void c_anchor(void)	{ sb()->block_loc[0] = cpu_to_be32(1); }
+static void c_block_range(void)	{ sb()->block_loc[1] = cpu_to_be32(PEBS); }
+static void c_block_vid(void)	{ sb()->block_loc[1] = cpu_to_be32(10); }
+static void c_block_ec(void)	{ sb()->block_ec[1] = cpu_to_be32(-1); }
+static void c_hdr_magic(void)	{ hdr()->magic = 0; }
+static void c_free_count(void)
+{
+	hdr()->free_peb_count = cpu_to_be32(PEBS + 1);
+}
+static void c_list_size(void)
+{
+	/* more records than there is fastmap */
+	hdr()->erase_peb_count = cpu_to_be32(PEBS);
+	hdr()->free_peb_count = cpu_to_be32(PEBS);
+	hdr()->used_peb_count = cpu_to_be32(PEBS);
+	hdr()->scrub_peb_count = cpu_to_be32(PEBS);
+}
+static void c_list_range(void)	{ list(3)->pnum = cpu_to_be32(PEBS); }
+static void c_list_twice(void)	{ list(3)->pnum = list(4)->pnum; }
+static void c_list_fm(void)	{ list(3)->pnum = cpu_to_be32(1); }
+static void c_ec(void)
+{
+	list(3)->ec = cpu_to_be32((u32)UBI_MAX_ERASECOUNTER + 1);
+}
+static void c_vol_count(void)	{ hdr()->vol_count = cpu_to_be32(4); }
+static void c_many_vols(void)	{ hdr()->vol_count = cpu_to_be32(100000); }
+static void c_vhdr_magic(void)	{ volhdr(1)->magic = 0; }
+static void c_eba_magic(void)	{ eba(1)->magic = 0; }
+static void c_vol_id(void)	{ volhdr(1)->vol_id = cpu_to_be32(UBI_MAX_VOLUMES); }
+static void c_vol_type(void)	{ volhdr(1)->vol_type = 7; }
+static void c_same_vol(void)	{ volhdr(2)->vol_id = volhdr(1)->vol_id; }
+static void c_reserved(void)
+{
+	eba(1)->reserved_pebs = cpu_to_be32(PEBS + 1);
+}
+static void c_eba_free(void)	{ eba(1)->pnum[6] = cpu_to_be32(40); }
+static void c_eba_twice(void)	{ eba(1)->pnum[6] = eba(1)->pnum[0]; }
+static void c_eba_range(void)	{ eba(1)->pnum[6] = cpu_to_be32(PEBS); }
+static void c_pool_magic(void)	{ pl(1)->magic = 0; }
+static void c_pool_max(void)	{ pl(0)->max_size = cpu_to_be16(1); }
+static void c_pool_size(void)
+{
+	pl(0)->size = cpu_to_be16(UBI_FM_MAX_POOL_SIZE + 1);
+	pl(0)->max_size = pl(0)->size;
+}
+static void c_pool_range(void)	{ pl(0)->pebs[1] = cpu_to_be32(PEBS); }
+static void c_pool_listed(void)	{ pl(0)->pebs[1] = cpu_to_be32(40); }
+
+static const struct {
+	const char *name;
+	void (*corrupt)(void);
+} corruptions[] = {
+	{ "data CRC", c_crc },
+	{ "super block magic", c_sb_magic },
+	{ "format version", c_version },
+	{ "no blocks", c_no_blocks },
+	{ "too many blocks", c_many_blocks },
+	{ "anchor not the first block", c_anchor },
+	{ "block out of range", c_block_range },
+	{ "block is not fastmap data", c_block_vid },
+	{ "block erase counter", c_block_ec },
+	{ "header magic", c_hdr_magic },
+	{ "free list longer than the device", c_free_count },
+	{ "lists past the end", c_list_size },
+	{ "listed PEB out of range", c_list_range },
+	{ "PEB listed twice", c_list_twice },
+	{ "fastmap block listed", c_list_fm },
+	{ "erase counter overflow", c_ec },
+	{ "volume past the end", c_vol_count },
+	{ "too many volumes", c_many_vols },
+	{ "volume header magic", c_vhdr_magic },
+	{ "EBA table magic", c_eba_magic },
+	{ "volume ID", c_vol_id },
+	{ "volume type", c_vol_type },
+	{ "volume twice", c_same_vol },
+	{ "EBA table past the end", c_reserved },
+	{ "LEB mapped to a free PEB", c_eba_free },
+	{ "two LEBs in one PEB", c_eba_twice },
+	{ "LEB mapped out of range", c_eba_range },
+	{ "pool magic", c_pool_magic },
+	{ "pool above its maximum", c_pool_max },
+	{ "pool too big", c_pool_size },
+	{ "pool PEB out of range", c_pool_range },
+	{ "pool PEB listed", c_pool_listed },
+};
+
+static void test_corrupt(void)
+{
+	struct ubi_scan_info *si;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(corruptions); i++) {
+		printf("--- %s\n", corruptions[i].name);
+		fm_bad_crc = 0;
+		build_image(corruptions[i].corrupt);
+		si = ubi_scan_fastmap(&ubi);
+		CHECK(!si, "%s: fastmap used", corruptions[i].name);
+		CHECK(ubi.fm_pnum == -1 && !ubi.fm_checked,
+		      "%s: fastmap state left behind", corruptions[i].name);
+		if (si)
+			ubi_scan_destroy_si(si);
+	}
+	fm_bad_crc = 0;
+}
+
+/* Without a fastmap there is nothing to attach from */
+static void test_none(void)
+{
+	build_image(NULL);
+	ubi_io_sync_erase(&ubi, 0, 0);
+	CHECK(!ubi_scan_fastmap(&ubi), "fastmap found on an erased anchor");
+}
+
+int main(void)
+{
+	test_attach();
+	test_check_mapping();
+	test_invalidate();
+	test_corrupt();
+	test_none();
+
+	printf("ubi_fastmap: %d checks failed\n", failed);
+	return failed ? 1 : 0;
+}
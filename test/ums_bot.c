@@ -0,0 +1,675 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+/*
+ * The Bulk-Only Transport of common/cmd_ums.c, looped back to a scripted
+ * host.  "ums ram 0" runs unchanged on a UDC model whose udc_irq() plays
+ * the host side: it queues each CBW with its data-out packets behind it,
+ * the way a host does, collects the data-in phase and the CSW, and checks
+ * them and the RAM block device under the command.  A packet only leaves
+ * the fifo when the armed urb has room for it, and a bulk-in transfer
+ * completes one udc_irq() later, as on a real controller.
+ */
+#define CONFIG_USBD_MANUFACTURER	"Test"
+#define CONFIG_USBD_PRODUCT_NAME	"Loopback"
+#define CONFIG_USBD_VENDORID		0x18d1
+#define CONFIG_USBD_PRODUCTID		0x0001
+#define CONFIG_UMS_BUFFER_SIZE		(64 << 10)
+#define EP0_MAX_PACKET_SIZE		64
+#define CONFIG_MUSB_UDC
+#define CONFIG_PARTITIONS
+
+#include <common.h>
+#include <usbdevice.h>
+
+#include "../common/cmd_ums.c"
+
+unsigned long long test_clock_us;
+
+/* the block device: 2 MiB of RAM */
+#define BLKSZ		512
+#define LBAS		4096
+#define PKTSIZE		CONFIG_USBD_UMS_BULK_PKTSIZE_HS
+#define TX_POLLS	3		/* udc_irq() calls per bulk-in transfer */
+
+static u8 ram[LBAS * BLKSZ];
+static u8 host_disk[LBAS * BLKSZ];	/* what the host believes is stored */
+static int ram_reads, ram_writes;	/* block_read/block_write calls */
+static lbaint_t ram_last_write;		/* blocks in the last write */
+static long ram_fail_lba = -1;		/* writes covering this block fail */
+
+static unsigned long ram_read(int dev, unsigned long start, lbaint_t blkcnt,
+			      void *buffer)
+{
+	ram_reads++;
+	memcpy(buffer, ram + start * BLKSZ, blkcnt * BLKSZ);
+	return blkcnt;
+}
+
+static unsigned long ram_write(int dev, unsigned long start, lbaint_t blkcnt,
+			       const void *buffer)
+{
+	ram_writes++;
+	ram_last_write = blkcnt;
+	if (ram_fail_lba >= (long)start && ram_fail_lba < (long)(start + blkcnt))
+		return 0;
+	memcpy(ram + start * BLKSZ, buffer, blkcnt * BLKSZ);
+	return blkcnt;
+}
+
+static block_dev_desc_t ram_dev = {
+	.type		= DEV_TYPE_HARDDISK,
+	.lba		= LBAS,
+	.blksz		= BLKSZ,
+	.block_read	= ram_read,
+	.block_write	= ram_write,
+};
+
+/* board and U-Boot services the command uses */
+ulong load_addr;
+struct usb_string_descriptor **usb_strings;
+
+block_dev_desc_t *get_dev(char *ifname, int dev)
+{
+	return strcmp(ifname, "ram") ? NULL : &ram_dev;
+}
+
+char *getenv(const char *name)
+{
+	return NULL;
+}
+
+int cmd_usage(const cmd_tbl_t *cmdtp)
+{
+	return 1;
+}
+
+ulong simple_strtoul(const char *cp, char **endp, unsigned int base)
+{
+	return strtoul(cp, endp, base);
+}
+
+void urb_link_init(urb_link *ul)
+{
+	ul->next = ul->prev = ul;
+}
+
+struct urb *usbd_alloc_urb(struct usb_device_instance *device,
+			   struct usb_endpoint_instance *endpoint)
+{
+	struct urb *urb = calloc(1, sizeof(*urb));
+
+	urb->device = device;
+	urb->endpoint = endpoint;
+	urb->buffer = (u8 *)urb->buffer_data;
+	urb->buffer_length = sizeof(urb->buffer_data);
+	return urb;
+}
+
+/*
+ * The host.  Each step is one command, or the host doing something else
+ * on the bus; the command's data-out is queued right behind its CBW.
+ */
+#define NO_CSW		-1
+
+struct step {
+	const char *name;
+	u8 cb[12];
+	u32 data_len;
+	int in;				/* data phase is device to host */
+	int no_data;			/* the device skips the data phase */
+	int bad_cbw;			/* send a CBW with a bad signature */
+	u32 reset_after;		/* Bulk-Only Reset after this much data */
+	int idle_ms;			/* just wait this long */
+	int bus_reset;			/* reset and reconfigure the bus */
+	/* expected */
+	int status;
+	u32 residue;
+	void (*before)(void);
+	void (*check)(const struct step *s, const u8 *in);
+};
+
+#define RW10(op, lba, n) { op, 0, ((lba) >> 24) & 0xff,		\
+			  ((lba) >> 16) & 0xff, ((lba) >> 8) & 0xff,	\
+			  (lba) & 0xff, 0, ((n) >> 8) & 0xff, (n) & 0xff }
+#define READ10(lba, n)	RW10(SCSI_READ10, lba, n)
+#define WRITE10(lba, n)	RW10(SCSI_WRITE10, lba, n)
+#define SENSE		{ SCSI_REQ_SENSE, 0, 0, 0, 18 }
+#define TUR		{ SCSI_TST_U_RDY }
+
+static struct {
+	int step;
+	int state;
+	u32 tag;
+
+	/* data-out packets not yet taken by the device */
+	u8 out[512 << 10];
+	u32 out_len, out_pos;
+	u32 out_sent;
+
+	/* data-in and CSW as received */
+	u8 in[512 << 10];
+	u32 in_len;
+
+	int tx_pending;			/* udc_irq() calls until the bulk-in
+					   transfer is done, or 0 */
+	unsigned long long until;	/* ms */
+	unsigned long long progress;	/* ms, last time anything moved */
+	int write_mark;			/* ram_writes before the step */
+	u32 data_lba, data_blks;	/* a read or write step's range */
+} host;
+
+#define H_START		0
+#define H_COMMAND	1
+#define H_IDLE		2
+#define H_RECONFIGURE	3
+#define H_DONE		4
+
+static int failed;
+
+#define FAIL(s, fmt, args...)	do {				\
+		printf("FAIL %s: " fmt "\n", (s)->name, ##args);	\
+		failed++;						\
+	} while (0)
+
+static unsigned long long now_ms(void)
+{
+	return test_clock_us / 1000;
+}
+
+static u8 pattern(u32 lba, u32 off, int seed)
+{
+	return (lba * 13 + off * 7 + seed + (off >> 8)) & 0xff;
+}
+
+/* step checks */
+
+static void check_data_in(const struct step *s, const u8 *in)
+{
+	if (memcmp(in, host_disk + host.data_lba * BLKSZ, s->data_len))
+		FAIL(s, "data read does not match");
+}
+
+static void check_zeros(const struct step *s, const u8 *in)
+{
+	u32 i;
+
+	for (i = 0; i < s->data_len; i++)
+		if (in[i]) {
+			FAIL(s, "padding is not zero at %u", i);
+			return;
+		}
+}
+
+static void check_stored(const struct step *s, const u8 *in)
+{
+	if (memcmp(ram, host_disk, sizeof(ram)))
+		FAIL(s, "the device does not hold what was written");
+}
+
+static void check_cached(const struct step *s, const u8 *in)
+{
+	if (ram_writes != host.write_mark)
+		FAIL(s, "%d block writes, the data should be cached",
+		     ram_writes - host.write_mark);
+}
+
+static void check_sync_once(const struct step *s, const u8 *in)
+{
+	check_stored(s, in);
+	if (ram_writes != host.write_mark + 1 || ram_last_write != 24)
+		FAIL(s, "%d block writes of %lu, expected one of 24",
+		     ram_writes - host.write_mark, (ulong)ram_last_write);
+}
+
+static void check_big_write(const struct step *s, const u8 *in)
+{
+	/* 300 blocks through a 128 block cache: two full flushes */
+	if (ram_writes != host.write_mark + 2)
+		FAIL(s, "%d block writes, expected 2",
+		     ram_writes - host.write_mark);
+}
+
+static void check_read_halves(const struct step *s, const u8 *in)
+{
+	check_data_in(s, in);
+	/* 300 blocks in halves of 64 */
+	if (ram_reads != 5)
+		FAIL(s, "%d block reads, expected 5", ram_reads);
+}
+
+static void check_inquiry(const struct step *s, const u8 *in)
+{
+	if (in[0] != 0x00 || !(in[1] & 0x80) || memcmp(in + 8, "U-Boot", 6))
+		FAIL(s, "bad INQUIRY data");
+}
+
+static void check_capacity(const struct step *s, const u8 *in)
+{
+	if (get_unaligned_be32(in) != LBAS - 1 ||
+	    get_unaligned_be32(in + 4) != BLKSZ)
+		FAIL(s, "capacity %u blocks of %u", get_unaligned_be32(in) + 1,
+		     get_unaligned_be32(in + 4));
+}
+
+static void check_mode_sense(const struct step *s, const u8 *in)
+{
+	if (in[0] != 23 || in[4] != 0x08 || !(in[6] & 0x04))
+		FAIL(s, "no caching page with WCE");
+}
+
+static void check_sense(const struct step *s, const u8 *in, u8 key, u8 asc)
+{
+	if (in[0] != 0x70 || in[2] != key || in[12] != asc)
+		FAIL(s, "sense %x/%02x, expected %x/%02x", in[2], in[12],
+		     key, asc);
+}
+
+static void check_invalid_opcode(const struct step *s, const u8 *in)
+{
+	check_sense(s, in, SK_ILLEGAL_REQUEST, ASC_INVALID_OPCODE);
+}
+
+static void check_out_of_range(const struct step *s, const u8 *in)
+{
+	check_sense(s, in, SK_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+}
+
+static void check_write_error(const struct step *s, const u8 *in)
+{
+	check_sense(s, in, SK_MEDIUM_ERROR, ASC_WRITE_ERROR);
+}
+
+static void check_no_sense(const struct step *s, const u8 *in)
+{
+	check_sense(s, in, SK_NO_SENSE, 0);
+}
+
+static void fail_writes(void)
+{
+	ram_fail_lba = 3000;
+}
+
+static void good_writes(void)
+{
+	ram_fail_lba = -1;
+	/* the failed write never reached the device */
+	memcpy(host_disk + 2996 * BLKSZ, ram + 2996 * BLKSZ, 8 * BLKSZ);
+}
+
+static void reads_count(void)
+{
+	ram_reads = 0;
+}
+
+static const struct step steps[] = {
+	{ "INQUIRY", { SCSI_INQUIRY, 0, 0, 0, 36 }, 36, 1,
+	  .status = UMS_CSW_GOOD, .check = check_inquiry },
+	{ "TEST UNIT READY", TUR, .status = UMS_CSW_GOOD },
+	{ "READ CAPACITY", { SCSI_RD_CAPAC }, 8, 1,
+	  .status = UMS_CSW_GOOD, .check = check_capacity },
+	{ "MODE SENSE(6), short reply", { SCSI_MODE_SEN6, 0, 0x3f, 0, 192 },
+	  192, 1, .status = UMS_CSW_GOOD, .residue = 192 - 24,
+	  .check = check_mode_sense },
+	{ "unknown opcode", { 0xff }, .status = UMS_CSW_FAILED },
+	{ "REQUEST SENSE: invalid opcode", SENSE, 18, 1,
+	  .status = UMS_CSW_GOOD, .check = check_invalid_opcode },
+	{ "REQUEST SENSE: cleared", SENSE, 18, 1,
+	  .status = UMS_CSW_GOOD, .check = check_no_sense },
+
+	{ "READ(10) 300 blocks", READ10(0, 300), 300 * BLKSZ, 1,
+	  .status = UMS_CSW_GOOD, .before = reads_count,
+	  .check = check_read_halves },
+	{ "READ(10) past the end", READ10(LBAS - 2, 4), 4 * BLKSZ, 1,
+	  .status = UMS_CSW_FAILED, .residue = 4 * BLKSZ,
+	  .check = check_zeros },
+	{ "REQUEST SENSE: out of range", SENSE, 18, 1,
+	  .status = UMS_CSW_GOOD, .check = check_out_of_range },
+	{ "READ(10) with the wrong length", READ10(0, 8), 512, 1,
+	  .no_data = 1, .status = UMS_CSW_PHASE_ERROR, .residue = 512 },
+	{ "READ(10) zero blocks", READ10(0, 0), .status = UMS_CSW_GOOD },
+
+	{ "WRITE(10) 8 blocks", WRITE10(100, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD, .check = check_cached },
+	{ "WRITE(10) 8 blocks, contiguous", WRITE10(108, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD, .check = check_cached },
+	{ "WRITE(10) 8 blocks, contiguous again", WRITE10(116, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD, .check = check_cached },
+	{ "SYNCHRONIZE CACHE", { SCSI_SYNC_CACHE },
+	  .status = UMS_CSW_GOOD, .check = check_sync_once },
+
+	{ "WRITE(10) 300 blocks", WRITE10(1000, 300), 300 * BLKSZ,
+	  .status = UMS_CSW_GOOD, .check = check_big_write },
+	{ "WRITE(10) elsewhere flushes", WRITE10(2000, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD },
+	{ "READ(10) of cached blocks", READ10(2000, 8), 8 * BLKSZ, 1,
+	  .status = UMS_CSW_GOOD, .check = check_data_in },
+	{ "all stored after the read", TUR, .status = UMS_CSW_GOOD,
+	  .check = check_stored },
+
+	{ "WRITE(10) past the end", WRITE10(LBAS - 1, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_FAILED, .residue = 8 * BLKSZ },
+	{ "REQUEST SENSE: write out of range", SENSE, 18, 1,
+	  .status = UMS_CSW_GOOD, .check = check_out_of_range },
+
+	{ "WRITE(10) onto a bad block", WRITE10(2996, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD, .before = fail_writes },
+	{ "SYNCHRONIZE CACHE: write-back fails", { SCSI_SYNC_CACHE },
+	  .status = UMS_CSW_FAILED },
+	{ "REQUEST SENSE: write error", SENSE, 18, 1,
+	  .status = UMS_CSW_GOOD, .check = check_write_error },
+	{ "SYNCHRONIZE CACHE: error reported once", { SCSI_SYNC_CACHE },
+	  .status = UMS_CSW_GOOD, .before = good_writes,
+	  .check = check_stored },
+
+	{ "CBW with a bad signature", TUR, .bad_cbw = 1, .status = NO_CSW },
+	{ "TEST UNIT READY after it", TUR, .status = UMS_CSW_GOOD },
+
+	{ "Bulk-Only Reset during READ(10)", READ10(0, 300), 300 * BLKSZ, 1,
+	  .reset_after = 8 * BLKSZ, .status = NO_CSW },
+	{ "READ(10) after the reset", READ10(8, 8), 8 * BLKSZ, 1,
+	  .status = UMS_CSW_GOOD, .check = check_data_in },
+	{ "Bulk-Only Reset during WRITE(10)", WRITE10(500, 256),
+	  256 * BLKSZ, .reset_after = 64 * BLKSZ, .status = NO_CSW },
+	{ "TEST UNIT READY after the reset", TUR, .status = UMS_CSW_GOOD },
+
+	{ "WRITE(10), then the host is quiet", WRITE10(3100, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD },
+	{ "written back when idle", .idle_ms = CONFIG_UMS_FLUSH_IDLE_MS + 100,
+	  .check = check_stored },
+	{ "WRITE(10), then a bus reset", WRITE10(3200, 8), 8 * BLKSZ,
+	  .status = UMS_CSW_GOOD },
+	{ "written back on the bus reset", .bus_reset = 1,
+	  .check = check_stored },
+	{ "TEST UNIT READY after the bus reset", TUR,
+	  .status = UMS_CSW_GOOD },
+
+	{ "eject", { SCSI_START_STP, 0, 0, 0, 0x02 },
+	  .status = UMS_CSW_GOOD, .check = check_stored },
+};
+
+static void host_queue_cbw(const struct step *s)
+{
+	struct ums_cbw cbw;
+
+	memset(&cbw, 0, sizeof(cbw));
+	cbw.signature = cpu_to_le32(s->bad_cbw ? 0x12345678 :
+				    UMS_CBW_SIGNATURE);
+	cbw.tag = ++host.tag;
+	cbw.data_len = cpu_to_le32(s->data_len);
+	cbw.flags = s->in ? UMS_CBW_DATA_IN : 0;
+	cbw.cb_len = 10;
+	memcpy(cbw.cb, s->cb, sizeof(s->cb));
+
+	memcpy(host.out, &cbw, UMS_CBW_SIZE);
+	host.out_len = UMS_CBW_SIZE;
+}
+
+static void host_queue_data(const struct step *s)
+{
+	u32 i;
+
+	for (i = 0; i < s->data_len; i++)
+		host.out[host.out_len + i] = pattern(host.data_lba, i, host.tag);
+	host.out_len += s->data_len;
+}
+
+static void host_next(void)
+{
+	host.step++;
+	host.state = host.step < ARRAY_SIZE(steps) ? H_START : H_DONE;
+}
+
+static void host_finish(const struct step *s)
+{
+	const u8 *csw = host.in + host.in_len - UMS_CSW_SIZE;
+	u32 data = host.in_len - UMS_CSW_SIZE;
+	u32 want_data = (s->in && !s->no_data) ? s->data_len : 0;
+
+	if (data != want_data)
+		FAIL(s, "%u bytes of data, expected %u", data, want_data);
+	else if (get_unaligned_le32(csw) != UMS_CSW_SIGNATURE)
+		FAIL(s, "bad CSW signature");
+	else if (get_unaligned_le32(csw + 4) != host.tag)
+		FAIL(s, "CSW tag %u, expected %u", get_unaligned_le32(csw + 4),
+		     host.tag);
+	else if (csw[12] != s->status)
+		FAIL(s, "status %d, expected %d", csw[12], s->status);
+	else if (get_unaligned_le32(csw + 8) != s->residue)
+		FAIL(s, "residue %u, expected %u",
+		     get_unaligned_le32(csw + 8), s->residue);
+
+	/* a good write is what the device holds from now on */
+	if (!s->in && s->data_len && csw[12] == UMS_CSW_GOOD)
+		memcpy(host_disk + host.data_lba * BLKSZ,
+		       host.out + UMS_CBW_SIZE, s->data_len);
+	if (s->check)
+		s->check(s, host.in);
+	host_next();
+}
+
+/* the class request, and the fifo flush a host does with it */
+static void host_bot_reset(void)
+{
+	struct usb_device_request req;
+
+	memset(&req, 0, sizeof(req));
+	req.bmRequestType = USB_TYPE_CLASS | USB_RECIP_INTERFACE;
+	req.bRequest = UMS_REQ_RESET;
+	device_instance->cdc_recv_setup(&req, NULL);
+	host.out_len = host.out_pos = 0;
+	host.tx_pending = 0;
+}
+
+static void host_run(void)
+{
+	const struct step *s = &steps[host.step];
+
+	switch (host.state) {
+	case H_START:
+		printf("--- %s\n", s->name);
+		host.in_len = 0;
+		host.out_len = host.out_pos = host.out_sent = 0;
+		host.write_mark = ram_writes;
+		host.progress = now_ms();
+		host.data_lba = get_unaligned_be32(s->cb + 2);
+		if (s->before)
+			s->before();
+		if (s->idle_ms) {
+			host.until = now_ms() + s->idle_ms;
+			host.state = H_IDLE;
+			break;
+		}
+		if (s->bus_reset) {
+			device_instance->event(device_instance, DEVICE_RESET,
+					       0);
+			host.until = now_ms() + 10;
+			host.state = H_RECONFIGURE;
+			break;
+		}
+		host_queue_cbw(s);
+		if (!s->in)
+			host_queue_data(s);
+		host.state = H_COMMAND;
+		break;
+
+	case H_IDLE:
+		if (now_ms() < host.until)
+			break;
+		if (s->check)
+			s->check(s, NULL);
+		host_next();
+		break;
+
+	case H_RECONFIGURE:
+		if (now_ms() < host.until)
+			break;
+		device_instance->event(device_instance,
+				       DEVICE_ADDRESS_ASSIGNED, 0);
+		device_instance->event(device_instance, DEVICE_CONFIGURED, 0);
+		if (s->check)
+			s->check(s, NULL);
+		host_next();
+		break;
+
+	case H_COMMAND:
+		if (s->reset_after && (host.in_len >= s->reset_after ||
+				       host.out_sent >= s->reset_after)) {
+			host_bot_reset();
+			host_next();
+			break;
+		}
+		if (s->status == NO_CSW) {
+			/* nothing may come back; give it time to */
+			if (host.in_len)
+				FAIL(s, "%u bytes came back", host.in_len);
+			if (host.in_len ||
+			    now_ms() - host.progress > 50)
+				host_next();
+			break;
+		}
+		if (host.in_len >= UMS_CSW_SIZE &&
+		    host.in_len >= ((s->in && !s->no_data) ?
+				    s->data_len : 0) + UMS_CSW_SIZE) {
+			host_finish(s);
+			break;
+		}
+		if (now_ms() - host.progress > 2000) {
+			FAIL(s, "stalled with %u of %u bytes out, %u in",
+			     host.out_pos, host.out_len, host.in_len);
+			host.state = H_DONE;
+		}
+		break;
+
+	case H_DONE:
+		/* the script is over; the device should have exited */
+		ums.exit = 1;
+		break;
+	}
+}
+
+/* the UDC */
+
+int udc_init(void)
+{
+	return 0;
+}
+
+void udc_setup_ep(struct usb_device_instance *device, unsigned int id,
+		  struct usb_endpoint_instance *endpoint)
+{
+}
+
+void udc_startup_events(struct usb_device_instance *device)
+{
+	device->event(device, DEVICE_ADDRESS_ASSIGNED, 0);
+	device->event(device, DEVICE_CONFIGURED, 0);
+}
+
+void udc_connect(void)
+{
+}
+
+void udc_disconnect(void)
+{
+}
+
+void udc_disable(void)
+{
+}
+
+int udc_endpoint_write(struct usb_endpoint_instance *endpoint)
+{
+	host.tx_pending = TX_POLLS;
+	return 0;
+}
+
+void udc_irq(void)
+{
+	struct usb_endpoint_instance *ep;
+	struct urb *urb;
+	u32 pkt;
+
+	test_clock_us += 20;
+
+	/* the host has taken the queued bulk-in transfer */
+	ep = &endpoint_instance[TX_EP_INDEX];
+	urb = ep->tx_urb;
+	if (host.tx_pending && --host.tx_pending == 0 && urb &&
+	    urb->actual_length) {
+		if (host.in_len + urb->actual_length > sizeof(host.in)) {
+			printf("FAIL: host buffer overflow\n");
+			exit(1);
+		}
+		memcpy(host.in + host.in_len, urb->buffer, urb->actual_length);
+		host.in_len += urb->actual_length;
+		urb->actual_length = 0;		/* usbd_tx_complete() */
+		host.progress = now_ms();
+	}
+
+	/* the next packet, when the armed urb has room for it */
+	ep = &endpoint_instance[RX_EP_INDEX];
+	urb = ep->rcv_urb;
+	if (host.out_pos < host.out_len && urb && ums.configured) {
+		pkt = host.out_pos ? min(host.out_len - host.out_pos,
+					 (u32)PKTSIZE) : UMS_CBW_SIZE;
+		if (urb->buffer_length - urb->actual_length >= pkt) {
+			memcpy(urb->buffer + urb->actual_length,
+			       host.out + host.out_pos, pkt);
+			urb->actual_length += pkt;
+			host.out_pos += pkt;
+			if (host.out_pos > UMS_CBW_SIZE)
+				host.out_sent += pkt;
+			host.progress = now_ms();
+		}
+	}
+
+	if (host.state != H_DONE || !ums.exit)
+		host_run();
+}
+
+extern cmd_tbl_t __u_boot_cmd_ums;
+
+int main(void)
+{
+	char *argv[] = { "ums", "ram", "0", NULL };
+	static u8 buf[CONFIG_UMS_BUFFER_SIZE];
+	u32 lba, i;
+	int ret;
+
+	for (lba = 0; lba < LBAS; lba++)
+		for (i = 0; i < BLKSZ; i++)
+			ram[lba * BLKSZ + i] = pattern(lba, i, 0);
+	memcpy(host_disk, ram, sizeof(ram));
+	load_addr = (ulong)buf;
+
+	ret = __u_boot_cmd_ums.cmd(&__u_boot_cmd_ums, 0, 3, argv);
+	if (ret) {
+		printf("FAIL: ums returned %d\n", ret);
+		failed++;
+	}
+	if (host.step != ARRAY_SIZE(steps)) {
+		printf("FAIL: ums exited at step %d of %d\n", host.step,
+		       (int)ARRAY_SIZE(steps));
+		failed++;
+	}
+
+	printf("ums_bot: %d checks failed\n", failed);
+	return failed ? 1 : 0;
+}